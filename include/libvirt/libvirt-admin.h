@@ -421,6 +421,16 @@ int virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
                                    const char *filters,
                                    unsigned int flags);
 
+int virAdmConnectGetStartupTimings(virAdmConnectPtr conn,
+                                   virTypedParameterPtr *params,
+                                   int *nparams,
+                                   unsigned int flags);
+
+int virAdmConnectGetMessageBufferStats(virAdmConnectPtr conn,
+                                       virTypedParameterPtr *params,
+                                       int *nparams,
+                                       unsigned int flags);
+
 # ifdef __cplusplus
 }
 # endif
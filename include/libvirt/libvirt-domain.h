@@ -845,10 +845,21 @@ typedef enum {
 
     /* Send memory pages to the destination host through several network
      * connections. See VIR_MIGRATE_PARAM_PARALLEL_* parameters for
-     * configuring the parallel migration.
+     * configuring the parallel migration. Cannot be combined with
+     * VIR_MIGRATE_TUNNELLED.
      */
     VIR_MIGRATE_PARALLEL          = (1 << 17),
 
+    /* Let the hypervisor driver watch the progress of live migration and
+     * escalate step by step when the migration does not converge: raise the
+     * maximum downtime, make auto-converge throttling more aggressive (with
+     * VIR_MIGRATE_AUTO_CONVERGE), enlarge the XBZRLE compression cache (with
+     * VIR_MIGRATE_COMPRESSED), and finally switch to post-copy (with
+     * VIR_MIGRATE_POSTCOPY). Each step taken is reported by
+     * virDomainGetJobStats, see VIR_DOMAIN_JOB_AUTO_TUNE_COUNT.
+     */
+    VIR_MIGRATE_AUTO_TUNE         = (1 << 18),
+
 } virDomainMigrateFlags;
 
 
@@ -3513,6 +3524,107 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_MEMORY_POSTCOPY_REQS     "memory_postcopy_requests"
 
+/**
+ * VIR_DOMAIN_JOB_MEMORY_PASS_COUNT:
+ *
+ * virDomainGetJobStats field: number of entries in the history of
+ * recently finished iterations over domain's memory during live
+ * migration, as VIR_TYPED_PARAM_UINT. The entries are numbered from 0
+ * (the oldest one) and described by the VIR_DOMAIN_JOB_MEMORY_PASS_*
+ * fields below. Only a few of the most recent iterations are kept.
+ */
+# define VIR_DOMAIN_JOB_MEMORY_PASS_COUNT        "memory_pass.count"
+
+/**
+ * VIR_DOMAIN_JOB_MEMORY_PASS_ITERATION:
+ *
+ * virDomainGetJobStats field: the value of VIR_DOMAIN_JOB_MEMORY_ITERATION
+ * when the iteration described by the history entry started, as
+ * VIR_TYPED_PARAM_ULLONG. The field name is a format string which needs
+ * to be expanded with the entry number. If the statistics were not
+ * refreshed often enough, an entry may cover several iterations, i.e.,
+ * all iterations up to the one described by the next entry.
+ */
+# define VIR_DOMAIN_JOB_MEMORY_PASS_ITERATION    "memory_pass.%u.iteration"
+
+/**
+ * VIR_DOMAIN_JOB_MEMORY_PASS_DURATION:
+ *
+ * virDomainGetJobStats field: how long the iteration took in milliseconds,
+ * as VIR_TYPED_PARAM_ULLONG. The field name is a format string which needs
+ * to be expanded with the entry number.
+ */
+# define VIR_DOMAIN_JOB_MEMORY_PASS_DURATION     "memory_pass.%u.duration"
+
+/**
+ * VIR_DOMAIN_JOB_MEMORY_PASS_BPS:
+ *
+ * virDomainGetJobStats field: average memory transfer rate during the
+ * iteration in bytes per second, as VIR_TYPED_PARAM_ULLONG. The field name
+ * is a format string which needs to be expanded with the entry number.
+ */
+# define VIR_DOMAIN_JOB_MEMORY_PASS_BPS          "memory_pass.%u.bps"
+
+/**
+ * VIR_DOMAIN_JOB_MEMORY_PASS_DIRTY_RATE:
+ *
+ * virDomainGetJobStats field: number of memory pages dirtied by the guest
+ * per second during the iteration, as VIR_TYPED_PARAM_ULLONG. Comparing
+ * it to VIR_DOMAIN_JOB_MEMORY_PASS_BPS tells whether the migration is
+ * converging. The field name is a format string which needs to be
+ * expanded with the entry number.
+ */
+# define VIR_DOMAIN_JOB_MEMORY_PASS_DIRTY_RATE   "memory_pass.%u.dirty_rate"
+
+/**
+ * virDomainJobAutoTuneAction:
+ *
+ * Steps taken by the hypervisor driver to make a live migration started
+ * with VIR_MIGRATE_AUTO_TUNE converge.
+ */
+typedef enum {
+    /* The maximum downtime was increased */
+    VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME = 1,
+    /* Auto-converge throttling was made more aggressive */
+    VIR_DOMAIN_JOB_AUTO_TUNE_THROTTLE = 2,
+    /* The compression cache was enlarged */
+    VIR_DOMAIN_JOB_AUTO_TUNE_COMPRESSION = 3,
+    /* Migration was switched to post-copy */
+    VIR_DOMAIN_JOB_AUTO_TUNE_POSTCOPY = 4,
+
+# ifdef VIR_ENUM_SENTINELS
+    VIR_DOMAIN_JOB_AUTO_TUNE_LAST
+# endif
+} virDomainJobAutoTuneAction;
+
+/**
+ * VIR_DOMAIN_JOB_AUTO_TUNE_COUNT:
+ *
+ * virDomainGetJobStats field: number of steps taken so far to make a live
+ * migration started with VIR_MIGRATE_AUTO_TUNE converge, as
+ * VIR_TYPED_PARAM_UINT. The steps are numbered from 0 and described by the
+ * VIR_DOMAIN_JOB_AUTO_TUNE_* fields below.
+ */
+# define VIR_DOMAIN_JOB_AUTO_TUNE_COUNT          "auto_tune.count"
+
+/**
+ * VIR_DOMAIN_JOB_AUTO_TUNE_ACTION:
+ *
+ * virDomainGetJobStats field: the step taken, as VIR_TYPED_PARAM_INT
+ * containing one of the virDomainJobAutoTuneAction values. The field name
+ * is a format string which needs to be expanded with the step number.
+ */
+# define VIR_DOMAIN_JOB_AUTO_TUNE_ACTION         "auto_tune.%u.action"
+
+/**
+ * VIR_DOMAIN_JOB_AUTO_TUNE_ITERATION:
+ *
+ * virDomainGetJobStats field: the value of VIR_DOMAIN_JOB_MEMORY_ITERATION
+ * when the step was taken, as VIR_TYPED_PARAM_ULLONG. The field name is a
+ * format string which needs to be expanded with the step number.
+ */
+# define VIR_DOMAIN_JOB_AUTO_TUNE_ITERATION      "auto_tune.%u.iteration"
+
 /**
  * VIR_DOMAIN_JOB_DISK_TOTAL:
  *
@@ -3551,6 +3663,17 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_DISK_BPS                 "disk_bps"
 
+/**
+ * VIR_DOMAIN_JOB_DISK_TIME_REMAINING:
+ *
+ * virDomainGetJobStats field: estimated time (ms) needed to transfer the
+ * remaining guest disk data (VIR_DOMAIN_JOB_DISK_REMAINING) at the average
+ * rate observed so far, as VIR_TYPED_PARAM_ULLONG. When copying disks is
+ * limited to a few disks at a time, disks waiting for their turn are
+ * included too.
+ */
+# define VIR_DOMAIN_JOB_DISK_TIME_REMAINING      "disk_time_remaining"
+
 /**
  * VIR_DOMAIN_JOB_COMPRESSION_CACHE:
  *
@@ -355,6 +355,7 @@ virStorageVolPtr        virStorageVolCreateXMLFrom      (virStoragePoolPtr pool,
 
 typedef enum {
     VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM = 1 << 0, /* Use sparse stream */
+    VIR_STORAGE_VOL_DOWNLOAD_BYPASS_CACHE = 1 << 1, /* Avoid file system cache pollution */
 } virStorageVolDownloadFlags;
 
 int                     virStorageVolDownload           (virStorageVolPtr vol,
@@ -364,6 +365,7 @@ int                     virStorageVolDownload           (virStorageVolPtr vol,
                                                          unsigned int flags);
 typedef enum {
     VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM = 1 << 0,  /* Use sparse stream */
+    VIR_STORAGE_VOL_UPLOAD_BYPASS_CACHE = 1 << 1,   /* Avoid file system cache pollution */
 } virStorageVolUploadFlags;
 
 int                     virStorageVolUpload             (virStorageVolPtr vol,
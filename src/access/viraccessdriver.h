@@ -26,6 +26,8 @@
 typedef int (*virAccessDriverCheckConnectDrv)(virAccessManagerPtr manager,
                                               const char *driverName,
                                               virAccessPermConnect av);
+/* Only the name and UUID of @domain may be used, some callers pass a
+ * stub definition (see qemuDomainPublishedACLDef) */
 typedef int (*virAccessDriverCheckDomainDrv)(virAccessManagerPtr manager,
                                              const char *driverName,
                                              virDomainDefPtr domain,
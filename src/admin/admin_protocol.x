@@ -46,6 +46,12 @@ const ADMIN_CLIENT_INFO_PARAMETERS_MAX = 64;
 /* Upper limit on number of client processing controls */
 const ADMIN_SERVER_CLIENT_LIMITS_MAX = 32;
 
+/* Upper limit on number of recorded daemon startup phases */
+const ADMIN_CONNECT_STARTUP_TIMINGS_MAX = 128;
+
+/* Upper limit on number of message buffer statistics */
+const ADMIN_CONNECT_MESSAGE_BUFFER_STATS_MAX = 64;
+
 /* A long string, which may NOT be NULL. */
 typedef string admin_nonnull_string<ADMIN_STRING_MAX>;
 
@@ -214,6 +220,22 @@ struct admin_connect_set_logging_filters_args {
     unsigned int flags;
 };
 
+struct admin_connect_get_startup_timings_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_startup_timings_ret {
+    admin_typed_param params<ADMIN_CONNECT_STARTUP_TIMINGS_MAX>;
+};
+
+struct admin_connect_get_message_buffer_stats_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_message_buffer_stats_ret {
+    admin_typed_param params<ADMIN_CONNECT_MESSAGE_BUFFER_STATS_MAX>;
+};
+
 /* Define the program number, protocol version and procedure numbers here. */
 const ADMIN_PROGRAM = 0x06900690;
 const ADMIN_PROTOCOL_VERSION = 1;
@@ -324,5 +346,15 @@ enum admin_procedure {
     /**
      * @generate: both
      */
-    ADMIN_PROC_SERVER_UPDATE_TLS_FILES = 18
+    ADMIN_PROC_SERVER_UPDATE_TLS_FILES = 18,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_STARTUP_TIMINGS = 19,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_MESSAGE_BUFFER_STATS = 20
 };
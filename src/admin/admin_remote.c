@@ -495,3 +495,87 @@ remoteAdminConnectGetLoggingFilters(virAdmConnectPtr conn,
     virObjectUnlock(priv);
     return rv;
 }
+
+static int
+remoteAdminConnectGetStartupTimings(virAdmConnectPtr conn,
+                                    virTypedParameterPtr *params,
+                                    int *nparams,
+                                    unsigned int flags)
+{
+    int rv = -1;
+    remoteAdminPrivPtr priv = conn->privateData;
+    admin_connect_get_startup_timings_args args;
+    admin_connect_get_startup_timings_ret ret;
+
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn,
+             0,
+             ADMIN_PROC_CONNECT_GET_STARTUP_TIMINGS,
+             (xdrproc_t) xdr_admin_connect_get_startup_timings_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_get_startup_timings_ret,
+             (char *) &ret) == -1)
+        goto done;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_CONNECT_STARTUP_TIMINGS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    xdr_free((xdrproc_t) xdr_admin_connect_get_startup_timings_ret,
+             (char *) &ret);
+ done:
+    virObjectUnlock(priv);
+    return rv;
+}
+
+static int
+remoteAdminConnectGetMessageBufferStats(virAdmConnectPtr conn,
+                                        virTypedParameterPtr *params,
+                                        int *nparams,
+                                        unsigned int flags)
+{
+    int rv = -1;
+    remoteAdminPrivPtr priv = conn->privateData;
+    admin_connect_get_message_buffer_stats_args args;
+    admin_connect_get_message_buffer_stats_ret ret;
+
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    virObjectLock(priv);
+
+    if (call(conn,
+             0,
+             ADMIN_PROC_CONNECT_GET_MESSAGE_BUFFER_STATS,
+             (xdrproc_t) xdr_admin_connect_get_message_buffer_stats_args,
+             (char *) &args,
+             (xdrproc_t) xdr_admin_connect_get_message_buffer_stats_ret,
+             (char *) &ret) == -1)
+        goto done;
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) ret.params.params_val,
+                                  ret.params.params_len,
+                                  ADMIN_CONNECT_MESSAGE_BUFFER_STATS_MAX,
+                                  params,
+                                  nparams) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    xdr_free((xdrproc_t) xdr_admin_connect_get_message_buffer_stats_ret,
+             (char *) &ret);
+ done:
+    virObjectUnlock(priv);
+    return rv;
+}
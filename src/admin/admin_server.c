@@ -27,6 +27,7 @@
 #include "viridentity.h"
 #include "virlog.h"
 #include "rpc/virnetdaemon.h"
+#include "rpc/virnetmessage.h"
 #include "rpc/virnetserver.h"
 #include "virstring.h"
 #include "virthreadpool.h"
@@ -376,3 +377,43 @@ adminServerUpdateTlsFiles(virNetServerPtr srv,
 
     return virNetServerUpdateTlsFiles(srv);
 }
+
+int
+adminConnectGetMessageBufferStats(virTypedParameterPtr *params,
+                                  int *nparams,
+                                  unsigned int flags)
+{
+    g_autoptr(virTypedParamList) paramlist = g_new0(virTypedParamList, 1);
+    g_autofree virNetMessageBufferStatsPtr stats = NULL;
+    size_t nstats;
+    size_t i;
+
+    virCheckFlags(0, -1);
+
+    nstats = virNetMessageBufferGetStats(&stats);
+
+    if (virTypedParamListAddUInt(paramlist, nstats, "class.count") < 0)
+        return -1;
+
+    for (i = 0; i < nstats; i++) {
+        if (virTypedParamListAddULLong(paramlist, stats[i].size,
+                                       "class.%zu.size", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, stats[i].cached,
+                                       "class.%zu.cached", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, stats[i].cachedMax,
+                                       "class.%zu.cached_max", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, stats[i].inuse,
+                                       "class.%zu.in_use", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, stats[i].inuseHigh,
+                                       "class.%zu.in_use_high", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, stats[i].hits,
+                                       "class.%zu.hits", i) < 0 ||
+            virTypedParamListAddULLong(paramlist, stats[i].misses,
+                                       "class.%zu.misses", i) < 0)
+            return -1;
+    }
+
+    *nparams = virTypedParamListStealParams(paramlist, params);
+
+    return 0;
+}
@@ -70,3 +70,7 @@ int adminServerSetClientLimits(virNetServerPtr srv,
 
 int adminServerUpdateTlsFiles(virNetServerPtr srv,
                               unsigned int flags);
+
+int adminConnectGetMessageBufferStats(virTypedParameterPtr *params,
+                                      int *nparams,
+                                      unsigned int flags);
@@ -31,6 +31,7 @@
 #include "virlog.h"
 #include "rpc/virnetdaemon.h"
 #include "rpc/virnetserver.h"
+#include "virdaemon.h"
 #include "virstring.h"
 #include "virthreadjob.h"
 #include "virtypedparam.h"
@@ -521,4 +522,66 @@ adminDispatchConnectGetLoggingFilters(virNetServerPtr server G_GNUC_UNUSED,
 
     return 0;
 }
+
+static int
+adminDispatchConnectGetStartupTimings(virNetServerPtr server G_GNUC_UNUSED,
+                                      virNetServerClientPtr client G_GNUC_UNUSED,
+                                      virNetMessagePtr msg G_GNUC_UNUSED,
+                                      virNetMessageErrorPtr rerr,
+                                      admin_connect_get_startup_timings_args *args,
+                                      admin_connect_get_startup_timings_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (virDaemonGetStartupPhases(&params, &nparams) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_CONNECT_STARTUP_TIMINGS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+static int
+adminDispatchConnectGetMessageBufferStats(virNetServerPtr server G_GNUC_UNUSED,
+                                          virNetServerClientPtr client G_GNUC_UNUSED,
+                                          virNetMessagePtr msg G_GNUC_UNUSED,
+                                          virNetMessageErrorPtr rerr,
+                                          admin_connect_get_message_buffer_stats_args *args,
+                                          admin_connect_get_message_buffer_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetMessageBufferStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                ADMIN_CONNECT_MESSAGE_BUFFER_STATS_MAX,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
 #include "admin_server_dispatch_stubs.h"
@@ -1266,3 +1266,98 @@ virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
     virDispatchError(NULL);
     return -1;
 }
+
+/**
+ * virAdmConnectGetStartupTimings:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to a list of startup phases
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves how long the individual phases of the daemon startup took,
+ * such as initializing each of the state drivers or loading the domain
+ * configuration files. Each phase is returned as a
+ * VIR_TYPED_PARAM_ULLONG parameter holding the duration in milliseconds,
+ * named "<component>.<phase>", e.g. "driver.QEMU" or "qemu.load_config".
+ * Only phases which have already finished are reported.
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetStartupTimings(virAdmConnectPtr conn,
+                               virTypedParameterPtr *params,
+                               int *nparams,
+                               unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetStartupTimings(conn, params, nparams,
+                                                   flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectGetMessageBufferStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to a list of statistics
+ *          (return value, allocated automatically)
+ * @nparams: pointer to number of parameters returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves usage statistics of the pool the daemon recycles RPC message
+ * buffers through. The pool consists of several size classes, their
+ * number is returned as the VIR_TYPED_PARAM_UINT parameter "class.count".
+ * For each class <num>, starting at 0, the following
+ * VIR_TYPED_PARAM_ULLONG parameters are returned:
+ *
+ * "class.<num>.size" - size of the buffers in the class in bytes
+ * "class.<num>.cached" - unused buffers kept for reuse
+ * "class.<num>.cached_max" - maximum number of buffers kept for reuse
+ * "class.<num>.in_use" - buffers currently used by messages
+ * "class.<num>.in_use_high" - highest number of buffers used at once
+ * "class.<num>.hits" - buffer allocations served from the pool
+ * "class.<num>.misses" - buffer allocations which had to allocate memory
+ *
+ * Returns 0 on success, allocating @params to size returned in @nparams, or
+ * -1 in case of an error. Caller is responsible for deallocating @params.
+ */
+int
+virAdmConnectGetMessageBufferStats(virAdmConnectPtr conn,
+                                   virTypedParameterPtr *params,
+                                   int *nparams,
+                                   unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetMessageBufferStats(conn, params, nparams,
+                                                       flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
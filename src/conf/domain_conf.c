@@ -3591,6 +3591,8 @@ static void virDomainObjDispose(void *obj)
 
     VIR_DEBUG("obj=%p", dom);
     virCondDestroy(&dom->cond);
+    virMutexDestroy(&dom->publishedLock);
+    virDomainObjPublishedClear(&dom->published);
     virDomainDefFree(dom->def);
     virDomainDefFree(dom->newDef);
 
@@ -3618,6 +3620,12 @@ virDomainObjNew(virDomainXMLOptionPtr xmlopt)
         goto error;
     }
 
+    if (virMutexInit(&domain->publishedLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("failed to initialize domain mutex"));
+        goto error;
+    }
+
     if (xmlopt->privateData.alloc) {
         domain->privateData = (xmlopt->privateData.alloc)(xmlopt->config.priv);
         if (!domain->privateData)
@@ -3696,6 +3704,8 @@ void virDomainObjAssignDef(virDomainObjPtr domain,
             domain->def = def;
         }
     }
+
+    virDomainObjPublish(domain);
 }
 
 
@@ -22389,6 +22399,8 @@ virDomainObjParseXML(xmlDocPtr xml,
     if (virDomainDefValidate(obj->def, flags, xmlopt) < 0)
         goto error;
 
+    virDomainObjPublish(obj);
+
     return obj;
 
  error:
@@ -22467,7 +22479,8 @@ virDomainDefParseNode(xmlDocPtr xml,
         return NULL;
 
     /* callback to fill driver specific domain aspects */
-    if (virDomainDefPostParse(def, flags, xmlopt, parseOpaque) < 0)
+    if (!(flags & VIR_DOMAIN_DEF_PARSE_SKIP_POST_PARSE) &&
+        virDomainDefPostParse(def, flags, xmlopt, parseOpaque) < 0)
         return NULL;
 
     /* validate configuration */
@@ -30608,6 +30621,97 @@ virDomainObjSetState(virDomainObjPtr dom, virDomainState state, int reason)
         dom->state.reason = reason;
     else
         dom->state.reason = 0;
+
+    virDomainObjPublish(dom);
+}
+
+
+/**
+ * virDomainObjPublish:
+ * @dom: locked domain object
+ *
+ * Refreshes the copy of the runtime state of @dom which can be read
+ * by virDomainObjGetPublished without locking the object. Drivers are
+ * expected to call this whenever they change the live definition in a
+ * way which would be visible to virDomainGetInfo; state changes are
+ * published automatically by virDomainObjSetState.
+ */
+void
+virDomainObjPublish(virDomainObjPtr dom)
+{
+    virDomainObjPublishedPtr pub = &dom->published;
+    virDomainDefPtr def = dom->def;
+
+    virMutexLock(&dom->publishedLock);
+
+    pub->state = dom->state;
+    pub->pid = dom->pid;
+    pub->removing = dom->removing;
+
+    if (def) {
+        if (STRNEQ_NULLABLE(pub->name, def->name)) {
+            g_free(pub->name);
+            pub->name = g_strdup(def->name);
+        }
+        memcpy(pub->uuid, def->uuid, VIR_UUID_BUFLEN);
+        pub->id = def->id;
+        pub->maxMemory = virDomainDefGetMemoryTotal(def);
+        pub->curBalloon = def->mem.cur_balloon;
+        pub->vcpus = virDomainDefGetVcpus(def);
+
+        /* without a balloon the guest always has all of its memory */
+        if (virDomainObjIsActive(dom) && !virDomainDefHasMemballoon(def))
+            pub->curBalloon = pub->maxMemory;
+    }
+
+    virMutexUnlock(&dom->publishedLock);
+}
+
+
+/**
+ * virDomainObjGetPublished:
+ * @dom: domain object, doesn't need to be locked
+ * @pub: filled with the published state
+ *
+ * Copies the state published by virDomainObjPublish into @pub. The
+ * caller has to hold a reference on @dom and clear @pub by
+ * virDomainObjPublishedClear once done.
+ *
+ * Returns 0 on success, -1 with an error reported if nothing was
+ * published for @dom yet.
+ */
+int
+virDomainObjGetPublished(virDomainObjPtr dom,
+                         virDomainObjPublishedPtr pub)
+{
+    int ret = -1;
+
+    virMutexLock(&dom->publishedLock);
+
+    if (dom->published.name) {
+        *pub = dom->published;
+        pub->name = g_strdup(dom->published.name);
+        ret = 0;
+    }
+
+    virMutexUnlock(&dom->publishedLock);
+
+    if (ret < 0)
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("domain state was not published yet"));
+
+    return ret;
+}
+
+
+void
+virDomainObjPublishedClear(virDomainObjPublishedPtr pub)
+{
+    if (!pub)
+        return;
+
+    g_free(pub->name);
+    memset(pub, 0, sizeof(*pub));
 }
 
 
@@ -2707,10 +2707,31 @@ struct _virDomainStateReason {
     int reason;
 };
 
+/* Copy of the frequently queried runtime state of a domain object
+ * which can be read without taking the object lock. */
+typedef struct _virDomainObjPublished virDomainObjPublished;
+typedef virDomainObjPublished *virDomainObjPublishedPtr;
+struct _virDomainObjPublished {
+    char *name;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int id;
+    pid_t pid;
+    virDomainStateReason state;
+    unsigned long long maxMemory; /* in KiB */
+    unsigned long long curBalloon; /* in KiB */
+    unsigned int vcpus;
+    bool removing; /* the object is being removed from its list */
+};
+
 struct _virDomainObj {
     virObjectLockable parent;
     virCond cond;
 
+    /* Protects @published only. It is a leaf lock that may be acquired
+     * with or without the object lock held. */
+    virMutex publishedLock;
+    virDomainObjPublished published;
+
     pid_t pid;
     virDomainStateReason state;
 
@@ -3142,6 +3163,9 @@ typedef enum {
      * post parse callbacks before starting. Failure of the post parse callback
      * is recorded as def->postParseFail */
     VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL = 1 << 12,
+    /* skip the post parse callbacks, the definition was formatted after
+     * they already ran (used when loading the domain parse cache) */
+    VIR_DOMAIN_DEF_PARSE_SKIP_POST_PARSE = 1 << 13,
 } virDomainDefParseFlags;
 
 typedef enum {
@@ -3494,6 +3518,14 @@ virDomainState
 virDomainObjGetState(virDomainObjPtr obj, int *reason)
         ATTRIBUTE_NONNULL(1);
 
+void virDomainObjPublish(virDomainObjPtr obj)
+        ATTRIBUTE_NONNULL(1);
+int virDomainObjGetPublished(virDomainObjPtr obj,
+                             virDomainObjPublishedPtr pub)
+        ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+void virDomainObjPublishedClear(virDomainObjPublishedPtr pub);
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(virDomainObjPublished, virDomainObjPublishedClear);
+
 virSecurityLabelDefPtr
 virDomainDefGetSecurityLabelDef(virDomainDefPtr def, const char *model);
 
@@ -22,15 +22,21 @@
 
 #include <config.h>
 
+#include <sys/stat.h>
+
 #include "internal.h"
 #include "datatypes.h"
 #include "virdomainobjlist.h"
 #include "checkpoint_conf.h"
 #include "snapshot_conf.h"
 #include "viralloc.h"
+#include "vircrypto.h"
 #include "virfile.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virthreadpool.h"
+#include "virutil.h"
+#include "virxml.h"
 #include "virdomainsnapshotobjlist.h"
 #include "virdomaincheckpointobjlist.h"
 
@@ -179,6 +185,48 @@ virDomainObjListFindByUUID(virDomainObjListPtr doms,
 }
 
 
+/**
+ * @doms: Domain object list
+ * @uuid: UUID to search the doms->objs table
+ *
+ * Lookup the @uuid in the doms->objs hash table and return a ref
+ * counted domain object if found. The object is not locked, so the
+ * caller may only access data which is safe to read without the lock,
+ * such as the state published by virDomainObjPublish, and has to
+ * release the reference by virObjectUnref when done with the object.
+ */
+virDomainObjPtr
+virDomainObjListFindByUUIDRef(virDomainObjListPtr doms,
+                              const unsigned char *uuid)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjPtr obj;
+    bool removing;
+
+    virUUIDFormat(uuid, uuidstr);
+
+    virObjectRWLockRead(doms);
+    if ((obj = virHashLookup(doms->objs, uuidstr)))
+        virObjectRef(obj);
+    virObjectRWUnlock(doms);
+
+    if (!obj)
+        return NULL;
+
+    /* the object lock isn't held, rely on the published flag */
+    virMutexLock(&obj->publishedLock);
+    removing = obj->published.removing;
+    virMutexUnlock(&obj->publishedLock);
+
+    if (removing) {
+        virObjectUnref(obj);
+        return NULL;
+    }
+
+    return obj;
+}
+
+
 static virDomainObjPtr
 virDomainObjListFindByNameLocked(virDomainObjListPtr doms,
                                  const char *name)
@@ -336,6 +384,7 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
         if (!(vm = virDomainObjNew(xmlopt)))
             goto error;
         vm->def = def;
+        virDomainObjPublish(vm);
 
         if (virDomainObjListAddObjLocked(doms, vm) < 0) {
             vm->def = NULL;
@@ -403,6 +452,7 @@ virDomainObjListRemove(virDomainObjListPtr doms,
                        virDomainObjPtr dom)
 {
     dom->removing = true;
+    virDomainObjPublish(dom);
     virObjectRef(dom);
     virObjectUnlock(dom);
     virObjectRWLockWrite(doms);
@@ -481,79 +531,489 @@ virDomainObjListRename(virDomainObjListPtr doms,
 }
 
 
-static virDomainObjPtr
-virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
-                           virDomainLoadConfigNotify notify,
-                           void *opaque)
+/* The result of parsing one file of the directory passed to
+ * virDomainObjListLoadAllConfigs. Parsing happens without holding the
+ * list lock, possibly in a worker thread, the parsed domain is added
+ * to the list afterwards. */
+typedef struct _virDomainObjListLoadItem virDomainObjListLoadItem;
+typedef virDomainObjListLoadItem *virDomainObjListLoadItemPtr;
+struct _virDomainObjListLoadItem {
+    char *name;
+
+    virDomainDefPtr def; /* parsed persistent config */
+    int autostart;
+    virDomainObjPtr obj; /* parsed live status */
+};
+
+typedef struct _virDomainObjListLoadData virDomainObjListLoadData;
+typedef virDomainObjListLoadData *virDomainObjListLoadDataPtr;
+struct _virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    const char *cacheDir;
+    virDomainObjListCacheKeyFunc cacheKey;
+    void *cacheKeyOpaque;
+    bool liveStatus;
+    virDomainXMLOptionPtr xmlopt;
+
+    virMutex lock;
+    virCond cond;
+    size_t npending;
+};
+
+
+/* Bump whenever the cache format or the meaning of its contents changes */
+#define VIR_DOMAIN_PARSE_CACHE_VERSION 2
+#define VIR_DOMAIN_PARSE_CACHE_MAX_LEN (10 * 1024 * 1024)
+#define VIR_DOMAIN_PARSE_CACHE_HEADER "<!-- sha256:"
+
+/*
+ * The parse cache stores persistent definitions as formatted after the
+ * post parse callbacks ran, so that loading them again does not need
+ * to repeat the callbacks (e.g. capabilities lookups and address
+ * assignment). A cache file is used only if the config file it was
+ * created from, the emulator binary, the daemon itself and the driver
+ * key did not change since, otherwise the config file is parsed as
+ * usual and the cache rewritten. The driver key is provided by the
+ * driver and covers whatever else the post parse callbacks depend on,
+ * e.g. the capabilities of the emulator and the driver configuration.
+ * The first line of the file holds the checksum of the rest of the file:
+ *
+ *   <!-- sha256:... -->
+ *   <domainParseCache version='2'>
+ *     <libvirt version='6006000' ctime='1596000000'/>
+ *     <source inode='1234' size='4567' mtime='1596000000'/>
+ *     <emulator path='/usr/bin/qemu-system-x86_64' ctime='1596000000'/>
+ *     <driver key='...'/>
+ *     <domain type='kvm'>
+ *       ...
+ *     </domain>
+ *   </domainParseCache>
+ */
+static bool
+virDomainObjListCacheCheckEmulator(xmlXPathContextPtr ctxt)
+{
+    g_autofree char *path = NULL;
+    long long emulatorCtime;
+    struct stat sb;
+
+    if (!(path = virXPathString("string(./emulator/@path)", ctxt)))
+        return true;
+
+    if (virXPathLongLong("string(./emulator/@ctime)", ctxt, &emulatorCtime) < 0 ||
+        stat(path, &sb) < 0)
+        return false;
+
+    return emulatorCtime == (long long) sb.st_ctime;
+}
+
+
+static bool
+virDomainObjListCacheCheckKey(virDomainObjListLoadDataPtr data,
+                              xmlXPathContextPtr ctxt,
+                              virDomainDefPtr def)
+{
+    g_autofree char *cachedKey = virXPathString("string(./driver/@key)", ctxt);
+    g_autofree char *key = NULL;
+
+    if (!data->cacheKey)
+        return !cachedKey;
+
+    if (!cachedKey || !(key = data->cacheKey(def, data->cacheKeyOpaque)))
+        return false;
+
+    return STREQ(key, cachedKey);
+}
+
+
+static virDomainDefPtr
+virDomainObjListCacheLoad(virDomainObjListLoadDataPtr data,
+                          const char *name,
+                          const struct stat *sb)
 {
-    char *configFile = NULL, *autostartLink = NULL;
+    g_autofree char *cacheFile = NULL;
+    g_autofree char *content = NULL;
+    g_autofree char *digest = NULL;
+    g_autofree char *header = NULL;
+    g_autoptr(xmlDoc) xml = NULL;
+    g_autoptr(xmlXPathContext) ctxt = NULL;
+    xmlNodePtr node;
+    char *body;
+    unsigned int version;
+    unsigned long libvirtVersion;
+    long long selfCtime;
+    unsigned long long inode;
+    long long size;
+    long long mtime;
     virDomainDefPtr def = NULL;
-    virDomainObjPtr dom;
-    int autostart;
-    virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
-    if (!(def = virDomainDefParseFile(configFile, xmlopt, NULL,
+    cacheFile = virDomainConfigFile(data->cacheDir, name);
+
+    if (virFileReadAllQuiet(cacheFile, VIR_DOMAIN_PARSE_CACHE_MAX_LEN, &content) < 0)
+        return NULL;
+
+    if (!(body = strchr(content, '\n')))
+        goto stale;
+    body++;
+
+    if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, body, &digest) < 0)
+        goto stale;
+
+    header = g_strdup_printf(VIR_DOMAIN_PARSE_CACHE_HEADER "%s -->\n", digest);
+    if (strlen(header) != (size_t) (body - content) ||
+        !STRPREFIX(content, header))
+        goto stale;
+
+    if (!(xml = virXMLParseStringCtxt(body, _("(domain_parse_cache)"), &ctxt)))
+        goto stale;
+
+    if (!virXMLNodeNameEqual(ctxt->node, "domainParseCache") ||
+        virXPathUInt("string(./@version)", ctxt, &version) < 0 ||
+        version != VIR_DOMAIN_PARSE_CACHE_VERSION)
+        goto stale;
+
+    if (virXPathULong("string(./libvirt/@version)", ctxt, &libvirtVersion) < 0 ||
+        virXPathLongLong("string(./libvirt/@ctime)", ctxt, &selfCtime) < 0 ||
+        libvirtVersion != LIBVIR_VERSION_NUMBER ||
+        selfCtime != (long long) virGetSelfLastChanged())
+        goto stale;
+
+    if (virXPathULongLong("string(./source/@inode)", ctxt, &inode) < 0 ||
+        virXPathLongLong("string(./source/@size)", ctxt, &size) < 0 ||
+        virXPathLongLong("string(./source/@mtime)", ctxt, &mtime) < 0 ||
+        inode != (unsigned long long) sb->st_ino ||
+        size != (long long) sb->st_size ||
+        mtime != (long long) sb->st_mtime)
+        goto stale;
+
+    if (!virDomainObjListCacheCheckEmulator(ctxt) ||
+        !(node = virXPathNode("./domain", ctxt)))
+        goto stale;
+
+    if (!(def = virDomainDefParseNode(xml, node, data->xmlopt, NULL,
                                       VIR_DOMAIN_DEF_PARSE_INACTIVE |
                                       VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
+                                      VIR_DOMAIN_DEF_PARSE_SKIP_POST_PARSE)))
+        goto stale;
+
+    if (STRNEQ(def->name, name) ||
+        !virDomainObjListCacheCheckKey(data, ctxt, def)) {
+        virDomainDefFree(def);
+        goto stale;
+    }
+
+    VIR_DEBUG("Loaded domain '%s' from parse cache", name);
+    return def;
+
+ stale:
+    VIR_DEBUG("Ignoring stale parse cache of domain '%s'", name);
+    virResetLastError();
+    return NULL;
+}
+
+
+static void
+virDomainObjListCacheSave(virDomainObjListLoadDataPtr data,
+                          virDomainDefPtr def,
+                          const struct stat *sb)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *cacheFile = NULL;
+    g_autofree char *domxml = NULL;
+    g_autofree char *body = NULL;
+    g_autofree char *digest = NULL;
+    g_autofree char *content = NULL;
+    g_autofree char *key = NULL;
+    struct stat esb;
+
+    if (def->emulator && stat(def->emulator, &esb) < 0) {
+        VIR_DEBUG("Not caching domain '%s', emulator '%s' is missing",
+                  def->name, def->emulator);
+        return;
+    }
+
+    if (data->cacheKey &&
+        !(key = data->cacheKey(def, data->cacheKeyOpaque)))
         goto error;
 
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
+    if (!(domxml = virDomainDefFormat(def, data->xmlopt,
+                                      VIR_DOMAIN_DEF_FORMAT_SECURE)))
         goto error;
 
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+    virBufferAsprintf(&buf, "<domainParseCache version='%d'>\n",
+                      VIR_DOMAIN_PARSE_CACHE_VERSION);
+    virBufferAdjustIndent(&buf, 2);
+    virBufferAsprintf(&buf, "<libvirt version='%lu' ctime='%lld'/>\n",
+                      (unsigned long) LIBVIR_VERSION_NUMBER,
+                      (long long) virGetSelfLastChanged());
+    virBufferAsprintf(&buf, "<source inode='%llu' size='%lld' mtime='%lld'/>\n",
+                      (unsigned long long) sb->st_ino,
+                      (long long) sb->st_size,
+                      (long long) sb->st_mtime);
+    if (def->emulator) {
+        virBufferEscapeString(&buf, "<emulator path='%s'", def->emulator);
+        virBufferAsprintf(&buf, " ctime='%lld'/>\n", (long long) esb.st_ctime);
+    }
+    virBufferEscapeString(&buf, "<driver key='%s'/>\n", key);
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAdd(&buf, domxml, -1);
+    virBufferAddLit(&buf, "</domainParseCache>\n");
+
+    body = virBufferContentAndReset(&buf);
+
+    if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, body, &digest) < 0)
         goto error;
 
-    if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
+    content = g_strdup_printf(VIR_DOMAIN_PARSE_CACHE_HEADER "%s -->\n%s",
+                              digest, body);
+
+    cacheFile = virDomainConfigFile(data->cacheDir, def->name);
+
+    if (virFileRewriteStr(cacheFile, S_IRUSR | S_IWUSR, content) < 0)
         goto error;
 
-    dom->autostart = autostart;
+    return;
+
+ error:
+    VIR_WARN("Unable to update parse cache of domain '%s': %s",
+             def->name, virGetLastErrorMessage());
+    virResetLastError();
+}
+
+
+/* Removes cache files of domains which no longer have a config file */
+static void
+virDomainObjListCachePrune(const char *cacheDir,
+                           virDomainObjListLoadItemPtr items,
+                           size_t nitems)
+{
+    g_autoptr(virHashTable) names = NULL;
+    DIR *dir;
+    struct dirent *entry;
+    size_t i;
+
+    if (virDirOpenQuiet(&dir, cacheDir) < 0)
+        return;
+
+    if (!(names = virHashNew(NULL)))
+        goto cleanup;
+
+    for (i = 0; i < nitems; i++) {
+        if (virHashAddEntry(names, items[i].name, (void *) 1) < 0)
+            goto cleanup;
+    }
+
+    while (virDirRead(dir, &entry, NULL) > 0) {
+        g_autofree char *path = g_strdup_printf("%s/%s", cacheDir, entry->d_name);
+
+        if (!virStringStripSuffix(entry->d_name, ".xml") ||
+            virHashLookup(names, entry->d_name))
+            continue;
+
+        VIR_DEBUG("Removing parse cache of domain '%s'", entry->d_name);
+        if (unlink(path) < 0 && errno != ENOENT)
+            VIR_WARN("Unable to remove '%s': %s", path, g_strerror(errno));
+    }
+
+ cleanup:
+    virResetLastError();
+    VIR_DIR_CLOSE(dir);
+}
+
+
+static int
+virDomainObjListParseConfig(virDomainObjListLoadDataPtr data,
+                            virDomainObjListLoadItemPtr item)
+{
+    g_autofree char *configFile = NULL;
+    g_autofree char *autostartLink = NULL;
+    g_autoptr(virDomainDef) def = NULL;
+    struct stat sb;
+    bool cache = false;
+
+    if ((configFile = virDomainConfigFile(data->configDir, item->name)) == NULL)
+        return -1;
+
+    if (data->cacheDir && stat(configFile, &sb) == 0) {
+        cache = true;
+        def = virDomainObjListCacheLoad(data, item->name, &sb);
+    }
+
+    if (!def) {
+        if (!(def = virDomainDefParseFile(configFile, data->xmlopt, NULL,
+                                          VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                          VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                          VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
+            return -1;
+
+        /* definitions whose post parse callbacks failed are retried
+         * later on, so they can't be cached */
+        if (cache && !def->postParseFailed)
+            virDomainObjListCacheSave(data, def, &sb);
+    }
+
+    if ((autostartLink = virDomainConfigFile(data->autostartDir, item->name)) == NULL)
+        return -1;
+
+    if ((item->autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
+        return -1;
+
+    item->def = g_steal_pointer(&def);
+    return 0;
+}
+
+
+static int
+virDomainObjListParseStatus(virDomainObjListLoadDataPtr data,
+                            virDomainObjListLoadItemPtr item)
+{
+    g_autofree char *statusFile = NULL;
+
+    if ((statusFile = virDomainConfigFile(data->configDir, item->name)) == NULL)
+        return -1;
+
+    if (!(item->obj = virDomainObjParseFile(statusFile, data->xmlopt,
+                                            VIR_DOMAIN_DEF_PARSE_STATUS |
+                                            VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                                            VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                                            VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                            VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
+        return -1;
+
+    /* locked again by the thread adding it to the list */
+    virObjectUnlock(item->obj);
+    return 0;
+}
+
+
+static void
+virDomainObjListParseItem(virDomainObjListLoadDataPtr data,
+                          virDomainObjListLoadItemPtr item)
+{
+    int rc;
+
+    VIR_INFO("Loading config file '%s.xml'", item->name);
+
+    if (data->liveStatus)
+        rc = virDomainObjListParseStatus(data, item);
+    else
+        rc = virDomainObjListParseConfig(data, item);
+
+    /* NB: ignoring errors, so one malformed config doesn't
+       kill the whole process */
+    if (rc < 0)
+        VIR_ERROR(_("Failed to load config for domain '%s'"), item->name);
+}
+
+
+static void
+virDomainObjListParseWorker(void *jobdata,
+                            void *opaque)
+{
+    virDomainObjListLoadDataPtr data = opaque;
+
+    virDomainObjListParseItem(data, jobdata);
+
+    virMutexLock(&data->lock);
+    if (--data->npending == 0)
+        virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+static int
+virDomainObjListParseAll(virDomainObjListLoadDataPtr data,
+                         virDomainObjListLoadItemPtr items,
+                         size_t nitems,
+                         unsigned int nworkers)
+{
+    virThreadPoolPtr pool = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (nworkers > nitems)
+        nworkers = nitems;
+
+    if (nworkers <= 1) {
+        for (i = 0; i < nitems; i++)
+            virDomainObjListParseItem(data, &items[i]);
+        return 0;
+    }
+
+    if (virMutexInit(&data->lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        return -1;
+    }
+    if (virCondInit(&data->cond) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init condition variable"));
+        virMutexDestroy(&data->lock);
+        return -1;
+    }
+
+    if (!(pool = virThreadPoolNewFull(0, nworkers, 0,
+                                      virDomainObjListParseWorker,
+                                      "domain-load", data)))
+        goto cleanup;
+
+    virMutexLock(&data->lock);
+    for (i = 0; i < nitems; i++) {
+        if (virThreadPoolSendJob(pool, 0, &items[i]) < 0)
+            break;
+        data->npending++;
+    }
+
+    while (data->npending > 0)
+        ignore_value(virCondWait(&data->cond, &data->lock));
+    virMutexUnlock(&data->lock);
+
+    /* parse what could not be queued in the caller */
+    for (; i < nitems; i++)
+        virDomainObjListParseItem(data, &items[i]);
+
+    ret = 0;
+
+ cleanup:
+    virThreadPoolFree(pool);
+    virCondDestroy(&data->cond);
+    virMutexDestroy(&data->lock);
+    return ret;
+}
+
+
+static virDomainObjPtr
+virDomainObjListLoadConfig(virDomainObjListPtr doms,
+                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadItemPtr item,
+                           virDomainLoadConfigNotify notify,
+                           void *opaque)
+{
+    virDomainObjPtr dom;
+    virDomainDefPtr oldDef = NULL;
+
+    if (!(dom = virDomainObjListAddLocked(doms, item->def, xmlopt, 0, &oldDef)))
+        return NULL;
+    item->def = NULL;
+
+    dom->autostart = item->autostart;
 
     if (notify)
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
-
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
 }
 
 
 static virDomainObjPtr
 virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjListLoadItemPtr item,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
+    virDomainObjPtr obj = g_steal_pointer(&item->obj);
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
-
+    virObjectLock(obj);
     virUUIDFormat(obj->def->uuid, uuidstr);
 
     if (virHashLookup(doms->objs, uuidstr) != NULL) {
@@ -569,27 +1029,70 @@ virDomainObjListLoadStatus(virDomainObjListPtr doms,
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
 
  error:
     virDomainObjEndAPI(&obj);
-    VIR_FREE(statusFile);
     return NULL;
 }
 
 
+/**
+ * virDomainObjListLoadAllConfigsParallel:
+ * @doms: domain object list
+ * @configDir: directory to scan for domain XML files
+ * @autostartDir: directory with autostart links, unused if @liveStatus
+ * @cacheDir: directory holding the parse cache, or NULL to disable it
+ * @cacheKey: callback computing the driver key of cached definitions
+ * @cacheKeyOpaque: opaque data passed to @cacheKey
+ * @liveStatus: whether @configDir contains status XMLs of running domains
+ * @xmlopt: XML parser configuration
+ * @nworkers: maximum number of threads parsing the XML files
+ * @notify: callback invoked for every loaded domain
+ * @opaque: opaque data for @notify
+ *
+ * Loads all domain XML files from @configDir into @doms. The files are
+ * parsed by up to @nworkers threads, the parsed domains are then added
+ * to @doms and passed to @notify in directory order while holding the
+ * list's write lock. If @nworkers is 0 or 1 the files are parsed in the
+ * calling thread.
+ *
+ * If @cacheDir is given, persistent definitions are loaded from the
+ * parse cache kept there when it is still up to date, skipping the post
+ * parse callbacks, and the cache is refreshed for the others. Cache
+ * files of domains without a config file in @configDir are removed. The
+ * cache is not used for status XMLs.
+ *
+ * Returns 0 on success, -1 on error. Failure to load a single domain is
+ * logged but not considered an error.
+ */
 int
-virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
-                               const char *configDir,
-                               const char *autostartDir,
-                               bool liveStatus,
-                               virDomainXMLOptionPtr xmlopt,
-                               virDomainLoadConfigNotify notify,
-                               void *opaque)
+virDomainObjListLoadAllConfigsParallel(virDomainObjListPtr doms,
+                                       const char *configDir,
+                                       const char *autostartDir,
+                                       const char *cacheDir,
+                                       virDomainObjListCacheKeyFunc cacheKey,
+                                       void *cacheKeyOpaque,
+                                       bool liveStatus,
+                                       virDomainXMLOptionPtr xmlopt,
+                                       unsigned int nworkers,
+                                       virDomainLoadConfigNotify notify,
+                                       void *opaque)
 {
+    virDomainObjListLoadData data = {
+        .configDir = configDir,
+        .autostartDir = autostartDir,
+        .cacheDir = liveStatus ? NULL : cacheDir,
+        .cacheKey = cacheKey,
+        .cacheKeyOpaque = cacheKeyOpaque,
+        .liveStatus = liveStatus,
+        .xmlopt = xmlopt,
+    };
+    virDomainObjListLoadItemPtr items = NULL;
+    size_t nitems = 0;
     DIR *dir;
     struct dirent *entry;
+    size_t i;
     int ret = -1;
     int rc;
 
@@ -598,47 +1101,83 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
+    while ((rc = virDirRead(dir, &entry, configDir)) > 0) {
+        virDomainObjListLoadItem item = { 0 };
+
+        if (!virStringStripSuffix(entry->d_name, ".xml"))
+            continue;
+
+        item.name = g_strdup(entry->d_name);
+        if (VIR_APPEND_ELEMENT(items, nitems, item) < 0) {
+            g_free(item.name);
+            goto cleanup;
+        }
+    }
+
+    if (rc < 0)
+        goto cleanup;
+
+    if (virDomainObjListParseAll(&data, items, nitems, nworkers) < 0)
+        goto cleanup;
+
+    if (data.cacheDir)
+        virDomainObjListCachePrune(data.cacheDir, items, nitems);
+
     virObjectRWLockWrite(doms);
 
-    while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
+    for (i = 0; i < nitems; i++) {
         virDomainObjPtr dom;
 
-        if (!virStringStripSuffix(entry->d_name, ".xml"))
+        /* parse errors were already logged */
+        if (!items[i].def && !items[i].obj)
             continue;
 
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
         if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
+            dom = virDomainObjListLoadStatus(doms, &items[i], notify, opaque);
         else
-            dom = virDomainObjListLoadConfig(doms,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+            dom = virDomainObjListLoadConfig(doms, xmlopt, &items[i],
+                                             notify, opaque);
+
         if (dom) {
             if (!liveStatus)
                 dom->persistent = 1;
             virDomainObjEndAPI(&dom);
         } else {
-            VIR_ERROR(_("Failed to load config for domain '%s'"), entry->d_name);
+            VIR_ERROR(_("Failed to load config for domain '%s'"), items[i].name);
         }
     }
 
-    VIR_DIR_CLOSE(dir);
     virObjectRWUnlock(doms);
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nitems; i++) {
+        g_free(items[i].name);
+        virDomainDefFree(items[i].def);
+        virObjectUnref(items[i].obj);
+    }
+    g_free(items);
+    VIR_DIR_CLOSE(dir);
     return ret;
 }
 
 
+int
+virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
+                               const char *configDir,
+                               const char *autostartDir,
+                               bool liveStatus,
+                               virDomainXMLOptionPtr xmlopt,
+                               virDomainLoadConfigNotify notify,
+                               void *opaque)
+{
+    return virDomainObjListLoadAllConfigsParallel(doms, configDir, autostartDir,
+                                                  NULL, NULL, NULL,
+                                                  liveStatus, xmlopt, 0,
+                                                  notify, opaque);
+}
+
+
 struct virDomainObjListData {
     virDomainObjListACLFilter filter;
     virConnectPtr conn;
@@ -33,6 +33,8 @@ virDomainObjPtr virDomainObjListFindByID(virDomainObjListPtr doms,
                                          int id);
 virDomainObjPtr virDomainObjListFindByUUID(virDomainObjListPtr doms,
                                            const unsigned char *uuid);
+virDomainObjPtr virDomainObjListFindByUUIDRef(virDomainObjListPtr doms,
+                                              const unsigned char *uuid);
 virDomainObjPtr virDomainObjListFindByName(virDomainObjListPtr doms,
                                            const char *name);
 
@@ -62,6 +64,19 @@ void virDomainObjListRemove(virDomainObjListPtr doms,
 void virDomainObjListRemoveLocked(virDomainObjListPtr doms,
                                   virDomainObjPtr dom);
 
+/**
+ * virDomainObjListCacheKeyFunc:
+ * @def: domain definition
+ * @opaque: opaque data passed to virDomainObjListLoadAllConfigsParallel
+ *
+ * Returns a string identifying the driver state the post parse callbacks
+ * of @def depend on (such as the capabilities of its emulator and the
+ * driver configuration), or NULL on error. A cached definition is used
+ * only if the key computed for it matches the one it was cached with.
+ */
+typedef char *(*virDomainObjListCacheKeyFunc)(virDomainDefPtr def,
+                                              void *opaque);
+
 int virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                    const char *configDir,
                                    const char *autostartDir,
@@ -69,6 +84,17 @@ int virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                    virDomainXMLOptionPtr xmlopt,
                                    virDomainLoadConfigNotify notify,
                                    void *opaque);
+int virDomainObjListLoadAllConfigsParallel(virDomainObjListPtr doms,
+                                           const char *configDir,
+                                           const char *autostartDir,
+                                           const char *cacheDir,
+                                           virDomainObjListCacheKeyFunc cacheKey,
+                                           void *cacheKeyOpaque,
+                                           bool liveStatus,
+                                           virDomainXMLOptionPtr xmlopt,
+                                           unsigned int nworkers,
+                                           virDomainLoadConfigNotify notify,
+                                           void *opaque);
 
 int virDomainObjListNumOfDomains(virDomainObjListPtr doms,
                                  bool active,
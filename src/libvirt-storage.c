@@ -1599,6 +1599,12 @@ virStorageVolCreateXMLFrom(virStoragePoolPtr pool,
  * VIR_STREAM_RECV_STOP_AT_HOLE) for honouring holes sent by
  * server.
  *
+ * If VIR_STORAGE_VOL_DOWNLOAD_BYPASS_CACHE is set in @flags the
+ * volume is read with direct I/O, so that the download does not
+ * fill the host page cache. @offset must be a multiple of 4 KiB
+ * and the flag can't be combined with
+ * VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM.
+ *
  * This call sets up an asynchronous stream; subsequent use of
  * stream APIs is necessary to transfer the actual data,
  * determine how much data is successfully transferred, and
@@ -1623,6 +1629,10 @@ virStorageVolDownload(virStorageVolPtr vol,
     virCheckStreamGoto(stream, error);
     virCheckReadOnlyGoto(vol->conn->flags, error);
 
+    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM,
+                             VIR_STORAGE_VOL_DOWNLOAD_BYPASS_CACHE,
+                             error);
+
     if (vol->conn != stream->conn) {
         virReportInvalidArg(stream,
                             _("stream in %s must match connection of volume '%s'"),
@@ -1670,6 +1680,12 @@ virStorageVolDownload(virStorageVolPtr vol,
  * the @stream with combination of virStreamSparseSendAll() or
  * virStreamSendHole() to preserve source file sparseness.
  *
+ * If VIR_STORAGE_VOL_UPLOAD_BYPASS_CACHE is set in @flags the
+ * volume is written with direct I/O, so that the upload does not
+ * fill the host page cache. @offset must be a multiple of 4 KiB
+ * and the flag can't be combined with
+ * VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM.
+ *
  * This call sets up an asynchronous stream; subsequent use of
  * stream APIs is necessary to transfer the actual data,
  * determine how much data is successfully transferred, and
@@ -1703,6 +1719,10 @@ virStorageVolUpload(virStorageVolPtr vol,
     virCheckStreamGoto(stream, error);
     virCheckReadOnlyGoto(vol->conn->flags, error);
 
+    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM,
+                             VIR_STORAGE_VOL_UPLOAD_BYPASS_CACHE,
+                             error);
+
     if (vol->conn != stream->conn) {
         virReportInvalidArg(stream,
                             _("stream in %s must match connection of volume '%s'"),
@@ -53,6 +53,8 @@
 #include "virstring.h"
 #include "virutil.h"
 #include "virtypedparam.h"
+#include "virdaemon.h"
+#include "virtime.h"
 
 #ifdef WITH_TEST
 # include "test/test_driver.h"
@@ -648,14 +650,22 @@ virStateInitialize(bool privileged,
         if (virStateDriverTab[i]->stateInitialize &&
             !virStateDriverTab[i]->initialized) {
             virDrvStateInitResult ret;
+            g_autofree char *phase = NULL;
+            unsigned long long start = 0;
+
             VIR_DEBUG("Running global init for %s state driver",
                       virStateDriverTab[i]->name);
             virStateDriverTab[i]->initialized = true;
+            ignore_value(virTimeMillisNow(&start));
             ret = virStateDriverTab[i]->stateInitialize(privileged,
                                                         root,
                                                         callback,
                                                         opaque);
             VIR_DEBUG("State init result %d (mandatory=%d)", ret, mandatory);
+
+            phase = g_strdup_printf("driver.%s", virStateDriverTab[i]->name);
+            virDaemonStartupPhaseRecord(phase, start);
+
             if (ret == VIR_DRV_STATE_INIT_ERROR) {
                 VIR_ERROR(_("Initialization of %s state driver failed: %s"),
                           virStateDriverTab[i]->name,
@@ -40,6 +40,7 @@
 #include "virfile.h"
 #include "virpidfile.h"
 #include "virstring.h"
+#include "virconf.h"
 #include "viraccessapicheck.h"
 
 #include "nwfilter_ipaddrmap.h"
@@ -170,6 +171,26 @@ virNWFilterTriggerRebuildImpl(void *opaque)
 }
 
 
+static int
+nwfilterLoadDriverConfig(const char *filename,
+                         char **firewallBackend)
+{
+    g_autoptr(virConf) conf = NULL;
+
+    /* Avoid error from non-existent or unreadable file. */
+    if (access(filename, R_OK) == -1)
+        return 0;
+
+    if (!(conf = virConfReadFile(filename, 0)))
+        return -1;
+
+    if (virConfGetValueString(conf, "firewall_backend", firewallBackend) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 /**
  * nwfilterStateInitialize:
  *
@@ -182,6 +203,7 @@ nwfilterStateInitialize(bool privileged,
                         void *opaque G_GNUC_UNUSED)
 {
     DBusConnection *sysbus = NULL;
+    g_autofree char *firewallBackend = NULL;
 
     if (root != NULL) {
         virReportError(VIR_ERR_INVALID_ARG, "%s",
@@ -231,7 +253,11 @@ nwfilterStateInitialize(bool privileged,
     if (virNWFilterDHCPSnoopInit() < 0)
         goto err_exit_learnshutdown;
 
-    if (virNWFilterTechDriversInit(privileged) < 0)
+    if (nwfilterLoadDriverConfig(SYSCONFDIR "/libvirt/nwfilter.conf",
+                                 &firewallBackend) < 0)
+        goto err_dhcpsnoop_shutdown;
+
+    if (virNWFilterTechDriversInit(privileged, firewallBackend) < 0)
         goto err_dhcpsnoop_shutdown;
 
     if (virNWFilterConfLayerInit(virNWFilterTriggerRebuildImpl,
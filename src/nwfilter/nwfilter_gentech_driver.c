@@ -30,6 +30,7 @@
 #include "virerror.h"
 #include "nwfilter_gentech_driver.h"
 #include "nwfilter_ebiptables_driver.h"
+#include "nwfilter_nftables_driver.h"
 #include "nwfilter_dhcpsnoop.h"
 #include "nwfilter_ipaddrmap.h"
 #include "nwfilter_learnipaddr.h"
@@ -52,9 +53,13 @@ static int _virNWFilterTeardownFilter(const char *ifname);
 
 static virNWFilterTechDriverPtr filter_tech_drivers[] = {
     &ebiptables_driver,
+    &nftables_driver,
     NULL
 };
 
+/* name of the technology driver instantiating all filters */
+static const char *filter_tech_drvname = EBIPTABLES_DRIVER_ID;
+
 /* Serializes instantiation of filters. This is necessary
  * to avoid lock ordering deadlocks. eg virNWFilterInstantiateFilterUpdate
  * will hold a lock on a virNWFilterObjPtr. This in turn invokes
@@ -71,18 +76,45 @@ static virNWFilterTechDriverPtr filter_tech_drivers[] = {
  */
 static virMutex updateMutex;
 
-int virNWFilterTechDriversInit(bool privileged)
+/**
+ * virNWFilterTechDriversInit:
+ * @privileged: whether the driver runs privileged
+ * @drvname: name of the technology driver to use, or NULL for the default
+ *
+ * Initialize the technology driver instantiating the filters. Only one
+ * driver is initialized as the drivers would otherwise both install
+ * rules for the same interfaces.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virNWFilterTechDriversInit(bool privileged, const char *drvname)
 {
     size_t i = 0;
-    VIR_DEBUG("Initializing NWFilter technology drivers");
-    if (virMutexInitRecursive(&updateMutex) < 0)
-        return -1;
+    VIR_DEBUG("Initializing NWFilter technology driver '%s'",
+              NULLSTR(drvname));
+
+    if (!drvname)
+        drvname = EBIPTABLES_DRIVER_ID;
 
     while (filter_tech_drivers[i]) {
-        if (!(filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED))
-            filter_tech_drivers[i]->init(privileged);
+        if (STREQ(filter_tech_drivers[i]->name, drvname))
+            break;
         i++;
     }
+
+    if (!filter_tech_drivers[i]) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("unknown nwfilter firewall backend '%s'"), drvname);
+        return -1;
+    }
+
+    if (virMutexInitRecursive(&updateMutex) < 0)
+        return -1;
+
+    filter_tech_drvname = filter_tech_drivers[i]->name;
+    if (!(filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED))
+        filter_tech_drivers[i]->init(privileged);
+
     return 0;
 }
 
@@ -678,7 +710,7 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
                                    bool *foundNewFilter)
 {
     int rc = -1;
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = filter_tech_drvname;
     virNWFilterTechDriverPtr techdriver;
     virNWFilterObjPtr obj;
     virNWFilterDefPtr filter;
@@ -844,7 +876,7 @@ virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
 static int
 virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = filter_tech_drvname;
     int ifindex;
     virNWFilterTechDriverPtr techdriver;
 
@@ -870,7 +902,7 @@ virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
 static int
 virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = filter_tech_drvname;
     int ifindex;
     virNWFilterTechDriverPtr techdriver;
 
@@ -896,7 +928,7 @@ virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
 static int
 _virNWFilterTeardownFilter(const char *ifname)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = filter_tech_drvname;
     virNWFilterTechDriverPtr techdriver;
     techdriver = virNWFilterTechDriverForName(drvname);
 
@@ -28,7 +28,7 @@
 
 virNWFilterTechDriverPtr virNWFilterTechDriverForName(const char *name);
 
-int virNWFilterTechDriversInit(bool privileged);
+int virNWFilterTechDriversInit(bool privileged, const char *drvname);
 void virNWFilterTechDriversShutdown(void);
 
 enum instCase {
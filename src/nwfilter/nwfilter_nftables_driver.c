@@ -0,0 +1,1855 @@
+/*
+ * nwfilter_nftables_driver.c: driver for nftables on tap devices
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <net/ethernet.h>
+
+#include "internal.h"
+
+#include "virbuffer.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virerror.h"
+#include "nwfilter_conf.h"
+#include "nwfilter_nftables_driver.h"
+#include "vircommand.h"
+#include "virhash.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NWFILTER
+
+VIR_LOG_INIT("nwfilter.nwfilter_nftables_driver");
+
+/*
+ * All rules live in a single table of the bridge family. The base chains
+ * dispatch frames to the chains of the interface they were received
+ * from or are sent to through the verdict maps keyed by the interface
+ * name, so the cost of the dispatch does not grow with the number of
+ * filtered interfaces:
+ *
+ *   table bridge libvirt_nwfilter {
+ *     map in_ifaces { type ifname : verdict; }
+ *     map out_ifaces { type ifname : verdict; }
+ *     set basic_macs { type ifname . ether_addr; }
+ *     chain prerouting { ...; iifname vmap @in_ifaces }
+ *     chain postrouting { ...; oifname vmap @out_ifaces }
+ *     chain basic { ... }
+ *     chain I-vnet0 { ...; ether type arp jump I-vnet0/arp }
+ *     chain I-vnet0/arp { ... }
+ *     ...
+ *   }
+ *
+ * The filters of an interface are instantiated into one of two
+ * generations of chains, 'I'/'O' and 'J'/'P'. applyNewRules replaces
+ * the generation that is not referenced from the maps and tearOldRules
+ * switches the map elements over to it, so neither step is visible to
+ * traffic before it is complete. Each step is a single nft transaction.
+ *
+ * The chains and map elements of each interface are listed from the
+ * table once and then tracked in memory as the driver changes them, so
+ * an operation on one interface does not need to list the rules of all
+ * the others. If applying a transaction fails the tracked state is
+ * dropped and listed again by the next operation.
+ */
+
+#define NFTABLES_FAMILY "bridge"
+#define NFTABLES_TABLE "libvirt_nwfilter"
+#define NFTABLES_TABLE_SPEC NFTABLES_FAMILY " " NFTABLES_TABLE
+
+#define NFTABLES_MAP_IN "in_ifaces"
+#define NFTABLES_MAP_OUT "out_ifaces"
+#define NFTABLES_SET_BASIC "basic_macs"
+#define NFTABLES_CHAIN_BASIC "basic"
+
+/* same as the nat table of ebtables */
+#define NFTABLES_CHAIN_PRIORITY "-300"
+
+/* characters that can appear in an unquoted name of a chain */
+#define NFTABLES_VALID_NAME \
+  "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-"
+
+/* characters that can appear in a value of a variable */
+#define NFTABLES_VALID_VALUE NFTABLES_VALID_NAME ":/"
+
+static const char nftablesChainPrefixIn[2] = { 'I', 'J' };
+static const char nftablesChainPrefixOut[2] = { 'O', 'P' };
+
+static const struct {
+    const char *name;
+    unsigned short ethertype; /* 0 if any frame enters the chain */
+} nftablesSubChainProtocols[] = {
+    { "ipv4", ETHERTYPE_IP },
+    { "ipv6", ETHERTYPE_IPV6 },
+    { "arp",  ETHERTYPE_ARP },
+    { "rarp", ETHERTYPE_REVARP },
+    { "vlan", ETHERTYPE_VLAN },
+    { "mac",  0 },
+};
+
+
+typedef struct _nftablesIfaceState nftablesIfaceState;
+typedef nftablesIfaceState *nftablesIfaceStatePtr;
+struct _nftablesIfaceState {
+    bool haveTable;
+    char **chains;
+    char *inVerdict;
+    char *outVerdict;
+    char *basicMac;
+};
+
+static void
+nftablesIfaceStateClear(nftablesIfaceStatePtr state)
+{
+    virStringListFree(state->chains);
+    g_free(state->inVerdict);
+    g_free(state->outVerdict);
+    g_free(state->basicMac);
+    memset(state, 0, sizeof(*state));
+}
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(nftablesIfaceState, nftablesIfaceStateClear);
+
+static void
+nftablesIfaceStateFree(void *opaque)
+{
+    nftablesIfaceStatePtr state = opaque;
+
+    if (!state)
+        return;
+
+    nftablesIfaceStateClear(state);
+    g_free(state);
+}
+
+
+static int
+nftablesIfaceStateCopy(nftablesIfaceStatePtr dst,
+                       const nftablesIfaceState *src)
+{
+    if (virStringListCopy(&dst->chains, (const char **)src->chains) < 0)
+        return -1;
+
+    dst->haveTable = src->haveTable;
+    dst->inVerdict = g_strdup(src->inVerdict);
+    dst->outVerdict = g_strdup(src->outVerdict);
+    dst->basicMac = g_strdup(src->basicMac);
+    return 0;
+}
+
+
+/* State of all filtered interfaces keyed by their name, NULL until the
+ * table is listed. Protected by nftablesStateLock. */
+static virMutex nftablesStateLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr nftablesIfaces;
+static bool nftablesHaveTable;
+
+
+typedef struct _nftablesRuleVars nftablesRuleVars;
+typedef nftablesRuleVars *nftablesRuleVarsPtr;
+struct _nftablesRuleVars {
+    virNWFilterVarCombIterPtr iter;
+
+    /* variable whose values are all matched at once as a set */
+    const char *setName;
+    virNWFilterVarValuePtr setValue;
+    bool setUnusable;
+};
+
+
+typedef enum {
+    NFTABLES_VALUE_PLAIN,
+    NFTABLES_VALUE_HEX,
+    NFTABLES_VALUE_ETHER_INT,
+    NFTABLES_VALUE_IPV4_INT,
+    NFTABLES_VALUE_IPV4_MASK_INT,
+} nftablesValueType;
+
+
+static int
+nftablesCheckName(const char *name)
+{
+    if (!*name || name[strspn(name, NFTABLES_VALID_NAME)] != '\0') {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                       _("name '%s' is not supported by the nftables driver"),
+                       name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static char *
+nftablesChainName(char prefix, const char *ifname, const char *suffix)
+{
+    if (!suffix ||
+        STREQ(suffix, virNWFilterChainSuffixTypeToString(
+                          VIR_NWFILTER_CHAINSUFFIX_ROOT)))
+        return g_strdup_printf("%c-%s", prefix, ifname);
+
+    return g_strdup_printf("%c-%s/%s", prefix, ifname, suffix);
+}
+
+
+/*
+ * Returns true if @chain is one of the chains of @ifname and stores the
+ * generation it belongs to in @gen
+ */
+static bool
+nftablesChainIsIface(const char *chain, const char *ifname, int *gen)
+{
+    const char *tmp;
+    size_t i;
+
+    if (!chain[0] || chain[1] != '-' || !STRPREFIX(chain + 2, ifname))
+        return false;
+
+    tmp = chain + 2 + strlen(ifname);
+    if (*tmp != '\0' && *tmp != '/')
+        return false;
+
+    for (i = 0; i < G_N_ELEMENTS(nftablesChainPrefixIn); i++) {
+        if (chain[0] == nftablesChainPrefixIn[i] ||
+            chain[0] == nftablesChainPrefixOut[i]) {
+            if (gen)
+                *gen = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * Returns the generation of the chains @verdict jumps to or -1 if it
+ * does not jump to a chain of @ifname
+ */
+static int
+nftablesVerdictGen(const char *verdict, const char *ifname)
+{
+    g_autofree char *chain = NULL;
+    const char *tmp;
+    int gen;
+
+    if (!verdict || !(tmp = STRSKIP(verdict, "jump ")))
+        return -1;
+
+    if (*tmp == '"')
+        tmp++;
+    chain = g_strndup(tmp, strcspn(tmp, "\""));
+
+    if (!nftablesChainIsIface(chain, ifname, &gen))
+        return -1;
+
+    return gen;
+}
+
+
+static int
+nftablesIfaceActiveGen(nftablesIfaceStatePtr state, const char *ifname)
+{
+    int gen;
+
+    if ((gen = nftablesVerdictGen(state->inVerdict, ifname)) >= 0)
+        return gen;
+
+    return nftablesVerdictGen(state->outVerdict, ifname);
+}
+
+
+typedef enum {
+    NFTABLES_BLOCK_NONE,
+    NFTABLES_BLOCK_MAP_IN,
+    NFTABLES_BLOCK_MAP_OUT,
+    NFTABLES_BLOCK_SET_BASIC,
+} nftablesBlock;
+
+
+static nftablesIfaceStatePtr
+nftablesIfacesGet(virHashTablePtr ifaces, const char *ifname)
+{
+    nftablesIfaceStatePtr state;
+
+    if ((state = virHashLookup(ifaces, ifname)))
+        return state;
+
+    state = g_new0(nftablesIfaceState, 1);
+    if (virHashAddEntry(ifaces, ifname, state) < 0) {
+        g_free(state);
+        return NULL;
+    }
+
+    return state;
+}
+
+
+/*
+ * Store the data of all elements of a listed map or set found on @line
+ * in the state of the interface they belong to, e.g. 'jump I-vnet0' of
+ * vnet0 from
+ *
+ *   elements = { "vnet0" : jump I-vnet0, "vnet1" : drop }
+ */
+static int
+nftablesParseElements(virHashTablePtr ifaces,
+                      const char *line,
+                      nftablesBlock block)
+{
+    const char *sep = block == NFTABLES_BLOCK_SET_BASIC ? " . " : " : ";
+    const char *cur = line;
+
+    while ((cur = strchr(cur, '"'))) {
+        g_autofree char *key = NULL;
+        nftablesIfaceStatePtr state;
+        const char *end;
+        char **value;
+        size_t len;
+
+        if (!(end = strchr(cur + 1, '"')))
+            break;
+
+        key = g_strndup(cur + 1, end - cur - 1);
+        cur = end + 1;
+
+        if (!STRPREFIX(cur, sep))
+            continue;
+        cur += strlen(sep);
+
+        len = strcspn(cur, ",}");
+        end = cur + len;
+        while (len > 0 && g_ascii_isspace(cur[len - 1]))
+            len--;
+
+        if (!(state = nftablesIfacesGet(ifaces, key)))
+            return -1;
+
+        switch (block) {
+        case NFTABLES_BLOCK_MAP_IN:
+            value = &state->inVerdict;
+            break;
+        case NFTABLES_BLOCK_MAP_OUT:
+            value = &state->outVerdict;
+            break;
+        case NFTABLES_BLOCK_SET_BASIC:
+            value = &state->basicMac;
+            break;
+        case NFTABLES_BLOCK_NONE:
+            return 0;
+        }
+
+        if (!*value)
+            *value = g_strndup(cur, len);
+        cur = end;
+    }
+
+    return 0;
+}
+
+
+/*
+ * List the table and collect the chains and map elements of every
+ * interface into nftablesIfaces. Must be called with nftablesStateLock
+ * held.
+ */
+static int
+nftablesListTable(void)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autoptr(virHashTable) ifaces = NULL;
+    g_autofree char *output = NULL;
+    g_autofree char *error = NULL;
+    VIR_AUTOSTRINGLIST lines = NULL;
+    nftablesBlock block = NFTABLES_BLOCK_NONE;
+    int status;
+    size_t i;
+
+    if (!(ifaces = virHashNew(nftablesIfaceStateFree)))
+        return -1;
+
+    cmd = virCommandNewArgList(NFT_PATH, "list", "table",
+                               NFTABLES_FAMILY, NFTABLES_TABLE, NULL);
+    virCommandSetOutputBuffer(cmd, &output);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        return -1;
+
+    if (status != 0) {
+        /* the table is created on first use */
+        if (error && strstr(error, "No such file or directory")) {
+            VIR_DEBUG("Table " NFTABLES_TABLE_SPEC " does not exist yet");
+            nftablesHaveTable = false;
+            nftablesIfaces = g_steal_pointer(&ifaces);
+            return 0;
+        }
+
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to list nftables table " NFTABLES_TABLE_SPEC
+                         ": %s"), NULLSTR(error));
+        return -1;
+    }
+
+    if (!(lines = virStringSplit(NULLSTR_EMPTY(output), "\n", 0)))
+        return -1;
+
+    for (i = 0; lines[i]; i++) {
+        const char *line = lines[i];
+        g_autofree char *name = NULL;
+        const char *tmp;
+
+        virSkipSpaces(&line);
+
+        if ((tmp = STRSKIP(line, "chain ")) ||
+            (tmp = STRSKIP(line, "map ")) ||
+            (tmp = STRSKIP(line, "set "))) {
+            if (*tmp == '"')
+                tmp++;
+            name = g_strndup(tmp, strcspn(tmp, "\" {"));
+
+            block = NFTABLES_BLOCK_NONE;
+            if (STRPREFIX(line, "chain ")) {
+                g_autofree char *ifname = NULL;
+                nftablesIfaceStatePtr state;
+
+                if (!name[0] || name[1] != '-')
+                    continue;
+
+                ifname = g_strndup(name + 2, strcspn(name + 2, "/"));
+                if (!nftablesChainIsIface(name, ifname, NULL))
+                    continue;
+
+                if (!(state = nftablesIfacesGet(ifaces, ifname)) ||
+                    virStringListAdd(&state->chains, name) < 0)
+                    return -1;
+            } else if (STREQ(name, NFTABLES_MAP_IN)) {
+                block = NFTABLES_BLOCK_MAP_IN;
+            } else if (STREQ(name, NFTABLES_MAP_OUT)) {
+                block = NFTABLES_BLOCK_MAP_OUT;
+            } else if (STREQ(name, NFTABLES_SET_BASIC)) {
+                block = NFTABLES_BLOCK_SET_BASIC;
+            }
+            continue;
+        }
+
+        if (block != NFTABLES_BLOCK_NONE &&
+            nftablesParseElements(ifaces, line, block) < 0)
+            return -1;
+    }
+
+    VIR_DEBUG("Listed the state of %zd interfaces", virHashSize(ifaces));
+
+    nftablesHaveTable = true;
+    nftablesIfaces = g_steal_pointer(&ifaces);
+    return 0;
+}
+
+
+/*
+ * Fill @state with the chains and map elements belonging to @ifname
+ */
+static int
+nftablesGetIfaceState(const char *ifname,
+                      nftablesIfaceStatePtr state)
+{
+    nftablesIfaceStatePtr cur;
+    int ret = -1;
+
+    virMutexLock(&nftablesStateLock);
+
+    if (!nftablesIfaces && nftablesListTable() < 0)
+        goto cleanup;
+
+    if ((cur = virHashLookup(nftablesIfaces, ifname)) &&
+        nftablesIfaceStateCopy(state, cur) < 0)
+        goto cleanup;
+
+    state->haveTable = nftablesHaveTable;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&nftablesStateLock);
+    return ret;
+}
+
+
+/*
+ * Record @state as the state of @ifname after the transaction changing
+ * it was applied
+ */
+static void
+nftablesSetIfaceState(const char *ifname,
+                      nftablesIfaceStatePtr state)
+{
+    nftablesIfaceStatePtr copy = NULL;
+
+    virMutexLock(&nftablesStateLock);
+
+    /* dropped meanwhile, the next operation lists the table again */
+    if (!nftablesIfaces)
+        goto cleanup;
+
+    nftablesHaveTable |= state->haveTable;
+
+    if (!state->chains && !state->inVerdict &&
+        !state->outVerdict && !state->basicMac) {
+        virHashRemoveEntry(nftablesIfaces, ifname);
+        goto cleanup;
+    }
+
+    copy = g_new0(nftablesIfaceState, 1);
+    if (nftablesIfaceStateCopy(copy, state) < 0 ||
+        virHashUpdateEntry(nftablesIfaces, ifname, copy) < 0) {
+        nftablesIfaceStateFree(copy);
+        g_clear_pointer(&nftablesIfaces, virHashFree);
+    }
+
+ cleanup:
+    virMutexUnlock(&nftablesStateLock);
+}
+
+
+static void
+nftablesDropState(void)
+{
+    virMutexLock(&nftablesStateLock);
+    g_clear_pointer(&nftablesIfaces, virHashFree);
+    virMutexUnlock(&nftablesStateLock);
+}
+
+
+static int
+nftablesApplyScript(virBufferPtr buf)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *script = NULL;
+    g_autofree char *error = NULL;
+
+    if (virBufferUse(buf) == 0)
+        return 0;
+
+    script = virBufferContentAndReset(buf);
+    VIR_DEBUG("Applying nftables script:\n%s", script);
+
+    cmd = virCommandNewArgList(NFT_PATH, "-f", "/dev/stdin", NULL);
+    virCommandSetInputBuffer(cmd, script);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    return virCommandRun(cmd, NULL);
+}
+
+
+/*
+ * Apply the transaction in @buf which changes the rules of @ifname to
+ * @state and keep track of the new state
+ */
+static int
+nftablesApplyIfaceScript(virBufferPtr buf,
+                         const char *ifname,
+                         nftablesIfaceStatePtr state)
+{
+    if (nftablesApplyScript(buf) < 0) {
+        /* the rules might have been changed partially */
+        nftablesDropState();
+        return -1;
+    }
+
+    nftablesSetIfaceState(ifname, state);
+    return 0;
+}
+
+
+static void
+nftablesCreateTable(virBufferPtr buf,
+                    nftablesIfaceStatePtr state)
+{
+    if (state->haveTable)
+        return;
+
+    state->haveTable = true;
+
+    virBufferAddLit(buf, "add table " NFTABLES_TABLE_SPEC "\n");
+    virBufferAddLit(buf, "add map " NFTABLES_TABLE_SPEC " " NFTABLES_MAP_IN
+                    " { type ifname : verdict; }\n");
+    virBufferAddLit(buf, "add map " NFTABLES_TABLE_SPEC " " NFTABLES_MAP_OUT
+                    " { type ifname : verdict; }\n");
+    virBufferAddLit(buf, "add set " NFTABLES_TABLE_SPEC " " NFTABLES_SET_BASIC
+                    " { type ifname . ether_addr; }\n");
+
+    virBufferAddLit(buf, "add chain " NFTABLES_TABLE_SPEC " prerouting"
+                    " { type filter hook prerouting priority "
+                    NFTABLES_CHAIN_PRIORITY "; policy accept; }\n");
+    virBufferAddLit(buf, "flush chain " NFTABLES_TABLE_SPEC " prerouting\n");
+    virBufferAddLit(buf, "add rule " NFTABLES_TABLE_SPEC " prerouting"
+                    " iifname vmap @" NFTABLES_MAP_IN "\n");
+
+    virBufferAddLit(buf, "add chain " NFTABLES_TABLE_SPEC " postrouting"
+                    " { type filter hook postrouting priority "
+                    NFTABLES_CHAIN_PRIORITY "; policy accept; }\n");
+    virBufferAddLit(buf, "flush chain " NFTABLES_TABLE_SPEC " postrouting\n");
+    virBufferAddLit(buf, "add rule " NFTABLES_TABLE_SPEC " postrouting"
+                    " oifname vmap @" NFTABLES_MAP_OUT "\n");
+
+    /* the basic rules of all interfaces share a chain, only the MAC
+     * address of each interface is stored in the set */
+    virBufferAddLit(buf, "add chain " NFTABLES_TABLE_SPEC " "
+                    NFTABLES_CHAIN_BASIC "\n");
+    virBufferAddLit(buf, "flush chain " NFTABLES_TABLE_SPEC " "
+                    NFTABLES_CHAIN_BASIC "\n");
+    virBufferAddLit(buf, "add rule " NFTABLES_TABLE_SPEC " "
+                    NFTABLES_CHAIN_BASIC
+                    " iifname . ether saddr != @" NFTABLES_SET_BASIC
+                    " drop\n");
+    virBufferAddLit(buf, "add rule " NFTABLES_TABLE_SPEC " "
+                    NFTABLES_CHAIN_BASIC " ether type { ip, arp } accept\n");
+    virBufferAddLit(buf, "add rule " NFTABLES_TABLE_SPEC " "
+                    NFTABLES_CHAIN_BASIC " drop\n");
+}
+
+
+static void
+nftablesRemoveIfaceElements(virBufferPtr buf,
+                            nftablesIfaceStatePtr state,
+                            const char *ifname)
+{
+    if (state->inVerdict)
+        virBufferAsprintf(buf, "delete element " NFTABLES_TABLE_SPEC " "
+                          NFTABLES_MAP_IN " { \"%s\" }\n", ifname);
+    if (state->outVerdict)
+        virBufferAsprintf(buf, "delete element " NFTABLES_TABLE_SPEC " "
+                          NFTABLES_MAP_OUT " { \"%s\" }\n", ifname);
+    if (state->basicMac)
+        virBufferAsprintf(buf, "delete element " NFTABLES_TABLE_SPEC " "
+                          NFTABLES_SET_BASIC " { \"%s\" . %s }\n",
+                          ifname, state->basicMac);
+
+    g_clear_pointer(&state->inVerdict, g_free);
+    g_clear_pointer(&state->outVerdict, g_free);
+    g_clear_pointer(&state->basicMac, g_free);
+}
+
+
+/*
+ * Remove the chains of @ifname belonging to generation @gen, or all of
+ * them if @gen is -1
+ */
+static void
+nftablesRemoveIfaceChains(virBufferPtr buf,
+                          nftablesIfaceStatePtr state,
+                          const char *ifname,
+                          int gen)
+{
+    size_t i;
+    int g;
+
+    /* the rules of the chains jump to each other, so all of them have
+     * to be flushed before any can be deleted */
+    for (i = 0; state->chains && state->chains[i]; i++) {
+        if (nftablesChainIsIface(state->chains[i], ifname, &g) &&
+            (gen < 0 || g == gen))
+            virBufferAsprintf(buf, "flush chain " NFTABLES_TABLE_SPEC " %s\n",
+                              state->chains[i]);
+    }
+
+    for (i = 0; state->chains && state->chains[i]; i++) {
+        if (nftablesChainIsIface(state->chains[i], ifname, &g) &&
+            (gen < 0 || g == gen))
+            virBufferAsprintf(buf, "delete chain " NFTABLES_TABLE_SPEC " %s\n",
+                              state->chains[i]);
+    }
+
+    for (i = 0; state->chains && state->chains[i];) {
+        if (nftablesChainIsIface(state->chains[i], ifname, &g) &&
+            (gen < 0 || g == gen)) {
+            g_autofree char *chain = g_strdup(state->chains[i]);
+
+            virStringListRemove(&state->chains, chain);
+        } else {
+            i++;
+        }
+    }
+}
+
+
+static int
+nftablesAddIfaceChain(virBufferPtr buf,
+                      nftablesIfaceStatePtr state,
+                      const char *chain)
+{
+    virBufferAsprintf(buf, "add chain " NFTABLES_TABLE_SPEC " %s\n", chain);
+
+    if (virStringListHasString((const char **)state->chains, chain))
+        return 0;
+
+    return virStringListAdd(&state->chains, chain);
+}
+
+
+/*
+ * Make the root chains of generation @gen the ones traffic of @ifname
+ * passes through
+ */
+static void
+nftablesLinkIfaceChains(virBufferPtr buf,
+                        nftablesIfaceStatePtr state,
+                        const char *ifname,
+                        int gen)
+{
+    g_autofree char *chain_in = nftablesChainName(nftablesChainPrefixIn[gen],
+                                                  ifname, NULL);
+    g_autofree char *chain_out = nftablesChainName(nftablesChainPrefixOut[gen],
+                                                   ifname, NULL);
+
+    if (virStringListHasString((const char **)state->chains, chain_in)) {
+        virBufferAsprintf(buf, "add element " NFTABLES_TABLE_SPEC " "
+                          NFTABLES_MAP_IN " { \"%s\" : jump %s }\n",
+                          ifname, chain_in);
+        g_free(state->inVerdict);
+        state->inVerdict = g_strdup_printf("jump %s", chain_in);
+    }
+    if (virStringListHasString((const char **)state->chains, chain_out)) {
+        virBufferAsprintf(buf, "add element " NFTABLES_TABLE_SPEC " "
+                          NFTABLES_MAP_OUT " { \"%s\" : jump %s }\n",
+                          ifname, chain_out);
+        g_free(state->outVerdict);
+        state->outVerdict = g_strdup_printf("jump %s", chain_out);
+    }
+}
+
+
+static char *
+nftablesFormatLiteral(nwItemDescPtr item, bool asHex)
+{
+    char macaddr[VIR_MAC_STRING_BUFLEN];
+
+    switch (item->datatype) {
+    case DATATYPE_IPADDR:
+    case DATATYPE_IPV6ADDR:
+        return virSocketAddrFormat(&item->u.ipaddr);
+
+    case DATATYPE_MACADDR:
+    case DATATYPE_MACMASK:
+        return g_strdup(virMacAddrFormat(&item->u.macaddr, macaddr));
+
+    case DATATYPE_IPMASK:
+    case DATATYPE_IPV6MASK:
+        return g_strdup_printf("%u", item->u.u8);
+
+    case DATATYPE_UINT32:
+    case DATATYPE_UINT32_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%u", item->u.u32);
+
+    case DATATYPE_UINT16:
+    case DATATYPE_UINT16_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%u", item->u.u16);
+
+    case DATATYPE_UINT8:
+    case DATATYPE_UINT8_HEX:
+        return g_strdup_printf(asHex ? "0x%x" : "%u", item->u.u8);
+
+    case DATATYPE_STRING:
+    case DATATYPE_STRINGCOPY:
+    case DATATYPE_BOOLEAN:
+    case DATATYPE_IPSETNAME:
+    case DATATYPE_IPSETFLAGS:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Cannot print data type %x"), item->datatype);
+        return NULL;
+    case DATATYPE_LAST:
+    default:
+        virReportEnumRangeError(virNWFilterAttrDataType, item->datatype);
+        return NULL;
+    }
+}
+
+
+/*
+ * Convert @value into the representation nft expects for @type. Raw
+ * payload matches, used for ARP as nft's arp expressions cannot be
+ * combined with RARP, only take integers.
+ */
+static char *
+nftablesConvertValue(const char *value, nftablesValueType type)
+{
+    virMacAddr mac;
+    virSocketAddr addr;
+    unsigned int prefix;
+    uint32_t mask;
+
+    /* values end up in a script, don't let them change its meaning */
+    if (!*value || value[strspn(value, NFTABLES_VALID_VALUE)] != '\0') {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("invalid value '%s' in filter rule"), value);
+        return NULL;
+    }
+
+    switch (type) {
+    case NFTABLES_VALUE_PLAIN:
+    case NFTABLES_VALUE_HEX:
+        return g_strdup(value);
+
+    case NFTABLES_VALUE_ETHER_INT:
+        if (virMacAddrParse(value, &mac) < 0) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("invalid MAC address '%s'"), value);
+            return NULL;
+        }
+        return g_strdup_printf("0x%02x%02x%02x%02x%02x%02x",
+                               mac.addr[0], mac.addr[1], mac.addr[2],
+                               mac.addr[3], mac.addr[4], mac.addr[5]);
+
+    case NFTABLES_VALUE_IPV4_INT:
+        if (virSocketAddrParseIPv4(&addr, value) < 0)
+            return NULL;
+        return g_strdup_printf("0x%08x",
+                               ntohl(addr.data.inet4.sin_addr.s_addr));
+
+    case NFTABLES_VALUE_IPV4_MASK_INT:
+        if (virStrToLong_ui(value, NULL, 10, &prefix) == 0) {
+            if (prefix > 32) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("invalid netmask '%s'"), value);
+                return NULL;
+            }
+            mask = prefix ? 0xffffffff << (32 - prefix) : 0;
+        } else {
+            if (virSocketAddrParseIPv4(&addr, value) < 0)
+                return NULL;
+            mask = ntohl(addr.data.inet4.sin_addr.s_addr);
+        }
+        return g_strdup_printf("0x%08x", mask);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Format the value of @item, or the set of all values of the variable
+ * if the rule is instantiated once for all of them. @allowSet tells
+ * whether a set can stand in for the value, which is not the case for
+ * masks and ranges.
+ */
+static char *
+nftablesFormatItem(nftablesRuleVarsPtr vars,
+                   nwItemDescPtr item,
+                   nftablesValueType type,
+                   bool allowSet)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *literal = NULL;
+    const char *value;
+    size_t i;
+
+    if (!(item->flags & NWFILTER_ENTRY_ITEM_FLAG_HAS_VAR)) {
+        if (!(literal = nftablesFormatLiteral(item, type == NFTABLES_VALUE_HEX)))
+            return NULL;
+        return nftablesConvertValue(literal, type);
+    }
+
+    if (vars->setName &&
+        STREQ(virNWFilterVarAccessGetVarName(item->varAccess), vars->setName)) {
+        /* a != b for all values is not the same as != { all values } */
+        if (!allowSet || ENTRY_WANT_NEG_SIGN(item))
+            vars->setUnusable = true;
+
+        virBufferAddLit(&buf, "{ ");
+        for (i = 0; i < virNWFilterVarValueGetCardinality(vars->setValue); i++) {
+            g_autofree char *conv = NULL;
+
+            value = virNWFilterVarValueGetNthValue(vars->setValue, i);
+            if (!(conv = nftablesConvertValue(value, type)))
+                return NULL;
+
+            if (i > 0)
+                virBufferAddLit(&buf, ", ");
+            virBufferAdd(&buf, conv, -1);
+        }
+        virBufferAddLit(&buf, " }");
+
+        return virBufferContentAndReset(&buf);
+    }
+
+    if (!(value = virNWFilterVarCombIterGetVarValue(vars->iter, item->varAccess)))
+        return NULL;
+
+    return nftablesConvertValue(value, type);
+}
+
+
+static int
+nftablesAddMatch(virBufferPtr buf,
+                 nftablesRuleVarsPtr vars,
+                 const char *expr,
+                 nwItemDescPtr item,
+                 nftablesValueType type)
+{
+    g_autofree char *value = NULL;
+
+    if (!HAS_ENTRY_ITEM(item))
+        return 0;
+
+    if (!(value = nftablesFormatItem(vars, item, type, true)))
+        return -1;
+
+    virBufferAsprintf(buf, " %s %s%s", expr,
+                      ENTRY_WANT_NEG_SIGN(item) ? "!= " : "", value);
+    return 0;
+}
+
+
+/*
+ * Like nftablesAddMatch, with @mask being a prefix length appended to the
+ * value if @prefix is true, or a bitwise mask applied to the packet data
+ * otherwise
+ */
+static int
+nftablesAddMaskedMatch(virBufferPtr buf,
+                       nftablesRuleVarsPtr vars,
+                       const char *expr,
+                       nwItemDescPtr item,
+                       nwItemDescPtr mask,
+                       nftablesValueType type,
+                       nftablesValueType maskType,
+                       bool prefix)
+{
+    g_autofree char *value = NULL;
+    g_autofree char *maskval = NULL;
+    const char *neg = ENTRY_WANT_NEG_SIGN(item) ? "!= " : "";
+
+    if (!HAS_ENTRY_ITEM(item))
+        return 0;
+
+    if (!HAS_ENTRY_ITEM(mask))
+        return nftablesAddMatch(buf, vars, expr, item, type);
+
+    if (!(value = nftablesFormatItem(vars, item, type, false)) ||
+        !(maskval = nftablesFormatItem(vars, mask, maskType, false)))
+        return -1;
+
+    if (prefix)
+        virBufferAsprintf(buf, " %s %s%s/%s", expr, neg, value, maskval);
+    else
+        virBufferAsprintf(buf, " %s & %s %s%s", expr, maskval,
+                          *neg ? neg : "== ", value);
+
+    return 0;
+}
+
+
+static int
+nftablesAddRangeMatch(virBufferPtr buf,
+                      nftablesRuleVarsPtr vars,
+                      const char *expr,
+                      nwItemDescPtr start,
+                      nwItemDescPtr end)
+{
+    g_autofree char *lo = NULL;
+    g_autofree char *hi = NULL;
+
+    if (!HAS_ENTRY_ITEM(start))
+        return 0;
+
+    if (!HAS_ENTRY_ITEM(end))
+        return nftablesAddMatch(buf, vars, expr, start, NFTABLES_VALUE_PLAIN);
+
+    if (!(lo = nftablesFormatItem(vars, start, NFTABLES_VALUE_PLAIN, false)) ||
+        !(hi = nftablesFormatItem(vars, end, NFTABLES_VALUE_PLAIN, false)))
+        return -1;
+
+    virBufferAsprintf(buf, " %s %s%s-%s", expr,
+                      ENTRY_WANT_NEG_SIGN(start) ? "!= " : "", lo, hi);
+    return 0;
+}
+
+
+static int
+nftablesHandleEthHdr(virBufferPtr buf,
+                     nftablesRuleVarsPtr vars,
+                     ethHdrDataDefPtr ethHdr,
+                     bool reverse)
+{
+    if (nftablesAddMaskedMatch(buf, vars,
+                               reverse ? "ether daddr" : "ether saddr",
+                               &ethHdr->dataSrcMACAddr,
+                               &ethHdr->dataSrcMACMask,
+                               NFTABLES_VALUE_PLAIN,
+                               NFTABLES_VALUE_PLAIN, false) < 0 ||
+        nftablesAddMaskedMatch(buf, vars,
+                               reverse ? "ether saddr" : "ether daddr",
+                               &ethHdr->dataDstMACAddr,
+                               &ethHdr->dataDstMACMask,
+                               NFTABLES_VALUE_PLAIN,
+                               NFTABLES_VALUE_PLAIN, false) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+nftablesHandleIPHdr(virBufferPtr buf,
+                    nftablesRuleVarsPtr vars,
+                    const char *family,
+                    const char *protocol,
+                    ipHdrDataDefPtr ipHdr,
+                    portDataDefPtr portData,
+                    bool reverse)
+{
+    g_autofree char *saddr = g_strdup_printf("%s saddr", family);
+    g_autofree char *daddr = g_strdup_printf("%s daddr", family);
+
+    if (nftablesAddMaskedMatch(buf, vars, reverse ? daddr : saddr,
+                               &ipHdr->dataSrcIPAddr, &ipHdr->dataSrcIPMask,
+                               NFTABLES_VALUE_PLAIN,
+                               NFTABLES_VALUE_PLAIN, true) < 0 ||
+        nftablesAddMaskedMatch(buf, vars, reverse ? saddr : daddr,
+                               &ipHdr->dataDstIPAddr, &ipHdr->dataDstIPMask,
+                               NFTABLES_VALUE_PLAIN,
+                               NFTABLES_VALUE_PLAIN, true) < 0 ||
+        nftablesAddMatch(buf, vars, protocol, &ipHdr->dataProtocolID,
+                         NFTABLES_VALUE_PLAIN) < 0 ||
+        nftablesAddRangeMatch(buf, vars, reverse ? "th dport" : "th sport",
+                              &portData->dataSrcPortStart,
+                              &portData->dataSrcPortEnd) < 0 ||
+        nftablesAddRangeMatch(buf, vars, reverse ? "th sport" : "th dport",
+                              &portData->dataDstPortStart,
+                              &portData->dataDstPortEnd) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+nftablesCreateRuleInstance(virBufferPtr buf,
+                           char chainPrefix,
+                           const char *chainSuffix,
+                           virNWFilterRuleDefPtr rule,
+                           const char *ifname,
+                           nftablesRuleVarsPtr vars,
+                           bool reverse)
+{
+    g_autofree char *chain = nftablesChainName(chainPrefix, ifname,
+                                               chainSuffix);
+    g_auto(virBuffer) matches = VIR_BUFFER_INITIALIZER;
+    const char *verdict;
+
+    switch ((int)rule->prtclType) {
+    case VIR_NWFILTER_RULE_PROTOCOL_MAC:
+        if (nftablesHandleEthHdr(&matches, vars,
+                                 &rule->p.ethHdrFilter.ethHdr, reverse) < 0 ||
+            nftablesAddMatch(&matches, vars, "ether type",
+                             &rule->p.ethHdrFilter.dataProtocolID,
+                             NFTABLES_VALUE_HEX) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_VLAN:
+        if (nftablesHandleEthHdr(&matches, vars,
+                                 &rule->p.vlanHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        /* matching on the VLAN header implies the ethertype */
+        if (!HAS_ENTRY_ITEM(&rule->p.vlanHdrFilter.dataVlanID) &&
+            !HAS_ENTRY_ITEM(&rule->p.vlanHdrFilter.dataVlanEncap))
+            virBufferAddLit(&matches, " ether type vlan");
+
+        if (nftablesAddMatch(&matches, vars, "vlan id",
+                             &rule->p.vlanHdrFilter.dataVlanID,
+                             NFTABLES_VALUE_PLAIN) < 0 ||
+            nftablesAddMatch(&matches, vars, "vlan type",
+                             &rule->p.vlanHdrFilter.dataVlanEncap,
+                             NFTABLES_VALUE_HEX) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_ARP:
+    case VIR_NWFILTER_RULE_PROTOCOL_RARP:
+        if (HAS_ENTRY_ITEM(&rule->p.arpHdrFilter.dataGratuitousARP) &&
+            rule->p.arpHdrFilter.dataGratuitousARP.u.boolean) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("matching gratuitous ARP packets is not "
+                             "supported by the nftables driver"));
+            return -1;
+        }
+
+        if (nftablesHandleEthHdr(&matches, vars,
+                                 &rule->p.arpHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAsprintf(&matches, " ether type 0x%04x",
+                          rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_ARP
+                          ? ETHERTYPE_ARP : ETHERTYPE_REVARP);
+
+        /* offsets of the fields of an ARP packet for IPv4 over ethernet */
+        if (nftablesAddMatch(&matches, vars, "@nh,0,16",
+                             &rule->p.arpHdrFilter.dataHWType,
+                             NFTABLES_VALUE_PLAIN) < 0 ||
+            nftablesAddMatch(&matches, vars, "@nh,16,16",
+                             &rule->p.arpHdrFilter.dataProtocolType,
+                             NFTABLES_VALUE_HEX) < 0 ||
+            nftablesAddMatch(&matches, vars, "@nh,48,16",
+                             &rule->p.arpHdrFilter.dataOpcode,
+                             NFTABLES_VALUE_PLAIN) < 0 ||
+            nftablesAddMaskedMatch(&matches, vars,
+                                   reverse ? "@nh,192,32" : "@nh,112,32",
+                                   &rule->p.arpHdrFilter.dataARPSrcIPAddr,
+                                   &rule->p.arpHdrFilter.dataARPSrcIPMask,
+                                   NFTABLES_VALUE_IPV4_INT,
+                                   NFTABLES_VALUE_IPV4_MASK_INT, false) < 0 ||
+            nftablesAddMaskedMatch(&matches, vars,
+                                   reverse ? "@nh,112,32" : "@nh,192,32",
+                                   &rule->p.arpHdrFilter.dataARPDstIPAddr,
+                                   &rule->p.arpHdrFilter.dataARPDstIPMask,
+                                   NFTABLES_VALUE_IPV4_INT,
+                                   NFTABLES_VALUE_IPV4_MASK_INT, false) < 0 ||
+            nftablesAddMatch(&matches, vars,
+                             reverse ? "@nh,144,48" : "@nh,64,48",
+                             &rule->p.arpHdrFilter.dataARPSrcMACAddr,
+                             NFTABLES_VALUE_ETHER_INT) < 0 ||
+            nftablesAddMatch(&matches, vars,
+                             reverse ? "@nh,64,48" : "@nh,144,48",
+                             &rule->p.arpHdrFilter.dataARPDstMACAddr,
+                             NFTABLES_VALUE_ETHER_INT) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_IP:
+        if (nftablesHandleEthHdr(&matches, vars,
+                                 &rule->p.ipHdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAsprintf(&matches, " ether type 0x%04x", ETHERTYPE_IP);
+
+        if (nftablesHandleIPHdr(&matches, vars, "ip", "ip protocol",
+                                &rule->p.ipHdrFilter.ipHdr,
+                                &rule->p.ipHdrFilter.portData, reverse) < 0 ||
+            nftablesAddMatch(&matches, vars, "ip dscp",
+                             &rule->p.ipHdrFilter.ipHdr.dataDSCP,
+                             NFTABLES_VALUE_HEX) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_IPV6:
+        if (nftablesHandleEthHdr(&matches, vars,
+                                 &rule->p.ipv6HdrFilter.ethHdr, reverse) < 0)
+            return -1;
+
+        virBufferAsprintf(&matches, " ether type 0x%04x", ETHERTYPE_IPV6);
+
+        if (nftablesHandleIPHdr(&matches, vars, "ip6", "ip6 nexthdr",
+                                &rule->p.ipv6HdrFilter.ipHdr,
+                                &rule->p.ipv6HdrFilter.portData, reverse) < 0 ||
+            nftablesAddRangeMatch(&matches, vars, "icmpv6 type",
+                                  &rule->p.ipv6HdrFilter.dataICMPTypeStart,
+                                  &rule->p.ipv6HdrFilter.dataICMPTypeEnd) < 0 ||
+            nftablesAddRangeMatch(&matches, vars, "icmpv6 code",
+                                  &rule->p.ipv6HdrFilter.dataICMPCodeStart,
+                                  &rule->p.ipv6HdrFilter.dataICMPCodeEnd) < 0)
+            return -1;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_NONE:
+        break;
+
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected rule protocol %d"),
+                       rule->prtclType);
+        return -1;
+    }
+
+    switch ((virNWFilterRuleActionType)rule->action) {
+    case VIR_NWFILTER_RULE_ACTION_DROP:
+    case VIR_NWFILTER_RULE_ACTION_REJECT:
+        /* REJECT not supported */
+        verdict = "drop";
+        break;
+    case VIR_NWFILTER_RULE_ACTION_ACCEPT:
+        verdict = "accept";
+        break;
+    case VIR_NWFILTER_RULE_ACTION_RETURN:
+        verdict = "return";
+        break;
+    case VIR_NWFILTER_RULE_ACTION_CONTINUE:
+        verdict = "continue";
+        break;
+    case VIR_NWFILTER_RULE_ACTION_LAST:
+    default:
+        virReportEnumRangeError(virNWFilterRuleActionType, rule->action);
+        return -1;
+    }
+
+    virBufferAsprintf(buf, "add rule " NFTABLES_TABLE_SPEC " %s%s %s\n",
+                      chain, NULLSTR_EMPTY(virBufferCurrentContent(&matches)),
+                      verdict);
+    return 0;
+}
+
+
+static int
+nftablesCreateRuleInstances(virBufferPtr buf,
+                            int gen,
+                            const char *chainSuffix,
+                            virNWFilterRuleDefPtr rule,
+                            const char *ifname,
+                            nftablesRuleVarsPtr vars)
+{
+    if (rule->tt == VIR_NWFILTER_RULE_DIRECTION_OUT ||
+        rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+        if (nftablesCreateRuleInstance(buf,
+                                       nftablesChainPrefixIn[gen],
+                                       chainSuffix,
+                                       rule,
+                                       ifname,
+                                       vars,
+                                       rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) < 0)
+            return -1;
+    }
+
+    if (rule->tt == VIR_NWFILTER_RULE_DIRECTION_IN ||
+        rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+        if (nftablesCreateRuleInstance(buf,
+                                       nftablesChainPrefixOut[gen],
+                                       chainSuffix,
+                                       rule,
+                                       ifname,
+                                       vars,
+                                       false) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesRuleInstCommand(virBufferPtr buf,
+                        int gen,
+                        const char *ifname,
+                        virNWFilterRuleInstPtr rule)
+{
+    nftablesRuleVars vars = { 0 };
+    virNWFilterVarCombIterPtr vciter, tmp;
+    int ret = -1;
+
+    tmp = vciter = virNWFilterVarCombIterCreate(rule->vars,
+                                                rule->def->varAccess,
+                                                rule->def->nVarAccess);
+    if (!vciter)
+        return -1;
+
+    vars.iter = vciter;
+
+    /* A rule iterating over the values of a single variable, like the IP
+     * addresses of the VM in 'no-ip-spoofing', is instantiated as one rule
+     * matching against a set of all the values rather than once for each
+     * value, unless the values are used in a way a set cannot express. */
+    if (rule->def->nVarAccess == 1 &&
+        virNWFilterVarAccessGetType(rule->def->varAccess[0]) ==
+        VIR_NWFILTER_VAR_ACCESS_ITERATOR) {
+        vars.setName = virNWFilterVarAccessGetVarName(rule->def->varAccess[0]);
+        vars.setValue = virHashLookup(rule->vars, vars.setName);
+
+        if (vars.setValue &&
+            virNWFilterVarValueGetCardinality(vars.setValue) > 1) {
+            g_auto(virBuffer) setbuf = VIR_BUFFER_INITIALIZER;
+
+            if (nftablesCreateRuleInstances(&setbuf, gen, rule->chainSuffix,
+                                            rule->def, ifname, &vars) < 0)
+                goto cleanup;
+
+            if (!vars.setUnusable) {
+                virBufferAddBuffer(buf, &setbuf);
+                ret = 0;
+                goto cleanup;
+            }
+        }
+
+        vars.setName = NULL;
+        vars.setValue = NULL;
+    }
+
+    do {
+        vars.iter = tmp;
+        if (nftablesCreateRuleInstances(buf, gen, rule->chainSuffix,
+                                        rule->def, ifname, &vars) < 0)
+            goto cleanup;
+        tmp = virNWFilterVarCombIterNext(tmp);
+    } while (tmp != NULL);
+
+    ret = 0;
+ cleanup:
+    virNWFilterVarCombIterFree(vciter);
+    return ret;
+}
+
+
+static int
+nftablesCheckRule(virNWFilterRuleInstPtr rule)
+{
+    if (!virNWFilterRuleIsProtocolEthernet(rule->def)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("the nftables driver only supports layer 2 rules"));
+        return -1;
+    }
+
+    if (rule->def->prtclType == VIR_NWFILTER_RULE_PROTOCOL_STP ||
+        STRPREFIX(rule->chainSuffix,
+                  virNWFilterChainSuffixTypeToString(
+                      VIR_NWFILTER_CHAINSUFFIX_STP))) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("STP filtering is not supported by the "
+                         "nftables driver"));
+        return -1;
+    }
+
+    return nftablesCheckName(rule->chainSuffix);
+}
+
+
+static int
+nftablesRuleInstSort(const void *a, const void *b)
+{
+    virNWFilterRuleInst * const *insta = a;
+    virNWFilterRuleInst * const *instb = b;
+    const char *root = virNWFilterChainSuffixTypeToString(
+                                     VIR_NWFILTER_CHAINSUFFIX_ROOT);
+    bool root_a = STREQ((*insta)->chainSuffix, root);
+    bool root_b = STREQ((*instb)->chainSuffix, root);
+
+    /* ensure root chain rules appear before all others */
+    if (root_a != root_b)
+        return root_a ? -1 : 1;
+
+    /* priorities are limited to range [-1000, 1000] */
+    return (*insta)->priority - (*instb)->priority;
+}
+
+
+struct nftablesSubChainInst {
+    virNWFilterChainPriority priority;
+    bool incoming;
+    const char *filtername;
+    unsigned short ethertype;
+};
+
+
+static int
+nftablesSubChainInstSort(const void *a, const void *b)
+{
+    const struct nftablesSubChainInst *insta = a;
+    const struct nftablesSubChainInst *instb = b;
+
+    /* priorities are limited to range [-1000, 1000] */
+    return insta->priority - instb->priority;
+}
+
+
+static int
+nftablesAddSubChainInst(struct nftablesSubChainInst **insts,
+                        size_t *ninsts,
+                        virNWFilterRuleInstPtr rule,
+                        bool incoming)
+{
+    struct nftablesSubChainInst inst = {
+        .priority = rule->chainPriority,
+        .incoming = incoming,
+        .filtername = rule->chainSuffix,
+    };
+    size_t i;
+
+    for (i = 0; i < *ninsts; i++) {
+        if ((*insts)[i].incoming == incoming &&
+            STREQ((*insts)[i].filtername, rule->chainSuffix))
+            return 0;
+    }
+
+    /* We do prefix-matching to determine the protocol */
+    for (i = 0; i < G_N_ELEMENTS(nftablesSubChainProtocols); i++) {
+        if (STRPREFIX(rule->chainSuffix, nftablesSubChainProtocols[i].name)) {
+            inst.ethertype = nftablesSubChainProtocols[i].ethertype;
+            return VIR_APPEND_ELEMENT(*insts, *ninsts, inst);
+        }
+    }
+
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("unexpected chain name '%s'"), rule->chainSuffix);
+    return -1;
+}
+
+
+static int
+nftablesApplyNewRules(const char *ifname,
+                      virNWFilterRuleInstPtr *rules,
+                      size_t nrules)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(nftablesIfaceState) state = { 0 };
+    const char *root = virNWFilterChainSuffixTypeToString(
+                                     VIR_NWFILTER_CHAINSUFFIX_ROOT);
+    struct nftablesSubChainInst *subchains = NULL;
+    size_t nsubchains = 0;
+    bool haveIn = false;
+    bool haveOut = false;
+    int active;
+    int gen;
+    size_t i, j;
+    int ret = -1;
+
+    if (nftablesCheckName(ifname) < 0)
+        return -1;
+
+    for (i = 0; i < nrules; i++) {
+        if (nftablesCheckRule(rules[i]) < 0)
+            return -1;
+    }
+
+    if (nrules)
+        qsort(rules, nrules, sizeof(rules[0]), nftablesRuleInstSort);
+
+    /* raise the priority of rules below the priority of their chain so
+     * that the chain is linked before its rules, see
+     * ebiptablesApplyNewRules */
+    for (i = 0; i < nrules; i++) {
+        if (rules[i]->chainPriority > rules[i]->priority &&
+            STRNEQ(rules[i]->chainSuffix, root))
+            rules[i]->priority = rules[i]->chainPriority;
+    }
+
+    for (i = 0; i < nrules; i++) {
+        bool incoming = rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_OUT ||
+                        rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT;
+        bool outgoing = rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_IN ||
+                        rules[i]->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT;
+
+        haveIn |= incoming;
+        haveOut |= outgoing;
+
+        if (STREQ(rules[i]->chainSuffix, root))
+            continue;
+
+        if ((incoming &&
+             nftablesAddSubChainInst(&subchains, &nsubchains,
+                                     rules[i], true) < 0) ||
+            (outgoing &&
+             nftablesAddSubChainInst(&subchains, &nsubchains,
+                                     rules[i], false) < 0))
+            goto cleanup;
+    }
+
+    if (nsubchains > 0)
+        qsort(subchains, nsubchains, sizeof(subchains[0]),
+              nftablesSubChainInstSort);
+
+    if (nftablesGetIfaceState(ifname, &state) < 0)
+        goto cleanup;
+
+    active = nftablesIfaceActiveGen(&state, ifname);
+    gen = active == 0 ? 1 : 0;
+
+    nftablesCreateTable(&buf, &state);
+
+    /* whatever exists apart from the active chains is a leftover of new
+     * rules that were never activated */
+    nftablesRemoveIfaceChains(&buf, &state, ifname, active < 0 ? -1 : gen);
+
+    if (haveIn) {
+        g_autofree char *chain = nftablesChainName(nftablesChainPrefixIn[gen],
+                                                   ifname, NULL);
+
+        if (nftablesAddIfaceChain(&buf, &state, chain) < 0)
+            goto cleanup;
+    }
+    if (haveOut) {
+        g_autofree char *chain = nftablesChainName(nftablesChainPrefixOut[gen],
+                                                   ifname, NULL);
+
+        if (nftablesAddIfaceChain(&buf, &state, chain) < 0)
+            goto cleanup;
+    }
+    for (i = 0; i < nsubchains; i++) {
+        char prefix = subchains[i].incoming ? nftablesChainPrefixIn[gen]
+                                            : nftablesChainPrefixOut[gen];
+        g_autofree char *chain = g_strdup_printf("%c-%s/%s", prefix, ifname,
+                                                 subchains[i].filtername);
+
+        if (nftablesAddIfaceChain(&buf, &state, chain) < 0)
+            goto cleanup;
+    }
+
+    /* interleave the jumps into the sub chains with the rules of the root
+     * chains according to their priorities */
+    for (i = 0, j = 0; i <= nrules; i++) {
+        while (j < nsubchains &&
+               (i == nrules || subchains[j].priority <= rules[i]->priority)) {
+            char prefix = subchains[j].incoming ? nftablesChainPrefixIn[gen]
+                                                : nftablesChainPrefixOut[gen];
+
+            virBufferAsprintf(&buf, "add rule " NFTABLES_TABLE_SPEC " %c-%s",
+                              prefix, ifname);
+            if (subchains[j].ethertype)
+                virBufferAsprintf(&buf, " ether type 0x%04x",
+                                  subchains[j].ethertype);
+            virBufferAsprintf(&buf, " jump %c-%s/%s\n",
+                              prefix, ifname, subchains[j].filtername);
+            j++;
+        }
+
+        if (i < nrules &&
+            nftablesRuleInstCommand(&buf, gen, ifname, rules[i]) < 0)
+            goto cleanup;
+    }
+
+    ret = nftablesApplyIfaceScript(&buf, ifname, &state);
+
+ cleanup:
+    VIR_FREE(subchains);
+    return ret;
+}
+
+
+static int
+nftablesTearNewRules(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(nftablesIfaceState) state = { 0 };
+    int active;
+
+    if (nftablesGetIfaceState(ifname, &state) < 0)
+        return -1;
+
+    active = nftablesIfaceActiveGen(&state, ifname);
+
+    nftablesRemoveIfaceChains(&buf, &state, ifname, active < 0 ? -1 : !active);
+
+    return nftablesApplyIfaceScript(&buf, ifname, &state);
+}
+
+
+static int
+nftablesTearOldRules(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(nftablesIfaceState) state = { 0 };
+    int active;
+    int gen = -1;
+
+    if (nftablesGetIfaceState(ifname, &state) < 0)
+        return -1;
+
+    if ((active = nftablesIfaceActiveGen(&state, ifname)) >= 0)
+        gen = !active;
+    else if (state.chains && state.chains[0])
+        nftablesChainIsIface(state.chains[0], ifname, &gen);
+
+    nftablesRemoveIfaceElements(&buf, &state, ifname);
+    if (active >= 0)
+        nftablesRemoveIfaceChains(&buf, &state, ifname, active);
+    if (gen >= 0)
+        nftablesLinkIfaceChains(&buf, &state, ifname, gen);
+
+    return nftablesApplyIfaceScript(&buf, ifname, &state);
+}
+
+
+/**
+ * nftablesAllTeardown:
+ * @ifname : the name of the interface to which the rules apply
+ *
+ * Unconditionally remove all chains and map elements that were
+ * created for the given interface (ifname).
+ *
+ * Returns 0 on success, -1 on failure
+ */
+static int
+nftablesAllTeardown(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(nftablesIfaceState) state = { 0 };
+
+    if (nftablesGetIfaceState(ifname, &state) < 0)
+        return -1;
+
+    nftablesRemoveIfaceElements(&buf, &state, ifname);
+    nftablesRemoveIfaceChains(&buf, &state, ifname, -1);
+
+    return nftablesApplyIfaceScript(&buf, ifname, &state);
+}
+
+
+static int
+nftablesCanApplyBasicRules(void)
+{
+    return true;
+}
+
+
+/**
+ * nftablesApplyBasicRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ * @macaddr: MAC address the VM is using in packets sent through the
+ *    interface
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply basic filtering rules on the given interface
+ * - filtering for MAC address spoofing
+ * - allowing IPv4 & ARP traffic
+ */
+static int
+nftablesApplyBasicRules(const char *ifname,
+                        const virMacAddr *macaddr)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(nftablesIfaceState) state = { 0 };
+    char macaddr_str[VIR_MAC_STRING_BUFLEN];
+
+    virMacAddrFormat(macaddr, macaddr_str);
+
+    if (nftablesCheckName(ifname) < 0 ||
+        nftablesGetIfaceState(ifname, &state) < 0)
+        return -1;
+
+    nftablesCreateTable(&buf, &state);
+
+    nftablesRemoveIfaceElements(&buf, &state, ifname);
+    nftablesRemoveIfaceChains(&buf, &state, ifname, -1);
+
+    virBufferAsprintf(&buf, "add element " NFTABLES_TABLE_SPEC " "
+                      NFTABLES_SET_BASIC " { \"%s\" . %s }\n",
+                      ifname, macaddr_str);
+    virBufferAsprintf(&buf, "add element " NFTABLES_TABLE_SPEC " "
+                      NFTABLES_MAP_IN " { \"%s\" : jump "
+                      NFTABLES_CHAIN_BASIC " }\n", ifname);
+    state.basicMac = g_strdup(macaddr_str);
+    state.inVerdict = g_strdup("jump " NFTABLES_CHAIN_BASIC);
+
+    if (nftablesApplyIfaceScript(&buf, ifname, &state) < 0)
+        goto tear_down;
+
+    return 0;
+
+ tear_down:
+    nftablesAllTeardown(ifname);
+    return -1;
+}
+
+
+/**
+ * nftablesApplyDHCPOnlyRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ * @macaddr: MAC address the VM is using in packets sent through the
+ *    interface
+ * @dhcpsrvrs: The DHCP server(s) from which the VM may receive traffic
+ *    from; may be NULL
+ * @leaveTemporary: Whether to leave the rules inactive until the next
+ *    call to tearOldRules (true) or activate them as part of this call
+ *    (false)
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply filtering rules so that the VM can only send and receive
+ * DHCP traffic and nothing else.
+ */
+static int
+nftablesApplyDHCPOnlyRules(const char *ifname,
+                           const virMacAddr *macaddr,
+                           virNWFilterVarValuePtr dhcpsrvrs,
+                           bool leaveTemporary)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(nftablesIfaceState) state = { 0 };
+    char macaddr_str[VIR_MAC_STRING_BUFLEN];
+    g_autofree char *chain_in = NULL;
+    g_autofree char *chain_out = NULL;
+    unsigned int num_dhcpsrvrs;
+    size_t i;
+    int gen;
+
+    virMacAddrFormat(macaddr, macaddr_str);
+
+    if (nftablesCheckName(ifname) < 0 ||
+        nftablesGetIfaceState(ifname, &state) < 0)
+        return -1;
+
+    gen = nftablesIfaceActiveGen(&state, ifname) == 0 ? 1 : 0;
+    chain_in = nftablesChainName(nftablesChainPrefixIn[gen], ifname, NULL);
+    chain_out = nftablesChainName(nftablesChainPrefixOut[gen], ifname, NULL);
+
+    nftablesCreateTable(&buf, &state);
+
+    if (leaveTemporary) {
+        nftablesRemoveIfaceChains(&buf, &state, ifname, gen);
+    } else {
+        nftablesRemoveIfaceElements(&buf, &state, ifname);
+        nftablesRemoveIfaceChains(&buf, &state, ifname, -1);
+    }
+
+    if (nftablesAddIfaceChain(&buf, &state, chain_in) < 0 ||
+        nftablesAddIfaceChain(&buf, &state, chain_out) < 0)
+        return -1;
+
+    virBufferAsprintf(&buf, "add rule " NFTABLES_TABLE_SPEC " %s"
+                      " ether saddr %s ether type ip ip protocol udp"
+                      " udp sport 68 udp dport 67 accept\n",
+                      chain_in, macaddr_str);
+    virBufferAsprintf(&buf, "add rule " NFTABLES_TABLE_SPEC " %s drop\n",
+                      chain_in);
+
+    /* allow responses to the MAC address of the VM or to the broadcast
+     * MAC address, from any of the DHCP servers if they are known */
+    virBufferAsprintf(&buf, "add rule " NFTABLES_TABLE_SPEC " %s"
+                      " ether daddr { %s, ff:ff:ff:ff:ff:ff }"
+                      " ether type ip ip protocol udp",
+                      chain_out, macaddr_str);
+
+    num_dhcpsrvrs = (dhcpsrvrs != NULL)
+                    ? virNWFilterVarValueGetCardinality(dhcpsrvrs)
+                    : 0;
+
+    if (num_dhcpsrvrs > 0) {
+        virBufferAddLit(&buf, " ip saddr { ");
+        for (i = 0; i < num_dhcpsrvrs; i++) {
+            const char *dhcpserver = virNWFilterVarValueGetNthValue(dhcpsrvrs, i);
+            virSocketAddr addr;
+
+            if (virSocketAddrParseIPv4(&addr, dhcpserver) < 0)
+                return -1;
+
+            virBufferAsprintf(&buf, "%s%s", i > 0 ? ", " : "", dhcpserver);
+        }
+        virBufferAddLit(&buf, " }");
+    }
+
+    virBufferAddLit(&buf, " udp sport 67 udp dport 68 accept\n");
+    virBufferAsprintf(&buf, "add rule " NFTABLES_TABLE_SPEC " %s drop\n",
+                      chain_out);
+
+    if (!leaveTemporary)
+        nftablesLinkIfaceChains(&buf, &state, ifname, gen);
+
+    if (nftablesApplyIfaceScript(&buf, ifname, &state) < 0)
+        goto tear_down;
+
+    return 0;
+
+ tear_down:
+    nftablesAllTeardown(ifname);
+    return -1;
+}
+
+
+/**
+ * nftablesApplyDropAllRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply filtering rules so that the VM cannot receive or send traffic.
+ */
+static int
+nftablesApplyDropAllRules(const char *ifname)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_auto(nftablesIfaceState) state = { 0 };
+
+    if (nftablesCheckName(ifname) < 0 ||
+        nftablesGetIfaceState(ifname, &state) < 0)
+        return -1;
+
+    nftablesCreateTable(&buf, &state);
+
+    nftablesRemoveIfaceElements(&buf, &state, ifname);
+    nftablesRemoveIfaceChains(&buf, &state, ifname, -1);
+
+    virBufferAsprintf(&buf, "add element " NFTABLES_TABLE_SPEC " "
+                      NFTABLES_MAP_IN " { \"%s\" : drop }\n", ifname);
+    virBufferAsprintf(&buf, "add element " NFTABLES_TABLE_SPEC " "
+                      NFTABLES_MAP_OUT " { \"%s\" : drop }\n", ifname);
+    state.inVerdict = g_strdup("drop");
+    state.outVerdict = g_strdup("drop");
+
+    if (nftablesApplyIfaceScript(&buf, ifname, &state) < 0)
+        goto tear_down;
+
+    return 0;
+
+ tear_down:
+    nftablesAllTeardown(ifname);
+    return -1;
+}
+
+
+static int
+nftablesRemoveBasicRules(const char *ifname)
+{
+    return nftablesAllTeardown(ifname);
+}
+
+
+static int
+nftablesDriverInit(bool privileged)
+{
+    g_autoptr(virCommand) cmd = NULL;
+
+    if (!privileged)
+        return 0;
+
+    cmd = virCommandNewArgList(NFT_PATH, "--version", NULL);
+    if (virCommandRun(cmd, NULL) < 0)
+        return -1;
+
+    nftables_driver.flags = TECHDRV_FLAG_INITIALIZED;
+
+    return 0;
+}
+
+
+static void
+nftablesDriverShutdown(void)
+{
+    nftablesDropState();
+    nftables_driver.flags = 0;
+}
+
+
+virNWFilterTechDriver nftables_driver = {
+    .name = NFTABLES_DRIVER_ID,
+    .flags = 0,
+
+    .init     = nftablesDriverInit,
+    .shutdown = nftablesDriverShutdown,
+
+    .applyNewRules       = nftablesApplyNewRules,
+    .tearNewRules        = nftablesTearNewRules,
+    .tearOldRules        = nftablesTearOldRules,
+    .allTeardown         = nftablesAllTeardown,
+
+    .canApplyBasicRules  = nftablesCanApplyBasicRules,
+    .applyBasicRules     = nftablesApplyBasicRules,
+    .applyDHCPOnlyRules  = nftablesApplyDHCPOnlyRules,
+    .applyDropAllRules   = nftablesApplyDropAllRules,
+    .removeBasicRules    = nftablesRemoveBasicRules,
+};
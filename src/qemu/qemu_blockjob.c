@@ -192,7 +192,7 @@ qemuBlockJobRegister(qemuBlockJobDataPtr job,
     }
 
     if (savestatus)
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusNow(vm);
 
     return 0;
 }
@@ -219,7 +219,7 @@ qemuBlockJobUnregister(qemuBlockJobDataPtr job,
     /* this may remove the last reference of 'job' */
     virHashRemoveEntry(priv->blockjobs, job->name);
 
-    qemuDomainSaveStatus(vm);
+    qemuDomainSaveStatusNow(vm);
 }
 
 
@@ -442,7 +442,7 @@ qemuBlockJobStarted(qemuBlockJobDataPtr job,
     if (job->state == QEMU_BLOCKJOB_STATE_NEW)
         job->state = QEMU_BLOCKJOB_STATE_RUNNING;
 
-    qemuDomainSaveStatus(vm);
+    qemuDomainSaveStatusNow(vm);
 }
 
 
@@ -805,7 +805,7 @@ qemuBlockJobEventProcessLegacy(virQEMUDriverPtr driver,
 
     case VIR_DOMAIN_BLOCK_JOB_READY:
         disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusNow(vm);
         break;
 
     case VIR_DOMAIN_BLOCK_JOB_FAILED:
@@ -1642,7 +1642,7 @@ qemuBlockJobEventProcessConcluded(qemuBlockJobDataPtr job,
         job->newstate = QEMU_BLOCKJOB_STATE_CANCELLED;
 
     if (refreshed)
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusNow(vm);
 
     VIR_DEBUG("handling job '%s' state '%d' newstate '%d'", job->name, job->state, job->newstate);
 
@@ -1692,7 +1692,7 @@ qemuBlockJobEventProcess(virQEMUDriverPtr driver,
         }
         job->state = job->newstate;
         job->newstate = -1;
-        qemuDomainSaveStatus(vm);
+        qemuDomainSaveStatusNow(vm);
         break;
 
     case QEMU_BLOCKJOB_STATE_NEW:
@@ -692,6 +692,9 @@ struct _virQEMUCaps {
 
     virQEMUDomainCapsCachePtr domCapsCache;
 
+    /* sha256 of the cache XML, filled in once probed or loaded */
+    char *digest;
+
     size_t ngicCapabilities;
     virGICCapability *gicCapabilities;
 
@@ -1093,6 +1096,145 @@ virQEMUCapsProbeHostCPU(virArch hostArch,
 }
 
 
+typedef struct _virQEMUCapsPrewarmData virQEMUCapsPrewarmData;
+typedef virQEMUCapsPrewarmData *virQEMUCapsPrewarmDataPtr;
+struct _virQEMUCapsPrewarmData {
+    virFileCachePtr cache;
+
+    virMutex lock;
+    char **binaries;
+    size_t next;
+};
+
+
+static void
+virQEMUCapsPrewarmWorker(void *opaque)
+{
+    virQEMUCapsPrewarmDataPtr data = opaque;
+
+    while (true) {
+        const char *binary;
+        virQEMUCapsPtr qemuCaps;
+
+        virMutexLock(&data->lock);
+        if ((binary = data->binaries[data->next]))
+            data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (!binary)
+            return;
+
+        /* Failures are reported again once the binary is really used */
+        if (!(qemuCaps = virQEMUCapsCacheLookup(data->cache, binary))) {
+            VIR_DEBUG("Failed to probe capabilities of %s: %s",
+                      binary, virGetLastErrorMessage());
+            virResetLastError();
+        }
+
+        virObjectUnref(qemuCaps);
+    }
+}
+
+
+/**
+ * virQEMUCapsCachePrewarm:
+ * @cache: QEMU capabilities cache
+ *
+ * Makes sure @cache holds valid capabilities of the default emulator
+ * binaries of all guest architectures, probing the binaries whose cached
+ * capabilities are missing or outdated concurrently.
+ */
+static void
+virQEMUCapsCachePrewarm(virFileCachePtr cache)
+{
+    virQEMUCapsPrewarmData data = { .cache = cache };
+    VIR_AUTOSTRINGLIST binaries = NULL;
+    g_autofree virThread *threads = NULL;
+    virArch hostarch = virArchFromHost();
+    size_t nthreads = 0;
+    size_t nbinaries;
+    size_t maxthreads;
+    size_t i;
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        g_autofree char *binary = virQEMUCapsGetDefaultEmulator(hostarch, i);
+
+        if (binary &&
+            !virStringListHasString((const char **)binaries, binary) &&
+            virStringListAdd(&binaries, binary) < 0)
+            return;
+    }
+
+    if (!(nbinaries = virStringListLength((const char * const *)binaries)))
+        return;
+
+    if (virMutexInit(&data.lock) < 0)
+        return;
+
+    data.binaries = binaries;
+
+    /* the calling thread probes binaries too */
+    maxthreads = MIN(nbinaries, g_get_num_processors()) - 1;
+    threads = g_new0(virThread, maxthreads + 1);
+
+    for (; nthreads < maxthreads; nthreads++) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                virQEMUCapsPrewarmWorker,
+                                "qemu-caps-probe", false, &data) < 0) {
+            virResetLastError();
+            break;
+        }
+    }
+
+    VIR_DEBUG("Probing %zu QEMU binaries with %zu threads",
+              nbinaries, nthreads + 1);
+
+    virQEMUCapsPrewarmWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virMutexDestroy(&data.lock);
+}
+
+
+static void
+virQEMUCapsCachePrewarmThread(void *opaque)
+{
+    virFileCachePtr cache = opaque;
+
+    virQEMUCapsCachePrewarm(cache);
+    virObjectUnref(cache);
+}
+
+
+/**
+ * virQEMUCapsCachePrewarmAsync:
+ * @cache: QEMU capabilities cache
+ *
+ * Same as virQEMUCapsCachePrewarm, except the binaries are probed in the
+ * background so that capabilities outdated by e.g. an upgrade of QEMU
+ * are refreshed before a domain needs them.
+ *
+ * Returns 0 on success, -1 if the background thread couldn't be started.
+ */
+int
+virQEMUCapsCachePrewarmAsync(virFileCachePtr cache)
+{
+    virThread thread;
+
+    virObjectRef(cache);
+
+    if (virThreadCreateFull(&thread, false, virQEMUCapsCachePrewarmThread,
+                            "qemu-caps-prewarm", false, cache) < 0) {
+        virObjectUnref(cache);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 virCapsPtr
 virQEMUCapsInit(virFileCachePtr cache)
 {
@@ -1126,6 +1268,8 @@ virQEMUCapsInit(virFileCachePtr cache)
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
      */
+    virQEMUCapsCachePrewarm(cache);
+
     for (i = 0; i < VIR_ARCH_LAST; i++)
         if (virQEMUCapsInitGuest(caps, cache,
                                  hostarch,
@@ -1982,6 +2126,7 @@ void virQEMUCapsDispose(void *obj)
     VIR_FREE(qemuCaps->kernelVersion);
     VIR_FREE(qemuCaps->binary);
     VIR_FREE(qemuCaps->hostCPUSignature);
+    VIR_FREE(qemuCaps->digest);
 
     VIR_FREE(qemuCaps->gicCapabilities);
 
@@ -2653,22 +2798,35 @@ static int
 virQEMUCapsProbeQMPDeviceProperties(virQEMUCapsPtr qemuCaps,
                                     qemuMonitorPtr mon)
 {
+    virQEMUCapsDeviceTypeProps *devices[G_N_ELEMENTS(virQEMUCapsDeviceProps)];
+    const char *types[G_N_ELEMENTS(virQEMUCapsDeviceProps)];
+    virHashTablePtr qemuprops[G_N_ELEMENTS(virQEMUCapsDeviceProps)];
+    size_t ndevices = 0;
+    int ret = -1;
     size_t i;
 
     for (i = 0; i < G_N_ELEMENTS(virQEMUCapsDeviceProps); i++) {
         virQEMUCapsDeviceTypeProps *device = virQEMUCapsDeviceProps + i;
-        g_autoptr(virHashTable) qemuprops = NULL;
-        size_t j;
 
         if (device->capsCondition >= 0 &&
             !virQEMUCapsGet(qemuCaps, device->capsCondition))
             continue;
 
-        if (!(qemuprops = qemuMonitorGetDeviceProps(mon, device->type)))
-            return -1;
+        devices[ndevices] = device;
+        types[ndevices++] = device->type;
+    }
+
+    /* the queries are independent of each other, so send them at once */
+    if (qemuMonitorGetDevicePropsBatch(mon, types, ndevices, qemuprops) < 0)
+        return -1;
+
+    for (i = 0; i < ndevices; i++) {
+        virQEMUCapsDeviceTypeProps *device = devices[i];
+        size_t j;
 
         for (j = 0; j < device->nprops; j++) {
-            virJSONValuePtr entry = virHashLookup(qemuprops, device->props[j].value);
+            virJSONValuePtr entry = virHashLookup(qemuprops[i],
+                                                  device->props[j].value);
 
             if (!entry)
                 continue;
@@ -2677,11 +2835,16 @@ virQEMUCapsProbeQMPDeviceProperties(virQEMUCapsPtr qemuCaps,
 
             if (device->props[j].cb &&
                 device->props[j].cb(entry, qemuCaps) < 0)
-                return -1;
+                goto cleanup;
         }
     }
 
-    return 0;
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ndevices; i++)
+        virHashFree(qemuprops[i]);
+    return ret;
 }
 
 
@@ -2689,6 +2852,11 @@ static int
 virQEMUCapsProbeQMPObjectProperties(virQEMUCapsPtr qemuCaps,
                                     qemuMonitorPtr mon)
 {
+    virQEMUCapsObjectTypeProps *objects[G_N_ELEMENTS(virQEMUCapsObjectProps)];
+    const char *types[G_N_ELEMENTS(virQEMUCapsObjectProps)];
+    char **values[G_N_ELEMENTS(virQEMUCapsObjectProps)];
+    int nvalues[G_N_ELEMENTS(virQEMUCapsObjectProps)];
+    size_t nobjects = 0;
     size_t i;
 
     if (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_QOM_LIST_PROPERTIES))
@@ -2696,20 +2864,25 @@ virQEMUCapsProbeQMPObjectProperties(virQEMUCapsPtr qemuCaps,
 
     for (i = 0; i < G_N_ELEMENTS(virQEMUCapsObjectProps); i++) {
         virQEMUCapsObjectTypeProps *props = virQEMUCapsObjectProps + i;
-        VIR_AUTOSTRINGLIST values = NULL;
-        int nvalues;
 
         if (props->capsCondition >= 0 &&
             !virQEMUCapsGet(qemuCaps, props->capsCondition))
             continue;
 
-        if ((nvalues = qemuMonitorGetObjectProps(mon, props->type, &values)) < 0)
-            return -1;
+        objects[nobjects] = props;
+        types[nobjects++] = props->type;
+    }
+
+    if (qemuMonitorGetObjectPropsBatch(mon, types, nobjects,
+                                       values, nvalues) < 0)
+        return -1;
 
+    for (i = 0; i < nobjects; i++) {
         virQEMUCapsProcessStringFlags(qemuCaps,
-                                      props->nprops,
-                                      props->props,
-                                      nvalues, values);
+                                      objects[i]->nprops,
+                                      objects[i]->props,
+                                      nvalues[i], values[i]);
+        virStringListFree(values[i]);
     }
 
     return 0;
@@ -4683,6 +4856,43 @@ virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps)
 }
 
 
+static char *
+virQEMUCapsComputeDigest(virQEMUCapsPtr qemuCaps)
+{
+    g_autofree char *xml = NULL;
+    char *digest = NULL;
+
+    if (!(xml = virQEMUCapsFormatCache(qemuCaps)))
+        return NULL;
+
+    if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, xml, &digest) < 0)
+        return NULL;
+
+    return digest;
+}
+
+
+/**
+ * virQEMUCapsGetDigest:
+ * @qemuCaps: QEMU capabilities
+ *
+ * Returns the sha256 checksum of @qemuCaps as stored in the capabilities
+ * cache, which changes whenever the capabilities are probed from a
+ * different binary or the probed data differs. Capabilities coming from
+ * the cache have the checksum computed once when they were probed or
+ * loaded, it's only computed here for those created otherwise. NULL is
+ * returned on error.
+ */
+char *
+virQEMUCapsGetDigest(virQEMUCapsPtr qemuCaps)
+{
+    if (qemuCaps->digest)
+        return g_strdup(qemuCaps->digest);
+
+    return virQEMUCapsComputeDigest(qemuCaps);
+}
+
+
 static int
 virQEMUCapsSaveFile(void *data,
                     const char *filename,
@@ -5246,9 +5456,107 @@ virQEMUCapsGetVirtType(virQEMUCapsPtr qemuCaps)
     return type;
 }
 
-int
-virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
-                          qemuMonitorPtr mon)
+/*
+ * The QEMU process used for probing TCG capabilities of a binary which
+ * also supports KVM. The process is started in a separate thread as
+ * soon as the KVM probe finds out it will be needed, so that QEMU starts
+ * up while the rest of the KVM capabilities are probed.
+ */
+typedef struct _virQEMUCapsProbeTCG virQEMUCapsProbeTCG;
+typedef virQEMUCapsProbeTCG *virQEMUCapsProbeTCGPtr;
+struct _virQEMUCapsProbeTCG {
+    const char *binary;
+    const char *libDir;
+    uid_t runUid;
+    gid_t runGid;
+
+    bool started;
+    virThread thread;
+    qemuProcessQMPPtr proc;
+    virErrorPtr err;
+};
+
+
+static void
+virQEMUCapsProbeTCGThread(void *opaque)
+{
+    virQEMUCapsProbeTCGPtr tcg = opaque;
+    qemuProcessQMPPtr proc;
+
+    if (!(proc = qemuProcessQMPNew(tcg->binary, tcg->libDir,
+                                   tcg->runUid, tcg->runGid, true)) ||
+        qemuProcessQMPStart(proc) < 0) {
+        virErrorPreserveLast(&tcg->err);
+        qemuProcessQMPFree(proc);
+        return;
+    }
+
+    tcg->proc = proc;
+}
+
+
+static void
+virQEMUCapsProbeTCGStart(virQEMUCapsProbeTCGPtr tcg)
+{
+    if (!tcg || tcg->started)
+        return;
+
+    if (virThreadCreateFull(&tcg->thread, true, virQEMUCapsProbeTCGThread,
+                            "qemu-caps-tcg", false, tcg) < 0) {
+        /* the process will be started once it is needed */
+        VIR_WARN("Failed to start TCG probe of %s in advance: %s",
+                 tcg->binary, virGetLastErrorMessage());
+        virResetLastError();
+        return;
+    }
+
+    tcg->started = true;
+}
+
+
+/*
+ * Waits for the QEMU process started by virQEMUCapsProbeTCGStart and
+ * returns it, the caller is responsible for freeing it.
+ */
+static qemuProcessQMPPtr
+virQEMUCapsProbeTCGWait(virQEMUCapsProbeTCGPtr tcg)
+{
+    if (!tcg->started)
+        return NULL;
+
+    virThreadJoin(&tcg->thread);
+    tcg->started = false;
+
+    if (!tcg->proc)
+        virErrorRestore(&tcg->err);
+
+    return g_steal_pointer(&tcg->proc);
+}
+
+
+/*
+ * Stops the QEMU process started by virQEMUCapsProbeTCGStart if the TCG
+ * probe did not use it
+ */
+static void
+virQEMUCapsProbeTCGFinish(virQEMUCapsProbeTCGPtr tcg)
+{
+    if (!tcg->started)
+        return;
+
+    virThreadJoin(&tcg->thread);
+    tcg->started = false;
+
+    qemuProcessQMPFree(g_steal_pointer(&tcg->proc));
+    virFreeError(tcg->err);
+    tcg->err = NULL;
+}
+
+
+static int
+virQEMUCapsInitQMPMonitorInternal(virQEMUCapsPtr qemuCaps,
+                                  qemuMonitorPtr mon,
+                                  virQEMUCapsProbeTCGPtr tcg)
 {
     int major, minor, micro;
     g_autofree char *package = NULL;
@@ -5290,6 +5598,10 @@ virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
     if (virQEMUCapsProbeQMPKVMState(qemuCaps, mon) < 0)
         return -1;
 
+    if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM) &&
+        virQEMUCapsGet(qemuCaps, QEMU_CAPS_TCG))
+        virQEMUCapsProbeTCGStart(tcg);
+
     type = virQEMUCapsGetVirtType(qemuCaps);
     accel = virQEMUCapsGetAccel(qemuCaps, type);
 
@@ -5332,6 +5644,14 @@ virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
 }
 
 
+int
+virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
+                          qemuMonitorPtr mon)
+{
+    return virQEMUCapsInitQMPMonitorInternal(qemuCaps, mon, NULL);
+}
+
+
 int
 virQEMUCapsInitQMPMonitorTCG(virQEMUCapsPtr qemuCaps,
                              qemuMonitorPtr mon)
@@ -5376,22 +5696,28 @@ virQEMUCapsInitQMPSingle(virQEMUCapsPtr qemuCaps,
                          const char *libDir,
                          uid_t runUid,
                          gid_t runGid,
+                         virQEMUCapsProbeTCGPtr tcg,
                          bool onlyTCG)
 {
     qemuProcessQMPPtr proc = NULL;
     int ret = -1;
 
-    if (!(proc = qemuProcessQMPNew(qemuCaps->binary, libDir,
-                                   runUid, runGid, onlyTCG)))
-        goto cleanup;
+    if (onlyTCG && tcg->started) {
+        if (!(proc = virQEMUCapsProbeTCGWait(tcg)))
+            goto cleanup;
+    } else {
+        if (!(proc = qemuProcessQMPNew(qemuCaps->binary, libDir,
+                                       runUid, runGid, onlyTCG)))
+            goto cleanup;
 
-    if (qemuProcessQMPStart(proc) < 0)
-        goto cleanup;
+        if (qemuProcessQMPStart(proc) < 0)
+            goto cleanup;
+    }
 
     if (onlyTCG)
         ret = virQEMUCapsInitQMPMonitorTCG(qemuCaps, proc->mon);
     else
-        ret = virQEMUCapsInitQMPMonitor(qemuCaps, proc->mon);
+        ret = virQEMUCapsInitQMPMonitorInternal(qemuCaps, proc->mon, tcg);
 
  cleanup:
     if (ret < 0)
@@ -5408,20 +5734,34 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
                    uid_t runUid,
                    gid_t runGid)
 {
-    if (virQEMUCapsInitQMPSingle(qemuCaps, libDir, runUid, runGid, false) < 0)
-        return -1;
+    virQEMUCapsProbeTCG tcg = {
+        .binary = qemuCaps->binary,
+        .libDir = libDir,
+        .runUid = runUid,
+        .runGid = runGid,
+    };
+    int ret = -1;
+
+    if (virQEMUCapsInitQMPSingle(qemuCaps, libDir, runUid, runGid,
+                                 &tcg, false) < 0)
+        goto cleanup;
 
     /*
      * If KVM was enabled during the first probe, we need to explicitly probe
      * for TCG capabilities by asking the same binary again and turning KVM
-     * off.
+     * off. The QEMU process for this was already started by the first probe.
      */
     if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM) &&
         virQEMUCapsGet(qemuCaps, QEMU_CAPS_TCG) &&
-        virQEMUCapsInitQMPSingle(qemuCaps, libDir, runUid, runGid, true) < 0)
-        return -1;
+        virQEMUCapsInitQMPSingle(qemuCaps, libDir, runUid, runGid,
+                                 &tcg, true) < 0)
+        goto cleanup;
 
-    return 0;
+    ret = 0;
+
+ cleanup:
+    virQEMUCapsProbeTCGFinish(&tcg);
+    return ret;
 }
 
 
@@ -5480,6 +5820,9 @@ virQEMUCapsNewForBinaryInternal(virArch hostArch,
         qemuCaps->kvmSupportsSecureGuest = virQEMUCapsKVMSupportsSecureGuest();
     }
 
+    if (!(qemuCaps->digest = virQEMUCapsComputeDigest(qemuCaps)))
+        goto error;
+
     return qemuCaps;
 
  error:
@@ -5525,6 +5868,9 @@ virQEMUCapsLoadFile(const char *filename,
         goto error;
     }
 
+    if (!(qemuCaps->digest = virQEMUCapsComputeDigest(qemuCaps)))
+        goto error;
+
     return qemuCaps;
 
  error:
@@ -700,6 +700,7 @@ virFileCachePtr virQEMUCapsCacheNew(const char *libDir,
                                     gid_t gid);
 virQEMUCapsPtr virQEMUCapsCacheLookup(virFileCachePtr cache,
                                       const char *binary);
+char *virQEMUCapsGetDigest(virQEMUCapsPtr qemuCaps);
 virQEMUCapsPtr virQEMUCapsCacheLookupCopy(virFileCachePtr cache,
                                           virDomainVirtType virtType,
                                           const char *binary,
@@ -713,6 +714,8 @@ virQEMUCapsPtr virQEMUCapsCacheLookupDefault(virFileCachePtr cache,
                                              virDomainVirtType *retVirttype,
                                              const char **retMachine);
 
+int virQEMUCapsCachePrewarmAsync(virFileCachePtr cache);
+
 virCapsPtr virQEMUCapsInit(virFileCachePtr cache);
 
 int virQEMUCapsGetDefaultVersion(virCapsPtr caps,
@@ -271,6 +271,11 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged,
 
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
+
+    cfg->statsWorkers = 4;
+    cfg->statsTimeout = 60;
+    cfg->startupWorkers = 4;
+
     cfg->seccompSandbox = -1;
 
     cfg->logTimestamp = true;
@@ -671,6 +676,12 @@ virQEMUDriverConfigLoadProcessEntry(virQEMUDriverConfigPtr cfg,
         return -1;
     if (virConfGetValueUInt(conf, "max_threads_per_process", &cfg->maxThreadsPerProc) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "status_save_interval", &cfg->statusSaveInterval) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "startup_workers", &cfg->startupWorkers) < 0)
+        return -1;
+    if (virConfGetValueBool(conf, "domain_parse_cache", &cfg->domainParseCache) < 0)
+        return -1;
 
     if (virConfGetValueType(conf, "max_core") == VIR_CONF_STRING) {
         if (virConfGetValueString(conf, "max_core", &corestr) < 0)
@@ -740,6 +751,10 @@ virQEMUDriverConfigLoadRPCEntry(virQEMUDriverConfigPtr cfg,
 {
     if (virConfGetValueUInt(conf, "max_queued", &cfg->maxQueuedJobs) < 0)
         return -1;
+    if (virConfGetValueUInt(conf, "stats_workers", &cfg->statsWorkers) < 0)
+        return -1;
+    if (virConfGetValueUInt(conf, "stats_timeout", &cfg->statsTimeout) < 0)
+        return -1;
     if (virConfGetValueInt(conf, "keepalive_interval", &cfg->keepAliveInterval) < 0)
         return -1;
     if (virConfGetValueUInt(conf, "keepalive_count", &cfg->keepAliveCount) < 0)
@@ -787,6 +802,10 @@ virQEMUDriverConfigLoadNetworkEntry(virQEMUDriverConfigPtr cfg,
         return -1;
     }
 
+    if (virConfGetValueUInt(conf, "migration_max_mirrors",
+                            &cfg->migrationMaxMirrors) < 0)
+        return -1;
+
     if (virConfGetValueString(conf, "migration_address", &cfg->migrationAddress) < 0)
         return -1;
     virStringStripIPv6Brackets(cfg->migrationAddress);
@@ -181,11 +181,17 @@ struct _virQEMUDriverConfig {
     unsigned int maxProcesses;
     unsigned int maxFiles;
     unsigned int maxThreadsPerProc;
+    unsigned int statusSaveInterval;
+    unsigned int startupWorkers;
+    bool domainParseCache;
     unsigned long long maxCore;
     bool dumpGuestCore;
 
     unsigned int maxQueuedJobs;
 
+    unsigned int statsWorkers;
+    unsigned int statsTimeout;
+
     char **securityDriverNames;
     bool securityDefaultConfined;
     bool securityRequireConfined;
@@ -210,6 +216,7 @@ struct _virQEMUDriverConfig {
     char *migrationAddress;
     unsigned int migrationPortMin;
     unsigned int migrationPortMax;
+    unsigned int migrationMaxMirrors;
 
     bool logTimestamp;
     bool stdioLogD;
@@ -244,6 +251,10 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workerPool;
 
+    /* Immutable pointer, self-locking APIs. NULL if stats are
+     * collected serially */
+    virThreadPoolPtr statsPool;
+
     /* Atomic increment only */
     int lastvmid;
 
@@ -118,6 +118,38 @@ qemuDomainObjFromDomain(virDomainPtr domain)
 }
 
 
+/**
+ * qemuDomainObjFromDomainRef:
+ * @domain: Domain pointer that has to be looked up
+ *
+ * This function looks up @domain like qemuDomainObjFromDomain, but doesn't
+ * lock the returned object. It's meant for read-only APIs which only need
+ * the state published by virDomainObjPublish and thus don't have to wait
+ * for the domain lock, which may be held for a long time by a running job.
+ *
+ * Returns the domain object with incremented reference counter which has to
+ * be released by calling virObjectUnref(), NULL otherwise.
+ */
+virDomainObjPtr
+qemuDomainObjFromDomainRef(virDomainPtr domain)
+{
+    virDomainObjPtr vm;
+    virQEMUDriverPtr driver = domain->conn->privateData;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+
+    vm = virDomainObjListFindByUUIDRef(driver->domains, domain->uuid);
+    if (!vm) {
+        virUUIDFormat(domain->uuid, uuidstr);
+        virReportError(VIR_ERR_NO_DOMAIN,
+                       _("no domain with matching uuid '%s' (%s)"),
+                       uuidstr, domain->name);
+        return NULL;
+    }
+
+    return vm;
+}
+
+
 struct _qemuDomainLogContext {
     GObject parent;
 
@@ -1570,6 +1602,9 @@ qemuDomainObjStopWorker(virDomainObjPtr dom)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
 
+    if (priv->saveStatusTimer)
+        qemuDomainObjSaveStatusNow(priv->driver, dom);
+
     if (priv->eventThread) {
         g_object_unref(priv->eventThread);
         priv->eventThread = NULL;
@@ -5528,12 +5563,38 @@ virDomainDefParserConfig virQEMUDriverDomainDefParserConfig = {
 };
 
 
+static void
+qemuDomainObjCancelSaveStatus(virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    if (!priv->saveStatusTimer)
+        return;
+
+    g_source_destroy(priv->saveStatusTimer);
+    g_clear_pointer(&priv->saveStatusTimer, g_source_unref);
+}
+
+
+/**
+ * qemuDomainObjSaveStatusNow:
+ * @driver: qemu driver data
+ * @obj: locked domain object
+ *
+ * Writes the status XML of @obj synchronously, superseding any save
+ * scheduled by qemuDomainObjSaveStatus. Used at the points where the
+ * state on disk must be current before proceeding, such as starting an
+ * async job, entering a new migration phase or registering a block job
+ * and changing its state.
+ */
 void
-qemuDomainObjSaveStatus(virQEMUDriverPtr driver,
-                        virDomainObjPtr obj)
+qemuDomainObjSaveStatusNow(virQEMUDriverPtr driver,
+                           virDomainObjPtr obj)
 {
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
+    qemuDomainObjCancelSaveStatus(obj);
+
     if (virDomainObjIsActive(obj)) {
         if (virDomainObjSave(obj, driver->xmlopt, cfg->stateDir) < 0)
             VIR_WARN("Failed to save status on vm %s", obj->def->name);
@@ -5541,10 +5602,85 @@ qemuDomainObjSaveStatus(virQEMUDriverPtr driver,
 }
 
 
+static gboolean
+qemuDomainObjSaveStatusTimeout(gpointer opaque)
+{
+    virDomainObjPtr obj = opaque;
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    virObjectLock(obj);
+
+    /* the save may have been flushed or rescheduled while we were
+     * waiting for the lock */
+    if (priv->saveStatusTimer == g_main_current_source())
+        qemuDomainObjSaveStatusNow(priv->driver, obj);
+
+    virObjectUnlock(obj);
+    return G_SOURCE_REMOVE;
+}
+
+
+/**
+ * qemuDomainObjSaveStatus:
+ * @driver: qemu driver data
+ * @obj: locked domain object
+ *
+ * Requests the status XML of @obj to be written. If status_save_interval
+ * is configured the write is deferred and coalesced with any further
+ * requests made until the interval expires, so that the file is
+ * rewritten at most once per interval.
+ */
+void
+qemuDomainObjSaveStatus(virQEMUDriverPtr driver,
+                        virDomainObjPtr obj)
+{
+    g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    if (cfg->statusSaveInterval == 0 || !priv->eventThread) {
+        qemuDomainObjSaveStatusNow(driver, obj);
+        return;
+    }
+
+    if (priv->saveStatusTimer || !virDomainObjIsActive(obj))
+        return;
+
+    priv->saveStatusTimer = g_timeout_source_new(cfg->statusSaveInterval);
+    g_source_set_callback(priv->saveStatusTimer,
+                          qemuDomainObjSaveStatusTimeout,
+                          virObjectRef(obj),
+                          (GDestroyNotify) virObjectUnref);
+    g_source_attach(priv->saveStatusTimer,
+                    virEventThreadGetContext(priv->eventThread));
+}
+
+
+/**
+ * qemuDomainObjFlushStatus:
+ * @obj: domain object
+ * @opaque: unused
+ *
+ * virDomainObjListIterator writing out a pending deferred status save.
+ */
+int
+qemuDomainObjFlushStatus(virDomainObjPtr obj,
+                         void *opaque G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    virObjectLock(obj);
+    if (priv->saveStatusTimer)
+        qemuDomainObjSaveStatusNow(priv->driver, obj);
+    virObjectUnlock(obj);
+
+    return 0;
+}
+
+
 void
-qemuDomainSaveStatus(virDomainObjPtr obj)
+qemuDomainSaveStatusNow(virDomainObjPtr obj)
 {
-    qemuDomainObjSaveStatus(QEMU_DOMAIN_PRIVATE(obj)->driver, obj);
+    qemuDomainObjSaveStatusNow(QEMU_DOMAIN_PRIVATE(obj)->driver, obj);
 }
 
 
@@ -63,8 +63,14 @@ typedef void (*qemuDomainCleanupCallback)(virQEMUDriverPtr driver,
 void
 qemuDomainObjSaveStatus(virQEMUDriverPtr driver,
                         virDomainObjPtr obj);
+void
+qemuDomainObjSaveStatusNow(virQEMUDriverPtr driver,
+                           virDomainObjPtr obj);
+int
+qemuDomainObjFlushStatus(virDomainObjPtr obj,
+                         void *opaque);
 
-void qemuDomainSaveStatus(virDomainObjPtr obj);
+void qemuDomainSaveStatusNow(virDomainObjPtr obj);
 void qemuDomainSaveConfig(virDomainObjPtr obj);
 
 
@@ -157,6 +163,10 @@ struct _qemuDomainObjPrivate {
     qemuAgentPtr agent;
     bool agentError;
 
+    /* non-zero while a stats pool worker collects stats of the domain,
+     * accessed atomically without the domain lock */
+    int statsCollecting;
+
     bool beingDestroyed;
     char *pidfile;
 
@@ -272,6 +282,9 @@ struct _qemuDomainObjPrivate {
     char **dbusVMStateIds;
     /* true if -object dbus-vmstate was added */
     bool dbusVMState;
+
+    /* pending coalesced save of the status XML, attached to eventThread */
+    GSource *saveStatusTimer;
 };
 
 #define QEMU_DOMAIN_PRIVATE(vm) \
@@ -292,6 +305,8 @@ struct _qemuDomainDiskPrivate {
 
     bool migrating; /* the disk is being migrated */
     virStorageSourcePtr migrSource; /* disk source object used for NBD migration */
+    unsigned long long migrPending; /* capacity of the disk until its mirror
+                                       reports the size of the copy */
 
     /* information about the device */
     bool tray; /* device has tray */
@@ -496,6 +511,7 @@ int qemuDomainObjStartWorker(virDomainObjPtr dom);
 void qemuDomainObjStopWorker(virDomainObjPtr dom);
 
 virDomainObjPtr qemuDomainObjFromDomain(virDomainPtr domain);
+virDomainObjPtr qemuDomainObjFromDomainRef(virDomainPtr domain);
 
 qemuDomainSaveCookiePtr qemuDomainSaveCookieNew(virDomainObjPtr vm);
 
@@ -275,6 +275,53 @@ qemuDomainJobInfoUpdateTime(qemuDomainJobInfoPtr jobInfo)
     return 0;
 }
 
+/*
+ * Called whenever fresh migration statistics were fetched from QEMU. Once
+ * the memory iteration reported by QEMU moves on, the pass which was
+ * running since the previous change is appended to the rolling history in
+ * @jobInfo, dropping the oldest entry if the history is full. When the
+ * statistics were not fetched often enough to see every iteration, the
+ * entry covers all passes which finished since the previous one.
+ */
+int
+qemuDomainJobInfoUpdateMigrationPass(qemuDomainJobInfoPtr jobInfo)
+{
+    qemuMonitorMigrationStats *stats = &jobInfo->stats.mig;
+    qemuDomainMigrationPassPtr pass;
+    unsigned long long now;
+
+    if (stats->ram_iteration == 0 ||
+        stats->ram_iteration == jobInfo->passIteration)
+        return 0;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    if (jobInfo->passStarted &&
+        stats->ram_iteration > jobInfo->passIteration &&
+        now > jobInfo->passStarted) {
+        if (jobInfo->npasses == QEMU_DOMAIN_JOB_MIGRATION_PASSES) {
+            memmove(jobInfo->passes, jobInfo->passes + 1,
+                    sizeof(jobInfo->passes[0]) * (jobInfo->npasses - 1));
+            jobInfo->npasses--;
+        }
+
+        pass = &jobInfo->passes[jobInfo->npasses++];
+        pass->iteration = jobInfo->passIteration;
+        pass->duration = now - jobInfo->passStarted;
+        pass->bps = 0;
+        if (stats->ram_transferred > jobInfo->passTransferred)
+            pass->bps = (stats->ram_transferred - jobInfo->passTransferred) *
+                        1000 / pass->duration;
+        pass->dirtyRate = stats->ram_dirty_rate;
+    }
+
+    jobInfo->passIteration = stats->ram_iteration;
+    jobInfo->passStarted = now;
+    jobInfo->passTransferred = stats->ram_transferred;
+    return 0;
+}
+
 int
 qemuDomainJobInfoUpdateDowntime(qemuDomainJobInfoPtr jobInfo)
 {
@@ -337,9 +384,11 @@ qemuDomainJobInfoToInfo(qemuDomainJobInfoPtr jobInfo,
         info->memRemaining = jobInfo->stats.mig.ram_remaining;
         info->memProcessed = jobInfo->stats.mig.ram_transferred;
         info->fileTotal = jobInfo->stats.mig.disk_total +
-                          jobInfo->mirrorStats.total;
+                          jobInfo->mirrorStats.total +
+                          jobInfo->mirrorStats.pending;
         info->fileRemaining = jobInfo->stats.mig.disk_remaining +
-                              (jobInfo->mirrorStats.total -
+                              (jobInfo->mirrorStats.total +
+                               jobInfo->mirrorStats.pending -
                                jobInfo->mirrorStats.transferred);
         info->fileProcessed = jobInfo->stats.mig.disk_transferred +
                               jobInfo->mirrorStats.transferred;
@@ -386,8 +435,11 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
     virTypedParameterPtr par = NULL;
     int maxpar = 0;
     int npar = 0;
-    unsigned long long mirrorRemaining = mirrorStats->total -
-                                         mirrorStats->transferred;
+    unsigned long long mirrorTotal = mirrorStats->total + mirrorStats->pending;
+    unsigned long long mirrorRemaining = mirrorTotal - mirrorStats->transferred;
+    unsigned long long diskRemaining = stats->disk_remaining + mirrorRemaining;
+    unsigned long long diskBps = stats->disk_bps + mirrorStats->bps;
+    size_t i;
 
     if (virTypedParamsAddInt(&par, &npar, &maxpar,
                              VIR_DOMAIN_JOB_OPERATION,
@@ -430,7 +482,7 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                                 VIR_DOMAIN_JOB_DATA_TOTAL,
                                 stats->ram_total +
                                 stats->disk_total +
-                                mirrorStats->total) < 0 ||
+                                mirrorTotal) < 0 ||
         virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_DATA_PROCESSED,
                                 stats->ram_transferred +
@@ -490,6 +542,64 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                                 stats->ram_page_size) < 0)
         goto error;
 
+    if (jobInfo->npasses > 0 &&
+        virTypedParamsAddUInt(&par, &npar, &maxpar,
+                              VIR_DOMAIN_JOB_MEMORY_PASS_COUNT,
+                              jobInfo->npasses) < 0)
+        goto error;
+
+    for (i = 0; i < jobInfo->npasses; i++) {
+        qemuDomainMigrationPassPtr pass = &jobInfo->passes[i];
+        char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+        g_snprintf(field, sizeof(field),
+                   VIR_DOMAIN_JOB_MEMORY_PASS_ITERATION, (unsigned int) i);
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar, field,
+                                    pass->iteration) < 0)
+            goto error;
+
+        g_snprintf(field, sizeof(field),
+                   VIR_DOMAIN_JOB_MEMORY_PASS_DURATION, (unsigned int) i);
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar, field,
+                                    pass->duration) < 0)
+            goto error;
+
+        g_snprintf(field, sizeof(field),
+                   VIR_DOMAIN_JOB_MEMORY_PASS_BPS, (unsigned int) i);
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar, field,
+                                    pass->bps) < 0)
+            goto error;
+
+        g_snprintf(field, sizeof(field),
+                   VIR_DOMAIN_JOB_MEMORY_PASS_DIRTY_RATE, (unsigned int) i);
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar, field,
+                                    pass->dirtyRate) < 0)
+            goto error;
+    }
+
+    if (jobInfo->nautoTune > 0 &&
+        virTypedParamsAddUInt(&par, &npar, &maxpar,
+                              VIR_DOMAIN_JOB_AUTO_TUNE_COUNT,
+                              jobInfo->nautoTune) < 0)
+        goto error;
+
+    for (i = 0; i < jobInfo->nautoTune; i++) {
+        qemuDomainAutoTuneStepPtr step = &jobInfo->autoTune[i];
+        char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+        g_snprintf(field, sizeof(field),
+                   VIR_DOMAIN_JOB_AUTO_TUNE_ACTION, (unsigned int) i);
+        if (virTypedParamsAddInt(&par, &npar, &maxpar, field,
+                                 step->action) < 0)
+            goto error;
+
+        g_snprintf(field, sizeof(field),
+                   VIR_DOMAIN_JOB_AUTO_TUNE_ITERATION, (unsigned int) i);
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar, field,
+                                    step->iteration) < 0)
+            goto error;
+    }
+
     /* The remaining stats are disk, mirror, or migration specific
      * so if this is a SAVEDUMP, we can just skip them */
     if (jobInfo->statsType == QEMU_DOMAIN_JOB_STATS_TYPE_SAVEDUMP)
@@ -498,21 +608,26 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
     if (virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_DISK_TOTAL,
                                 stats->disk_total +
-                                mirrorStats->total) < 0 ||
+                                mirrorTotal) < 0 ||
         virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_DISK_PROCESSED,
                                 stats->disk_transferred +
                                 mirrorStats->transferred) < 0 ||
         virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_DISK_REMAINING,
-                                stats->disk_remaining +
-                                mirrorRemaining) < 0)
+                                diskRemaining) < 0)
         goto error;
 
-    if (stats->disk_bps &&
+    if (diskBps &&
         virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_DISK_BPS,
-                                stats->disk_bps) < 0)
+                                diskBps) < 0)
+        goto error;
+
+    if (diskBps && diskRemaining &&
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_DISK_TIME_REMAINING,
+                                diskRemaining * 1000 / diskBps) < 0)
         goto error;
 
     if (stats->xbzrle_set) {
@@ -706,7 +821,7 @@ qemuDomainObjSetJobPhase(virQEMUDriverPtr driver,
 
     priv->job.phase = phase;
     priv->job.asyncOwner = me;
-    qemuDomainObjSaveStatus(driver, obj);
+    qemuDomainObjSaveStatusNow(driver, obj);
 }
 
 void
@@ -729,7 +844,7 @@ qemuDomainObjDiscardAsyncJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
     if (priv->job.active == QEMU_JOB_ASYNC_NESTED)
         qemuDomainObjResetJob(&priv->job);
     qemuDomainObjResetAsyncJob(&priv->job);
-    qemuDomainObjSaveStatus(driver, obj);
+    qemuDomainObjSaveStatusNow(driver, obj);
 }
 
 void
@@ -909,7 +1024,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     }
 
     if (qemuDomainTrackJob(job))
-        qemuDomainObjSaveStatus(driver, obj);
+        qemuDomainObjSaveStatusNow(driver, obj);
 
     return 0;
 
@@ -1131,7 +1246,11 @@ qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
 
     qemuDomainObjResetJob(&priv->job);
     if (qemuDomainTrackJob(job))
-        qemuDomainObjSaveStatus(driver, obj);
+        qemuDomainObjSaveStatusNow(driver, obj);
+
+    /* Let the lockless query APIs see whatever the job changed */
+    virDomainObjPublish(obj);
+
     /* We indeed need to wake up ALL threads waiting because
      * grabbing a job requires checking more variables. */
     virCondBroadcast(&priv->job.cond);
@@ -1168,7 +1287,8 @@ qemuDomainObjEndAsyncJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               obj, obj->def->name);
 
     qemuDomainObjResetAsyncJob(&priv->job);
-    qemuDomainObjSaveStatus(driver, obj);
+    qemuDomainObjSaveStatusNow(driver, obj);
+    virDomainObjPublish(obj);
     virCondBroadcast(&priv->job.asyncCond);
 }
 
@@ -105,6 +105,9 @@ typedef qemuDomainMirrorStats *qemuDomainMirrorStatsPtr;
 struct _qemuDomainMirrorStats {
     unsigned long long transferred;
     unsigned long long total;
+    unsigned long long pending; /* size of disks waiting for their mirror */
+    unsigned long long started; /* when the first mirror was started */
+    unsigned long long bps; /* average transfer rate since @started */
 };
 
 typedef struct _qemuDomainBackupStats qemuDomainBackupStats;
@@ -115,6 +118,28 @@ struct _qemuDomainBackupStats {
     unsigned long long tmp_total;
 };
 
+/* Number of finished memory passes remembered for a migration job */
+#define QEMU_DOMAIN_JOB_MIGRATION_PASSES 4
+
+typedef struct _qemuDomainMigrationPass qemuDomainMigrationPass;
+typedef qemuDomainMigrationPass *qemuDomainMigrationPassPtr;
+struct _qemuDomainMigrationPass {
+    unsigned long long iteration; /* first iteration covered by the entry */
+    unsigned long long duration; /* in milliseconds */
+    unsigned long long bps; /* memory throughput during the pass */
+    unsigned long long dirtyRate; /* pages dirtied per second */
+};
+
+/* Every virDomainJobAutoTuneAction is taken at most once */
+#define QEMU_DOMAIN_JOB_AUTO_TUNE_STEPS (VIR_DOMAIN_JOB_AUTO_TUNE_LAST - 1)
+
+typedef struct _qemuDomainAutoTuneStep qemuDomainAutoTuneStep;
+typedef qemuDomainAutoTuneStep *qemuDomainAutoTuneStepPtr;
+struct _qemuDomainAutoTuneStep {
+    int action; /* virDomainJobAutoTuneAction */
+    unsigned long long iteration; /* memory pass when the step was taken */
+};
+
 typedef struct _qemuDomainJobInfo qemuDomainJobInfo;
 typedef qemuDomainJobInfo *qemuDomainJobInfoPtr;
 struct _qemuDomainJobInfo {
@@ -143,6 +168,19 @@ struct _qemuDomainJobInfo {
     } stats;
     qemuDomainMirrorStats mirrorStats;
 
+    /* Rolling history of finished memory passes, oldest first */
+    qemuDomainMigrationPass passes[QEMU_DOMAIN_JOB_MIGRATION_PASSES];
+    size_t npasses;
+    unsigned long long passIteration; /* iteration of the current pass */
+    unsigned long long passStarted; /* when the current pass was seen first */
+    unsigned long long passTransferred; /* ram_transferred at passStarted */
+    unsigned long long passEvent; /* last MIGRATION_PASS event from QEMU */
+
+    /* Steps taken by the VIR_MIGRATE_AUTO_TUNE controller */
+    qemuDomainAutoTuneStep autoTune[QEMU_DOMAIN_JOB_AUTO_TUNE_STEPS];
+    size_t nautoTune;
+    int autoTuneNext; /* next virDomainJobAutoTuneAction to try */
+
     char *errmsg; /* optional error message for failed completed jobs */
 };
 
@@ -248,6 +286,8 @@ void qemuDomainRemoveInactiveJobLocked(virQEMUDriverPtr driver,
 
 int qemuDomainJobInfoUpdateTime(qemuDomainJobInfoPtr jobInfo)
     ATTRIBUTE_NONNULL(1);
+int qemuDomainJobInfoUpdateMigrationPass(qemuDomainJobInfoPtr jobInfo)
+    ATTRIBUTE_NONNULL(1);
 int qemuDomainJobInfoUpdateDowntime(qemuDomainJobInfoPtr jobInfo)
     ATTRIBUTE_NONNULL(1);
 int qemuDomainJobInfoToInfo(qemuDomainJobInfoPtr jobInfo,
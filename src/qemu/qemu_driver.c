@@ -48,6 +48,7 @@
 #include "qemu_migration_params.h"
 #include "qemu_blockjob.h"
 #include "qemu_security.h"
+#include "qemu_statsbatch.h"
 #include "qemu_checkpoint.h"
 #include "qemu_backup.h"
 
@@ -55,6 +56,7 @@
 #include "virlog.h"
 #include "datatypes.h"
 #include "virbuffer.h"
+#include "virdaemon.h"
 #include "virhostcpu.h"
 #include "virhostmem.h"
 #include "virnetdevtap.h"
@@ -81,6 +83,7 @@
 #include "virstoragefile.h"
 #include "virfile.h"
 #include "virfdstream.h"
+#include "vircrypto.h"
 #include "configmake.h"
 #include "virthreadpool.h"
 #include "locking/lock_manager.h"
@@ -136,6 +139,7 @@ VIR_LOG_INIT("qemu.qemu_driver");
 
 static void qemuProcessEventHandler(void *data, void *opaque);
 
+
 static int qemuStateCleanup(void);
 
 static int qemuDomainObjStart(virConnectPtr conn,
@@ -620,6 +624,39 @@ qemuDomainFindMaxID(virDomainObjPtr vm,
 }
 
 
+typedef struct _qemuDomainParseCacheKeyData qemuDomainParseCacheKeyData;
+struct _qemuDomainParseCacheKeyData {
+    virQEMUDriverPtr driver;
+    const char *configDigest; /* sha256 of qemu.conf */
+};
+
+
+/* The post parse callbacks depend on the capabilities of the emulator
+ * and on the defaults from qemu.conf, make the parse cache key cover
+ * both. */
+static char *
+qemuDomainParseCacheKey(virDomainDefPtr def,
+                        void *opaque)
+{
+    qemuDomainParseCacheKeyData *data = opaque;
+    g_autoptr(virQEMUCaps) qemuCaps = NULL;
+    g_autofree char *capsDigest = NULL;
+
+    if (!def->emulator) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("missing emulator of domain '%s'"), def->name);
+        return NULL;
+    }
+
+    if (!(qemuCaps = virQEMUCapsCacheLookup(data->driver->qemuCapsCache,
+                                            def->emulator)) ||
+        !(capsDigest = virQEMUCapsGetDigest(qemuCaps)))
+        return NULL;
+
+    return g_strdup_printf("%s:%s", data->configDigest, capsDigest);
+}
+
+
 /**
  * qemuStateInitialize:
  *
@@ -632,6 +669,10 @@ qemuStateInitialize(bool privileged,
                     void *opaque)
 {
     g_autofree char *driverConf = NULL;
+    g_autofree char *parseCacheDir = NULL;
+    g_autofree char *driverConfContent = NULL;
+    g_autofree char *driverConfDigest = NULL;
+    qemuDomainParseCacheKeyData parseCacheKeyData = { 0 };
     virQEMUDriverConfigPtr cfg;
     uid_t run_uid = -1;
     gid_t run_gid = -1;
@@ -639,6 +680,7 @@ qemuStateInitialize(bool privileged,
     size_t i;
     const char *defsecmodel = NULL;
     g_autofree virSecurityManagerPtr *sec_managers = NULL;
+    unsigned long long phaseStart = 0;
 
     if (VIR_ALLOC(qemu_driver) < 0)
         return VIR_DRV_STATE_INIT_ERROR;
@@ -938,12 +980,15 @@ qemuStateInitialize(bool privileged,
         goto error;
 
     /* Get all the running persistent or transient configs first */
-    if (virDomainObjListLoadAllConfigs(qemu_driver->domains,
-                                       cfg->stateDir,
-                                       NULL, true,
-                                       qemu_driver->xmlopt,
-                                       NULL, NULL) < 0)
+    ignore_value(virTimeMillisNow(&phaseStart));
+    if (virDomainObjListLoadAllConfigsParallel(qemu_driver->domains,
+                                               cfg->stateDir,
+                                               NULL, NULL, NULL, NULL, true,
+                                               qemu_driver->xmlopt,
+                                               cfg->startupWorkers,
+                                               NULL, NULL) < 0)
         goto error;
+    virDaemonStartupPhaseRecord("qemu.load_status", phaseStart);
 
     /* find the maximum ID from active and transient configs to initialize
      * the driver with. This is to avoid race between autostart and reconnect
@@ -959,12 +1004,41 @@ qemuStateInitialize(bool privileged,
                             NULL);
 
     /* Then inactive persistent configs */
-    if (virDomainObjListLoadAllConfigs(qemu_driver->domains,
-                                       cfg->configDir,
-                                       cfg->autostartDir, false,
-                                       qemu_driver->xmlopt,
-                                       NULL, NULL) < 0)
+    if (cfg->domainParseCache) {
+        parseCacheDir = g_strdup_printf("%s/parsecache", cfg->stateDir);
+        if (virFileMakePathWithMode(parseCacheDir, S_IRWXU) < 0) {
+            VIR_WARN("Unable to create parse cache directory '%s': %s",
+                     parseCacheDir, g_strerror(errno));
+            g_clear_pointer(&parseCacheDir, g_free);
+        }
+
+        if (virFileReadAllQuiet(driverConf, 1024 * 1024, &driverConfContent) < 0)
+            driverConfContent = g_strdup("");
+
+        if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, driverConfContent,
+                                &driverConfDigest) < 0) {
+            VIR_WARN("Unable to checksum '%s', not using parse cache: %s",
+                     driverConf, virGetLastErrorMessage());
+            virResetLastError();
+            g_clear_pointer(&parseCacheDir, g_free);
+        }
+
+        parseCacheKeyData.driver = qemu_driver;
+        parseCacheKeyData.configDigest = driverConfDigest;
+    }
+
+    ignore_value(virTimeMillisNow(&phaseStart));
+    if (virDomainObjListLoadAllConfigsParallel(qemu_driver->domains,
+                                               cfg->configDir,
+                                               cfg->autostartDir,
+                                               parseCacheDir,
+                                               qemuDomainParseCacheKey,
+                                               &parseCacheKeyData, false,
+                                               qemu_driver->xmlopt,
+                                               cfg->startupWorkers,
+                                               NULL, NULL) < 0)
         goto error;
+    virDaemonStartupPhaseRecord("qemu.load_config", phaseStart);
 
     virDomainObjListForEach(qemu_driver->domains,
                             false,
@@ -989,13 +1063,24 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    if (cfg->statsWorkers > 0 &&
+        !(qemu_driver->statsPool = virThreadPoolNewFull(0, cfg->statsWorkers, 0,
+                                                        qemuStatsBatchJobRun,
+                                                        "qemu-stats", qemu_driver)))
+        goto error;
+
+    ignore_value(virTimeMillisNow(&phaseStart));
     qemuProcessReconnectAll(qemu_driver);
+    virDaemonStartupPhaseRecord("qemu.reconnect", phaseStart);
 
     if (virDriverShouldAutostart(cfg->stateDir, &autostart) < 0)
         goto error;
 
-    if (autostart)
+    if (autostart) {
+        ignore_value(virTimeMillisNow(&phaseStart));
         qemuAutostartDomains(qemu_driver);
+        virDaemonStartupPhaseRecord("qemu.autostart", phaseStart);
+    }
 
     return VIR_DRV_STATE_INIT_COMPLETE;
 
@@ -1037,6 +1122,15 @@ qemuStateReload(void)
                                    cfg->autostartDir, false,
                                    qemu_driver->xmlopt,
                                    qemuNotifyLoadDomain, qemu_driver);
+
+    /* refresh the capabilities of QEMU binaries upgraded meanwhile so
+     * that starting the next domain doesn't have to wait for them */
+    if (virQEMUCapsCachePrewarmAsync(qemu_driver->qemuCapsCache) < 0) {
+        VIR_WARN("Failed to refresh QEMU capabilities: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     return 0;
 }
 
@@ -1109,6 +1203,11 @@ qemuStateCleanup(void)
     if (!qemu_driver)
         return -1;
 
+    /* write out status saves which are still being coalesced */
+    if (qemu_driver->domains)
+        virDomainObjListForEach(qemu_driver->domains, false,
+                                qemuDomainObjFlushStatus, NULL);
+
     virObjectUnref(qemu_driver->migrationErrors);
     virObjectUnref(qemu_driver->closeCallbacks);
     virLockManagerPluginUnref(qemu_driver->lockManager);
@@ -1129,6 +1228,7 @@ qemuStateCleanup(void)
     VIR_FREE(qemu_driver->qemuImgBinary);
     virObjectUnref(qemu_driver->domains);
     virThreadPoolFree(qemu_driver->workerPool);
+    virThreadPoolFree(qemu_driver->statsPool);
 
     if (qemu_driver->lockFD != -1)
         virPidFileRelease(qemu_driver->config->stateDir, "driver", qemu_driver->lockFD);
@@ -2631,57 +2731,75 @@ static int qemuDomainSendKey(virDomainPtr domain,
 }
 
 
+/**
+ * qemuDomainPublishedACLDef:
+ * @pub: published state of a domain
+ * @def: definition to fill
+ *
+ * The lockless query APIs must not look at vm->def which may be replaced
+ * while they run. The access drivers only care about the name and UUID of
+ * the domain, so a stub definition built from the published state is
+ * enough for the ACL checks. @def is only valid as long as @pub is.
+ */
+static void
+qemuDomainPublishedACLDef(virDomainObjPublishedPtr pub,
+                          virDomainDefPtr def)
+{
+    memset(def, 0, sizeof(*def));
+    def->name = pub->name;
+    def->id = pub->id;
+    memcpy(def->uuid, pub->uuid, VIR_UUID_BUFLEN);
+}
+
+
 static int
 qemuDomainGetInfo(virDomainPtr dom,
                   virDomainInfoPtr info)
 {
-    unsigned long long maxmem;
-    virDomainObjPtr vm;
-    int ret = -1;
+    g_autoptr(virDomainObj) vm = NULL;
+    g_auto(virDomainObjPublished) pub = { 0 };
+    virDomainDef aclDef;
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+    if (!(vm = qemuDomainObjFromDomainRef(dom)))
+        return -1;
 
-    if (virDomainGetInfoEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (virDomainObjGetPublished(vm, &pub) < 0)
+        return -1;
 
-    qemuDomainUpdateCurrentMemorySize(vm);
+    qemuDomainPublishedACLDef(&pub, &aclDef);
+    if (virDomainGetInfoEnsureACL(dom->conn, &aclDef) < 0)
+        return -1;
 
     memset(info, 0, sizeof(*info));
 
-    info->state = virDomainObjGetState(vm, NULL);
+    info->state = pub.state.state;
 
-    maxmem = virDomainDefGetMemoryTotal(vm->def);
-    if (VIR_ASSIGN_IS_OVERFLOW(info->maxMem, maxmem)) {
+    if (VIR_ASSIGN_IS_OVERFLOW(info->maxMem, pub.maxMemory)) {
         virReportError(VIR_ERR_OVERFLOW, "%s",
                        _("Initial memory size too large"));
-        goto cleanup;
+        return -1;
     }
 
-    if (VIR_ASSIGN_IS_OVERFLOW(info->memory, vm->def->mem.cur_balloon)) {
+    if (VIR_ASSIGN_IS_OVERFLOW(info->memory, pub.curBalloon)) {
         virReportError(VIR_ERR_OVERFLOW, "%s",
                        _("Current memory size too large"));
-        goto cleanup;
+        return -1;
     }
 
-    if (virDomainObjIsActive(vm)) {
-        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL, vm->pid, 0) < 0) {
+    if (pub.id != -1) {
+        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL, pub.pid, 0) < 0) {
             virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                            _("cannot read cputime for domain"));
-            goto cleanup;
+            return -1;
         }
     }
 
-    if (VIR_ASSIGN_IS_OVERFLOW(info->nrVirtCpu, virDomainDefGetVcpus(vm->def))) {
+    if (VIR_ASSIGN_IS_OVERFLOW(info->nrVirtCpu, pub.vcpus)) {
         virReportError(VIR_ERR_OVERFLOW, "%s", _("cpu count too large"));
-        goto cleanup;
+        return -1;
     }
 
-    ret = 0;
-
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    return 0;
 }
 
 static int
@@ -2690,23 +2808,27 @@ qemuDomainGetState(virDomainPtr dom,
                    int *reason,
                    unsigned int flags)
 {
-    virDomainObjPtr vm;
-    int ret = -1;
+    g_autoptr(virDomainObj) vm = NULL;
+    g_auto(virDomainObjPublished) pub = { 0 };
+    virDomainDef aclDef;
 
     virCheckFlags(0, -1);
 
-    if (!(vm = qemuDomainObjFromDomain(dom)))
-        goto cleanup;
+    if (!(vm = qemuDomainObjFromDomainRef(dom)))
+        return -1;
 
-    if (virDomainGetStateEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (virDomainObjGetPublished(vm, &pub) < 0)
+        return -1;
 
-    *state = virDomainObjGetState(vm, reason);
-    ret = 0;
+    qemuDomainPublishedACLDef(&pub, &aclDef);
+    if (virDomainGetStateEnsureACL(dom->conn, &aclDef) < 0)
+        return -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    *state = pub.state.state;
+    if (reason)
+        *reason = pub.state.reason;
+
+    return 0;
 }
 
 static int
@@ -13731,6 +13853,11 @@ qemuDomainAbortJobMigration(virDomainObjPtr vm)
     if (qemuDomainObjExitMonitor(priv->driver, vm) < 0)
         ret = -1;
 
+    /* Without migration events nothing else tells the thread waiting for
+     * the migration to finish that QEMU cancelled it, wake it up so that
+     * it doesn't keep sleeping until its next poll. */
+    virDomainObjBroadcast(vm);
+
     return ret;
 }
 
@@ -20645,11 +20772,40 @@ qemuConnectGetDomainCapabilities(virConnectPtr conn,
 }
 
 
+/* Data shared by the collection of stats of all domains in one
+ * virConnectGetAllDomainStats call */
+typedef struct _qemuDomainGetStatsData qemuDomainGetStatsData;
+typedef qemuDomainGetStatsData *qemuDomainGetStatsDataPtr;
+struct _qemuDomainGetStatsData {
+    virConnectPtr conn;
+    unsigned int stats;
+    unsigned int privflags;
+    unsigned int flags;
+    /* host interface stats, read once for all domains */
+    virNetDevTapStatsCachePtr tapStats;
+};
+
+
+static void
+qemuDomainGetStatsDataFree(void *opaque)
+{
+    qemuDomainGetStatsDataPtr data = opaque;
+
+    if (!data)
+        return;
+
+    virObjectUnref(data->conn);
+    virNetDevTapStatsCacheFree(data->tapStats);
+    g_free(data);
+}
+
+
 static int
 qemuDomainGetStatsState(virQEMUDriverPtr driver G_GNUC_UNUSED,
                         virDomainObjPtr dom,
                         virTypedParamListPtr params,
-                        unsigned int privflags G_GNUC_UNUSED)
+                        unsigned int privflags G_GNUC_UNUSED,
+                        qemuDomainGetStatsDataPtr data G_GNUC_UNUSED)
 {
     if (virTypedParamListAddInt(params, dom->state.state, "state.state") < 0)
         return -1;
@@ -20952,22 +21108,19 @@ qemuDomainGetStatsCpuCgroup(virDomainObjPtr dom,
                             virTypedParamListPtr params)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
-    unsigned long long cpu_time = 0;
-    unsigned long long user_time = 0;
-    unsigned long long sys_time = 0;
-    int err = 0;
+    virCgroupStats stats;
 
     if (!priv->cgroup)
         return 0;
 
-    err = virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time);
-    if (!err && virTypedParamListAddULLong(params, cpu_time, "cpu.time") < 0)
-        return -1;
+    if (virCgroupGetStatsSnapshot(priv->cgroup, VIR_CGROUP_STATS_CPU, &stats) < 0) {
+        virResetLastError();
+        return 0;
+    }
 
-    err = virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time);
-    if (!err && virTypedParamListAddULLong(params, user_time, "cpu.user") < 0)
-        return -1;
-    if (!err && virTypedParamListAddULLong(params, sys_time, "cpu.system") < 0)
+    if (virTypedParamListAddULLong(params, stats.cpuTime, "cpu.time") < 0 ||
+        virTypedParamListAddULLong(params, stats.userTime, "cpu.user") < 0 ||
+        virTypedParamListAddULLong(params, stats.sysTime, "cpu.system") < 0)
         return -1;
 
     return 0;
@@ -20978,7 +21131,8 @@ static int
 qemuDomainGetStatsCpu(virQEMUDriverPtr driver,
                       virDomainObjPtr dom,
                       virTypedParamListPtr params,
-                      unsigned int privflags G_GNUC_UNUSED)
+                      unsigned int privflags G_GNUC_UNUSED,
+                      qemuDomainGetStatsDataPtr data G_GNUC_UNUSED)
 {
     if (qemuDomainGetStatsCpuCgroup(dom, params) < 0)
         return -1;
@@ -20994,7 +21148,8 @@ static int
 qemuDomainGetStatsMemory(virQEMUDriverPtr driver,
                          virDomainObjPtr dom,
                          virTypedParamListPtr params,
-                         unsigned int privflags G_GNUC_UNUSED)
+                         unsigned int privflags G_GNUC_UNUSED,
+                         qemuDomainGetStatsDataPtr data G_GNUC_UNUSED)
 
 {
     return qemuDomainGetStatsMemoryBandwidth(driver, dom, params);
@@ -21005,7 +21160,8 @@ static int
 qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
                           virTypedParamListPtr params,
-                          unsigned int privflags)
+                          unsigned int privflags,
+                          qemuDomainGetStatsDataPtr data G_GNUC_UNUSED)
 {
     virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
     int nr_stats;
@@ -21063,7 +21219,8 @@ static int
 qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
                        virDomainObjPtr dom,
                        virTypedParamListPtr params,
-                       unsigned int privflags)
+                       unsigned int privflags,
+                       qemuDomainGetStatsDataPtr data G_GNUC_UNUSED)
 {
     virDomainVcpuDefPtr vcpu;
     qemuDomainVcpuPrivatePtr vcpupriv;
@@ -21147,7 +21304,8 @@ static int
 qemuDomainGetStatsInterface(virQEMUDriverPtr driver G_GNUC_UNUSED,
                             virDomainObjPtr dom,
                             virTypedParamListPtr params,
-                            unsigned int privflags G_GNUC_UNUSED)
+                            unsigned int privflags G_GNUC_UNUSED,
+                            qemuDomainGetStatsDataPtr data)
 {
     size_t i;
     struct _virDomainInterfaceStats tmp;
@@ -21179,8 +21337,8 @@ qemuDomainGetStatsInterface(virQEMUDriverPtr driver G_GNUC_UNUSED,
                 continue;
             }
         } else {
-            if (virNetDevTapInterfaceStats(net->ifname, &tmp,
-                                           !virDomainNetTypeSharesHostView(net)) < 0) {
+            if (virNetDevTapInterfaceStatsCached(data->tapStats, net->ifname, &tmp,
+                                                 !virDomainNetTypeSharesHostView(net)) < 0) {
                 virResetLastError();
                 continue;
             }
@@ -21488,7 +21646,8 @@ static int
 qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
                         virDomainObjPtr dom,
                         virTypedParamListPtr params,
-                        unsigned int privflags)
+                        unsigned int privflags,
+                        qemuDomainGetStatsDataPtr data G_GNUC_UNUSED)
 {
     size_t i;
     int ret = -1;
@@ -21506,26 +21665,23 @@ qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
     bool visitBacking = !!(privflags & QEMU_DOMAIN_STATS_BACKING);
 
     if (HAVE_JOB(privflags) && virDomainObjIsActive(dom)) {
-        qemuDomainObjEnterMonitor(driver, dom);
+        bool capacityErr;
 
-        rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats, visitBacking);
+        qemuDomainObjEnterMonitor(driver, dom);
 
-        if (rc >= 0) {
-            if (blockdev)
-                rc = qemuMonitorBlockStatsUpdateCapacityBlockdev(priv->mon, stats);
-            else
-                ignore_value(qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats,
-                                                                 visitBacking));
-        }
+        rc = qemuMonitorGetAllBlockStatsCapacity(priv->mon, &stats, visitBacking,
+                                                 blockdev, &capacityErr,
+                                                 fetchnodedata ? &nodedata : NULL);
 
-        if (fetchnodedata)
-            nodedata = qemuMonitorQueryNamedBlockNodes(priv->mon);
+        /* missing capacity data is fatal only with -blockdev */
+        if (rc >= 0 && blockdev && capacityErr)
+            rc = -1;
 
         if (qemuDomainObjExitMonitor(driver, dom) < 0)
             goto cleanup;
 
         /* failure to retrieve stats is fine at this point */
-        if (rc < 0 || (fetchnodedata && !nodedata))
+        if (rc < 0)
             virResetLastError();
     }
 
@@ -21563,7 +21719,8 @@ static int
 qemuDomainGetStatsIOThread(virQEMUDriverPtr driver,
                            virDomainObjPtr dom,
                            virTypedParamListPtr params,
-                           unsigned int privflags)
+                           unsigned int privflags,
+                           qemuDomainGetStatsDataPtr data G_GNUC_UNUSED)
 {
     qemuDomainObjPrivatePtr priv = dom->privateData;
     size_t i;
@@ -21639,7 +21796,8 @@ static int
 qemuDomainGetStatsPerf(virQEMUDriverPtr driver G_GNUC_UNUSED,
                        virDomainObjPtr dom,
                        virTypedParamListPtr params,
-                       unsigned int privflags G_GNUC_UNUSED)
+                       unsigned int privflags G_GNUC_UNUSED,
+                       qemuDomainGetStatsDataPtr data G_GNUC_UNUSED)
 {
     size_t i;
     qemuDomainObjPrivatePtr priv = dom->privateData;
@@ -21659,7 +21817,8 @@ typedef int
 (*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
                           virDomainObjPtr dom,
                           virTypedParamListPtr list,
-                          unsigned int flags);
+                          unsigned int flags,
+                          qemuDomainGetStatsDataPtr data);
 
 struct qemuDomainGetStatsWorker {
     qemuDomainGetStatsFunc func;
@@ -21724,12 +21883,12 @@ qemuDomainGetStatsNeedMonitor(unsigned int stats)
 
 
 static int
-qemuDomainGetStats(virConnectPtr conn,
+qemuDomainGetStats(qemuDomainGetStatsDataPtr data,
                    virDomainObjPtr dom,
-                   unsigned int stats,
                    virDomainStatsRecordPtr *record,
                    unsigned int flags)
 {
+    virConnectPtr conn = data->conn;
     g_autofree virDomainStatsRecordPtr tmp = NULL;
     g_autoptr(virTypedParamList) params = NULL;
     size_t i;
@@ -21738,9 +21897,9 @@ qemuDomainGetStats(virConnectPtr conn,
         return -1;
 
     for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
-        if (stats & qemuDomainGetStatsWorkers[i].stats) {
+        if (data->stats & qemuDomainGetStatsWorkers[i].stats) {
             if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, params,
-                                                  flags) < 0)
+                                                  flags, data) < 0)
                 return -1;
         }
     }
@@ -21758,6 +21917,52 @@ qemuDomainGetStats(virConnectPtr conn,
 }
 
 
+static int
+qemuConnectGetAllDomainStatsOne(qemuDomainGetStatsDataPtr data,
+                                virDomainObjPtr vm,
+                                virDomainStatsRecordPtr *record)
+{
+    virQEMUDriverPtr driver = data->conn->privateData;
+    unsigned int domflags = 0;
+    int ret;
+
+    virObjectLock(vm);
+
+    if (HAVE_JOB(data->privflags)) {
+        int rv;
+
+        if (data->flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
+            rv = qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY);
+        else
+            rv = qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY);
+
+        if (rv == 0)
+            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    }
+    /* else: without a job it's still possible to gather some data */
+
+    if (data->flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+
+    ret = qemuDomainGetStats(data, vm, record, domflags);
+
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndJob(driver, vm);
+
+    virObjectUnlock(vm);
+    return ret;
+}
+
+
+static int
+qemuDomainGetStatsCollect(virDomainObjPtr vm,
+                          void *opaque,
+                          virDomainStatsRecordPtr *record)
+{
+    return qemuConnectGetAllDomainStatsOne(opaque, vm, record);
+}
+
+
 static int
 qemuConnectGetAllDomainStats(virConnectPtr conn,
                              virDomainPtr *doms,
@@ -21769,15 +21974,13 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     virQEMUDriverPtr driver = conn->privateData;
     virErrorPtr orig_err = NULL;
     virDomainObjPtr *vms = NULL;
-    virDomainObjPtr vm;
     size_t nvms;
     virDomainStatsRecordPtr *tmpstats = NULL;
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
     int nstats = 0;
     size_t i;
     int ret = -1;
-    unsigned int privflags = 0;
-    unsigned int domflags = 0;
+    qemuDomainGetStatsDataPtr data = NULL;
     unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
                                    VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
@@ -21810,46 +22013,37 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
         goto cleanup;
 
-    if (qemuDomainGetStatsNeedMonitor(stats))
-        privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-
-    for (i = 0; i < nvms; i++) {
-        virDomainStatsRecordPtr tmp = NULL;
-        domflags = 0;
-        vm = vms[i];
-
-        virObjectLock(vm);
-
-        if (HAVE_JOB(privflags)) {
-            int rv;
-
-            if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
-                rv = qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY);
-            else
-                rv = qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY);
-
-            if (rv == 0)
-                domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-        }
-        /* else: without a job it's still possible to gather some data */
-
-        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
-            domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
-            if (HAVE_JOB(domflags) && vm)
-                qemuDomainObjEndJob(driver, vm);
+    data = g_new0(qemuDomainGetStatsData, 1);
+    data->conn = virObjectRef(conn);
+    data->stats = stats;
+    data->flags = flags;
+    if (stats & VIR_DOMAIN_STATS_INTERFACE)
+        data->tapStats = virNetDevTapStatsCacheNew();
 
-            virObjectUnlock(vm);
+    if (qemuDomainGetStatsNeedMonitor(stats))
+        data->privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+
+    if (driver->statsPool && nvms > 1) {
+        g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
+
+        /* the data may need to outlive this call if a domain times out */
+        if (qemuStatsBatchRun(driver->statsPool, vms, nvms,
+                              cfg->statsTimeout * 1000ull, enforce,
+                              qemuDomainGetStatsCollect,
+                              g_steal_pointer(&data),
+                              qemuDomainGetStatsDataFree,
+                              tmpstats, &nstats) < 0)
             goto cleanup;
-        }
-
-        if (tmp)
-            tmpstats[nstats++] = tmp;
+    } else {
+        for (i = 0; i < nvms; i++) {
+            virDomainStatsRecordPtr tmp = NULL;
 
-        if (HAVE_JOB(domflags))
-            qemuDomainObjEndJob(driver, vm);
+            if (qemuConnectGetAllDomainStatsOne(data, vms[i], &tmp) < 0)
+                goto cleanup;
 
-        virObjectUnlock(vm);
+            if (tmp)
+                tmpstats[nstats++] = tmp;
+        }
     }
 
     *retStats = tmpstats;
@@ -21861,6 +22055,7 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
     virErrorPreserveLast(&orig_err);
     virDomainStatsRecordListFree(tmpstats);
     virObjectListFreeCount(vms, nvms);
+    qemuDomainGetStatsDataFree(data);
     virErrorRestore(&orig_err);
 
     return ret;
@@ -26,6 +26,8 @@
 #include <poll.h>
 
 #include "qemu_migration.h"
+#define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+#include "qemu_migrationpriv.h"
 #include "qemu_migration_cookie.h"
 #include "qemu_migration_params.h"
 #include "qemu_monitor.h"
@@ -295,13 +297,65 @@ qemuMigrationAnyCopyDisk(virDomainDiskDef const *disk,
 }
 
 
-static int
+/* Upper limit of threads creating volumes for incoming storage migration */
+#define QEMU_MIGRATION_PRECREATE_THREADS 8
+
+typedef struct _qemuMigrationDstPrecreateData qemuMigrationDstPrecreateData;
+typedef qemuMigrationDstPrecreateData *qemuMigrationDstPrecreateDataPtr;
+struct _qemuMigrationDstPrecreateData {
+    virConnectPtr conn;
+    virDomainDiskDefPtr *disks;
+    unsigned long long *capacities;
+    size_t ndisks;
+
+    virMutex lock;
+    size_t next;
+    virErrorPtr err; /* the first error, stops all workers */
+};
+
+
+static void
+qemuMigrationDstPrecreateWorker(void *opaque)
+{
+    qemuMigrationDstPrecreateDataPtr data = opaque;
+
+    while (true) {
+        size_t i = data->ndisks;
+
+        virMutexLock(&data->lock);
+        if (!data->err && data->next < data->ndisks)
+            i = data->next++;
+        virMutexUnlock(&data->lock);
+
+        if (i == data->ndisks)
+            return;
+
+        if (qemuMigrationDstPrecreateDisk(data->conn, data->disks[i],
+                                          data->capacities[i]) < 0) {
+            virMutexLock(&data->lock);
+            if (!data->err)
+                virErrorPreserveLast(&data->err);
+            virMutexUnlock(&data->lock);
+            virResetLastError();
+        }
+    }
+}
+
+
+int
 qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
                                  qemuMigrationCookieNBDPtr nbd,
                                  size_t nmigrate_disks,
                                  const char **migrate_disks,
                                  bool incremental)
 {
+    qemuMigrationDstPrecreateData data = { 0 };
+    g_autofree virDomainDiskDefPtr *disks = NULL;
+    g_autofree unsigned long long *capacities = NULL;
+    g_autofree virThread *threads = NULL;
+    size_t ndisks = 0;
+    size_t nthreads = 0;
+    size_t maxthreads;
     int ret = -1;
     size_t i = 0;
     virConnectPtr conn;
@@ -312,6 +366,9 @@ qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
     if (!(conn = virGetConnectStorage()))
         return -1;
 
+    disks = g_new0(virDomainDiskDefPtr, nbd->ndisks);
+    capacities = g_new0(unsigned long long, nbd->ndisks);
+
     for (i = 0; i < nbd->ndisks; i++) {
         virDomainDiskDefPtr disk;
         const char *diskSrcPath;
@@ -349,8 +406,51 @@ qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
 
         VIR_DEBUG("Proceeding with disk source %s", NULLSTR(diskSrcPath));
 
-        if (qemuMigrationDstPrecreateDisk(conn, disk, nbd->disks[i].capacity) < 0)
-            goto cleanup;
+        disks[ndisks] = disk;
+        capacities[ndisks] = nbd->disks[i].capacity;
+        ndisks++;
+    }
+
+    if (ndisks == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    /* Creating a volume may take a while (e.g., when metadata of a qcow2
+     * image is preallocated), let's create them concurrently. */
+    if (virMutexInit(&data.lock) < 0)
+        goto cleanup;
+
+    data.conn = conn;
+    data.disks = disks;
+    data.capacities = capacities;
+    data.ndisks = ndisks;
+
+    /* the calling thread creates volumes too */
+    maxthreads = MIN(ndisks, QEMU_MIGRATION_PRECREATE_THREADS) - 1;
+    threads = g_new0(virThread, maxthreads + 1);
+
+    for (; nthreads < maxthreads; nthreads++) {
+        if (virThreadCreateFull(&threads[nthreads], true,
+                                qemuMigrationDstPrecreateWorker,
+                                "qemu-mig-precreate", false, &data) < 0) {
+            virResetLastError();
+            break;
+        }
+    }
+
+    VIR_DEBUG("Creating %zu volumes with %zu threads", ndisks, nthreads + 1);
+
+    qemuMigrationDstPrecreateWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virMutexDestroy(&data.lock);
+
+    if (data.err) {
+        virErrorRestore(&data.err);
+        goto cleanup;
     }
 
     ret = 0;
@@ -505,6 +605,8 @@ qemuMigrationNBDReportMirrorError(qemuBlockJobDataPtr job,
  *
  * Check the status of all drives copied via qemuMigrationSrcNBDStorageCopy.
  * Any pending block job events for the mirrored disks will be processed.
+ * If @notReadyRet is not NULL, the number of mirrors which are not ready yet
+ * is stored there.
  *
  * Returns 1 if all mirrors are "ready",
  *         0 if some mirrors are still performing initial sync,
@@ -512,7 +614,8 @@ qemuMigrationNBDReportMirrorError(qemuBlockJobDataPtr job,
  */
 static int
 qemuMigrationSrcNBDStorageCopyReady(virDomainObjPtr vm,
-                                    qemuDomainAsyncJob asyncJob)
+                                    qemuDomainAsyncJob asyncJob,
+                                    size_t *notReadyRet)
 {
     size_t i;
     size_t notReady = 0;
@@ -544,6 +647,9 @@ qemuMigrationSrcNBDStorageCopyReady(virDomainObjPtr vm,
             notReady++;
     }
 
+    if (notReadyRet)
+        *notReadyRet = notReady;
+
     if (notReady) {
         VIR_DEBUG("Waiting for %zu disk mirrors to get ready", notReady);
         return 0;
@@ -975,6 +1081,47 @@ qemuMigrationSrcNBDStorageCopyOne(virQEMUDriverPtr driver,
 }
 
 
+/* Remembers capacities of @disks so that disks waiting for their copy to
+ * start can be accounted for in the migration progress. */
+static int
+qemuMigrationSrcNBDStorageCopyCapacities(virQEMUDriverPtr driver,
+                                         virDomainObjPtr vm,
+                                         virDomainDiskDefPtr *disks,
+                                         size_t ndisks)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    g_autoptr(virHashTable) stats = virHashNew(virHashValueFree);
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    size_t i;
+    int rc;
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm,
+                                       QEMU_ASYNC_JOB_MIGRATION_OUT) < 0)
+        return -1;
+    if (blockdev)
+        rc = qemuMonitorBlockStatsUpdateCapacityBlockdev(priv->mon, stats);
+    else
+        rc = qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats, false);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+        return -1;
+
+    for (i = 0; i < ndisks; i++) {
+        qemuBlockStats *entry;
+
+        if (blockdev)
+            entry = virHashLookup(stats, disks[i]->src->nodeformat);
+        else
+            entry = disks[i]->info.alias ?
+                    virHashLookup(stats, disks[i]->info.alias) : NULL;
+
+        if (entry)
+            QEMU_DOMAIN_DISK_PRIVATE(disks[i])->migrPending = entry->capacity;
+    }
+
+    return 0;
+}
+
+
 /**
  * qemuMigrationSrcNBDStorageCopy:
  * @driver: qemu driver
@@ -985,7 +1132,9 @@ qemuMigrationSrcNBDStorageCopyOne(virQEMUDriverPtr driver,
  * @migrate_flags: migrate monitor command flags
  *
  * Migrate non-shared storage using the NBD protocol to the server running
- * inside the qemu process on dst and wait until the copy converges.
+ * inside the qemu process on dst and wait until the copy converges. At most
+ * migration_max_mirrors disks (from qemu.conf) are copied at the same time,
+ * the next disk is started once another one finishes its initial copy.
  * On success update @migrate_flags so we don't tell 'migrate' command
  * to do the very same operation. On failure, the caller is
  * expected to call qemuMigrationSrcNBDCopyCancel to stop all
@@ -994,7 +1143,7 @@ qemuMigrationSrcNBDStorageCopyOne(virQEMUDriverPtr driver,
  * Returns 0 on success (@migrate_flags updated),
  *        -1 otherwise.
  */
-static int
+int
 qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
                                virDomainObjPtr vm,
                                qemuMigrationCookiePtr mig,
@@ -1008,10 +1157,16 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
                                unsigned int flags)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainMirrorStatsPtr mirrorStats = &priv->job.current->mirrorStats;
     int port;
     size_t i;
     unsigned long long mirror_speed = speed;
     bool mirror_shallow = *migrate_flags & QEMU_MONITOR_MIGRATE_NON_SHARED_INC;
+    g_autofree virDomainDiskDefPtr *disks = NULL;
+    size_t ndisks = 0;
+    size_t started = 0;
+    size_t notReady = 0;
+    size_t limit;
     int rv;
     g_autoptr(virQEMUDriverConfig) cfg = virQEMUDriverGetConfig(driver);
 
@@ -1029,28 +1184,66 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
     port = mig->nbd->port;
     mig->nbd->port = 0;
 
+    disks = g_new0(virDomainDiskDefPtr, vm->def->ndisks);
+
     for (i = 0; i < vm->def->ndisks; i++) {
-        virDomainDiskDefPtr disk = vm->def->disks[i];
+        QEMU_DOMAIN_DISK_PRIVATE(vm->def->disks[i])->migrPending = 0;
 
         /* check whether disk should be migrated */
-        if (!qemuMigrationAnyCopyDisk(disk, nmigrate_disks, migrate_disks))
-            continue;
+        if (qemuMigrationAnyCopyDisk(vm->def->disks[i],
+                                     nmigrate_disks, migrate_disks))
+            disks[ndisks++] = vm->def->disks[i];
+    }
 
-        if (qemuMigrationSrcNBDStorageCopyOne(driver, vm, disk, host, port,
-                                              mirror_speed, mirror_shallow,
-                                              tlsAlias, flags) < 0)
-            return -1;
+    limit = cfg->migrationMaxMirrors;
+    if (limit == 0 || limit > ndisks)
+        limit = ndisks;
 
-        if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0) {
-            VIR_WARN("Failed to save status on vm %s", vm->def->name);
+    if (limit < ndisks) {
+        if (qemuMigrationSrcNBDStorageCopyCapacities(driver, vm,
+                                                     disks, ndisks) < 0)
             return -1;
+
+        /* qemuMigrationSrcFetchMirrorStats stops counting a disk as
+         * pending once its mirror reports how much it has to copy */
+        for (i = 0; i < ndisks; i++) {
+            qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disks[i]);
+
+            mirrorStats->pending += diskPriv->migrPending;
         }
+
+        VIR_DEBUG("Copying %zu disks, at most %zu at a time", ndisks, limit);
     }
 
-    while ((rv = qemuMigrationSrcNBDStorageCopyReady(vm, QEMU_ASYNC_JOB_MIGRATION_OUT)) != 1) {
+    if (virTimeMillisNow(&mirrorStats->started) < 0)
+        return -1;
+
+    while (true) {
+        for (; started < ndisks && notReady < limit; started++, notReady++) {
+            if (qemuMigrationSrcNBDStorageCopyOne(driver, vm, disks[started],
+                                                  host, port,
+                                                  mirror_speed, mirror_shallow,
+                                                  tlsAlias, flags) < 0)
+                return -1;
+
+            if (virDomainObjSave(vm, driver->xmlopt, cfg->stateDir) < 0) {
+                VIR_WARN("Failed to save status on vm %s", vm->def->name);
+                return -1;
+            }
+        }
+
+        rv = qemuMigrationSrcNBDStorageCopyReady(vm, QEMU_ASYNC_JOB_MIGRATION_OUT,
+                                                 &notReady);
         if (rv < 0)
             return -1;
 
+        if (started == ndisks && rv == 1)
+            break;
+
+        /* some mirrors got ready, start copying the next disks */
+        if (started < ndisks && notReady < limit)
+            continue;
+
         if (priv->job.abortJob) {
             priv->job.current->status = QEMU_DOMAIN_JOB_STATUS_CANCELED;
             virReportError(VIR_ERR_OPERATION_ABORTED, _("%s: %s"),
@@ -1497,6 +1690,7 @@ qemuMigrationAnyFetchStats(virQEMUDriverPtr driver,
         return -1;
 
     jobInfo->stats.mig = stats;
+    ignore_value(qemuDomainJobInfoUpdateMigrationPass(jobInfo));
 
     return 0;
 }
@@ -1590,6 +1784,7 @@ enum qemuMigrationCompletedFlags {
     QEMU_MIGRATION_COMPLETED_CHECK_STORAGE  = (1 << 1),
     QEMU_MIGRATION_COMPLETED_POSTCOPY       = (1 << 2),
     QEMU_MIGRATION_COMPLETED_PRE_SWITCHOVER = (1 << 3),
+    QEMU_MIGRATION_COMPLETED_AUTO_TUNE      = (1 << 4),
 };
 
 
@@ -1615,7 +1810,7 @@ qemuMigrationAnyCompleted(virQEMUDriverPtr driver,
 
     /* This flag should only be set when run on src host */
     if (flags & QEMU_MIGRATION_COMPLETED_CHECK_STORAGE &&
-        qemuMigrationSrcNBDStorageCopyReady(vm, asyncJob) < 0)
+        qemuMigrationSrcNBDStorageCopyReady(vm, asyncJob, NULL) < 0)
         goto error;
 
     if (flags & QEMU_MIGRATION_COMPLETED_ABORT_ON_ERROR &&
@@ -1687,6 +1882,244 @@ qemuMigrationAnyCompleted(virQEMUDriverPtr driver,
 }
 
 
+/* Without migration events, QEMU has to be polled for progress. The polling
+ * interval starts at QEMU_MIGRATION_POLL_MIN and doubles after every check
+ * up to QEMU_MIGRATION_POLL_MAX to avoid taking the monitor too often during
+ * long migrations, but it drops back to the minimum once the remaining memory
+ * could be transferred within the current interval so that the end of the
+ * migration is noticed quickly.
+ */
+#define QEMU_MIGRATION_POLL_MIN 50
+#define QEMU_MIGRATION_POLL_MAX 800
+
+static unsigned long long
+qemuMigrationSrcNextPollInterval(qemuDomainJobInfoPtr jobInfo,
+                                 unsigned long long interval)
+{
+    qemuMonitorMigrationStats *stats = &jobInfo->stats.mig;
+
+    if (stats->ram_bps &&
+        stats->ram_remaining * 1000 / stats->ram_bps <= interval)
+        return QEMU_MIGRATION_POLL_MIN;
+
+    return MIN(interval * 2, QEMU_MIGRATION_POLL_MAX);
+}
+
+
+/* QEMU's default downtime-limit, the escalation starts from it when the
+ * limit was set lower (even to 0) */
+#define QEMU_MIGRATION_AUTO_TUNE_MIN_DOWNTIME 300 /* ms */
+#define QEMU_MIGRATION_AUTO_TUNE_MAX_DOWNTIME 2000 /* ms */
+#define QEMU_MIGRATION_AUTO_TUNE_THROTTLE_INITIAL 50
+#define QEMU_MIGRATION_AUTO_TUNE_THROTTLE_INCREMENT 20
+
+/* A memory pass is considered converging if the guest dirtied less than half
+ * of the memory transferred during the pass. */
+static bool
+qemuMigrationSrcAutoTunePassConverging(qemuDomainJobInfoPtr jobInfo,
+                                       qemuDomainMigrationPassPtr pass)
+{
+    unsigned long long pageSize = jobInfo->stats.mig.ram_page_size;
+
+    if (pageSize == 0)
+        pageSize = virGetSystemPageSize();
+
+    return pass->dirtyRate * pageSize * 2 < pass->bps;
+}
+
+
+/**
+ * qemuMigrationSrcAutoTuneStep:
+ *
+ * Takes a single step to make the migration converge.
+ *
+ * Returns 1 if the step was taken, 0 if it cannot be used for the current
+ * migration, and -1 on error.
+ */
+static int
+qemuMigrationSrcAutoTuneStep(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             qemuDomainAsyncJob asyncJob,
+                             virDomainJobAutoTuneAction action)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
+    g_autoptr(qemuMigrationParams) current = NULL;
+    g_autoptr(qemuMigrationParams) migParams = NULL;
+    unsigned long long value;
+    unsigned long long limit;
+    int throttle;
+    int rc;
+
+    switch (action) {
+    case VIR_DOMAIN_JOB_AUTO_TUNE_POSTCOPY:
+        if (!(priv->job.apiFlags & VIR_MIGRATE_POSTCOPY))
+            return 0;
+
+        VIR_INFO("Switching migration of domain %s to post-copy",
+                 vm->def->name);
+
+        if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+            return -1;
+        rc = qemuMonitorMigrateStartPostCopy(priv->mon);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+            return -1;
+        return 1;
+
+    case VIR_DOMAIN_JOB_AUTO_TUNE_THROTTLE:
+        if (!(priv->job.apiFlags & VIR_MIGRATE_AUTO_CONVERGE))
+            return 0;
+        break;
+
+    case VIR_DOMAIN_JOB_AUTO_TUNE_COMPRESSION:
+        /* QEMU reports XBZRLE statistics only when XBZRLE is enabled */
+        if (!jobInfo->stats.mig.xbzrle_set)
+            return 0;
+        break;
+
+    case VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME:
+    case VIR_DOMAIN_JOB_AUTO_TUNE_LAST:
+        break;
+    }
+
+    if (qemuMigrationParamsFetch(driver, vm, asyncJob, &current) < 0 ||
+        !(migParams = qemuMigrationParamsNew()))
+        return -1;
+
+    switch (action) {
+    case VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME:
+        if (qemuMigrationParamsGetULL(current,
+                                      QEMU_MIGRATION_PARAM_DOWNTIME_LIMIT,
+                                      &value) != 0 ||
+            value >= QEMU_MIGRATION_AUTO_TUNE_MAX_DOWNTIME)
+            return 0;
+
+        value = MAX(value, QEMU_MIGRATION_AUTO_TUNE_MIN_DOWNTIME) * 4;
+        value = MIN(value, QEMU_MIGRATION_AUTO_TUNE_MAX_DOWNTIME);
+        VIR_INFO("Raising maximum downtime of domain %s migration to %llu ms",
+                 vm->def->name, value);
+
+        if (qemuMigrationParamsSetULL(migParams,
+                                      QEMU_MIGRATION_PARAM_DOWNTIME_LIMIT,
+                                      value) < 0)
+            return -1;
+        break;
+
+    case VIR_DOMAIN_JOB_AUTO_TUNE_THROTTLE:
+        if (qemuMigrationParamsGetInt(current,
+                                      QEMU_MIGRATION_PARAM_THROTTLE_INCREMENT,
+                                      &throttle) != 0 ||
+            throttle >= QEMU_MIGRATION_AUTO_TUNE_THROTTLE_INCREMENT)
+            return 0;
+
+        VIR_INFO("Raising CPU throttling increment of domain %s to %d%%",
+                 vm->def->name, QEMU_MIGRATION_AUTO_TUNE_THROTTLE_INCREMENT);
+
+        if (qemuMigrationParamsSetInt(migParams,
+                                      QEMU_MIGRATION_PARAM_THROTTLE_INCREMENT,
+                                      QEMU_MIGRATION_AUTO_TUNE_THROTTLE_INCREMENT) < 0)
+            return -1;
+
+        if (qemuMigrationParamsGetInt(current,
+                                      QEMU_MIGRATION_PARAM_THROTTLE_INITIAL,
+                                      &throttle) == 0 &&
+            throttle < QEMU_MIGRATION_AUTO_TUNE_THROTTLE_INITIAL &&
+            qemuMigrationParamsSetInt(migParams,
+                                      QEMU_MIGRATION_PARAM_THROTTLE_INITIAL,
+                                      QEMU_MIGRATION_AUTO_TUNE_THROTTLE_INITIAL) < 0)
+            return -1;
+        break;
+
+    case VIR_DOMAIN_JOB_AUTO_TUNE_COMPRESSION:
+        /* Never let the cache grow over a quarter of guest memory */
+        limit = virDomainDefGetMemoryTotal(vm->def) * 1024 / 4;
+        if (qemuMigrationParamsGetULL(current,
+                                      QEMU_MIGRATION_PARAM_XBZRLE_CACHE_SIZE,
+                                      &value) != 0 ||
+            value == 0 || value * 2 > limit)
+            return 0;
+
+        value *= 2;
+        VIR_INFO("Raising XBZRLE cache size of domain %s migration to %llu bytes",
+                 vm->def->name, value);
+
+        if (qemuMigrationParamsSetULL(migParams,
+                                      QEMU_MIGRATION_PARAM_XBZRLE_CACHE_SIZE,
+                                      value) < 0)
+            return -1;
+        break;
+
+    case VIR_DOMAIN_JOB_AUTO_TUNE_POSTCOPY:
+    case VIR_DOMAIN_JOB_AUTO_TUNE_LAST:
+        return 0;
+    }
+
+    if (qemuMigrationParamsUpdate(driver, vm, asyncJob, migParams) < 0)
+        return -1;
+
+    return 1;
+}
+
+
+/*
+ * Controller for migrations started with VIR_MIGRATE_AUTO_TUNE. When two
+ * consecutive memory passes do not converge, the next available step from
+ * virDomainJobAutoTuneAction is taken. Another step is only considered once
+ * two more passes finished after the previous one so that each step has a
+ * chance to show its effect. The original migration parameters are restored
+ * by qemuMigrationParamsReset once migration finishes.
+ */
+void
+qemuMigrationSrcAutoTune(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm,
+                         qemuDomainAsyncJob asyncJob)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
+    qemuDomainAutoTuneStepPtr step;
+    int action;
+    int rc;
+
+    if (jobInfo->status != QEMU_DOMAIN_JOB_STATUS_MIGRATING ||
+        jobInfo->npasses < 2 ||
+        jobInfo->autoTuneNext >= VIR_DOMAIN_JOB_AUTO_TUNE_LAST)
+        return;
+
+    if (jobInfo->nautoTune > 0 &&
+        jobInfo->passes[jobInfo->npasses - 2].iteration <=
+        jobInfo->autoTune[jobInfo->nautoTune - 1].iteration)
+        return;
+
+    if (qemuMigrationSrcAutoTunePassConverging(jobInfo,
+                                               &jobInfo->passes[jobInfo->npasses - 1]) ||
+        qemuMigrationSrcAutoTunePassConverging(jobInfo,
+                                               &jobInfo->passes[jobInfo->npasses - 2]))
+        return;
+
+    action = MAX(jobInfo->autoTuneNext, VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME);
+    for (; action < VIR_DOMAIN_JOB_AUTO_TUNE_LAST; action++) {
+        if ((rc = qemuMigrationSrcAutoTuneStep(driver, vm, asyncJob, action)) == 0)
+            continue;
+
+        jobInfo->autoTuneNext = action + 1;
+
+        if (rc < 0) {
+            VIR_WARN("Failed to help migration of domain %s converge: %s",
+                     vm->def->name, virGetLastErrorMessage());
+            virResetLastError();
+            return;
+        }
+
+        step = &jobInfo->autoTune[jobInfo->nautoTune++];
+        step->action = action;
+        step->iteration = jobInfo->passIteration;
+        return;
+    }
+
+    jobInfo->autoTuneNext = action;
+}
+
+
 /* Returns 0 on success, -2 when migration needs to be cancelled, or -1 when
  * QEMU reports failed migration.
  */
@@ -1700,6 +2133,8 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = vm->privateData;
     qemuDomainJobInfoPtr jobInfo = priv->job.current;
     bool events = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
+    unsigned long long interval = QEMU_MIGRATION_POLL_MIN;
+    unsigned long long now;
     int rv;
 
     jobInfo->status = QEMU_DOMAIN_JOB_STATUS_MIGRATING;
@@ -1709,19 +2144,40 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
         if (rv < 0)
             return rv;
 
+        if (flags & QEMU_MIGRATION_COMPLETED_AUTO_TUNE)
+            qemuMigrationSrcAutoTune(driver, vm, asyncJob);
+
         if (events) {
             if (virDomainObjWait(vm) < 0) {
                 if (virDomainObjIsActive(vm))
                     jobInfo->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
                 return -2;
             }
+
+            /* Refresh the statistics once per memory pass to keep the pass
+             * history up to date, other wake ups are handled without
+             * talking to QEMU. */
+            if (jobInfo->passEvent > jobInfo->passIteration &&
+                jobInfo->status == QEMU_DOMAIN_JOB_STATUS_MIGRATING)
+                ignore_value(qemuMigrationAnyFetchStats(driver, vm, asyncJob,
+                                                        jobInfo, NULL));
         } else {
-            /* Poll every 50ms for progress & to allow cancellation */
-            struct timespec ts = { .tv_sec = 0, .tv_nsec = 50 * 1000 * 1000ull };
+            /* Sleeping on the domain condition rather than in nanosleep
+             * lets qemuDomainAbortJobMigration wake us up as soon as it
+             * cancelled the migration. */
+            if (virTimeMillisNow(&now) < 0)
+                return -2;
+
+            if (virDomainObjWaitUntil(vm, now + interval) < 0) {
+                if (virDomainObjIsActive(vm))
+                    jobInfo->status = QEMU_DOMAIN_JOB_STATUS_FAILED;
+                return -2;
+            }
 
-            virObjectUnlock(vm);
-            nanosleep(&ts, NULL);
-            virObjectLock(vm);
+            if (priv->job.abortJob)
+                interval = QEMU_MIGRATION_POLL_MIN;
+            else
+                interval = qemuMigrationSrcNextPollInterval(jobInfo, interval);
         }
     }
 
@@ -2291,6 +2747,30 @@ qemuMigrationDstPrepareCleanup(virQEMUDriverPtr driver,
     qemuDomainObjDiscardAsyncJob(driver, vm);
 }
 
+/* The pipes between QEMU and the migration tunnel are much larger
+ * than the default 64 KiB so that QEMU can keep producing migration
+ * data while the tunnel is busy pushing the previous chunk through
+ * the RPC connection (and vice versa on the destination). */
+#define TUNNEL_PIPE_SIZE (4 * 1024 * 1024)
+
+#ifdef F_SETPIPE_SZ
+static void
+qemuMigrationTunnelSetPipeSize(int fd)
+{
+    /* Best effort, the kernel caps the size by fs.pipe-max-size for
+     * processes without CAP_SYS_RESOURCE */
+    if (fcntl(fd, F_SETPIPE_SZ, TUNNEL_PIPE_SIZE) < 0)
+        VIR_DEBUG("Unable to resize migration tunnel pipe: %s",
+                  g_strerror(errno));
+}
+#else /* !F_SETPIPE_SZ */
+static void
+qemuMigrationTunnelSetPipeSize(int fd G_GNUC_UNUSED)
+{
+}
+#endif /* !F_SETPIPE_SZ */
+
+
 static qemuProcessIncomingDefPtr
 qemuMigrationDstPrepare(virDomainObjPtr vm,
                         bool tunnel,
@@ -2536,9 +3016,11 @@ qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
     if (flags & VIR_MIGRATE_OFFLINE)
         goto done;
 
-    if (tunnel &&
-        virPipe(dataFD) < 0)
-        goto stopjob;
+    if (tunnel) {
+        if (virPipe(dataFD) < 0)
+            goto stopjob;
+        qemuMigrationTunnelSetPipeSize(dataFD[1]);
+    }
 
     startFlags = VIR_QEMU_PROCESS_START_AUTODESTROY;
 
@@ -3153,7 +3635,10 @@ struct _qemuMigrationSpec {
     } fwd;
 };
 
-#define TUNNEL_SEND_BUF_SIZE 65536
+/* Each chunk read from QEMU is sent as one stream packet, so it must
+ * not exceed the largest payload an older peer accepts in a packet
+ * (VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX) */
+#define TUNNEL_SEND_BUF_SIZE (256 * 1024 - 24)
 
 typedef struct _qemuMigrationIOThread qemuMigrationIOThread;
 typedef qemuMigrationIOThread *qemuMigrationIOThreadPtr;
@@ -3229,7 +3714,11 @@ static void qemuMigrationSrcIOFunc(void *arg)
         if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
             int nbytes;
 
-            nbytes = saferead(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
+            /* Send whatever is available rather than waiting for
+             * the whole buffer to be filled */
+            nbytes = read(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
+            if (nbytes < 0 && errno == EINTR)
+                continue;
             if (nbytes > 0) {
                 if (virStreamSend(data->st, buffer, nbytes) < 0)
                     goto error;
@@ -3689,6 +4178,8 @@ qemuMigrationSrcRun(virQEMUDriverPtr driver,
         waitFlags |= QEMU_MIGRATION_COMPLETED_CHECK_STORAGE;
     if (flags & VIR_MIGRATE_POSTCOPY)
         waitFlags |= QEMU_MIGRATION_COMPLETED_POSTCOPY;
+    if (flags & VIR_MIGRATE_AUTO_TUNE)
+        waitFlags |= QEMU_MIGRATION_COMPLETED_AUTO_TUNE;
 
     rc = qemuMigrationSrcWaitForCompletion(driver, vm,
                                            QEMU_ASYNC_JOB_MIGRATION_OUT,
@@ -3922,7 +4413,6 @@ qemuMigrationSrcPerformTunnel(virQEMUDriverPtr driver,
     spec.fwdType = MIGRATION_FWD_STREAM;
     spec.fwd.stream = st;
 
-
     spec.destType = MIGRATION_DEST_FD;
     spec.dest.fd.qemu = -1;
     spec.dest.fd.local = -1;
@@ -3932,6 +4422,7 @@ qemuMigrationSrcPerformTunnel(virQEMUDriverPtr driver,
 
     spec.dest.fd.qemu = fds[1];
     spec.dest.fd.local = fds[0];
+    qemuMigrationTunnelSetPipeSize(fds[0]);
 
     if (spec.dest.fd.qemu == -1 ||
         qemuSecuritySetImageFDLabel(driver->securityManager, vm->def,
@@ -5594,6 +6085,7 @@ qemuMigrationSrcFetchMirrorStats(virQEMUDriverPtr driver,
     bool nbd = false;
     virHashTablePtr blockinfo = NULL;
     qemuDomainMirrorStatsPtr stats = &jobInfo->mirrorStats;
+    unsigned long long now;
 
     for (i = 0; i < vm->def->ndisks; i++) {
         virDomainDiskDefPtr disk = vm->def->disks[i];
@@ -5614,15 +6106,26 @@ qemuMigrationSrcFetchMirrorStats(virQEMUDriverPtr driver,
     if (qemuDomainObjExitMonitor(driver, vm) < 0 || !blockinfo)
         return -1;
 
-    memset(stats, 0, sizeof(*stats));
+    stats->transferred = 0;
+    stats->total = 0;
+    stats->pending = 0;
 
     for (i = 0; i < vm->def->ndisks; i++) {
         virDomainDiskDefPtr disk = vm->def->disks[i];
         qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
-        qemuMonitorBlockJobInfoPtr data;
+        qemuMonitorBlockJobInfoPtr data = NULL;
+
+        if (diskPriv->migrating)
+            data = virHashLookup(blockinfo, disk->info.alias);
 
-        if (!diskPriv->migrating ||
-            !(data = virHashLookup(blockinfo, disk->info.alias)))
+        /* A mirror which has just been started doesn't know the size of
+         * the copy yet, keep counting the whole disk as pending until it
+         * does so that the total doesn't drop in the meantime. */
+        if (data && data->end > 0)
+            diskPriv->migrPending = 0;
+        stats->pending += diskPriv->migrPending;
+
+        if (!data)
             continue;
 
         stats->transferred += data->cur;
@@ -5630,5 +6133,11 @@ qemuMigrationSrcFetchMirrorStats(virQEMUDriverPtr driver,
     }
 
     virHashFree(blockinfo);
+
+    if (stats->started &&
+        virTimeMillisNow(&now) == 0 &&
+        now > stats->started)
+        stats->bps = stats->transferred * 1000 / (now - stats->started);
+
     return 0;
 }
@@ -817,6 +817,52 @@ qemuMigrationCapsToJSON(virBitmapPtr caps,
 }
 
 
+/* Sends parameters stored in @migParams to QEMU, the caller has to enter the
+ * monitor first. */
+static int
+qemuMigrationParamsApplyValues(virDomainObjPtr vm,
+                               qemuMigrationParamsPtr migParams)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool xbzrleCacheSize_old = false;
+    g_autoptr(virJSONValue) params = NULL;
+    qemuMigrationParam xbzrle = QEMU_MIGRATION_PARAM_XBZRLE_CACHE_SIZE;
+    int ret = -1;
+    int rc;
+
+    /* If QEMU is too old to support xbzrle-cache-size migration parameter,
+     * we need to set it via migrate-set-cache-size and tell
+     * qemuMonitorSetMigrationParams to ignore this parameter.
+     */
+    if (migParams->params[xbzrle].set &&
+        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_PARAM_XBZRLE_CACHE_SIZE)) {
+        if (qemuMonitorSetMigrationCacheSize(priv->mon,
+                                             migParams->params[xbzrle].value.ull) < 0)
+            goto cleanup;
+        xbzrleCacheSize_old = true;
+        migParams->params[xbzrle].set = false;
+    }
+
+    if (!(params = qemuMigrationParamsToJSON(migParams)))
+        goto cleanup;
+
+    if (virJSONValueObjectKeysNumber(params) > 0) {
+        rc = qemuMonitorSetMigrationParams(priv->mon, params);
+        params = NULL;
+        if (rc < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (xbzrleCacheSize_old)
+        migParams->params[xbzrle].set = true;
+
+    return ret;
+}
+
+
 /**
  * qemuMigrationParamsApply
  * @driver: qemu driver
@@ -835,10 +881,7 @@ qemuMigrationParamsApply(virQEMUDriverPtr driver,
                          qemuMigrationParamsPtr migParams)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
-    bool xbzrleCacheSize_old = false;
-    g_autoptr(virJSONValue) params = NULL;
     g_autoptr(virJSONValue) caps = NULL;
-    qemuMigrationParam xbzrle = QEMU_MIGRATION_PARAM_XBZRLE_CACHE_SIZE;
     int ret = -1;
     int rc;
 
@@ -864,37 +907,47 @@ qemuMigrationParamsApply(virQEMUDriverPtr driver,
         }
     }
 
-    /* If QEMU is too old to support xbzrle-cache-size migration parameter,
-     * we need to set it via migrate-set-cache-size and tell
-     * qemuMonitorSetMigrationParams to ignore this parameter.
-     */
-    if (migParams->params[xbzrle].set &&
-        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_PARAM_XBZRLE_CACHE_SIZE)) {
-        if (qemuMonitorSetMigrationCacheSize(priv->mon,
-                                             migParams->params[xbzrle].value.ull) < 0)
-            goto cleanup;
-        xbzrleCacheSize_old = true;
-        migParams->params[xbzrle].set = false;
-    }
-
-    if (!(params = qemuMigrationParamsToJSON(migParams)))
+    if (qemuMigrationParamsApplyValues(vm, migParams) < 0)
         goto cleanup;
 
-    if (virJSONValueObjectKeysNumber(params) > 0) {
-        rc = qemuMonitorSetMigrationParams(priv->mon, params);
-        params = NULL;
-        if (rc < 0)
-            goto cleanup;
-    }
-
     ret = 0;
 
  cleanup:
     if (qemuDomainObjExitMonitor(driver, vm) < 0)
         ret = -1;
 
-    if (xbzrleCacheSize_old)
-        migParams->params[xbzrle].set = true;
+    return ret;
+}
+
+
+/**
+ * qemuMigrationParamsUpdate
+ * @driver: qemu driver
+ * @vm: domain object
+ * @asyncJob: migration job
+ * @migParams: migration parameters to send to QEMU
+ *
+ * Send parameters stored in @migParams to QEMU while migration is already
+ * running. Unlike qemuMigrationParamsApply, migration capabilities are left
+ * untouched since QEMU does not allow them to be changed at this point.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+qemuMigrationParamsUpdate(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm,
+                          int asyncJob,
+                          qemuMigrationParamsPtr migParams)
+{
+    int ret;
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return -1;
+
+    ret = qemuMigrationParamsApplyValues(vm, migParams);
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
 
     return ret;
 }
@@ -1134,6 +1187,41 @@ qemuMigrationParamsGetULL(qemuMigrationParamsPtr migParams,
 }
 
 
+int
+qemuMigrationParamsSetInt(qemuMigrationParamsPtr migParams,
+                          qemuMigrationParam param,
+                          int value)
+{
+    if (qemuMigrationParamsCheckType(param, QEMU_MIGRATION_PARAM_TYPE_INT) < 0)
+        return -1;
+
+    migParams->params[param].value.i = value;
+    migParams->params[param].set = true;
+    return 0;
+}
+
+
+/**
+ * Returns -1 on error,
+ *          0 on success,
+ *          1 if the parameter is not supported by QEMU.
+ */
+int
+qemuMigrationParamsGetInt(qemuMigrationParamsPtr migParams,
+                          qemuMigrationParam param,
+                          int *value)
+{
+    if (qemuMigrationParamsCheckType(param, QEMU_MIGRATION_PARAM_TYPE_INT) < 0)
+        return -1;
+
+    if (!migParams->params[param].set)
+        return 1;
+
+    *value = migParams->params[param].value.i;
+    return 0;
+}
+
+
 /**
  * qemuMigrationParamsCheck:
  *
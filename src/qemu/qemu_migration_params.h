@@ -100,6 +100,12 @@ qemuMigrationParamsApply(virQEMUDriverPtr driver,
                          int asyncJob,
                          qemuMigrationParamsPtr migParams);
 
+int
+qemuMigrationParamsUpdate(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm,
+                          int asyncJob,
+                          qemuMigrationParamsPtr migParams);
+
 int
 qemuMigrationParamsEnableTLS(virQEMUDriverPtr driver,
                              virDomainObjPtr vm,
@@ -129,6 +135,16 @@ qemuMigrationParamsGetULL(qemuMigrationParamsPtr migParams,
                           qemuMigrationParam param,
                           unsigned long long *value);
 
+int
+qemuMigrationParamsSetInt(qemuMigrationParamsPtr migParams,
+                          qemuMigrationParam param,
+                          int value);
+
+int
+qemuMigrationParamsGetInt(qemuMigrationParamsPtr migParams,
+                          qemuMigrationParam param,
+                          int *value);
+
 int
 qemuMigrationParamsCheck(virQEMUDriverPtr driver,
                          virDomainObjPtr vm,
@@ -0,0 +1,52 @@
+/*
+ * qemu_migrationpriv.h: private declarations for migration handling
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+# error "qemu_migrationpriv.h may only be included by qemu_migration.c or test suites"
+#endif /* LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW */
+
+#pragma once
+
+#include "qemu_domain.h"
+#include "qemu_migration_cookie.h"
+
+void
+qemuMigrationSrcAutoTune(virQEMUDriverPtr driver,
+                         virDomainObjPtr vm,
+                         qemuDomainAsyncJob asyncJob);
+
+int
+qemuMigrationDstPrecreateStorage(virDomainObjPtr vm,
+                                 qemuMigrationCookieNBDPtr nbd,
+                                 size_t nmigrate_disks,
+                                 const char **migrate_disks,
+                                 bool incremental);
+
+int
+qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm,
+                               qemuMigrationCookiePtr mig,
+                               const char *host,
+                               unsigned long speed,
+                               unsigned int *migrate_flags,
+                               size_t nmigrate_disks,
+                               const char **migrate_disks,
+                               virConnectPtr dconn,
+                               const char *tlsAlias,
+                               unsigned int flags);
@@ -83,9 +83,11 @@ struct _qemuMonitor {
     qemuMonitorCallbacksPtr cb;
     void *callbackOpaque;
 
-    /* If there's a command being processed this will be
-     * non-NULL */
-    qemuMonitorMessagePtr msg;
+    /* Commands being processed in the order they were submitted. They are
+     * transmitted one after another without waiting for the replies which
+     * are matched to the commands by their "id". */
+    qemuMonitorMessagePtr *msgs;
+    size_t nmsgs;
 
     /* Buffer incoming data ready for Text/QMP monitor
      * code to process & find message boundaries */
@@ -232,6 +234,7 @@ qemuMonitorDispose(void *obj)
     virResetError(&mon->lastError);
     virCondDestroy(&mon->notify);
     VIR_FREE(mon->buffer);
+    VIR_FREE(mon->msgs);
     virJSONValueFree(mon->options);
     VIR_FREE(mon->balloonpath);
 }
@@ -305,6 +308,110 @@ qemuMonitorOpenUnix(const char *monitor,
 }
 
 
+/* Returns the first message which was not fully transmitted yet */
+static qemuMonitorMessagePtr
+qemuMonitorGetTxMessage(qemuMonitorPtr mon)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        if (mon->msgs[i]->txOffset < mon->msgs[i]->txLength)
+            return mon->msgs[i];
+    }
+
+    return NULL;
+}
+
+
+/**
+ * qemuMonitorGetPendingReply:
+ * @mon: monitor object
+ *
+ * Returns the oldest message which was fully transmitted and still waits for
+ * its reply, or NULL if there's no such message. Call this function while
+ * holding the monitor lock.
+ */
+qemuMonitorMessagePtr
+qemuMonitorGetPendingReply(qemuMonitorPtr mon)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        qemuMonitorMessagePtr msg = mon->msgs[i];
+
+        if (msg->txOffset < msg->txLength)
+            break;
+
+        if (!msg->finished)
+            return msg;
+    }
+
+    return NULL;
+}
+
+
+/**
+ * qemuMonitorFindPendingReply:
+ * @mon: monitor object
+ * @id: id of the command
+ *
+ * Returns the transmitted message with @id still waiting for its reply, or
+ * NULL if there's no such message. Call this function while holding the
+ * monitor lock.
+ */
+qemuMonitorMessagePtr
+qemuMonitorFindPendingReply(qemuMonitorPtr mon,
+                            const char *id)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        qemuMonitorMessagePtr msg = mon->msgs[i];
+
+        if (msg->txOffset < msg->txLength)
+            break;
+
+        if (!msg->finished && STREQ_NULLABLE(msg->id, id))
+            return msg;
+    }
+
+    return NULL;
+}
+
+
+/* Marks all pending messages as finished, e.g. after a fatal error. Returns
+ * true if any message was affected. */
+static bool
+qemuMonitorFinishAllMessages(qemuMonitorPtr mon)
+{
+    bool ret = false;
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        if (!mon->msgs[i]->finished) {
+            mon->msgs[i]->finished = true;
+            ret = true;
+        }
+    }
+
+    return ret;
+}
+
+
+static bool
+qemuMonitorHasFinishedMessage(qemuMonitorPtr mon)
+{
+    size_t i;
+
+    for (i = 0; i < mon->nmsgs; i++) {
+        if (mon->msgs[i]->finished)
+            return true;
+    }
+
+    return false;
+}
+
+
 /* This method processes data that has been received
  * from the monitor. Looking for async events and
  * replies/errors.
@@ -313,18 +420,15 @@ static int
 qemuMonitorIOProcess(qemuMonitorPtr mon)
 {
     int len;
-    qemuMonitorMessagePtr msg = NULL;
-
-    /* See if there's a message & whether its ready for its reply
-     * ie whether its completed writing all its data */
-    if (mon->msg && mon->msg->txOffset == mon->msg->txLength)
-        msg = mon->msg;
+#if DEBUG_IO && DEBUG_RAW_IO
+    qemuMonitorMessagePtr msg = qemuMonitorGetPendingReply(mon);
+#endif
 
 #if DEBUG_IO
 # if DEBUG_RAW_IO
     char *str1 = qemuMonitorEscapeNonPrintable(msg ? msg->txBuffer : "");
     char *str2 = qemuMonitorEscapeNonPrintable(mon->buffer);
-    VIR_ERROR(_("Process %d %p %p [[[[%s]]][[[%s]]]"), (int)mon->bufferOffset, mon->msg, msg, str1, str2);
+    VIR_ERROR(_("Process %d %p [[[[%s]]][[[%s]]]"), (int)mon->bufferOffset, msg, str1, str2);
     VIR_FREE(str1);
     VIR_FREE(str2);
 # else
@@ -336,8 +440,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
                 mon, mon->buffer, mon->bufferOffset);
 
     len = qemuMonitorJSONIOProcess(mon,
-                                   mon->buffer, mon->bufferOffset,
-                                   msg);
+                                   mon->buffer, mon->bufferOffset);
     if (len < 0)
         return -1;
 
@@ -355,10 +458,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
     VIR_DEBUG("Process done %d used %d", (int)mon->bufferOffset, len);
 #endif
 
-    /* As the monitor mutex was unlocked in qemuMonitorJSONIOProcess()
-     * while dealing with qemu event, mon->msg could be changed which
-     * means the above 'msg' may be invalid, thus we use 'mon->msg' here */
-    if (mon->msg && mon->msg->finished)
+    if (qemuMonitorHasFinishedMessage(mon))
         virCondBroadcast(&mon->notify);
     return len;
 }
@@ -416,26 +516,27 @@ qemuMonitorIOWrite(qemuMonitorPtr mon)
     int done;
     char *buf;
     size_t len;
+    qemuMonitorMessagePtr msg;
 
-    /* If no active message, or fully transmitted, the no-op */
-    if (!mon->msg || mon->msg->txOffset == mon->msg->txLength)
+    /* If no message is waiting to be transmitted, the no-op */
+    if (!(msg = qemuMonitorGetTxMessage(mon)))
         return 0;
 
-    buf = mon->msg->txBuffer + mon->msg->txOffset;
-    len = mon->msg->txLength - mon->msg->txOffset;
-    if (mon->msg->txFD == -1)
+    buf = msg->txBuffer + msg->txOffset;
+    len = msg->txLength - msg->txOffset;
+    if (msg->txFD == -1)
         done = write(mon->fd, buf, len);
     else
-        done = qemuMonitorIOWriteWithFD(mon, buf, len, mon->msg->txFD);
+        done = qemuMonitorIOWriteWithFD(mon, buf, len, msg->txFD);
 
     PROBE(QEMU_MONITOR_IO_WRITE,
           "mon=%p buf=%s len=%zu ret=%d errno=%d",
           mon, buf, len, done, done < 0 ? errno : 0);
 
-    if (mon->msg->txFD != -1) {
+    if (msg->txFD != -1) {
         PROBE(QEMU_MONITOR_IO_SEND_FD,
               "mon=%p fd=%d ret=%d errno=%d",
-              mon, mon->msg->txFD, done, done < 0 ? errno : 0);
+              mon, msg->txFD, done, done < 0 ? errno : 0);
     }
 
     if (done < 0) {
@@ -446,7 +547,7 @@ qemuMonitorIOWrite(qemuMonitorPtr mon)
                              _("Unable to write to monitor"));
         return -1;
     }
-    mon->msg->txOffset += done;
+    msg->txOffset += done;
     return done;
 }
 
@@ -616,12 +717,10 @@ qemuMonitorIO(GSocket *socket G_GNUC_UNUSED,
         }
 
         VIR_DEBUG("Error on monitor %s", NULLSTR(mon->lastError.message));
-        /* If IO process resulted in an error & we have a message,
-         * then wakeup that waiter */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = true;
-            virCondSignal(&mon->notify);
-        }
+        /* If IO process resulted in an error & we have messages,
+         * then wakeup the waiter */
+        if (qemuMonitorFinishAllMessages(mon))
+            virCondBroadcast(&mon->notify);
     }
 
     qemuMonitorUpdateWatch(mon);
@@ -826,8 +925,7 @@ qemuMonitorRegister(qemuMonitorPtr mon)
     if (mon->lastError.code == VIR_ERR_OK) {
         cond |= G_IO_IN;
 
-        if ((mon->msg && mon->msg->txOffset < mon->msg->txLength) &&
-            !mon->waitGreeting)
+        if (qemuMonitorGetTxMessage(mon) && !mon->waitGreeting)
             cond |= G_IO_OUT;
     }
 
@@ -877,7 +975,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
     /* In case another thread is waiting for its monitor command to be
      * processed, we need to wake it up with appropriate error set.
      */
-    if (mon->msg) {
+    if (mon->nmsgs > 0) {
         if (mon->lastError.code == VIR_ERR_OK) {
             virErrorPtr err;
 
@@ -891,8 +989,8 @@ qemuMonitorClose(qemuMonitorPtr mon)
             else
                 virResetLastError();
         }
-        mon->msg->finished = true;
-        virCondSignal(&mon->notify);
+        qemuMonitorFinishAllMessages(mon);
+        virCondBroadcast(&mon->notify);
     }
 
     /* Propagate existing monitor error in case the current thread has no
@@ -927,8 +1025,45 @@ qemuMonitorResetCommandID(qemuMonitorPtr mon)
 int
 qemuMonitorSend(qemuMonitorPtr mon,
                 qemuMonitorMessagePtr msg)
+{
+    return qemuMonitorSendBatch(mon, &msg, 1);
+}
+
+
+static bool
+qemuMonitorBatchFinished(qemuMonitorMessagePtr *msgs,
+                         size_t nmsgs)
+{
+    size_t i;
+
+    for (i = 0; i < nmsgs; i++) {
+        if (!msgs[i]->finished)
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * qemuMonitorSendBatch:
+ * @mon: monitor object
+ * @msgs: messages to send
+ * @nmsgs: number of messages in @msgs
+ *
+ * Queues all of @msgs for transmission at once and waits until replies to
+ * all of them are received. The commands are sent back to back so that
+ * processing of the whole batch takes roughly one round trip to qemu.
+ *
+ * Returns 0 if all the replies were received, -1 if the monitor failed.
+ */
+int
+qemuMonitorSendBatch(qemuMonitorPtr mon,
+                     qemuMonitorMessagePtr *msgs,
+                     size_t nmsgs)
 {
     int ret = -1;
+    size_t i;
 
     /* Check whether qemu quit unexpectedly */
     if (mon->lastError.code != VIR_ERR_OK) {
@@ -938,14 +1073,18 @@ qemuMonitorSend(qemuMonitorPtr mon,
         return -1;
     }
 
-    mon->msg = msg;
-    qemuMonitorUpdateWatch(mon);
+    for (i = 0; i < nmsgs; i++) {
+        if (VIR_APPEND_ELEMENT_COPY(mon->msgs, mon->nmsgs, msgs[i]) < 0)
+            goto cleanup;
 
-    PROBE(QEMU_MONITOR_SEND_MSG,
-          "mon=%p msg=%s fd=%d",
-          mon, mon->msg->txBuffer, mon->msg->txFD);
+        PROBE(QEMU_MONITOR_SEND_MSG,
+              "mon=%p msg=%s fd=%d",
+              mon, msgs[i]->txBuffer, msgs[i]->txFD);
+    }
 
-    while (!mon->msg->finished) {
+    qemuMonitorUpdateWatch(mon);
+
+    while (!qemuMonitorBatchFinished(msgs, nmsgs)) {
         if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Unable to wait on monitor condition"));
@@ -963,7 +1102,16 @@ qemuMonitorSend(qemuMonitorPtr mon,
     ret = 0;
 
  cleanup:
-    mon->msg = NULL;
+    for (i = 0; i < nmsgs; i++) {
+        size_t j;
+
+        for (j = 0; j < mon->nmsgs; j++) {
+            if (mon->msgs[j] == msgs[i]) {
+                VIR_DELETE_ELEMENT(mon->msgs, j, mon->nmsgs);
+                break;
+            }
+        }
+    }
     qemuMonitorUpdateWatch(mon);
 
     return ret;
@@ -2157,6 +2305,59 @@ qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorGetAllBlockStatsCapacity:
+ * @mon: monitor object
+ * @ret_stats: filled with a hash table of qemuBlockStats
+ * @backingChain: collect stats of the backing chain
+ * @blockdev: the VM uses -blockdev
+ * @capacityErr: set to true if the capacity data couldn't be fetched
+ * @nodedata: optionally filled with the reply of query-named-block-nodes
+ *
+ * Equivalent of qemuMonitorGetAllBlockStatsInfo followed by
+ * qemuMonitorBlockStatsUpdateCapacityBlockdev (or
+ * qemuMonitorBlockStatsUpdateCapacity) and, if @nodedata is not NULL,
+ * qemuMonitorQueryNamedBlockNodes but issuing all the commands at once.
+ * @nodedata is left NULL if the node data couldn't be fetched.
+ *
+ * This covers the monitor queries of the block stats group only; the
+ * other stats groups still issue their own commands.
+ */
+int
+qemuMonitorGetAllBlockStatsCapacity(qemuMonitorPtr mon,
+                                    virHashTablePtr *ret_stats,
+                                    bool backingChain,
+                                    bool blockdev,
+                                    bool *capacityErr,
+                                    virJSONValuePtr *nodedata)
+{
+    int ret = -1;
+    VIR_DEBUG("ret_stats=%p, backing=%d, blockdev=%d, nodedata=%p",
+              ret_stats, backingChain, blockdev, nodedata);
+
+    *capacityErr = true;
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (!(*ret_stats = virHashCreate(10, virHashValueFree)))
+        goto error;
+
+    ret = qemuMonitorJSONGetAllBlockStatsCapacity(mon, *ret_stats,
+                                                  backingChain, blockdev,
+                                                  capacityErr, nodedata);
+
+    if (ret < 0)
+        goto error;
+
+    return ret;
+
+ error:
+    virHashFree(*ret_stats);
+    *ret_stats = NULL;
+    return -1;
+}
+
+
 /* Updates "stats" to fill virtual and physical size of the image */
 int
 qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
@@ -3800,6 +4001,36 @@ qemuMonitorGetObjectProps(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorGetDevicePropsBatch(qemuMonitorPtr mon,
+                               const char **devices,
+                               size_t ndevices,
+                               virHashTablePtr *props)
+{
+    VIR_DEBUG("ndevices=%zu", ndevices);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONGetDevicePropsBatch(mon, devices, ndevices, props);
+}
+
+
+int
+qemuMonitorGetObjectPropsBatch(qemuMonitorPtr mon,
+                               const char **objects,
+                               size_t nobjects,
+                               char ***props,
+                               int *nprops)
+{
+    VIR_DEBUG("nobjects=%zu", nobjects);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONGetObjectPropsBatch(mon, objects, nobjects,
+                                              props, nprops);
+}
+
+
 char *
 qemuMonitorGetTargetArch(qemuMonitorPtr mon)
 {
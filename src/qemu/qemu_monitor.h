@@ -39,9 +39,25 @@ typedef qemuMonitor *qemuMonitorPtr;
 typedef struct _qemuMonitorMessage qemuMonitorMessage;
 typedef qemuMonitorMessage *qemuMonitorMessagePtr;
 
+typedef struct _qemuMonitorReplyDecoder qemuMonitorReplyDecoder;
+typedef qemuMonitorReplyDecoder *qemuMonitorReplyDecoderPtr;
+
+/* Decodes the contents of the "return" member of a successful reply while
+ * it's being parsed. The callbacks must stop the parser on anything they
+ * don't understand so that the reply is processed the usual way. */
+struct _qemuMonitorReplyDecoder {
+    const virJSONStreamCallbacks *callbacks;
+    /* discards partially decoded data after the parser was stopped */
+    void (*reset)(void *opaque);
+    void *opaque;
+};
+
 struct _qemuMonitorMessage {
     int txFD;
 
+    /* "id" of the command used to match the reply, may be NULL */
+    const char *id;
+
     char *txBuffer;
     int txOffset;
     int txLength;
@@ -51,6 +67,10 @@ struct _qemuMonitorMessage {
     int rxLength;
     /* Used by the JSON monitor to hold reply / error */
     void *rxObject;
+    /* Optionally used by the JSON monitor to decode the reply without
+     * building rxObject; rxDecoded is true if the decoder consumed it */
+    qemuMonitorReplyDecoderPtr rxDecoder;
+    bool rxDecoded;
 
     /* True if rxBuffer / rxObject are ready, or a
      * fatal error occurred on the monitor channel
@@ -409,6 +429,12 @@ int qemuMonitorSetLink(qemuMonitorPtr mon,
 char *qemuMonitorNextCommandID(qemuMonitorPtr mon);
 int qemuMonitorSend(qemuMonitorPtr mon,
                     qemuMonitorMessagePtr msg);
+int qemuMonitorSendBatch(qemuMonitorPtr mon,
+                         qemuMonitorMessagePtr *msgs,
+                         size_t nmsgs);
+qemuMonitorMessagePtr qemuMonitorGetPendingReply(qemuMonitorPtr mon);
+qemuMonitorMessagePtr qemuMonitorFindPendingReply(qemuMonitorPtr mon,
+                                                  const char *id);
 virJSONValuePtr qemuMonitorGetOptions(qemuMonitorPtr mon)
     ATTRIBUTE_NONNULL(1);
 void qemuMonitorSetOptions(qemuMonitorPtr mon, virJSONValuePtr options)
@@ -666,6 +692,14 @@ int qemuMonitorGetAllBlockStatsInfo(qemuMonitorPtr mon,
                                     bool backingChain)
     ATTRIBUTE_NONNULL(2);
 
+int qemuMonitorGetAllBlockStatsCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr *ret_stats,
+                                        bool backingChain,
+                                        bool blockdev,
+                                        bool *capacityErr,
+                                        virJSONValuePtr *nodedata)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(5);
+
 int qemuMonitorBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                         virHashTablePtr stats,
                                         bool backingChain)
@@ -1212,6 +1246,15 @@ virHashTablePtr qemuMonitorGetDeviceProps(qemuMonitorPtr mon,
 int qemuMonitorGetObjectProps(qemuMonitorPtr mon,
                               const char *object,
                               char ***props);
+int qemuMonitorGetDevicePropsBatch(qemuMonitorPtr mon,
+                                   const char **devices,
+                                   size_t ndevices,
+                                   virHashTablePtr *props);
+int qemuMonitorGetObjectPropsBatch(qemuMonitorPtr mon,
+                                   const char **objects,
+                                   size_t nobjects,
+                                   char ***props,
+                                   int *nprops);
 char *qemuMonitorGetTargetArch(qemuMonitorPtr mon);
 
 int qemuMonitorNBDServerStart(qemuMonitorPtr mon,
@@ -209,6 +209,139 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
     return 0;
 }
 
+/* Wraps a qemuMonitorReplyDecoder and passes it only the contents of the
+ * "return" member of the reply. Anything else (events, errors, greeting)
+ * stops the parser so that the line is processed as a virJSONValue tree. */
+typedef struct _qemuMonitorJSONReplyEnvelope qemuMonitorJSONReplyEnvelope;
+typedef qemuMonitorJSONReplyEnvelope *qemuMonitorJSONReplyEnvelopePtr;
+struct _qemuMonitorJSONReplyEnvelope {
+    qemuMonitorPtr mon;
+    qemuMonitorReplyDecoderPtr decoder;
+    const char *id;
+    size_t depth;
+    bool haveReturn;
+};
+
+
+static int
+qemuMonitorJSONReplyEnvelopeValue(void *opaque,
+                                  const char *key,
+                                  virJSONType type,
+                                  const char *val)
+{
+    qemuMonitorJSONReplyEnvelopePtr env = opaque;
+
+    switch (env->depth) {
+    case 0:
+        return 1;
+
+    case 1:
+        /* the only scalar member of a reply we expect is the id, which
+         * must not belong to a different command in flight */
+        if (!STREQ_NULLABLE(key, "id"))
+            return 1;
+
+        if (env->id && STRNEQ_NULLABLE(val, env->id) &&
+            qemuMonitorFindPendingReply(env->mon, val))
+            return 1;
+
+        return 0;
+
+    default:
+        return env->decoder->callbacks->value(env->decoder->opaque,
+                                              key, type, val);
+    }
+}
+
+
+static int
+qemuMonitorJSONReplyEnvelopeStart(void *opaque,
+                                  const char *key,
+                                  virJSONType type)
+{
+    qemuMonitorJSONReplyEnvelopePtr env = opaque;
+
+    switch (env->depth) {
+    case 0:
+        if (type != VIR_JSON_TYPE_OBJECT)
+            return 1;
+        break;
+
+    case 1:
+        if (!STREQ_NULLABLE(key, "return") || env->haveReturn)
+            return 1;
+        env->haveReturn = true;
+        G_GNUC_FALLTHROUGH;
+
+    default:
+        if (env->decoder->callbacks->startContainer(env->decoder->opaque,
+                                                    key, type) != 0)
+            return 1;
+    }
+
+    env->depth++;
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONReplyEnvelopeEnd(void *opaque,
+                                virJSONType type)
+{
+    qemuMonitorJSONReplyEnvelopePtr env = opaque;
+
+    if (--env->depth == 0)
+        return env->haveReturn ? 0 : 1;
+
+    return env->decoder->callbacks->endContainer(env->decoder->opaque, type);
+}
+
+
+static const virJSONStreamCallbacks qemuMonitorJSONReplyEnvelopeCallbacks = {
+    .value = qemuMonitorJSONReplyEnvelopeValue,
+    .startContainer = qemuMonitorJSONReplyEnvelopeStart,
+    .endContainer = qemuMonitorJSONReplyEnvelopeEnd,
+};
+
+
+/**
+ * qemuMonitorJSONIOProcessLineDecode:
+ * @mon: monitor object
+ * @line: line received from the monitor
+ * @msg: message waiting for a reply
+ *
+ * Feeds @line to the reply decoder of @msg. Returns 1 if the decoder
+ * consumed the line as the reply of @msg, 0 if the line needs to be
+ * processed as usual and -1 if @line is not valid JSON.
+ */
+static int
+qemuMonitorJSONIOProcessLineDecode(qemuMonitorPtr mon,
+                                   const char *line,
+                                   qemuMonitorMessagePtr msg)
+{
+    qemuMonitorJSONReplyEnvelope env = { .mon = mon,
+                                         .decoder = msg->rxDecoder,
+                                         .id = msg->id };
+    int rc;
+
+    if ((rc = virJSONParseStream(line, &qemuMonitorJSONReplyEnvelopeCallbacks,
+                                 &env)) < 0)
+        return -1;
+
+    if (rc == 1) {
+        msg->rxDecoder->reset(msg->rxDecoder->opaque);
+        return 0;
+    }
+
+    PROBE(QEMU_MONITOR_RECV_REPLY,
+          "mon=%p reply=%s", mon, line);
+
+    msg->rxDecoded = true;
+    msg->finished = 1;
+    return 1;
+}
+
+
 int
 qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                              const char *line,
@@ -216,9 +349,20 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 {
     virJSONValuePtr obj = NULL;
     int ret = -1;
+    int rc;
 
     VIR_DEBUG("Line [%s]", line);
 
+    if (msg && msg->rxDecoder && !msg->finished) {
+        if ((rc = qemuMonitorJSONIOProcessLineDecode(mon, line, msg)) < 0)
+            goto cleanup;
+
+        if (rc == 1) {
+            ret = 0;
+            goto cleanup;
+        }
+    }
+
     if (!(obj = virJSONValueFromString(line)))
         goto cleanup;
 
@@ -236,8 +380,20 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
         ret = qemuMonitorJSONIOProcessEvent(mon, obj);
     } else if (virJSONValueObjectHasKey(obj, "error") == 1 ||
                virJSONValueObjectHasKey(obj, "return") == 1) {
+        const char *id = virJSONValueObjectGetString(obj, "id");
+
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
+
+        /* with multiple commands in flight the reply may belong to a
+         * command other than the oldest one */
+        if (msg && id && msg->id && STRNEQ(id, msg->id)) {
+            qemuMonitorMessagePtr other = qemuMonitorFindPendingReply(mon, id);
+
+            if (other)
+                msg = other;
+        }
+
         if (msg) {
             msg->rxObject = obj;
             msg->finished = 1;
@@ -259,8 +415,7 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
                              const char *data,
-                             size_t len,
-                             qemuMonitorMessagePtr msg)
+                             size_t len)
 {
     int used = 0;
     /*VIR_DEBUG("Data %d bytes [%s]", len, data);*/
@@ -274,7 +429,8 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
             line = g_strndup(data + used, got);
             used += got + strlen(LINE_ENDING);
             line[got] = '\0'; /* kill \n */
-            if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0) {
+            if (qemuMonitorJSONIOProcessLine(mon, line,
+                                             qemuMonitorGetPendingReply(mon)) < 0) {
                 VIR_FREE(line);
                 return -1;
             }
@@ -292,59 +448,163 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
     return used;
 }
 
+/* Fills @msg for transmitting @cmd. The caller must free @msg->txBuffer
+ * and @id afterwards. */
 static int
-qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
-                             virJSONValuePtr cmd,
-                             int scm_fd,
-                             virJSONValuePtr *reply)
+qemuMonitorJSONCommandPrepare(qemuMonitorPtr mon,
+                              virJSONValuePtr cmd,
+                              int scm_fd,
+                              qemuMonitorReplyDecoderPtr decoder,
+                              qemuMonitorMessagePtr msg,
+                              char **id)
 {
-    int ret = -1;
-    qemuMonitorMessage msg;
     g_auto(virBuffer) cmdbuf = VIR_BUFFER_INITIALIZER;
-    char *id = NULL;
 
-    *reply = NULL;
-
-    memset(&msg, 0, sizeof(msg));
+    memset(msg, 0, sizeof(*msg));
 
     if (virJSONValueObjectHasKey(cmd, "execute") == 1) {
-        if (!(id = qemuMonitorNextCommandID(mon)))
-            goto cleanup;
-        if (virJSONValueObjectAppendString(cmd, "id", id) < 0) {
+        if (!(*id = qemuMonitorNextCommandID(mon)))
+            return -1;
+        if (virJSONValueObjectAppendString(cmd, "id", *id) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Unable to append command 'id' string"));
-            goto cleanup;
+            return -1;
         }
     }
 
     if (virJSONValueToBuffer(cmd, &cmdbuf, false) < 0)
-        goto cleanup;
+        return -1;
     virBufferAddLit(&cmdbuf, "\r\n");
 
-    msg.txLength = virBufferUse(&cmdbuf);
-    msg.txBuffer = virBufferContentAndReset(&cmdbuf);
-    msg.txFD = scm_fd;
+    msg->txLength = virBufferUse(&cmdbuf);
+    msg->txBuffer = virBufferContentAndReset(&cmdbuf);
+    msg->txFD = scm_fd;
+    msg->id = *id;
+    msg->rxDecoder = decoder;
 
-    ret = qemuMonitorSend(mon, &msg);
+    return 0;
+}
 
-    if (ret == 0) {
-        if (!msg.rxObject) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("Missing monitor reply object"));
-            ret = -1;
-        } else {
-            *reply = msg.rxObject;
-        }
+
+static int
+qemuMonitorJSONCommandGetReply(qemuMonitorMessagePtr msg,
+                               virJSONValuePtr *reply)
+{
+    if (msg->rxDecoded)
+        return 0;
+
+    if (!msg->rxObject) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Missing monitor reply object"));
+        return -1;
     }
 
+    *reply = g_steal_pointer(&msg->rxObject);
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONCommandFull(qemuMonitorPtr mon,
+                           virJSONValuePtr cmd,
+                           int scm_fd,
+                           qemuMonitorReplyDecoderPtr decoder,
+                           virJSONValuePtr *reply)
+{
+    int ret = -1;
+    qemuMonitorMessage msg;
+    g_autofree char *id = NULL;
+
+    *reply = NULL;
+
+    if (qemuMonitorJSONCommandPrepare(mon, cmd, scm_fd, decoder, &msg, &id) < 0)
+        goto cleanup;
+
+    if (qemuMonitorSend(mon, &msg) < 0)
+        goto cleanup;
+
+    ret = qemuMonitorJSONCommandGetReply(&msg, reply);
+
  cleanup:
-    VIR_FREE(id);
+    virJSONValueFree(msg.rxObject);
     VIR_FREE(msg.txBuffer);
 
     return ret;
 }
 
 
+/**
+ * qemuMonitorJSONCommandBatch:
+ * @mon: monitor object
+ * @cmds: commands to execute
+ * @decoders: reply decoders for @cmds (may be NULL or contain NULL entries)
+ * @replies: filled with the replies to @cmds
+ * @ncmds: number of commands in @cmds
+ *
+ * Sends all of @cmds to qemu without waiting for the individual replies and
+ * waits for all of them afterwards, which saves a round trip per command.
+ * Replies consumed by a decoder are left NULL in @replies (see
+ * qemuMonitorJSONCommandDecode). On failure all @replies are NULL.
+ */
+static int
+qemuMonitorJSONCommandBatch(qemuMonitorPtr mon,
+                            virJSONValuePtr *cmds,
+                            qemuMonitorReplyDecoderPtr *decoders,
+                            virJSONValuePtr *replies,
+                            size_t ncmds)
+{
+    g_autofree qemuMonitorMessage *msgs = g_new0(qemuMonitorMessage, ncmds);
+    g_autofree qemuMonitorMessagePtr *msgptrs = g_new0(qemuMonitorMessagePtr, ncmds);
+    g_autofree char **ids = g_new0(char *, ncmds);
+    int ret = -1;
+    size_t i;
+
+    for (i = 0; i < ncmds; i++) {
+        replies[i] = NULL;
+        msgs[i].txFD = -1;
+        msgptrs[i] = msgs + i;
+    }
+
+    for (i = 0; i < ncmds; i++) {
+        if (qemuMonitorJSONCommandPrepare(mon, cmds[i], -1,
+                                          decoders ? decoders[i] : NULL,
+                                          msgs + i, ids + i) < 0)
+            goto cleanup;
+    }
+
+    if (qemuMonitorSendBatch(mon, msgptrs, ncmds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        if (qemuMonitorJSONCommandGetReply(msgs + i, replies + i) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ncmds; i++) {
+        if (ret < 0)
+            g_clear_pointer(&replies[i], virJSONValueFree);
+        virJSONValueFree(msgs[i].rxObject);
+        VIR_FREE(msgs[i].txBuffer);
+        VIR_FREE(ids[i]);
+    }
+
+    return ret;
+}
+
+
+static int
+qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
+                             virJSONValuePtr cmd,
+                             int scm_fd,
+                             virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, scm_fd, NULL, reply);
+}
+
+
 static int
 qemuMonitorJSONCommand(qemuMonitorPtr mon,
                        virJSONValuePtr cmd,
@@ -353,6 +613,28 @@ qemuMonitorJSONCommand(qemuMonitorPtr mon,
     return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
 }
 
+
+/**
+ * qemuMonitorJSONCommandDecode:
+ * @mon: monitor object
+ * @cmd: command to execute
+ * @decoder: decoder for the reply
+ * @reply: filled with the reply if it was not consumed by @decoder
+ *
+ * Executes @cmd and lets @decoder process a successful reply while it's
+ * being parsed. If @decoder didn't handle the reply (e.g. because it's an
+ * error) it's returned in @reply and the caller must process it as usual.
+ * On success @reply is NULL if the data was consumed by @decoder.
+ */
+static int
+qemuMonitorJSONCommandDecode(qemuMonitorPtr mon,
+                             virJSONValuePtr cmd,
+                             qemuMonitorReplyDecoderPtr decoder,
+                             virJSONValuePtr *reply)
+{
+    return qemuMonitorJSONCommandFull(mon, cmd, -1, decoder, reply);
+}
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -1952,6 +2234,153 @@ qemuMonitorJSONExtractCPUInfo(virJSONValuePtr data,
 }
 
 
+/*
+ * Streaming decoder of the query-cpus-fast reply filling the entries
+ * directly, see qemuMonitorJSONExtractCPUInfo for the format.
+ */
+typedef struct _qemuMonitorJSONQueryCPUsDecoder qemuMonitorJSONQueryCPUsDecoder;
+typedef qemuMonitorJSONQueryCPUsDecoder *qemuMonitorJSONQueryCPUsDecoderPtr;
+struct _qemuMonitorJSONQueryCPUsDecoder {
+    size_t depth;
+
+    struct qemuMonitorQueryCpusEntry *cpus;
+    size_t ncpus;
+    size_t cpus_alloc;
+
+    /* state of the entry being decoded */
+    virTristateBool targetS390;
+    virTristateBool archS390;
+    virTristateBool halted;
+};
+
+
+static void
+qemuMonitorJSONQueryCPUsDecoderReset(void *opaque)
+{
+    qemuMonitorJSONQueryCPUsDecoderPtr dec = opaque;
+
+    qemuMonitorQueryCpusFree(dec->cpus, dec->ncpus);
+    memset(dec, 0, sizeof(*dec));
+}
+
+
+static int
+qemuMonitorJSONQueryCPUsDecoderStart(void *opaque,
+                                     const char *key G_GNUC_UNUSED,
+                                     virJSONType type)
+{
+    qemuMonitorJSONQueryCPUsDecoderPtr dec = opaque;
+
+    switch (dec->depth) {
+    case 0:
+        if (type != VIR_JSON_TYPE_ARRAY)
+            return 1;
+        break;
+
+    case 1:
+        if (type != VIR_JSON_TYPE_OBJECT)
+            return 1;
+
+        VIR_RESIZE_N(dec->cpus, dec->cpus_alloc, dec->ncpus, 1);
+        dec->cpus[dec->ncpus].qemu_id = -1;
+        dec->ncpus++;
+
+        dec->targetS390 = VIR_TRISTATE_BOOL_ABSENT;
+        dec->archS390 = VIR_TRISTATE_BOOL_ABSENT;
+        dec->halted = VIR_TRISTATE_BOOL_ABSENT;
+        break;
+    }
+
+    dec->depth++;
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONQueryCPUsDecoderEnd(void *opaque,
+                                   virJSONType type G_GNUC_UNUSED)
+{
+    qemuMonitorJSONQueryCPUsDecoderPtr dec = opaque;
+    virTristateBool s390;
+
+    switch (--dec->depth) {
+    case 0:
+        /* let the tree based code handle the empty reply */
+        if (dec->ncpus == 0)
+            return 1;
+        break;
+
+    case 1:
+        /* "arch" is used only if "target" is missing */
+        if ((s390 = dec->targetS390) == VIR_TRISTATE_BOOL_ABSENT)
+            s390 = dec->archS390;
+
+        if (s390 == VIR_TRISTATE_BOOL_YES &&
+            dec->halted != VIR_TRISTATE_BOOL_ABSENT)
+            dec->cpus[dec->ncpus - 1].halted = dec->halted == VIR_TRISTATE_BOOL_YES;
+        break;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONQueryCPUsDecoderValue(void *opaque,
+                                     const char *key,
+                                     virJSONType type,
+                                     const char *val)
+{
+    qemuMonitorJSONQueryCPUsDecoderPtr dec = opaque;
+    struct qemuMonitorQueryCpusEntry *cpu;
+
+    if (dec->depth == 1)
+        return 1;
+
+    if (dec->depth != 2 || !key)
+        return 0;
+
+    cpu = dec->cpus + dec->ncpus - 1;
+
+    if (type == VIR_JSON_TYPE_NUMBER) {
+        int num;
+
+        if (virStrToLong_i(val, NULL, 10, &num) < 0)
+            return 0;
+
+        if (STREQ(key, "cpu-index"))
+            cpu->qemu_id = num;
+        else if (STREQ(key, "thread-id"))
+            cpu->tid = num;
+    } else if (type == VIR_JSON_TYPE_STRING) {
+        bool s390 = STREQ(val, "s390") || STREQ(val, "s390x");
+
+        if (STREQ(key, "qom-path")) {
+            g_free(cpu->qom_path);
+            cpu->qom_path = g_strdup(val);
+        } else if (STREQ(key, "target")) {
+            dec->targetS390 = virTristateBoolFromBool(s390);
+        } else if (STREQ(key, "arch")) {
+            dec->archS390 = virTristateBoolFromBool(s390);
+        } else if (STREQ(key, "cpu-state")) {
+            if (STREQ(val, "operating") || STREQ(val, "load"))
+                dec->halted = VIR_TRISTATE_BOOL_NO;
+            else if (STREQ(val, "stopped") || STREQ(val, "check-stop"))
+                dec->halted = VIR_TRISTATE_BOOL_YES;
+        }
+    }
+
+    return 0;
+}
+
+
+static const virJSONStreamCallbacks qemuMonitorJSONQueryCPUsDecoderCallbacks = {
+    .value = qemuMonitorJSONQueryCPUsDecoderValue,
+    .startContainer = qemuMonitorJSONQueryCPUsDecoderStart,
+    .endContainer = qemuMonitorJSONQueryCPUsDecoderEnd,
+};
+
+
 /**
  * qemuMonitorJSONQueryCPUs:
  *
@@ -1979,6 +2408,12 @@ qemuMonitorJSONQueryCPUs(qemuMonitorPtr mon,
     virJSONValuePtr cmd;
     virJSONValuePtr reply = NULL;
     virJSONValuePtr data;
+    qemuMonitorJSONQueryCPUsDecoder dec = { 0 };
+    qemuMonitorReplyDecoder decoder = {
+        &qemuMonitorJSONQueryCPUsDecoderCallbacks,
+        qemuMonitorJSONQueryCPUsDecoderReset,
+        &dec
+    };
 
     if (fast)
         cmd = qemuMonitorJSONMakeCommand("query-cpus-fast", NULL);
@@ -1988,8 +2423,21 @@ qemuMonitorJSONQueryCPUs(qemuMonitorPtr mon,
     if (!cmd)
         return -1;
 
-    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
-        goto cleanup;
+    if (fast) {
+        if (qemuMonitorJSONCommandDecode(mon, cmd, &decoder, &reply) < 0)
+            goto cleanup;
+
+        if (!reply) {
+            *entries = g_steal_pointer(&dec.cpus);
+            *nentries = dec.ncpus;
+            dec.ncpus = 0;
+            ret = 0;
+            goto cleanup;
+        }
+    } else {
+        if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+            goto cleanup;
+    }
 
     if (force && qemuMonitorJSONCheckError(cmd, reply) < 0)
         goto cleanup;
@@ -2002,6 +2450,7 @@ qemuMonitorJSONQueryCPUs(qemuMonitorPtr mon,
     ret = qemuMonitorJSONExtractCPUInfo(data, entries, nentries, fast);
 
  cleanup:
+    qemuMonitorJSONQueryCPUsDecoderReset(&dec);
     virJSONValueFree(cmd);
     virJSONValueFree(reply);
     return ret;
@@ -2687,19 +3136,411 @@ qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
 }
 
 
-int
-qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
-                                    virHashTablePtr hash,
-                                    bool backingChain)
+/*
+ * Streaming decoder of the query-blockstats reply. Stats of every node are
+ * collected in @entries under all the names the tree based code would use
+ * and added to the stats hash table only once the whole reply was decoded.
+ */
+typedef enum {
+    QEMU_MONITOR_JSON_BLOCKSTATS_CTX_RETURN,
+    QEMU_MONITOR_JSON_BLOCKSTATS_CTX_DEVICE,
+    QEMU_MONITOR_JSON_BLOCKSTATS_CTX_STATS,
+    QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT,
+    QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT_STATS,
+    QEMU_MONITOR_JSON_BLOCKSTATS_CTX_SKIP,
+} qemuMonitorJSONBlockStatsCtx;
+
+typedef struct _qemuMonitorJSONBlockStatsNode qemuMonitorJSONBlockStatsNode;
+typedef qemuMonitorJSONBlockStatsNode *qemuMonitorJSONBlockStatsNodePtr;
+struct _qemuMonitorJSONBlockStatsNode {
+    qemuBlockStats stats;
+    unsigned int found; /* bitmap of qemuMonitorJSONBlockStatsFields indices */
+    bool haveStats;
+    char *qdev;
+    char *nodename;
+};
+
+typedef struct _qemuMonitorJSONBlockStatsEntry qemuMonitorJSONBlockStatsEntry;
+typedef qemuMonitorJSONBlockStatsEntry *qemuMonitorJSONBlockStatsEntryPtr;
+struct _qemuMonitorJSONBlockStatsEntry {
+    char *name;
+    qemuBlockStats stats;
+};
+
+typedef struct _qemuMonitorJSONBlockStatsDecoder qemuMonitorJSONBlockStatsDecoder;
+typedef qemuMonitorJSONBlockStatsDecoder *qemuMonitorJSONBlockStatsDecoderPtr;
+struct _qemuMonitorJSONBlockStatsDecoder {
+    bool backingChain;
+
+    qemuMonitorJSONBlockStatsCtx *ctx;
+    size_t nctx;
+    size_t ctx_alloc;
+
+    /* nodes of the backing chain of the device being decoded */
+    qemuMonitorJSONBlockStatsNodePtr nodes;
+    size_t nnodes; /* depth of the currently open node */
+    size_t nodes_alloc;
+    char *device;
+    bool haveDevice;
+
+    qemuMonitorJSONBlockStatsEntryPtr entries;
+    size_t nentries;
+    size_t entries_alloc;
+
+    int nstats;
+};
+
+struct qemuMonitorJSONBlockStatsField {
+    const char *name;
+    size_t offset;
+    bool mandatory;
+};
+
+static const struct qemuMonitorJSONBlockStatsField qemuMonitorJSONBlockStatsFields[] = {
+    { "rd_bytes", offsetof(qemuBlockStats, rd_bytes), true },
+    { "wr_bytes", offsetof(qemuBlockStats, wr_bytes), true },
+    { "rd_operations", offsetof(qemuBlockStats, rd_req), true },
+    { "wr_operations", offsetof(qemuBlockStats, wr_req), true },
+    { "rd_total_time_ns", offsetof(qemuBlockStats, rd_total_times), false },
+    { "wr_total_time_ns", offsetof(qemuBlockStats, wr_total_times), false },
+    { "flush_operations", offsetof(qemuBlockStats, flush_req), false },
+    { "flush_total_time_ns", offsetof(qemuBlockStats, flush_total_times), false },
+};
+
+
+static void
+qemuMonitorJSONBlockStatsDecoderClearNodes(qemuMonitorJSONBlockStatsDecoderPtr dec)
+{
+    size_t i;
+
+    for (i = 0; i < dec->nodes_alloc; i++) {
+        VIR_FREE(dec->nodes[i].qdev);
+        VIR_FREE(dec->nodes[i].nodename);
+        memset(&dec->nodes[i], 0, sizeof(dec->nodes[i]));
+    }
+
+    dec->nnodes = 0;
+    VIR_FREE(dec->device);
+    dec->haveDevice = false;
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecoderReset(void *opaque)
+{
+    qemuMonitorJSONBlockStatsDecoderPtr dec = opaque;
+    size_t i;
+
+    qemuMonitorJSONBlockStatsDecoderClearNodes(dec);
+
+    for (i = 0; i < dec->nentries; i++)
+        VIR_FREE(dec->entries[i].name);
+    dec->nentries = 0;
+
+    dec->nctx = 0;
+    dec->nstats = 0;
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecoderFree(qemuMonitorJSONBlockStatsDecoderPtr dec)
+{
+    qemuMonitorJSONBlockStatsDecoderReset(dec);
+    VIR_FREE(dec->ctx);
+    VIR_FREE(dec->nodes);
+    VIR_FREE(dec->entries);
+}
+
+
+static qemuMonitorJSONBlockStatsNodePtr
+qemuMonitorJSONBlockStatsDecoderNode(qemuMonitorJSONBlockStatsDecoderPtr dec)
+{
+    return &dec->nodes[dec->nnodes - 1];
+}
+
+
+static void
+qemuMonitorJSONBlockStatsDecoderAddEntry(qemuMonitorJSONBlockStatsDecoderPtr dec,
+                                         char *name,
+                                         qemuMonitorJSONBlockStatsNodePtr node)
+{
+    VIR_RESIZE_N(dec->entries, dec->entries_alloc, dec->nentries, 1);
+    dec->entries[dec->nentries].name = name;
+    dec->entries[dec->nentries].stats = node->stats;
+    dec->nentries++;
+}
+
+
+/* Mirrors qemuMonitorJSONGetOneBlockStatsInfo for the decoded backing chain
+ * of one device. Returns 1 if the data doesn't have the expected format. */
+static int
+qemuMonitorJSONBlockStatsDecoderFinishDevice(qemuMonitorJSONBlockStatsDecoderPtr dec)
+{
+    const char *dev_name = dec->device;
+    size_t depth;
+    size_t i;
+
+    if (!dec->haveDevice)
+        return 1;
+
+    if (dev_name && *dev_name == '\0')
+        dev_name = NULL;
+
+    for (depth = 0; depth < dec->nodes_alloc; depth++) {
+        qemuMonitorJSONBlockStatsNodePtr node = dec->nodes + depth;
+        char *devicename = NULL;
+        bool addqdev;
+
+        if (!node->haveStats)
+            break;
+
+        if (dev_name)
+            devicename = qemuDomainStorageAlias(dev_name, depth);
+
+        if (!devicename && !node->qdev && !node->nodename)
+            return 1;
+
+        if (depth == 0) {
+            int nstats = 0;
+
+            for (i = 0; i < G_N_ELEMENTS(qemuMonitorJSONBlockStatsFields); i++) {
+                if (node->found & (1U << i))
+                    nstats++;
+            }
+
+            if (nstats > dec->nstats)
+                dec->nstats = nstats;
+        }
+
+        addqdev = node->qdev && STRNEQ_NULLABLE(node->qdev, devicename);
+
+        if (devicename)
+            qemuMonitorJSONBlockStatsDecoderAddEntry(dec, devicename, node);
+
+        if (addqdev)
+            qemuMonitorJSONBlockStatsDecoderAddEntry(dec,
+                                                     g_steal_pointer(&node->qdev),
+                                                     node);
+
+        if (node->nodename)
+            qemuMonitorJSONBlockStatsDecoderAddEntry(dec,
+                                                     g_steal_pointer(&node->nodename),
+                                                     node);
+    }
+
+    qemuMonitorJSONBlockStatsDecoderClearNodes(dec);
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONBlockStatsDecoderStart(void *opaque,
+                                      const char *key,
+                                      virJSONType type)
+{
+    qemuMonitorJSONBlockStatsDecoderPtr dec = opaque;
+    qemuMonitorJSONBlockStatsCtx ctx = QEMU_MONITOR_JSON_BLOCKSTATS_CTX_SKIP;
+    qemuMonitorJSONBlockStatsCtx parent = QEMU_MONITOR_JSON_BLOCKSTATS_CTX_SKIP;
+
+    if (dec->nctx == 0) {
+        if (type != VIR_JSON_TYPE_ARRAY)
+            return 1;
+        ctx = QEMU_MONITOR_JSON_BLOCKSTATS_CTX_RETURN;
+    } else {
+        parent = dec->ctx[dec->nctx - 1];
+    }
+
+    switch (parent) {
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_RETURN:
+        if (type != VIR_JSON_TYPE_OBJECT)
+            return 1;
+        ctx = QEMU_MONITOR_JSON_BLOCKSTATS_CTX_DEVICE;
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_DEVICE:
+        if (STREQ_NULLABLE(key, "stats")) {
+            if (type != VIR_JSON_TYPE_OBJECT)
+                return 1;
+            ctx = QEMU_MONITOR_JSON_BLOCKSTATS_CTX_STATS;
+        } else if (STREQ_NULLABLE(key, "parent") &&
+                   type == VIR_JSON_TYPE_OBJECT) {
+            ctx = QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT;
+        } else if (STREQ_NULLABLE(key, "backing") && dec->backingChain &&
+                   type == VIR_JSON_TYPE_OBJECT) {
+            ctx = QEMU_MONITOR_JSON_BLOCKSTATS_CTX_DEVICE;
+        }
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT:
+        if (STREQ_NULLABLE(key, "stats") && type == VIR_JSON_TYPE_OBJECT)
+            ctx = QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT_STATS;
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_STATS:
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT_STATS:
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_SKIP:
+        break;
+    }
+
+    if (ctx == QEMU_MONITOR_JSON_BLOCKSTATS_CTX_DEVICE) {
+        VIR_RESIZE_N(dec->nodes, dec->nodes_alloc, dec->nnodes, 1);
+        dec->nnodes++;
+    }
+
+    VIR_RESIZE_N(dec->ctx, dec->ctx_alloc, dec->nctx, 1);
+    dec->ctx[dec->nctx++] = ctx;
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONBlockStatsDecoderEnd(void *opaque,
+                                    virJSONType type G_GNUC_UNUSED)
+{
+    qemuMonitorJSONBlockStatsDecoderPtr dec = opaque;
+    qemuMonitorJSONBlockStatsNodePtr node;
+    size_t i;
+
+    switch (dec->ctx[--dec->nctx]) {
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_DEVICE:
+        node = qemuMonitorJSONBlockStatsDecoderNode(dec);
+
+        if (!node->haveStats)
+            return 1;
+
+        for (i = 0; i < G_N_ELEMENTS(qemuMonitorJSONBlockStatsFields); i++) {
+            if (qemuMonitorJSONBlockStatsFields[i].mandatory &&
+                !(node->found & (1U << i)))
+                return 1;
+        }
+
+        if (--dec->nnodes == 0)
+            return qemuMonitorJSONBlockStatsDecoderFinishDevice(dec);
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_STATS:
+        qemuMonitorJSONBlockStatsDecoderNode(dec)->haveStats = true;
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_RETURN:
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT:
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT_STATS:
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_SKIP:
+        break;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONBlockStatsDecoderValue(void *opaque,
+                                      const char *key,
+                                      virJSONType type,
+                                      const char *val)
+{
+    qemuMonitorJSONBlockStatsDecoderPtr dec = opaque;
+    qemuMonitorJSONBlockStatsNodePtr node;
+    size_t i;
+
+    if (dec->nctx == 0 || !key)
+        return 1;
+
+    switch (dec->ctx[dec->nctx - 1]) {
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_RETURN:
+        return 1;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_DEVICE:
+        node = qemuMonitorJSONBlockStatsDecoderNode(dec);
+
+        if (type != VIR_JSON_TYPE_STRING)
+            break;
+
+        if (STREQ(key, "device") && dec->nnodes == 1) {
+            dec->device = g_strdup(val);
+            dec->haveDevice = true;
+        } else if (STREQ(key, "qdev")) {
+            node->qdev = g_strdup(val);
+        } else if (STREQ(key, "node-name")) {
+            node->nodename = g_strdup(val);
+        }
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_STATS:
+        node = qemuMonitorJSONBlockStatsDecoderNode(dec);
+
+        for (i = 0; i < G_N_ELEMENTS(qemuMonitorJSONBlockStatsFields); i++) {
+            const struct qemuMonitorJSONBlockStatsField *field = qemuMonitorJSONBlockStatsFields + i;
+            unsigned long long *stat;
+
+            if (STRNEQ(key, field->name))
+                continue;
+
+            stat = (unsigned long long *)((char *)&node->stats + field->offset);
+
+            if (type != VIR_JSON_TYPE_NUMBER ||
+                virStrToLong_ull(val, NULL, 10, stat) < 0)
+                return 1;
+
+            node->found |= 1U << i;
+            break;
+        }
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT_STATS:
+        node = qemuMonitorJSONBlockStatsDecoderNode(dec);
+
+        if (STREQ(key, "wr_highest_offset") &&
+            type == VIR_JSON_TYPE_NUMBER &&
+            virStrToLong_ull(val, NULL, 10, &node->stats.wr_highest_offset) == 0)
+            node->stats.wr_highest_offset_valid = true;
+        break;
+
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_PARENT:
+    case QEMU_MONITOR_JSON_BLOCKSTATS_CTX_SKIP:
+        break;
+    }
+
+    return 0;
+}
+
+
+static const virJSONStreamCallbacks qemuMonitorJSONBlockStatsDecoderCallbacks = {
+    .value = qemuMonitorJSONBlockStatsDecoderValue,
+    .startContainer = qemuMonitorJSONBlockStatsDecoderStart,
+    .endContainer = qemuMonitorJSONBlockStatsDecoderEnd,
+};
+
+
+/* Processes the query-blockstats reply either decoded by @dec or in
+ * @reply if @dec didn't handle it. Returns the number of stats. */
+static int
+qemuMonitorJSONBlockStatsProcessReply(virJSONValuePtr cmd,
+                                      virJSONValuePtr reply,
+                                      qemuMonitorJSONBlockStatsDecoderPtr dec,
+                                      virHashTablePtr hash)
 {
     int nstats = 0;
     int rc;
     size_t i;
-    g_autoptr(virJSONValue) devices = NULL;
+    virJSONValuePtr devices;
 
-    if (!(devices = qemuMonitorJSONQueryBlockstats(mon)))
+    if (!reply) {
+        for (i = 0; i < dec->nentries; i++) {
+            if (qemuMonitorJSONAddOneBlockStatsInfo(&dec->entries[i].stats,
+                                                    dec->entries[i].name,
+                                                    hash) < 0)
+                return -1;
+        }
+
+        return dec->nstats;
+    }
+
+    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
         return -1;
 
+    devices = virJSONValueObjectGetArray(reply, "return");
+
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev = virJSONValueArrayGet(devices, i);
         const char *dev_name;
@@ -2722,7 +3563,7 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
             dev_name = NULL;
 
         rc = qemuMonitorJSONGetOneBlockStatsInfo(dev, dev_name, 0, hash,
-                                                 backingChain);
+                                                 dec->backingChain);
 
         if (rc < 0)
             return -1;
@@ -2735,6 +3576,35 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
+                                    virHashTablePtr hash,
+                                    bool backingChain)
+{
+    int ret = -1;
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+    qemuMonitorJSONBlockStatsDecoder dec = { .backingChain = backingChain };
+    qemuMonitorReplyDecoder decoder = {
+        &qemuMonitorJSONBlockStatsDecoderCallbacks,
+        qemuMonitorJSONBlockStatsDecoderReset,
+        &dec
+    };
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommandDecode(mon, cmd, &decoder, &reply) < 0)
+        goto cleanup;
+
+    ret = qemuMonitorJSONBlockStatsProcessReply(cmd, reply, &dec, hash);
+
+ cleanup:
+    qemuMonitorJSONBlockStatsDecoderFree(&dec);
+    return ret;
+}
+
+
 static int
 qemuMonitorJSONBlockStatsUpdateCapacityData(virJSONValuePtr image,
                                             const char *name,
@@ -2801,17 +3671,12 @@ qemuMonitorJSONBlockStatsUpdateCapacityOne(virJSONValuePtr image,
 }
 
 
-int
-qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
-                                        virHashTablePtr stats,
-                                        bool backingChain)
+static int
+qemuMonitorJSONBlockStatsUpdateCapacityDevices(virJSONValuePtr devices,
+                                               virHashTablePtr stats,
+                                               bool backingChain)
 {
-    int ret = -1;
     size_t i;
-    virJSONValuePtr devices;
-
-    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
-        return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev;
@@ -2820,10 +3685,10 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
         const char *dev_name;
 
         if (!(dev = qemuMonitorJSONGetBlockDev(devices, i)))
-            goto cleanup;
+            return -1;
 
         if (!(dev_name = qemuMonitorJSONGetBlockDevDevice(dev)))
-            goto cleanup;
+            return -1;
 
         /* drive may be empty */
         if (!(inserted = virJSONValueObjectGetObject(dev, "inserted")) ||
@@ -2833,14 +3698,25 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
         if (qemuMonitorJSONBlockStatsUpdateCapacityOne(image, dev_name, 0,
                                                        stats,
                                                        backingChain) < 0)
-            goto cleanup;
+            return -1;
     }
 
-    ret = 0;
+    return 0;
+}
 
- cleanup:
-    virJSONValueFree(devices);
-    return ret;
+
+int
+qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr stats,
+                                        bool backingChain)
+{
+    g_autoptr(virJSONValue) devices = NULL;
+
+    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
+        return -1;
+
+    return qemuMonitorJSONBlockStatsUpdateCapacityDevices(devices, stats,
+                                                          backingChain);
 }
 
 
@@ -2872,25 +3748,356 @@ qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker(size_t pos G_GNUC_UNUSED,
 }
 
 
+static int
+qemuMonitorJSONBlockStatsUpdateCapacityNodes(virJSONValuePtr nodes,
+                                             virHashTablePtr stats)
+{
+    return virJSONValueArrayForeachSteal(nodes,
+                                         qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker,
+                                         stats);
+}
+
+
+/*
+ * Streaming decoder of the query-named-block-nodes reply collecting the
+ * data used by qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker.
+ * The stats hash table is updated only once the whole reply was decoded.
+ */
+typedef struct _qemuMonitorJSONNamedNodesCapacity qemuMonitorJSONNamedNodesCapacity;
+typedef qemuMonitorJSONNamedNodesCapacity *qemuMonitorJSONNamedNodesCapacityPtr;
+struct _qemuMonitorJSONNamedNodesCapacity {
+    char *nodename;
+    bool haveImage;
+    bool haveCapacity;
+    bool havePhysical;
+    bool haveThreshold;
+    unsigned long long capacity;
+    unsigned long long physical;
+    unsigned long long write_threshold;
+};
+
+typedef struct _qemuMonitorJSONNamedNodesDecoder qemuMonitorJSONNamedNodesDecoder;
+typedef qemuMonitorJSONNamedNodesDecoder *qemuMonitorJSONNamedNodesDecoderPtr;
+struct _qemuMonitorJSONNamedNodesDecoder {
+    size_t depth;
+    bool inImage; /* decoding the top level "image" of the current node */
+
+    qemuMonitorJSONNamedNodesCapacityPtr nodes;
+    size_t nnodes;
+    size_t nodes_alloc;
+};
+
+
+static void
+qemuMonitorJSONNamedNodesDecoderReset(void *opaque)
+{
+    qemuMonitorJSONNamedNodesDecoderPtr dec = opaque;
+    size_t i;
+
+    for (i = 0; i < dec->nnodes; i++)
+        VIR_FREE(dec->nodes[i].nodename);
+    VIR_FREE(dec->nodes);
+    memset(dec, 0, sizeof(*dec));
+}
+
+
+static int
+qemuMonitorJSONNamedNodesDecoderStart(void *opaque,
+                                      const char *key,
+                                      virJSONType type)
+{
+    qemuMonitorJSONNamedNodesDecoderPtr dec = opaque;
+
+    switch (dec->depth) {
+    case 0:
+        if (type != VIR_JSON_TYPE_ARRAY)
+            return 1;
+        break;
+
+    case 1:
+        if (type != VIR_JSON_TYPE_OBJECT)
+            return 1;
+
+        VIR_RESIZE_N(dec->nodes, dec->nodes_alloc, dec->nnodes, 1);
+        dec->nnodes++;
+        break;
+
+    case 2:
+        if (STREQ_NULLABLE(key, "image") && type == VIR_JSON_TYPE_OBJECT) {
+            dec->nodes[dec->nnodes - 1].haveImage = true;
+            dec->inImage = true;
+        }
+        break;
+    }
+
+    dec->depth++;
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONNamedNodesDecoderEnd(void *opaque,
+                                    virJSONType type G_GNUC_UNUSED)
+{
+    qemuMonitorJSONNamedNodesDecoderPtr dec = opaque;
+    qemuMonitorJSONNamedNodesCapacityPtr node;
+
+    switch (--dec->depth) {
+    case 1:
+        /* let the tree based code report the broken entry */
+        node = dec->nodes + dec->nnodes - 1;
+        if (!node->nodename || !node->haveImage)
+            return 1;
+        break;
+
+    case 2:
+        dec->inImage = false;
+        break;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuMonitorJSONNamedNodesDecoderValue(void *opaque,
+                                      const char *key,
+                                      virJSONType type,
+                                      const char *val)
+{
+    qemuMonitorJSONNamedNodesDecoderPtr dec = opaque;
+    qemuMonitorJSONNamedNodesCapacityPtr node;
+
+    if (dec->depth < 2)
+        return 1;
+
+    if (!key)
+        return 0;
+
+    node = dec->nodes + dec->nnodes - 1;
+
+    if (dec->depth == 2) {
+        if (STREQ(key, "node-name") && type == VIR_JSON_TYPE_STRING) {
+            g_free(node->nodename);
+            node->nodename = g_strdup(val);
+        } else if (STREQ(key, "write_threshold") &&
+                   type == VIR_JSON_TYPE_NUMBER &&
+                   virStrToLong_ull(val, NULL, 10, &node->write_threshold) == 0) {
+            node->haveThreshold = true;
+        }
+    } else if (dec->depth == 3 && dec->inImage &&
+               type == VIR_JSON_TYPE_NUMBER) {
+        if (STREQ(key, "virtual-size") &&
+            virStrToLong_ull(val, NULL, 10, &node->capacity) == 0)
+            node->haveCapacity = true;
+        else if (STREQ(key, "actual-size") &&
+                 virStrToLong_ull(val, NULL, 10, &node->physical) == 0)
+            node->havePhysical = true;
+    }
+
+    return 0;
+}
+
+
+static const virJSONStreamCallbacks qemuMonitorJSONNamedNodesDecoderCallbacks = {
+    .value = qemuMonitorJSONNamedNodesDecoderValue,
+    .startContainer = qemuMonitorJSONNamedNodesDecoderStart,
+    .endContainer = qemuMonitorJSONNamedNodesDecoderEnd,
+};
+
+
+/* Same as qemuMonitorJSONBlockStatsUpdateCapacityNodes for the data
+ * collected by @dec */
+static int
+qemuMonitorJSONNamedNodesDecoderUpdateCapacity(qemuMonitorJSONNamedNodesDecoderPtr dec,
+                                               virHashTablePtr stats)
+{
+    size_t i;
+
+    for (i = 0; i < dec->nnodes; i++) {
+        qemuMonitorJSONNamedNodesCapacityPtr node = dec->nodes + i;
+        qemuBlockStatsPtr bstats;
+
+        if (!(bstats = virHashLookup(stats, node->nodename))) {
+            bstats = g_new0(qemuBlockStats, 1);
+
+            if (virHashAddEntry(stats, node->nodename, bstats) < 0) {
+                VIR_FREE(bstats);
+                return -1;
+            }
+        }
+
+        if (node->haveCapacity) {
+            bstats->capacity = node->capacity;
+
+            /* if actual-size is missing, image is not thin provisioned */
+            if (node->havePhysical)
+                bstats->physical = node->physical;
+            else
+                bstats->physical = node->capacity;
+        }
+
+        if (node->haveThreshold)
+            bstats->write_threshold = node->write_threshold;
+    }
+
+    return 0;
+}
+
+
 int
 qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
                                                 virHashTablePtr stats)
 {
-    virJSONValuePtr nodes;
+    g_autoptr(virJSONValue) cmd = NULL;
+    g_autoptr(virJSONValue) reply = NULL;
+    qemuMonitorJSONNamedNodesDecoder dec = { 0 };
+    qemuMonitorReplyDecoder decoder = {
+        &qemuMonitorJSONNamedNodesDecoderCallbacks,
+        qemuMonitorJSONNamedNodesDecoderReset,
+        &dec
+    };
     int ret = -1;
 
-    if (!(nodes = qemuMonitorJSONQueryNamedBlockNodes(mon, false)))
+    if (!(cmd = qemuMonitorJSONMakeCommand("query-named-block-nodes",
+                                           "B:flat", false,
+                                           NULL)))
         return -1;
 
-    if (virJSONValueArrayForeachSteal(nodes,
-                                      qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker,
-                                      stats) < 0)
+    if (qemuMonitorJSONCommandDecode(mon, cmd, &decoder, &reply) < 0)
         goto cleanup;
 
-    ret = 0;
+    if (!reply) {
+        ret = qemuMonitorJSONNamedNodesDecoderUpdateCapacity(&dec, stats);
+        goto cleanup;
+    }
+
+    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
+        goto cleanup;
+
+    ret = qemuMonitorJSONBlockStatsUpdateCapacityNodes(virJSONValueObjectGetArray(reply, "return"),
+                                                       stats);
+
+ cleanup:
+    qemuMonitorJSONNamedNodesDecoderReset(&dec);
+    return ret;
+}
+
+
+/**
+ * qemuMonitorJSONGetAllBlockStatsCapacity:
+ * @mon: monitor object
+ * @hash: hash table to fill with qemuBlockStats
+ * @backingChain: collect stats of the backing chain
+ * @blockdev: use 'query-named-block-nodes' rather than 'query-block' for
+ *            the capacity data
+ * @capacityErr: set to true if fetching the capacity data failed
+ *
+ * Issues 'query-blockstats' along with the command providing the capacity
+ * data as one batch so that only one round trip to qemu is needed. Failure
+ * to fetch the capacity is reported via @capacityErr so that callers can
+ * decide whether it's fatal.
+ *
+ * Returns the number of stats as qemuMonitorJSONGetAllBlockStatsInfo.
+ */
+int
+qemuMonitorJSONGetAllBlockStatsCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr hash,
+                                        bool backingChain,
+                                        bool blockdev,
+                                        bool *capacityErr,
+                                        virJSONValuePtr *nodedata)
+{
+    virJSONValuePtr cmds[3] = { NULL, NULL, NULL };
+    virJSONValuePtr replies[3] = { NULL, NULL, NULL };
+    size_t ncmds = 2;
+    qemuMonitorJSONBlockStatsDecoder dec = { .backingChain = backingChain };
+    qemuMonitorReplyDecoder decoder = {
+        &qemuMonitorJSONBlockStatsDecoderCallbacks,
+        qemuMonitorJSONBlockStatsDecoderReset,
+        &dec
+    };
+    qemuMonitorJSONNamedNodesDecoder nodesDec = { 0 };
+    qemuMonitorReplyDecoder nodesDecoder = {
+        &qemuMonitorJSONNamedNodesDecoderCallbacks,
+        qemuMonitorJSONNamedNodesDecoderReset,
+        &nodesDec
+    };
+    qemuMonitorReplyDecoderPtr decoders[3] = { &decoder, NULL, NULL };
+    int ret = -1;
+    int nstats;
+    size_t i;
+
+    *capacityErr = true;
+    if (nodedata)
+        *nodedata = NULL;
+
+    if (!(cmds[0] = qemuMonitorJSONMakeCommand("query-blockstats", NULL)))
+        goto cleanup;
+
+    if (blockdev) {
+        cmds[1] = qemuMonitorJSONMakeCommand("query-named-block-nodes",
+                                             "B:flat", false,
+                                             NULL);
+        decoders[1] = &nodesDecoder;
+    } else {
+        cmds[1] = qemuMonitorJSONMakeCommand("query-block", NULL);
+    }
+
+    if (!cmds[1])
+        goto cleanup;
+
+    if (nodedata) {
+        if (!(cmds[2] = qemuMonitorJSONMakeCommand("query-named-block-nodes",
+                                                   "B:flat", false,
+                                                   NULL)))
+            goto cleanup;
+        ncmds++;
+    }
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, decoders, replies, ncmds) < 0)
+        goto cleanup;
+
+    if ((nstats = qemuMonitorJSONBlockStatsProcessReply(cmds[0], replies[0],
+                                                        &dec, hash)) < 0)
+        goto cleanup;
+
+    if (blockdev && !replies[1]) {
+        if (qemuMonitorJSONNamedNodesDecoderUpdateCapacity(&nodesDec, hash) == 0)
+            *capacityErr = false;
+    } else if (qemuMonitorJSONCheckReply(cmds[1], replies[1],
+                                         VIR_JSON_TYPE_ARRAY) == 0) {
+        virJSONValuePtr data = virJSONValueObjectGetArray(replies[1], "return");
+        int rc;
+
+        if (blockdev)
+            rc = qemuMonitorJSONBlockStatsUpdateCapacityNodes(data, hash);
+        else
+            rc = qemuMonitorJSONBlockStatsUpdateCapacityDevices(data, hash,
+                                                                backingChain);
+
+        if (rc == 0)
+            *capacityErr = false;
+    }
+
+    /* like the capacity data, the node data is optional */
+    if (nodedata) {
+        if (qemuMonitorJSONCheckReply(cmds[2], replies[2],
+                                      VIR_JSON_TYPE_ARRAY) == 0)
+            *nodedata = virJSONValueObjectStealArray(replies[2], "return");
+        else
+            virResetLastError();
+    }
+
+    ret = nstats;
 
  cleanup:
-    virJSONValueFree(nodes);
+    qemuMonitorJSONBlockStatsDecoderFree(&dec);
+    qemuMonitorJSONNamedNodesDecoderReset(&nodesDec);
+    for (i = 0; i < G_N_ELEMENTS(cmds); i++) {
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
     return ret;
 }
 
@@ -6753,11 +7960,32 @@ qemuMonitorJSONGetDevicePropsWorker(size_t pos G_GNUC_UNUSED,
 }
 
 
+static virHashTablePtr
+qemuMonitorJSONDevicePropsProcessReply(virJSONValuePtr cmd,
+                                       virJSONValuePtr reply)
+{
+    g_autoptr(virHashTable) props = virHashNew(virJSONValueHashFree);
+
+    /* return empty hash */
+    if (qemuMonitorJSONHasError(reply, "DeviceNotFound"))
+        return g_steal_pointer(&props);
+
+    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
+        return NULL;
+
+    if (virJSONValueArrayForeachSteal(virJSONValueObjectGetArray(reply, "return"),
+                                      qemuMonitorJSONGetDevicePropsWorker,
+                                      props) < 0)
+        return NULL;
+
+    return g_steal_pointer(&props);
+}
+
+
 virHashTablePtr
 qemuMonitorJSONGetDeviceProps(qemuMonitorPtr mon,
                               const char *device)
 {
-    g_autoptr(virHashTable) props = virHashNew(virJSONValueHashFree);
     g_autoptr(virJSONValue) cmd = NULL;
     g_autoptr(virJSONValue) reply = NULL;
 
@@ -6769,19 +7997,78 @@ qemuMonitorJSONGetDeviceProps(qemuMonitorPtr mon,
     if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
         return NULL;
 
-    /* return empty hash */
-    if (qemuMonitorJSONHasError(reply, "DeviceNotFound"))
-        return g_steal_pointer(&props);
+    return qemuMonitorJSONDevicePropsProcessReply(cmd, reply);
+}
 
-    if (qemuMonitorJSONCheckReply(cmd, reply, VIR_JSON_TYPE_ARRAY) < 0)
-        return NULL;
 
-    if (virJSONValueArrayForeachSteal(virJSONValueObjectGetArray(reply, "return"),
-                                      qemuMonitorJSONGetDevicePropsWorker,
-                                      props) < 0)
-        return NULL;
+/**
+ * qemuMonitorJSONGetDevicePropsBatch:
+ * @mon: monitor object
+ * @devices: device types to query
+ * @ndevices: number of device types in @devices
+ * @props: array of @ndevices entries filled with the property hashes
+ *
+ * Same as qemuMonitorJSONGetDeviceProps for all of @devices at once,
+ * without waiting for a reply before sending the next query.
+ *
+ * Returns 0 on success, -1 on error in which case @props is cleared.
+ */
+int
+qemuMonitorJSONGetDevicePropsBatch(qemuMonitorPtr mon,
+                                   const char **devices,
+                                   size_t ndevices,
+                                   virHashTablePtr *props)
+{
+    g_autofree virJSONValuePtr *cmds = g_new0(virJSONValuePtr, ndevices);
+    g_autofree virJSONValuePtr *replies = g_new0(virJSONValuePtr, ndevices);
+    int ret = -1;
+    size_t i;
 
-    return g_steal_pointer(&props);
+    if (ndevices == 0)
+        return 0;
+
+    for (i = 0; i < ndevices; i++) {
+        props[i] = NULL;
+
+        if (!(cmds[i] = qemuMonitorJSONMakeCommand("device-list-properties",
+                                                   "s:typename", devices[i],
+                                                   NULL)))
+            goto cleanup;
+    }
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, NULL, replies, ndevices) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndevices; i++) {
+        if (!(props[i] = qemuMonitorJSONDevicePropsProcessReply(cmds[i],
+                                                                replies[i])))
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ndevices; i++) {
+        if (ret < 0)
+            g_clear_pointer(&props[i], virHashFree);
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
+    return ret;
+}
+
+
+static int
+qemuMonitorJSONObjectPropsProcessReply(virJSONValuePtr cmd,
+                                       virJSONValuePtr reply,
+                                       char ***props)
+{
+    *props = NULL;
+
+    if (qemuMonitorJSONHasError(reply, "DeviceNotFound"))
+        return 0;
+
+    return qemuMonitorJSONParsePropsList(cmd, reply, NULL, props);
 }
 
 
@@ -6804,15 +8091,74 @@ qemuMonitorJSONGetObjectProps(qemuMonitorPtr mon,
     if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
         goto cleanup;
 
-    if (qemuMonitorJSONHasError(reply, "DeviceNotFound")) {
-        ret = 0;
+    ret = qemuMonitorJSONObjectPropsProcessReply(cmd, reply, props);
+ cleanup:
+    virJSONValueFree(reply);
+    virJSONValueFree(cmd);
+    return ret;
+}
+
+
+/**
+ * qemuMonitorJSONGetObjectPropsBatch:
+ * @mon: monitor object
+ * @objects: object types to query
+ * @nobjects: number of object types in @objects
+ * @props: array of @nobjects entries filled with the property name lists
+ * @nprops: array of @nobjects entries filled with the lengths of @props
+ *
+ * Same as qemuMonitorJSONGetObjectProps for all of @objects at once,
+ * without waiting for a reply before sending the next query.
+ *
+ * Returns 0 on success, -1 on error in which case @props is cleared.
+ */
+int
+qemuMonitorJSONGetObjectPropsBatch(qemuMonitorPtr mon,
+                                   const char **objects,
+                                   size_t nobjects,
+                                   char ***props,
+                                   int *nprops)
+{
+    g_autofree virJSONValuePtr *cmds = g_new0(virJSONValuePtr, nobjects);
+    g_autofree virJSONValuePtr *replies = g_new0(virJSONValuePtr, nobjects);
+    int ret = -1;
+    size_t i;
+
+    if (nobjects == 0)
+        return 0;
+
+    for (i = 0; i < nobjects; i++) {
+        props[i] = NULL;
+        nprops[i] = 0;
+
+        if (!(cmds[i] = qemuMonitorJSONMakeCommand("qom-list-properties",
+                                                   "s:typename", objects[i],
+                                                   NULL)))
+            goto cleanup;
+    }
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, NULL, replies, nobjects) < 0)
         goto cleanup;
+
+    for (i = 0; i < nobjects; i++) {
+        if ((nprops[i] = qemuMonitorJSONObjectPropsProcessReply(cmds[i],
+                                                                replies[i],
+                                                                props + i)) < 0)
+            goto cleanup;
     }
 
-    ret = qemuMonitorJSONParsePropsList(cmd, reply, NULL, props);
+    ret = 0;
+
  cleanup:
-    virJSONValueFree(reply);
-    virJSONValueFree(cmd);
+    for (i = 0; i < nobjects; i++) {
+        if (ret < 0) {
+            virStringListFree(props[i]);
+            props[i] = NULL;
+            nprops[i] = 0;
+        }
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
     return ret;
 }
 
@@ -34,8 +34,7 @@ int qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
                              const char *data,
-                             size_t len,
-                             qemuMonitorMessagePtr msg);
+                             size_t len);
 
 int qemuMonitorJSONHumanCommand(qemuMonitorPtr mon,
                                 const char *cmd,
@@ -86,6 +85,12 @@ int qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                             bool backingChain);
 int qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
                                                     virHashTablePtr stats);
+int qemuMonitorJSONGetAllBlockStatsCapacity(qemuMonitorPtr mon,
+                                            virHashTablePtr hash,
+                                            bool backingChain,
+                                            bool blockdev,
+                                            bool *capacityErr,
+                                            virJSONValuePtr *nodedata);
 
 virHashTablePtr
 qemuMonitorJSONBlockGetNamedNodeDataJSON(virJSONValuePtr nodes);
@@ -494,6 +499,17 @@ int qemuMonitorJSONGetObjectProps(qemuMonitorPtr mon,
                                   const char *object,
                                   char ***props)
     ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+int qemuMonitorJSONGetDevicePropsBatch(qemuMonitorPtr mon,
+                                       const char **devices,
+                                       size_t ndevices,
+                                       virHashTablePtr *props)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4);
+int qemuMonitorJSONGetObjectPropsBatch(qemuMonitorPtr mon,
+                                       const char **objects,
+                                       size_t nobjects,
+                                       char ***props,
+                                       int *nprops)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4) ATTRIBUTE_NONNULL(5);
 char *qemuMonitorJSONGetTargetArch(qemuMonitorPtr mon);
 
 int qemuMonitorJSONNBDServerStart(qemuMonitorPtr mon,
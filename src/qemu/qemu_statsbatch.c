@@ -0,0 +1,406 @@
+/*
+ * qemu_statsbatch.c: parallel collection of domain statistics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_domain.h"
+#include "qemu_statsbatch.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virlog.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_statsbatch");
+
+
+typedef struct _qemuStatsBatchItem qemuStatsBatchItem;
+typedef qemuStatsBatchItem *qemuStatsBatchItemPtr;
+struct _qemuStatsBatchItem {
+    virDomainObjPtr vm;
+    char *name;
+    virDomainStatsRecordPtr record;
+    unsigned long long submitted; /* ms since epoch */
+    unsigned long long started; /* ms since epoch, 0 if not picked up yet */
+    bool finished;
+    bool busy; /* a previous collection of the domain is still running */
+};
+
+/* Shared by the caller of qemuStatsBatchRun and the jobs dispatched to
+ * the stats pool. The caller may give up waiting for domains which time
+ * out, in which case the batch stays alive until the last job
+ * referencing it finishes. */
+typedef struct _qemuStatsBatch qemuStatsBatch;
+typedef qemuStatsBatch *qemuStatsBatchPtr;
+struct _qemuStatsBatch {
+    virObjectLockable parent;
+
+    virCond cond;
+
+    qemuStatsBatchCollectFunc collect;
+    void *opaque;
+    virFreeCallback opaqueFree;
+
+    qemuStatsBatchItemPtr items;
+    size_t nitems;
+    size_t npending;
+    unsigned long long progress; /* ms since epoch of the last job start or finish */
+
+    bool abandoned;
+    bool failed;
+    virErrorPtr error; /* first error reported by a job */
+};
+
+typedef struct _qemuStatsBatchJob qemuStatsBatchJob;
+typedef qemuStatsBatchJob *qemuStatsBatchJobPtr;
+struct _qemuStatsBatchJob {
+    qemuStatsBatchPtr batch;
+    size_t idx;
+};
+
+static virClassPtr qemuStatsBatchClass;
+
+
+static void
+qemuStatsBatchRecordFree(virDomainStatsRecordPtr record)
+{
+    if (!record)
+        return;
+
+    virTypedParamsFree(record->params, record->nparams);
+    virObjectUnref(record->dom);
+    g_free(record);
+}
+
+
+static void
+qemuStatsBatchDispose(void *obj)
+{
+    qemuStatsBatchPtr batch = obj;
+    size_t i;
+
+    for (i = 0; i < batch->nitems; i++) {
+        qemuStatsBatchRecordFree(batch->items[i].record);
+        virObjectUnref(batch->items[i].vm);
+        g_free(batch->items[i].name);
+    }
+    g_free(batch->items);
+
+    if (batch->opaqueFree)
+        batch->opaqueFree(batch->opaque);
+
+    virFreeError(batch->error);
+    virCondDestroy(&batch->cond);
+}
+
+
+static int
+qemuStatsBatchOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(qemuStatsBatch, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(qemuStatsBatch);
+
+
+static qemuStatsBatchPtr
+qemuStatsBatchNew(virDomainObjPtr *vms,
+                  size_t nvms,
+                  qemuStatsBatchCollectFunc collect,
+                  void *opaque,
+                  virFreeCallback opaqueFree)
+{
+    qemuStatsBatchPtr batch;
+    size_t i;
+
+    if (qemuStatsBatchInitialize() < 0 ||
+        !(batch = virObjectLockableNew(qemuStatsBatchClass))) {
+        if (opaqueFree)
+            opaqueFree(opaque);
+        return NULL;
+    }
+
+    batch->opaque = opaque;
+    batch->opaqueFree = opaqueFree;
+    batch->collect = collect;
+
+    if (virCondInit(&batch->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virObjectUnref(batch);
+        return NULL;
+    }
+
+    batch->items = g_new0(qemuStatsBatchItem, nvms);
+    batch->nitems = nvms;
+
+    for (i = 0; i < nvms; i++) {
+        batch->items[i].vm = virObjectRef(vms[i]);
+        virObjectLock(vms[i]);
+        batch->items[i].name = g_strdup(vms[i]->def->name);
+        virObjectUnlock(vms[i]);
+    }
+
+    return batch;
+}
+
+
+/**
+ * qemuStatsBatchJobRun:
+ *
+ * Worker function of the stats thread pool, collects the stats of one
+ * domain of a batch.
+ */
+void
+qemuStatsBatchJobRun(void *data,
+                     void *opaque G_GNUC_UNUSED)
+{
+    qemuStatsBatchJobPtr job = data;
+    qemuStatsBatchPtr batch = job->batch;
+    qemuStatsBatchItemPtr item = &batch->items[job->idx];
+    qemuDomainObjPrivatePtr priv = item->vm->privateData;
+    virDomainStatsRecordPtr record = NULL;
+    unsigned long long now = 0;
+    bool abandoned;
+    int rc = 0;
+
+    virResetLastError();
+    ignore_value(virTimeMillisNow(&now));
+
+    virObjectLock(batch);
+    abandoned = batch->abandoned;
+    item->started = now;
+    batch->progress = now;
+    virObjectUnlock(batch);
+
+    if (!abandoned)
+        rc = batch->collect(item->vm, batch->opaque, &record);
+
+    /* let the following calls collect stats of the domain again */
+    g_atomic_int_set(&priv->statsCollecting, 0);
+
+    virObjectLock(batch);
+
+    if (rc < 0) {
+        batch->failed = true;
+        if (!batch->error)
+            batch->error = virSaveLastError();
+    }
+
+    if (batch->abandoned)
+        qemuStatsBatchRecordFree(record);
+    else
+        item->record = record;
+
+    ignore_value(virTimeMillisNow(&batch->progress));
+    item->finished = true;
+    batch->npending--;
+    virCondSignal(&batch->cond);
+
+    virObjectUnlock(batch);
+    virObjectUnref(batch);
+    g_free(job);
+}
+
+
+/**
+ * qemuStatsBatchWait:
+ * @batch: locked batch of stats jobs
+ * @timeout: per-domain timeout in milliseconds, 0 to wait forever
+ *
+ * Wait until every job of @batch finished or ran out of time. A domain
+ * runs out of time @timeout milliseconds after its collection started.
+ * Domains still queued behind busy workers only run out of time once
+ * no job of the batch made any progress for @timeout milliseconds, so
+ * that a long queue is not mistaken for a hung monitor.
+ */
+static void
+qemuStatsBatchWait(qemuStatsBatchPtr batch,
+                   unsigned long long timeout)
+{
+    while (batch->npending > 0) {
+        unsigned long long now;
+        unsigned long long deadline = 0;
+        size_t i;
+
+        if (timeout == 0) {
+            if (virCondWait(&batch->cond, &batch->parent.lock) < 0)
+                return;
+            continue;
+        }
+
+        if (virTimeMillisNow(&now) < 0)
+            return;
+
+        for (i = 0; i < batch->nitems; i++) {
+            qemuStatsBatchItemPtr item = &batch->items[i];
+            unsigned long long limit;
+
+            if (item->finished || item->busy)
+                continue;
+
+            if (item->started)
+                limit = item->started + timeout;
+            else
+                limit = MAX(item->submitted, batch->progress) + timeout;
+
+            if (limit > now && (deadline == 0 || limit < deadline))
+                deadline = limit;
+        }
+
+        /* all the remaining domains ran out of time */
+        if (deadline == 0)
+            return;
+
+        if (virCondWaitUntil(&batch->cond, &batch->parent.lock, deadline) < 0 &&
+            errno != ETIMEDOUT)
+            return;
+    }
+}
+
+
+/**
+ * qemuStatsBatchRun:
+ * @pool: thread pool running qemuStatsBatchJobRun
+ * @vms: domains to collect stats of
+ * @nvms: number of domains in @vms
+ * @timeout: per-domain timeout in milliseconds, 0 to wait forever
+ * @enforce: fail if stats of any domain couldn't be collected
+ * @collect: function collecting the stats of one domain
+ * @opaque: data passed to @collect
+ * @opaqueFree: function freeing @opaque
+ * @records: filled with the collected records
+ * @nrecords: incremented by the number of records added to @records
+ *
+ * Collects the stats of @vms in parallel using the workers of @pool.
+ * Ownership of @opaque is passed to this function as it may need to
+ * outlive the call if a domain times out.
+ *
+ * A domain whose collection times out keeps occupying its worker until
+ * the monitor call it is stuck in returns. Such a domain is skipped by
+ * the following calls until then, so that hung domains can't take over
+ * all the workers of @pool and stall the collection of the others.
+ * Skipped and timed out domains are left out of the result with a
+ * warning, or make the call fail if @enforce is true.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuStatsBatchRun(virThreadPoolPtr pool,
+                  virDomainObjPtr *vms,
+                  size_t nvms,
+                  unsigned long long timeout,
+                  bool enforce,
+                  qemuStatsBatchCollectFunc collect,
+                  void *opaque,
+                  virFreeCallback opaqueFree,
+                  virDomainStatsRecordPtr *records,
+                  int *nrecords)
+{
+    qemuStatsBatchPtr batch;
+    unsigned long long now;
+    size_t i;
+    int ret = -1;
+
+    if (!(batch = qemuStatsBatchNew(vms, nvms, collect, opaque, opaqueFree)))
+        return -1;
+
+    virObjectLock(batch);
+
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvms; i++) {
+        qemuStatsBatchItemPtr item = &batch->items[i];
+        qemuDomainObjPrivatePtr priv = item->vm->privateData;
+        qemuStatsBatchJobPtr job;
+
+        if (!g_atomic_int_compare_and_exchange(&priv->statsCollecting, 0, 1)) {
+            item->busy = true;
+            continue;
+        }
+
+        job = g_new0(qemuStatsBatchJob, 1);
+        job->batch = virObjectRef(batch);
+        job->idx = i;
+        item->submitted = now;
+
+        if (virThreadPoolSendJob(pool, 0, job) < 0) {
+            g_atomic_int_set(&priv->statsCollecting, 0);
+            virObjectUnref(batch);
+            g_free(job);
+            goto cleanup;
+        }
+
+        batch->npending++;
+    }
+
+    qemuStatsBatchWait(batch, timeout);
+
+    if (batch->failed) {
+        if (batch->error)
+            virSetError(batch->error);
+        goto cleanup;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        qemuStatsBatchItemPtr item = &batch->items[i];
+
+        if (item->busy) {
+            if (enforce) {
+                virReportError(VIR_ERR_OPERATION_TIMEOUT,
+                               _("statistics of domain '%s' are still being "
+                                 "collected by a previous call"),
+                               item->name);
+                goto cleanup;
+            }
+
+            VIR_WARN("Skipping statistics of domain '%s' whose previous "
+                     "collection is still running", item->name);
+            continue;
+        }
+
+        if (!item->finished) {
+            if (enforce) {
+                virReportError(VIR_ERR_OPERATION_TIMEOUT,
+                               _("timed out collecting statistics of domain '%s'"),
+                               item->name);
+                goto cleanup;
+            }
+
+            VIR_WARN("Timed out collecting statistics of domain '%s'",
+                     item->name);
+            continue;
+        }
+
+        if (item->record)
+            records[(*nrecords)++] = g_steal_pointer(&item->record);
+    }
+
+    ret = 0;
+
+ cleanup:
+    batch->abandoned = true;
+    virObjectUnlock(batch);
+    virObjectUnref(batch);
+    return ret;
+}
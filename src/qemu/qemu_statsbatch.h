@@ -0,0 +1,51 @@
+/*
+ * qemu_statsbatch.h: parallel collection of domain statistics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "domain_conf.h"
+#include "virthreadpool.h"
+
+/**
+ * qemuStatsBatchCollectFunc:
+ * @vm: unlocked domain object
+ * @opaque: data passed to qemuStatsBatchRun
+ * @record: filled with the stats record of @vm, may be left NULL
+ *
+ * Collects the statistics of a single domain. Called from the workers
+ * of the stats thread pool.
+ *
+ * Returns 0 on success, -1 on error (with an error reported).
+ */
+typedef int (*qemuStatsBatchCollectFunc)(virDomainObjPtr vm,
+                                         void *opaque,
+                                         virDomainStatsRecordPtr *record);
+
+void qemuStatsBatchJobRun(void *data,
+                          void *opaque);
+
+int qemuStatsBatchRun(virThreadPoolPtr pool,
+                      virDomainObjPtr *vms,
+                      size_t nvms,
+                      unsigned long long timeout,
+                      bool enforce,
+                      qemuStatsBatchCollectFunc collect,
+                      void *opaque,
+                      virFreeCallback opaqueFree,
+                      virDomainStatsRecordPtr *records,
+                      int *nrecords);
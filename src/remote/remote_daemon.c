@@ -58,6 +58,7 @@
 #include "virsystemd.h"
 #include "virhostuptime.h"
 #include "virdaemon.h"
+#include "virtime.h"
 
 #include "driver.h"
 
@@ -579,6 +580,7 @@ static void daemonRunStateInit(void *opaque)
 {
     virNetDaemonPtr dmn = opaque;
     g_autoptr(virIdentity) sysident = virIdentityGetSystem();
+    unsigned long long start = 0;
 #ifdef MODULE_NAME
     bool mandatory = true;
 #else /* ! MODULE_NAME */
@@ -591,6 +593,8 @@ static void daemonRunStateInit(void *opaque)
        we're done so clients get a chance to connect */
     daemonInhibitCallback(true, dmn);
 
+    ignore_value(virTimeMillisNow(&start));
+
     /* Start the stateful HV drivers
      * This is deliberately done after telling the parent process
      * we're ready, since it can take a long time and this will
@@ -607,6 +611,7 @@ static void daemonRunStateInit(void *opaque)
     }
 
     driversInitialized = true;
+    virDaemonStartupPhaseRecord("daemon.state_init", start);
 
 #ifdef WITH_DBUS
     /* Tie the non-privileged daemons to the session/shutdown lifecycle */
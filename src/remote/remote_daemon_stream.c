@@ -932,13 +932,25 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
-        if (virNetServerProgramSendStreamData(stream->prog,
-                                              client,
-                                              msg,
-                                              stream->procedure,
-                                              stream->serial,
-                                              buffer, rv) < 0)
-            goto cleanup;
+        if (rv == 0) {
+            if (virNetServerProgramSendStreamData(stream->prog,
+                                                  client,
+                                                  msg,
+                                                  stream->procedure,
+                                                  stream->serial,
+                                                  buffer, 0) < 0)
+                goto cleanup;
+        } else {
+            /* Hand the buffer over to the message rather than copying
+             * the data into the message buffer */
+            if (virNetServerProgramSendStreamDataAttach(stream->prog,
+                                                        client,
+                                                        msg,
+                                                        stream->procedure,
+                                                        stream->serial,
+                                                        &buffer, rv) < 0)
+                goto cleanup;
+        }
         msg = NULL;
     }
 
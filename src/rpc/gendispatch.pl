@@ -2152,6 +2152,9 @@ elsif ($mode eq "client") {
                 } elsif ($object eq "NetworkPort") {
                     push @argdecls, "virNetworkDefPtr net";
                 }
+                # Access drivers must only look at the name and UUID of
+                # a domain: the lockless qemu query APIs pass a stub
+                # definition with nothing else filled in
                 push @argdecls, "$objecttype $arg";
             }
             if ($checkflags) {
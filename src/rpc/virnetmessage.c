@@ -29,11 +29,188 @@
 #include "virfile.h"
 #include "virutil.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/*
+ * Message buffers are recycled through a small pool rather than being
+ * allocated and freed for every RPC call. The pool has one size class
+ * for every buffer size that virNetMessageEncodePayload may grow a
+ * buffer to, starting at VIR_NET_MESSAGE_INITIAL. Each class keeps a
+ * bounded number of unused buffers so that an occasional burst of large
+ * messages does not pin memory forever. Buffers larger than the biggest
+ * class are allocated and freed directly.
+ */
+#define VIR_NET_MESSAGE_BUFFER_CLASSES 5
+
+static const size_t virNetMessageBufferCachedMax[VIR_NET_MESSAGE_BUFFER_CLASSES] = {
+    32, 8, 4, 2, 1,
+};
+
+typedef struct _virNetMessageBufferClass virNetMessageBufferClass;
+struct _virNetMessageBufferClass {
+    virNetMessageBufferStats stats;
+    char **cache;
+};
+
+static virMutex virNetMessageBufferLock = VIR_MUTEX_INITIALIZER;
+static virNetMessageBufferClass virNetMessageBufferPool[VIR_NET_MESSAGE_BUFFER_CLASSES];
+
+
+static size_t
+virNetMessageBufferClassSize(size_t idx)
+{
+    return ((size_t)VIR_NET_MESSAGE_INITIAL << idx) + VIR_NET_MESSAGE_LEN_MAX;
+}
+
+
+/*
+ * Returns the index of the smallest class able to hold @len bytes,
+ * or -1 if @len is bigger than any class.
+ */
+static int
+virNetMessageBufferClassFind(size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_NET_MESSAGE_BUFFER_CLASSES; i++) {
+        if (len <= virNetMessageBufferClassSize(i))
+            return i;
+    }
+
+    return -1;
+}
+
+
+static char *
+virNetMessageBufferAlloc(size_t len,
+                         size_t *size)
+{
+    virNetMessageBufferClass *class;
+    char *buf = NULL;
+    int idx;
+
+    if ((idx = virNetMessageBufferClassFind(len)) < 0) {
+        *size = len;
+        return g_new(char, len);
+    }
+
+    class = &virNetMessageBufferPool[idx];
+    *size = virNetMessageBufferClassSize(idx);
+
+    virMutexLock(&virNetMessageBufferLock);
+    if (class->stats.cached > 0) {
+        buf = class->cache[--class->stats.cached];
+        class->stats.hits++;
+    } else {
+        class->stats.misses++;
+    }
+    if (++class->stats.inuse > class->stats.inuseHigh)
+        class->stats.inuseHigh = class->stats.inuse;
+    virMutexUnlock(&virNetMessageBufferLock);
+
+    if (!buf)
+        buf = g_new(char, *size);
+
+    return buf;
+}
+
+
+static void
+virNetMessageBufferRelease(char *buf,
+                           size_t size)
+{
+    virNetMessageBufferClass *class;
+    int idx;
+
+    if (!buf)
+        return;
+
+    if (size == 0 ||
+        (idx = virNetMessageBufferClassFind(size)) < 0 ||
+        virNetMessageBufferClassSize(idx) != size) {
+        g_free(buf);
+        return;
+    }
+
+    class = &virNetMessageBufferPool[idx];
+
+    virMutexLock(&virNetMessageBufferLock);
+    class->stats.inuse--;
+    if (class->stats.cached < virNetMessageBufferCachedMax[idx]) {
+        if (!class->cache)
+            class->cache = g_new0(char *, virNetMessageBufferCachedMax[idx]);
+        class->cache[class->stats.cached++] = g_steal_pointer(&buf);
+    }
+    virMutexUnlock(&virNetMessageBufferLock);
+
+    g_free(buf);
+}
+
+
+/**
+ * virNetMessageBufferReserve:
+ * @msg: the message
+ * @len: number of bytes needed
+ *
+ * Makes sure the buffer of @msg can hold at least @len bytes, taking a
+ * buffer from the pool if it needs to be replaced. The first
+ * msg->bufferLength bytes of the buffer are preserved, so callers have
+ * to update msg->bufferLength only afterwards.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetMessageBufferReserve(virNetMessagePtr msg,
+                           size_t len)
+{
+    char *buf;
+    size_t size;
+
+    if (msg->buffer && len <= msg->bufferSize)
+        return 0;
+
+    buf = virNetMessageBufferAlloc(len, &size);
+
+    if (msg->buffer) {
+        memcpy(buf, msg->buffer, MIN(msg->bufferLength, len));
+        virNetMessageBufferRelease(msg->buffer, msg->bufferSize);
+    }
+
+    msg->buffer = buf;
+    msg->bufferSize = size;
+    return 0;
+}
+
+
+/**
+ * virNetMessageBufferGetStats:
+ * @stats: filled with a newly allocated array of per-class statistics
+ *
+ * Returns the number of elements in @stats.
+ */
+size_t
+virNetMessageBufferGetStats(virNetMessageBufferStatsPtr *stats)
+{
+    size_t i;
+
+    *stats = g_new0(virNetMessageBufferStats, VIR_NET_MESSAGE_BUFFER_CLASSES);
+
+    virMutexLock(&virNetMessageBufferLock);
+    for (i = 0; i < VIR_NET_MESSAGE_BUFFER_CLASSES; i++) {
+        (*stats)[i] = virNetMessageBufferPool[i].stats;
+        (*stats)[i].size = virNetMessageBufferClassSize(i);
+        (*stats)[i].cachedMax = virNetMessageBufferCachedMax[i];
+    }
+    virMutexUnlock(&virNetMessageBufferLock);
+
+    return VIR_NET_MESSAGE_BUFFER_CLASSES;
+}
+
+
 virNetMessagePtr virNetMessageNew(bool tracked)
 {
     virNetMessagePtr msg;
@@ -62,7 +239,12 @@ virNetMessageClearPayload(virNetMessagePtr msg)
 
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
-    VIR_FREE(msg->buffer);
+    virNetMessageBufferRelease(g_steal_pointer(&msg->buffer), msg->bufferSize);
+    msg->bufferSize = 0;
+
+    msg->payloadOffset = 0;
+    msg->payloadLength = 0;
+    VIR_FREE(msg->payload);
 }
 
 
@@ -152,9 +334,9 @@ int virNetMessageDecodeLength(virNetMessagePtr msg)
 
     /* Extend our declared buffer length and carry
        on reading the header + payload */
-    msg->bufferLength += len;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageBufferReserve(msg, msg->bufferLength + len) < 0)
         goto cleanup;
+    msg->bufferLength += len;
 
     VIR_DEBUG("Got length, now need %zu total (%u more)",
               msg->bufferLength, len);
@@ -229,9 +411,10 @@ int virNetMessageEncodeHeader(virNetMessagePtr msg)
     int ret = -1;
     unsigned int len = 0;
 
-    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    msg->bufferLength = 0;
+    if (virNetMessageBufferReserve(msg, VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX) < 0)
         return ret;
+    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
     msg->bufferOffset = 0;
 
     /* Format the header. */
@@ -369,11 +552,11 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
 
         xdr_destroy(&xdr);
 
-        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageBufferReserve(msg, newlen + VIR_NET_MESSAGE_LEN_MAX) < 0)
             goto error;
 
+        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
+
         xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
                       msg->bufferLength - msg->bufferOffset, XDR_ENCODE);
 
@@ -453,11 +636,11 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
             return -1;
         }
 
-        msg->bufferLength = msg->bufferOffset + len;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageBufferReserve(msg, msg->bufferOffset + len) < 0)
             return -1;
 
+        msg->bufferLength = msg->bufferOffset + len;
+
         VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
     }
 
@@ -484,6 +667,59 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
 }
 
 
+/**
+ * virNetMessageEncodePayloadAttach:
+ * @msg: the outgoing message, with its header already encoded
+ * @data: the raw payload, ownership is transferred to @msg
+ * @len: length of @data
+ *
+ * Like virNetMessageEncodePayloadRaw, but rather than copying @data
+ * after the header, @data is attached to @msg and written out from
+ * where it is. Only the header ends up in msg->buffer.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int virNetMessageEncodePayloadAttach(virNetMessagePtr msg,
+                                     char **data,
+                                     size_t len)
+{
+    XDR xdr;
+    unsigned int msglen;
+
+    if ((msg->bufferOffset + len) >
+        (VIR_NET_MESSAGE_MAX + VIR_NET_MESSAGE_LEN_MAX)) {
+        virReportError(VIR_ERR_RPC,
+                       _("Stream data too long to send "
+                         "(%zu bytes needed, %zu bytes available)"),
+                       len,
+                       VIR_NET_MESSAGE_MAX +
+                       VIR_NET_MESSAGE_LEN_MAX -
+                       msg->bufferOffset);
+        return -1;
+    }
+
+    /* Encode the length word covering both the header and the payload. */
+    VIR_DEBUG("Encode length as %zu", msg->bufferOffset + len);
+    xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
+    msglen = msg->bufferOffset + len;
+    if (!xdr_u_int(&xdr, &msglen)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message length"));
+        xdr_destroy(&xdr);
+        return -1;
+    }
+    xdr_destroy(&xdr);
+
+    VIR_FREE(msg->payload);
+    msg->payload = g_steal_pointer(data);
+    msg->payloadLength = len;
+    msg->payloadOffset = 0;
+
+    msg->bufferLength = msg->bufferOffset;
+    msg->bufferOffset = 0;
+    return 0;
+}
+
+
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
 {
     XDR xdr;
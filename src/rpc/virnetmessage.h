@@ -37,6 +37,15 @@ struct _virNetMessage {
                   /* Maximum   VIR_NET_MESSAGE_MAX     + VIR_NET_MESSAGE_LEN_MAX */
     size_t bufferLength;
     size_t bufferOffset;
+    size_t bufferSize; /* Allocated size of @buffer if obtained via
+                        * virNetMessageBufferReserve, 0 otherwise */
+
+    /* Optional data sent on the wire right after @buffer, without being
+     * copied into it. Counted in the length word, but not in
+     * @bufferLength. */
+    char *payload;
+    size_t payloadLength;
+    size_t payloadOffset;
 
     virNetMessageHeader header;
 
@@ -51,8 +60,30 @@ struct _virNetMessage {
 };
 
 
+typedef struct _virNetMessageBufferStats virNetMessageBufferStats;
+typedef virNetMessageBufferStats *virNetMessageBufferStatsPtr;
+
+/* Usage of one size class of the message buffer pool */
+struct _virNetMessageBufferStats {
+    size_t size;                /* size of the buffers in this class */
+    size_t cached;              /* unused buffers kept for reuse */
+    size_t cachedMax;           /* limit of @cached */
+    size_t inuse;               /* buffers currently held by messages */
+    size_t inuseHigh;           /* high-water mark of @inuse */
+    unsigned long long hits;    /* allocations served from the cache */
+    unsigned long long misses;  /* allocations which needed malloc */
+};
+
+
 virNetMessagePtr virNetMessageNew(bool tracked);
 
+int virNetMessageBufferReserve(virNetMessagePtr msg,
+                               size_t len)
+    ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+
+size_t virNetMessageBufferGetStats(virNetMessageBufferStatsPtr *stats)
+    ATTRIBUTE_NONNULL(1);
+
 void virNetMessageClearPayload(virNetMessagePtr msg);
 
 void virNetMessageClear(virNetMessagePtr);
@@ -90,6 +121,10 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
 int virNetMessageEncodePayloadEmpty(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) G_GNUC_WARN_UNUSED_RESULT;
+int virNetMessageEncodePayloadAttach(virNetMessagePtr msg,
+                                     char **data,
+                                     size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
 
 void virNetMessageSaveError(virNetMessageErrorPtr rerr)
     ATTRIBUTE_NONNULL(1);
@@ -27,6 +27,7 @@
 #include "virerror.h"
 #include "virthread.h"
 #include "virthreadpool.h"
+#include "virhashcode.h"
 #include "virstring.h"
 #include "virutil.h"
 
@@ -58,13 +59,19 @@ struct _virNetServer {
     size_t nprograms;
     virNetServerProgramPtr *programs;
 
-    size_t nclients;                    /* Current clients count */
-    virNetServerClientPtr *clients;     /* Clients */
+    virHashTablePtr clients;            /* Clients keyed by their ID */
     unsigned long long next_client_id;  /* next client ID */
     size_t nclients_max;                /* Max allowed clients count */
     size_t nclients_unauth;             /* Unauthenticated clients count */
     size_t nclients_unauth_max;         /* Max allowed unauth clients count */
 
+    /* Clients marked for closing which were not reaped yet. Protected
+     * by its own lock rather than the server lock, as clients are
+     * queued here with their own lock held. */
+    virMutex closingLock;
+    size_t nclosing;
+    virNetServerClientPtr *closing;
+
     int keepaliveInterval;
     unsigned int keepaliveCount;
 
@@ -94,6 +101,61 @@ static int virNetServerOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virNetServer);
 
+
+static uint32_t
+virNetServerClientIDCode(const void *name,
+                         uint32_t seed)
+{
+    unsigned long long value = *((unsigned long long *)name);
+    return virHashCodeGen(&value, sizeof(value), seed);
+}
+
+
+static bool
+virNetServerClientIDEqual(const void *namea,
+                          const void *nameb)
+{
+    return *((unsigned long long *)namea) == *((unsigned long long *)nameb);
+}
+
+
+static void *
+virNetServerClientIDCopy(const void *name)
+{
+    unsigned long long *copy = g_new0(unsigned long long, 1);
+
+    *copy = *((unsigned long long *)name);
+    return (void *)copy;
+}
+
+
+static char *
+virNetServerClientIDPrintHuman(const void *name)
+{
+    return g_strdup_printf("%llu", *((unsigned long long *)name));
+}
+
+
+static void
+virNetServerClientIDFree(void *name)
+{
+    VIR_FREE(name);
+}
+
+
+static int
+virNetServerClientIDCompare(const virHashKeyValuePair *a,
+                            const virHashKeyValuePair *b)
+{
+    unsigned long long ida = *((unsigned long long *)a->key);
+    unsigned long long idb = *((unsigned long long *)b->key);
+
+    if (ida < idb)
+        return -1;
+    return ida > idb;
+}
+
+
 unsigned long long virNetServerNextClientID(virNetServerPtr srv)
 {
     unsigned long long val;
@@ -255,10 +317,12 @@ virNetServerDispatchNewMessage(virNetServerClientPtr client,
 static void
 virNetServerCheckLimits(virNetServerPtr srv)
 {
+    size_t nclients = virHashSize(srv->clients);
+
     VIR_DEBUG("Checking client-related limits to re-enable or temporarily "
               "suspend services: nclients=%zu nclients_max=%zu "
               "nclients_unauth=%zu nclients_unauth_max=%zu",
-              srv->nclients, srv->nclients_max,
+              nclients, srv->nclients_max,
               srv->nclients_unauth, srv->nclients_unauth_max);
 
     /* Check the max_anonymous_clients and max_clients limits so that we can
@@ -268,13 +332,13 @@ virNetServerCheckLimits(virNetServerPtr srv)
      * A new client can only be accepted if both max_clients and
      * max_anonymous_clients wouldn't get overcommitted by accepting it.
      */
-    if (srv->nclients >= srv->nclients_max ||
+    if (nclients >= srv->nclients_max ||
         (srv->nclients_unauth_max &&
          srv->nclients_unauth >= srv->nclients_unauth_max)) {
         /* Temporarily stop accepting new clients */
         VIR_INFO("Temporarily suspending services");
         virNetServerUpdateServicesLocked(srv, false);
-    } else if (srv->nclients < srv->nclients_max &&
+    } else if (nclients < srv->nclients_max &&
                (!srv->nclients_unauth_max ||
                 srv->nclients_unauth < srv->nclients_unauth_max)) {
         /* Now it makes sense to accept() a new client. */
@@ -283,21 +347,44 @@ virNetServerCheckLimits(virNetServerPtr srv)
     }
 }
 
+/*
+ * Called with @client locked, possibly with @srv locked too, so only
+ * the closing queue lock may be acquired here.
+ */
+static void
+virNetServerClientWantClose(virNetServerClientPtr client,
+                            void *opaque)
+{
+    virNetServerPtr srv = opaque;
+    virNetServerClientPtr ref = virObjectRef(client);
+
+    virMutexLock(&srv->closingLock);
+    ignore_value(VIR_APPEND_ELEMENT(srv->closing, srv->nclosing, ref));
+    virMutexUnlock(&srv->closingLock);
+}
+
+
 int virNetServerAddClient(virNetServerPtr srv,
                           virNetServerClientPtr client)
 {
+    unsigned long long id = virNetServerClientGetID(client);
+
     virObjectLock(srv);
 
     if (virNetServerClientInit(client) < 0)
         goto error;
 
-    if (VIR_EXPAND_N(srv->clients, srv->nclients, 1) < 0)
+    if (virHashAddEntry(srv->clients, &id, client) < 0)
         goto error;
-    srv->clients[srv->nclients-1] = virObjectRef(client);
+    virObjectRef(client);
 
     virObjectLock(client);
     if (virNetServerClientIsAuthPendingLocked(client))
         virNetServerTrackPendingAuthLocked(srv);
+    virNetServerClientSetWantCloseNotifyLocked(client,
+                                               virNetServerClientWantClose,
+                                               virObjectRef(srv),
+                                               virObjectFreeCallback);
     virObjectUnlock(client);
 
     virNetServerCheckLimits(srv);
@@ -369,6 +456,22 @@ virNetServerPtr virNetServerNew(const char *name,
     if (!(srv = virObjectLockableNew(virNetServerClass)))
         return NULL;
 
+    if (virMutexInit(&srv->closingLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        virObjectUnref(srv);
+        return NULL;
+    }
+
+    if (!(srv->clients = virHashCreateFull(32,
+                                           virObjectFreeHashData,
+                                           virNetServerClientIDCode,
+                                           virNetServerClientIDEqual,
+                                           virNetServerClientIDCopy,
+                                           virNetServerClientIDPrintHuman,
+                                           virNetServerClientIDFree)))
+        goto error;
+
     if (!(srv->workers = virThreadPoolNewFull(min_workers, max_workers,
                                               priority_workers,
                                               virNetServerHandleJob,
@@ -551,6 +654,7 @@ virJSONValuePtr virNetServerPreExecRestart(virNetServerPtr srv)
 {
     virJSONValuePtr object = virJSONValueNewObject();
     virJSONValuePtr clients;
+    g_autofree virHashKeyValuePairPtr clientItems = NULL;
     virJSONValuePtr services;
     size_t i;
 
@@ -628,9 +732,15 @@ virJSONValuePtr virNetServerPreExecRestart(virNetServerPtr srv)
         goto error;
     }
 
-    for (i = 0; i < srv->nclients; i++) {
+    if (!(clientItems = virHashGetItems(srv->clients,
+                                        virNetServerClientIDCompare)))
+        goto error;
+
+    for (i = 0; clientItems[i].key; i++) {
+        virNetServerClientPtr client = (virNetServerClientPtr) clientItems[i].value;
         virJSONValuePtr child;
-        if (!(child = virNetServerClientPreExecRestart(srv->clients[i])))
+
+        if (!(child = virNetServerClientPreExecRestart(client)))
             goto error;
 
         if (virJSONValueArrayAppend(clients, child) < 0) {
@@ -922,11 +1032,22 @@ void virNetServerDispose(void *obj)
         virObjectUnref(srv->programs[i]);
     VIR_FREE(srv->programs);
 
-    for (i = 0; i < srv->nclients; i++)
-        virObjectUnref(srv->clients[i]);
-    VIR_FREE(srv->clients);
+    virHashFree(srv->clients);
+
+    virObjectListFreeCount(srv->closing, srv->nclosing);
+    virMutexDestroy(&srv->closingLock);
+}
+
+static int
+virNetServerCloseClient(void *payload,
+                        const void *name G_GNUC_UNUSED,
+                        void *opaque G_GNUC_UNUSED)
+{
+    virNetServerClientClose(payload);
+    return 0;
 }
 
+
 void virNetServerClose(virNetServerPtr srv)
 {
     size_t i;
@@ -939,8 +1060,7 @@ void virNetServerClose(virNetServerPtr srv)
     for (i = 0; i < srv->nservices; i++)
         virNetServerServiceClose(srv->services[i]);
 
-    for (i = 0; i < srv->nclients; i++)
-        virNetServerClientClose(srv->clients[i]);
+    virHashForEach(srv->clients, virNetServerCloseClient, NULL);
 
     virObjectUnlock(srv);
 }
@@ -964,51 +1084,63 @@ virNetServerHasClients(virNetServerPtr srv)
     bool ret;
 
     virObjectLock(srv);
-    ret = !!srv->nclients;
+    ret = virHashSize(srv->clients) > 0;
     virObjectUnlock(srv);
 
     return ret;
 }
 
+/*
+ * Reaps the clients which were marked for closing since the last call.
+ * Only the queued clients are looked at, so the cost does not depend on
+ * the number of connected clients.
+ */
 void
 virNetServerProcessClients(virNetServerPtr srv)
 {
+    virNetServerClientPtr *closing;
+    size_t nclosing;
     size_t i;
-    virNetServerClientPtr client;
 
-    virObjectLock(srv);
+    virMutexLock(&srv->closingLock);
+    closing = g_steal_pointer(&srv->closing);
+    nclosing = srv->nclosing;
+    srv->nclosing = 0;
+    virMutexUnlock(&srv->closingLock);
 
- reprocess:
-    for (i = 0; i < srv->nclients; i++) {
-        /* Coverity 5.3.0 couldn't see that srv->clients is non-NULL
-         * if srv->nclients is non-zero.  */
-        sa_assert(srv->clients);
+    for (i = 0; i < nclosing; i++) {
+        virNetServerClientPtr client = closing[i];
+        unsigned long long id = virNetServerClientGetID(client);
+        virNetServerClientPtr stolen = NULL;
 
-        client = srv->clients[i];
+        virObjectLock(srv);
         virObjectLock(client);
+
         if (virNetServerClientWantCloseLocked(client))
             virNetServerClientCloseLocked(client);
 
-        if (virNetServerClientIsClosedLocked(client)) {
-            VIR_DELETE_ELEMENT(srv->clients, i, srv->nclients);
+        if (virNetServerClientIsClosedLocked(client) &&
+            virHashLookup(srv->clients, &id) == client) {
+            stolen = virHashSteal(srv->clients, &id);
 
             /* Update server authentication tracking */
             virNetServerSetClientAuthCompletedLocked(srv, client);
             virObjectUnlock(client);
 
             virNetServerCheckLimits(srv);
-
-            virObjectUnlock(srv);
-            virObjectUnref(client);
-            virObjectLock(srv);
-
-            goto reprocess;
         } else {
             virObjectUnlock(client);
         }
+
+        virObjectUnlock(srv);
+
+        /* Drop the references without holding the server lock as
+         * disposing of the client may call back into drivers */
+        virObjectUnref(stolen);
+        virObjectUnref(client);
     }
 
-    virObjectUnlock(srv);
+    VIR_FREE(closing);
 }
 
 const char *
@@ -1073,7 +1205,7 @@ virNetServerGetCurrentClients(virNetServerPtr srv)
     size_t ret;
 
     virObjectLock(srv);
-    ret = srv->nclients;
+    ret = virHashSize(srv->clients);
     virObjectUnlock(srv);
 
     return ret;
@@ -1128,23 +1260,22 @@ virNetServerGetClients(virNetServerPtr srv,
     size_t i;
     size_t nclients = 0;
     virNetServerClientPtr *list = NULL;
+    g_autofree virHashKeyValuePairPtr items = NULL;
 
     virObjectLock(srv);
 
-    for (i = 0; i < srv->nclients; i++) {
-        virNetServerClientPtr client = virObjectRef(srv->clients[i]);
-        if (VIR_APPEND_ELEMENT(list, nclients, client) < 0) {
-            virObjectUnref(client);
-            goto cleanup;
-        }
-    }
+    if (!(items = virHashGetItems(srv->clients, virNetServerClientIDCompare)))
+        goto cleanup;
+
+    list = g_new0(virNetServerClientPtr, virHashSize(srv->clients) + 1);
+
+    for (i = 0; items[i].key; i++)
+        list[nclients++] = virObjectRef((void *) items[i].value);
 
-    *clts = list;
-    list = NULL;
+    *clts = g_steal_pointer(&list);
     ret = nclients;
 
  cleanup:
-    virObjectListFreeCount(list, nclients);
     virObjectUnlock(srv);
     return ret;
 }
@@ -1153,17 +1284,10 @@ virNetServerClientPtr
 virNetServerGetClient(virNetServerPtr srv,
                       unsigned long long id)
 {
-    size_t i;
     virNetServerClientPtr ret = NULL;
 
     virObjectLock(srv);
-
-    for (i = 0; i < srv->nclients; i++) {
-        virNetServerClientPtr client = srv->clients[i];
-        if (virNetServerClientGetID(client) == id)
-            ret = virObjectRef(client);
-    }
-
+    ret = virObjectRef(virHashLookup(srv->clients, &id));
     virObjectUnlock(srv);
 
     if (!ret)
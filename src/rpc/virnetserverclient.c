@@ -111,6 +111,12 @@ struct _virNetServerClient
     virNetServerClientDispatchFunc dispatchFunc;
     void *dispatchOpaque;
 
+    /* Invoked once, the first time the client is marked for closing */
+    virNetServerClientWantCloseFunc wantCloseFunc;
+    void *wantCloseOpaque;
+    virFreeCallback wantCloseOpaqueFree;
+    bool wantCloseNotified;
+
     void *privateData;
     virFreeCallback privateDataFreeFunc;
     virNetServerClientPrivPreExecRestart privateDataPreExecRestart;
@@ -140,6 +146,28 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
 static int virNetServerClientSendMessageLocked(virNetServerClientPtr client,
                                                virNetMessagePtr msg);
 
+/*
+ * @client: a locked client object
+ *
+ * Marks the client for closing and lets the owner know about it, so
+ * that it can reap the client without looking at every other client.
+ */
+static void
+virNetServerClientSetWantCloseLocked(virNetServerClientPtr client)
+{
+    client->wantClose = true;
+
+    if (client->wantCloseFunc && !client->wantCloseNotified) {
+        client->wantCloseNotified = true;
+        client->wantCloseFunc(client, client->wantCloseOpaque);
+
+        /* the notification is never sent again, release the opaque */
+        if (client->wantCloseOpaqueFree)
+            client->wantCloseOpaqueFree(client->wantCloseOpaque);
+        client->wantCloseOpaque = NULL;
+    }
+}
+
 /*
  * @client: a locked client object
  */
@@ -330,7 +358,7 @@ static void virNetServerClientDispatchMessage(virNetServerClientPtr client,
     virObjectLock(client);
     if (!client->dispatchFunc) {
         virNetMessageFree(msg);
-        client->wantClose = true;
+        virNetServerClientSetWantCloseLocked(client);
         virObjectUnlock(client);
     } else {
         virObjectUnlock(client);
@@ -944,6 +972,36 @@ void virNetServerClientSetDispatcher(virNetServerClientPtr client,
 }
 
 
+/*
+ * @client: a locked client object
+ *
+ * Registers @func to be called once the client is marked for closing.
+ * @func is called with @client locked and thus must not acquire any
+ * lock which may be held while locking a client. If the client is
+ * already marked for closing, @func is called right away. @opaque is
+ * released by @ff once @func was called or when the client is freed.
+ */
+void
+virNetServerClientSetWantCloseNotifyLocked(virNetServerClientPtr client,
+                                           virNetServerClientWantCloseFunc func,
+                                           void *opaque,
+                                           virFreeCallback ff)
+{
+    if (client->wantCloseFunc) {
+        if (ff)
+            ff(opaque);
+        return;
+    }
+
+    client->wantCloseFunc = func;
+    client->wantCloseOpaque = opaque;
+    client->wantCloseOpaqueFree = ff;
+
+    if (client->wantClose)
+        virNetServerClientSetWantCloseLocked(client);
+}
+
+
 const char *virNetServerClientLocalAddrStringSASL(virNetServerClientPtr client)
 {
     if (!client->sock)
@@ -978,6 +1036,9 @@ void virNetServerClientDispose(void *obj)
 
     g_clear_object(&client->identity);
 
+    if (client->wantCloseOpaque && client->wantCloseOpaqueFree)
+        client->wantCloseOpaqueFree(client->wantCloseOpaque);
+
 #if WITH_SASL
     virObjectUnref(client->sasl);
 #endif
@@ -1037,7 +1098,7 @@ virNetServerClientCloseLocked(virNetServerClientPtr client)
         virObjectUnref(client->tls);
         client->tls = NULL;
     }
-    client->wantClose = true;
+    virNetServerClientSetWantCloseLocked(client);
 
     while (client->rx) {
         virNetMessagePtr msg
@@ -1083,7 +1144,7 @@ void virNetServerClientDelayedClose(virNetServerClientPtr client)
 void virNetServerClientImmediateClose(virNetServerClientPtr client)
 {
     virObjectLock(client);
-    client->wantClose = true;
+    virNetServerClientSetWantCloseLocked(client);
     virObjectUnlock(client);
 }
 
@@ -1138,7 +1199,7 @@ int virNetServerClientInit(virNetServerClientPtr client)
     return 0;
 
  error:
-    client->wantClose = true;
+    virNetServerClientSetWantCloseLocked(client);
     virObjectUnlock(client);
     return -1;
 }
@@ -1161,7 +1222,7 @@ static ssize_t virNetServerClientRead(virNetServerClientPtr client)
         virReportError(VIR_ERR_RPC,
                        _("unexpected zero/negative length request %lld"),
                        (long long int)(client->rx->bufferLength - client->rx->bufferOffset));
-        client->wantClose = true;
+        virNetServerClientSetWantCloseLocked(client);
         return -1;
     }
 
@@ -1191,7 +1252,7 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
  readmore:
     if (client->rx->nfds == 0) {
         if (virNetServerClientRead(client) < 0) {
-            client->wantClose = true;
+            virNetServerClientSetWantCloseLocked(client);
             return NULL; /* Error */
         }
     }
@@ -1202,7 +1263,7 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
     /* Either done with length word header */
     if (client->rx->bufferLength == VIR_NET_MESSAGE_LEN_MAX) {
         if (virNetMessageDecodeLength(client->rx) < 0) {
-            client->wantClose = true;
+            virNetServerClientSetWantCloseLocked(client);
             return NULL;
         }
 
@@ -1223,7 +1284,7 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
         if (virNetMessageDecodeHeader(msg) < 0) {
             virNetMessageQueueServe(&client->rx);
             virNetMessageFree(msg);
-            client->wantClose = true;
+            virNetServerClientSetWantCloseLocked(client);
             return NULL;
         }
 
@@ -1233,7 +1294,7 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
             if (virNetMessageDecodeNumFDs(msg) < 0) {
                 virNetMessageQueueServe(&client->rx);
                 virNetMessageFree(msg);
-                client->wantClose = true;
+                virNetServerClientSetWantCloseLocked(client);
                 return NULL; /* Error */
             }
 
@@ -1243,7 +1304,7 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
                 if ((rv = virNetSocketRecvFD(client->sock, &(msg->fds[i]))) < 0) {
                     virNetMessageQueueServe(&client->rx);
                     virNetMessageFree(msg);
-                    client->wantClose = true;
+                    virNetServerClientSetWantCloseLocked(client);
                     return NULL;
                 }
                 if (rv == 0) /* Blocking */
@@ -1288,7 +1349,7 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
                 if (ret < 0) {
                     virNetMessageFree(msg);
                     msg = NULL;
-                    client->wantClose = true;
+                    virNetServerClientSetWantCloseLocked(client);
                     break;
                 }
                 if (ret > 0) {
@@ -1303,12 +1364,12 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
         /* Possibly need to create another receive buffer */
         if (client->nrequests < client->nrequests_max) {
             if (!(client->rx = virNetMessageNew(true))) {
-                client->wantClose = true;
+                virNetServerClientSetWantCloseLocked(client);
             } else {
                 client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
                 if (VIR_ALLOC_N(client->rx->buffer,
                                 client->rx->bufferLength) < 0) {
-                    client->wantClose = true;
+                    virNetServerClientSetWantCloseLocked(client);
                 } else {
                     client->nrequests++;
                 }
@@ -1321,6 +1382,18 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
 }
 
 
+/*
+ * Whether both the buffer and the attached payload of @msg were
+ * written out completely
+ */
+static bool
+virNetServerClientMessageSent(virNetMessagePtr msg)
+{
+    return msg->bufferOffset == msg->bufferLength &&
+        msg->payloadOffset == msg->payloadLength;
+}
+
+
 /*
  * Send client->tx using no encoding
  *
@@ -1331,26 +1404,46 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
  */
 static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
 {
+    virNetMessagePtr msg = client->tx;
+    GOutputVector vec[2];
+    size_t nvec = 0;
+    size_t header;
     ssize_t ret;
 
-    if (client->tx->bufferLength < client->tx->bufferOffset) {
+    if (msg->bufferLength < msg->bufferOffset ||
+        msg->payloadLength < msg->payloadOffset) {
         virReportError(VIR_ERR_RPC,
                        _("unexpected zero/negative length request %lld"),
-                       (long long int)(client->tx->bufferLength - client->tx->bufferOffset));
-        client->wantClose = true;
+                       (long long int)(msg->bufferLength - msg->bufferOffset +
+                                       msg->payloadLength - msg->payloadOffset));
+        virNetServerClientSetWantCloseLocked(client);
         return -1;
     }
 
-    if (client->tx->bufferLength == client->tx->bufferOffset)
+    if (virNetServerClientMessageSent(msg))
         return 1;
 
-    ret = virNetSocketWrite(client->sock,
-                            client->tx->buffer + client->tx->bufferOffset,
-                            client->tx->bufferLength - client->tx->bufferOffset);
+    /* Send the header and the attached payload, if any, together
+     * without copying the payload into the message buffer first */
+    if (msg->bufferOffset < msg->bufferLength) {
+        vec[nvec].buffer = msg->buffer + msg->bufferOffset;
+        vec[nvec].size = msg->bufferLength - msg->bufferOffset;
+        nvec++;
+    }
+
+    if (msg->payloadOffset < msg->payloadLength) {
+        vec[nvec].buffer = msg->payload + msg->payloadOffset;
+        vec[nvec].size = msg->payloadLength - msg->payloadOffset;
+        nvec++;
+    }
+
+    ret = virNetSocketWritev(client->sock, vec, nvec);
     if (ret <= 0)
         return ret; /* -1 error, 0 = egain */
 
-    client->tx->bufferOffset += ret;
+    header = MIN(ret, msg->bufferLength - msg->bufferOffset);
+    msg->bufferOffset += header;
+    msg->payloadOffset += ret - header;
     return ret;
 }
 
@@ -1363,25 +1456,25 @@ static void
 virNetServerClientDispatchWrite(virNetServerClientPtr client)
 {
     while (client->tx) {
-        if (client->tx->bufferOffset < client->tx->bufferLength) {
+        if (!virNetServerClientMessageSent(client->tx)) {
             ssize_t ret;
             ret = virNetServerClientWrite(client);
             if (ret < 0) {
-                client->wantClose = true;
+                virNetServerClientSetWantCloseLocked(client);
                 return;
             }
             if (ret == 0)
                 return; /* Would block on write EAGAIN */
         }
 
-        if (client->tx->bufferOffset == client->tx->bufferLength) {
+        if (virNetServerClientMessageSent(client->tx)) {
             virNetMessagePtr msg;
             size_t i;
 
             for (i = client->tx->donefds; i < client->tx->nfds; i++) {
                 int rv;
                 if ((rv = virNetSocketSendFD(client->sock, client->tx->fds[i])) < 0) {
-                    client->wantClose = true;
+                    virNetServerClientSetWantCloseLocked(client);
                     return;
                 }
                 if (rv == 0) /* Blocking */
@@ -1426,7 +1519,7 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
             virNetServerClientUpdateEvent(client);
 
             if (client->delayedClose)
-                client->wantClose = true;
+                virNetServerClientSetWantCloseLocked(client);
          }
     }
 }
@@ -1443,7 +1536,7 @@ virNetServerClientDispatchHandshake(virNetServerClientPtr client)
     if (ret == 0) {
         /* Finished.  Next step is to check the certificate. */
         if (virNetServerClientCheckAccess(client) < 0)
-            client->wantClose = true;
+            virNetServerClientSetWantCloseLocked(client);
         else
             virNetServerClientUpdateEvent(client);
     } else if (ret > 0) {
@@ -1453,7 +1546,7 @@ virNetServerClientDispatchHandshake(virNetServerClientPtr client)
         virNetServerClientUpdateEvent(client);
     } else {
         /* Fatal error in handshake */
-        client->wantClose = true;
+        virNetServerClientSetWantCloseLocked(client);
     }
 }
 
@@ -1491,7 +1584,7 @@ virNetServerClientDispatchEvent(virNetSocketPtr sock, int events, void *opaque)
      * disconnect */
     if (events & (VIR_EVENT_HANDLE_ERROR |
                   VIR_EVENT_HANDLE_HANGUP))
-        client->wantClose = true;
+        virNetServerClientSetWantCloseLocked(client);
 
     virObjectUnlock(client);
 
@@ -1513,7 +1606,7 @@ virNetServerClientSendMessageLocked(virNetServerClientPtr client,
     if (client->sock && !client->wantClose) {
         PROBE(RPC_SERVER_CLIENT_MSG_TX_QUEUE,
               "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
-              client, msg->bufferLength,
+              client, msg->bufferLength + msg->payloadLength,
               msg->header.prog, msg->header.vers, msg->header.proc,
               msg->header.type, msg->header.status, msg->header.serial);
         virNetMessageQueuePush(&client->tx, msg);
@@ -40,6 +40,9 @@ typedef void (*virNetServerClientDispatchFunc)(virNetServerClientPtr client,
                                                virNetMessagePtr msg,
                                                void *opaque);
 
+typedef void (*virNetServerClientWantCloseFunc)(virNetServerClientPtr client,
+                                                void *opaque);
+
 /*
  * @client is locked when this callback is called
  */
@@ -139,6 +142,10 @@ void virNetServerClientSetCloseHook(virNetServerClientPtr client,
 void virNetServerClientSetDispatcher(virNetServerClientPtr client,
                                      virNetServerClientDispatchFunc func,
                                      void *opaque);
+void virNetServerClientSetWantCloseNotifyLocked(virNetServerClientPtr client,
+                                                virNetServerClientWantCloseFunc func,
+                                                void *opaque,
+                                                virFreeCallback ff);
 void virNetServerClientClose(virNetServerClientPtr client);
 void virNetServerClientCloseLocked(virNetServerClientPtr client);
 bool virNetServerClientIsClosedLocked(virNetServerClientPtr client);
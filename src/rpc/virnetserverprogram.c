@@ -534,6 +534,42 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
 }
 
 
+/**
+ * virNetServerProgramSendStreamDataAttach:
+ *
+ * Like virNetServerProgramSendStreamData, but @data is not copied into
+ * the message buffer. Instead the ownership of @data is transferred to
+ * @msg and it is written out directly after the message header.
+ */
+int virNetServerProgramSendStreamDataAttach(virNetServerProgramPtr prog,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg,
+                                            int procedure,
+                                            unsigned int serial,
+                                            char **data,
+                                            size_t len)
+{
+    VIR_DEBUG("client=%p msg=%p data=%p len=%zu", client, msg, *data, len);
+
+    msg->header.prog = prog->program;
+    msg->header.vers = prog->version;
+    msg->header.proc = procedure;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = serial;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        return -1;
+
+    if (virNetMessageEncodePayloadAttach(msg, data, len) < 0)
+        return -1;
+
+    VIR_DEBUG("Total %zu", msg->bufferLength + msg->payloadLength);
+
+    return virNetServerClientSendMessage(client, msg);
+}
+
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
@@ -98,6 +98,14 @@ int virNetServerProgramSendStreamData(virNetServerProgramPtr prog,
                                       const char *data,
                                       size_t len);
 
+int virNetServerProgramSendStreamDataAttach(virNetServerProgramPtr prog,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg,
+                                            int procedure,
+                                            unsigned int serial,
+                                            char **data,
+                                            size_t len);
+
 int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
                                       virNetServerClientPtr client,
                                       virNetMessagePtr msg,
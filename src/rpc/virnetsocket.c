@@ -22,6 +22,9 @@
 #include <config.h>
 
 #include <sys/stat.h>
+#ifndef WIN32
+# include <sys/uio.h>
+#endif
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
@@ -1877,6 +1880,99 @@ static ssize_t virNetSocketWriteWire(virNetSocketPtr sock, const char *buf, size
 }
 
 
+/* Maximum amount of data carried by a single TLS record */
+#define VIR_NET_SOCKET_TLS_RECORD_MAX (16 * 1024)
+
+/* Maximum number of vectors passed to a single writev() call */
+#define VIR_NET_SOCKET_WRITEV_MAX 8
+
+/*
+ * Writes out the concatenation of @vec, which must not start with an
+ * empty vector. Returns the number of bytes written, 0 on EAGAIN or -1
+ * on error, like virNetSocketWriteWire.
+ */
+static ssize_t virNetSocketWritevWire(virNetSocketPtr sock,
+                                      const GOutputVector *vec,
+                                      size_t nvec)
+{
+#ifndef WIN32
+    struct iovec iov[VIR_NET_SOCKET_WRITEV_MAX];
+#endif
+    ssize_t ret;
+    size_t i;
+
+    if (nvec == 1)
+        return virNetSocketWriteWire(sock, vec[0].buffer, vec[0].size);
+
+#if WITH_SSH2
+    if (sock->sshSession)
+        return virNetSocketWriteWire(sock, vec[0].buffer, vec[0].size);
+#endif
+
+#if WITH_LIBSSH
+    if (sock->libsshSession)
+        return virNetSocketWriteWire(sock, vec[0].buffer, vec[0].size);
+#endif
+
+    if (sock->tlsSession &&
+        virNetTLSSessionGetHandshakeStatus(sock->tlsSession) ==
+        VIR_NET_TLS_HANDSHAKE_COMPLETE) {
+        char record[VIR_NET_SOCKET_TLS_RECORD_MAX];
+        size_t len = 0;
+
+        /* Large vectors fill whole records on their own */
+        if (vec[0].size >= sizeof(record))
+            return virNetSocketWriteWire(sock, vec[0].buffer, vec[0].size);
+
+        /* Otherwise merge the leading vectors into a single record,
+         * rather than sending e.g. a message header in a record of its
+         * own. The record is rebuilt from the same data if the write
+         * is retried after EAGAIN, as GnuTLS requires. */
+        for (i = 0; i < nvec && len < sizeof(record); i++) {
+            size_t n = MIN(vec[i].size, sizeof(record) - len);
+
+            memcpy(record + len, vec[i].buffer, n);
+            len += n;
+        }
+
+        return virNetSocketWriteWire(sock, record, len);
+    }
+
+#ifndef WIN32
+    nvec = MIN(nvec, G_N_ELEMENTS(iov));
+    for (i = 0; i < nvec; i++) {
+        iov[i].iov_base = (void *) vec[i].buffer;
+        iov[i].iov_len = vec[i].size;
+    }
+
+ rewrite:
+    ret = writev(sock->fd, iov, nvec);
+
+    if (ret < 0) {
+        if (errno == EINTR)
+            goto rewrite;
+        if (errno == EAGAIN)
+            return 0;
+
+        virReportSystemError(errno, "%s",
+                             _("Cannot write data"));
+        return -1;
+    }
+    if (ret == 0) {
+        virReportSystemError(EIO, "%s",
+                             _("End of file while writing data"));
+        return -1;
+    }
+
+    return ret;
+#else /* WIN32 */
+    ret = virNetSocketWriteWire(sock, vec[0].buffer, vec[0].size);
+
+    return ret;
+#endif /* WIN32 */
+}
+
+
 #if WITH_SASL
 static ssize_t virNetSocketReadSASL(virNetSocketPtr sock, char *buf, size_t len)
 {
@@ -2014,6 +2110,45 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+/**
+ * virNetSocketWritev:
+ * @sock: the socket
+ * @vec: data to write
+ * @nvec: number of elements in @vec
+ *
+ * Writes out the concatenation of the buffers in @vec, using a single
+ * writev() for plain sockets. With TLS small leading buffers are merged
+ * into one record. SASL and SSH transports write one buffer at a time.
+ *
+ * Returns the number of bytes written, which may end within any of the
+ * buffers, 0 if the write would block, or -1 on error.
+ */
+ssize_t virNetSocketWritev(virNetSocketPtr sock,
+                           const GOutputVector *vec,
+                           size_t nvec)
+{
+    ssize_t ret;
+
+    while (nvec > 0 && vec[0].size == 0) {
+        vec++;
+        nvec--;
+    }
+
+    if (nvec == 0)
+        return 0;
+
+    virObjectLock(sock);
+#if WITH_SASL
+    if (sock->saslSession)
+        ret = virNetSocketWriteSASL(sock, vec[0].buffer, vec[0].size);
+    else
+#endif
+        ret = virNetSocketWritevWire(sock, vec, nvec);
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -2224,7 +2224,8 @@ storageVolDownload(virStorageVolPtr vol,
     virStorageVolDefPtr voldef = NULL;
     int ret = -1;
 
-    virCheckFlags(VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM, -1);
+    virCheckFlags(VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM |
+                  VIR_STORAGE_VOL_DOWNLOAD_BYPASS_CACHE, -1);
 
     if (!(voldef = virStorageVolDefFromVol(vol, &obj, &backend)))
         return -1;
@@ -2393,7 +2394,8 @@ storageVolUpload(virStorageVolPtr vol,
     int rc;
     int ret = -1;
 
-    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, -1);
+    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM |
+                  VIR_STORAGE_VOL_UPLOAD_BYPASS_CACHE, -1);
 
     if (!(voldef = virStorageVolDefFromVol(vol, &obj, &backend)))
         return -1;
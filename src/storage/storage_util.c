@@ -122,6 +122,108 @@ reflinkCloneFile(int dest_fd G_GNUC_UNUSED,
 #endif
 
 
+#define COPY_RANGE_CHUNK_SIZE (64 * 1024 * 1024)
+
+/*
+ * Let the kernel copy @total bytes from @inputfd to @fd with
+ * copy_file_range(), which allows filesystems to share extents or
+ * do a server side copy. Holes in the input are skipped, leaving
+ * holes in the output. The copy is done in chunks so that
+ * the allocation of the new volume grows steadily and can be
+ * watched via virStorageVolGetInfo.
+ *
+ * Returns 0 on success, 1 if the kernel can't copy between these
+ * files (the caller should fall back to copying the data itself
+ * from the current positions in both files), -errno on error.
+ */
+#if HAVE_COPY_FILE_RANGE
+static int
+storageBackendCopyFileRange(virStorageVolDefPtr vol,
+                            virStorageVolDefPtr inputvol,
+                            int inputfd,
+                            int fd,
+                            unsigned long long *total)
+{
+    bool copied = false;
+
+    while (*total > 0) {
+        int inData;
+        long long len;
+
+        if (virFileInData(inputfd, &inData, &len) < 0)
+            return -EIO;
+
+        /* implicit hole at EOF */
+        if (len == 0)
+            break;
+
+        if (len > *total)
+            len = *total;
+
+        if (!inData) {
+            if (lseek(inputfd, len, SEEK_CUR) < 0 ||
+                lseek(fd, len, SEEK_CUR) < 0) {
+                int ret = -errno;
+                virReportSystemError(errno,
+                                     _("cannot extend file '%s'"),
+                                     vol->target.path);
+                return ret;
+            }
+            *total -= len;
+            continue;
+        }
+
+        while (len > 0) {
+            ssize_t got;
+
+            got = copy_file_range(inputfd, NULL, fd, NULL,
+                                  MIN(len, COPY_RANGE_CHUNK_SIZE), 0);
+            if (got < 0) {
+                int ret = -errno;
+
+                if (errno == EINTR)
+                    continue;
+
+                if (!copied &&
+                    (errno == ENOSYS || errno == EINVAL ||
+                     errno == EXDEV || errno == EOPNOTSUPP)) {
+                    VIR_DEBUG("copy_file_range not usable from '%s' to '%s': %s",
+                              inputvol->target.path, vol->target.path,
+                              g_strerror(errno));
+                    return 1;
+                }
+
+                virReportSystemError(errno,
+                                     _("failed to copy '%s' to '%s'"),
+                                     inputvol->target.path, vol->target.path);
+                return ret;
+            }
+
+            /* input file is shorter than expected */
+            if (got == 0)
+                return 0;
+
+            copied = true;
+            len -= got;
+            *total -= got;
+        }
+    }
+
+    return 0;
+}
+#else /* !HAVE_COPY_FILE_RANGE */
+static int
+storageBackendCopyFileRange(virStorageVolDefPtr vol G_GNUC_UNUSED,
+                            virStorageVolDefPtr inputvol G_GNUC_UNUSED,
+                            int inputfd G_GNUC_UNUSED,
+                            int fd G_GNUC_UNUSED,
+                            unsigned long long *total G_GNUC_UNUSED)
+{
+    return 1;
+}
+#endif /* !HAVE_COPY_FILE_RANGE */
+
+
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
@@ -132,6 +234,7 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
 {
     int amtread = -1;
     int ret = 0;
+    int rc = 1;
     size_t rbytes = READ_BLOCK_SIZE_DEFAULT;
     int wbytes = 0;
     int interval;
@@ -176,7 +279,35 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
         }
     }
 
-    while (amtread != 0) {
+    /* Even if not asked to, clone the whole file if the new volume
+     * is allowed to be sparse anyway: sharing the extents costs no
+     * more space than a sparse copy until either volume is written. */
+    if (want_sparse &&
+        vol->target.allocation < inputvol->target.capacity &&
+        fstat(inputfd, &st) == 0 &&
+        S_ISREG(st.st_mode) &&
+        (unsigned long long) st.st_size == *total) {
+        if (reflinkCloneFile(fd, inputfd) == 0) {
+            VIR_DEBUG("cloned '%s' to '%s'",
+                      inputvol->target.path, vol->target.path);
+            *total = 0;
+            return 0;
+        }
+        VIR_DEBUG("cannot clone '%s' to '%s': %s",
+                  inputvol->target.path, vol->target.path,
+                  g_strerror(errno));
+    }
+
+    /* Holes are skipped and extents may end up shared with the input
+     * volume, so only when the new volume is meant to be sparse rather
+     * than merely allowed to skip zeroes of space allocated upfront */
+    if (want_sparse &&
+        vol->target.allocation < inputvol->target.capacity &&
+        (rc = storageBackendCopyFileRange(vol, inputvol, inputfd,
+                                          fd, total)) < 0)
+        return rc;
+
+    while (rc > 0 && amtread != 0) {
         int amtleft;
 
         if (*total < rbytes)
@@ -2383,6 +2514,22 @@ storageBackendPloopHasSnapshots(char *path)
 }
 
 
+static int
+storageBackendVolStreamDirectFlag(int *oflags)
+{
+    int directFlag = virFileDirectFdFlag();
+
+    if (directFlag < 0) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("bypass cache unsupported by this system"));
+        return -1;
+    }
+
+    *oflags |= directFlag;
+    return 0;
+}
+
+
 int
 virStorageBackendVolUploadLocal(virStoragePoolObjPtr pool G_GNUC_UNUSED,
                                 virStorageVolDefPtr vol,
@@ -2394,9 +2541,16 @@ virStorageBackendVolUploadLocal(virStoragePoolObjPtr pool G_GNUC_UNUSED,
     char *target_path = vol->target.path;
     int has_snap = 0;
     bool sparse = flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM;
+    int oflags = O_WRONLY;
     g_autofree char *path = NULL;
 
-    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM, -1);
+    virCheckFlags(VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM |
+                  VIR_STORAGE_VOL_UPLOAD_BYPASS_CACHE, -1);
+
+    if (flags & VIR_STORAGE_VOL_UPLOAD_BYPASS_CACHE &&
+        storageBackendVolStreamDirectFlag(&oflags) < 0)
+        return -1;
+
     /* if volume has target format VIR_STORAGE_FILE_PLOOP
      * we need to restore DiskDescriptor.xml, according to
      * new contents of volume. This operation will be performed
@@ -2420,7 +2574,7 @@ virStorageBackendVolUploadLocal(virStoragePoolObjPtr pool G_GNUC_UNUSED,
     /* Not using O_CREAT because the file is required to already exist at
      * this point */
     return virFDStreamOpenBlockDevice(stream, target_path,
-                                      offset, len, sparse, O_WRONLY);
+                                      offset, len, sparse, oflags);
 }
 
 int
@@ -2434,9 +2588,16 @@ virStorageBackendVolDownloadLocal(virStoragePoolObjPtr pool G_GNUC_UNUSED,
     char *target_path = vol->target.path;
     int has_snap = 0;
     bool sparse = flags & VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM;
+    int oflags = O_RDONLY;
     g_autofree char *path = NULL;
 
-    virCheckFlags(VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM, -1);
+    virCheckFlags(VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM |
+                  VIR_STORAGE_VOL_DOWNLOAD_BYPASS_CACHE, -1);
+
+    if (flags & VIR_STORAGE_VOL_DOWNLOAD_BYPASS_CACHE &&
+        storageBackendVolStreamDirectFlag(&oflags) < 0)
+        return -1;
+
     if (vol->target.format == VIR_STORAGE_FILE_PLOOP) {
         has_snap = storageBackendPloopHasSnapshots(vol->target.path);
         if (has_snap < 0) {
@@ -2452,7 +2613,7 @@ virStorageBackendVolDownloadLocal(virStoragePoolObjPtr pool G_GNUC_UNUSED,
     }
 
     return virFDStreamOpenBlockDevice(stream, target_path,
-                                      offset, len, sparse, O_RDONLY);
+                                      offset, len, sparse, oflags);
 }
 
 
@@ -2495,22 +2656,66 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/* Bytes zeroed by a single offloaded request */
+#define WIPE_ZERO_RANGE_SIZE (64 * 1024 * 1024)
+/* Size of the buffer used when we have to write the zeroes ourselves */
+#define WIPE_WRITE_SIZE (1024 * 1024)
+
+
+/*
+ * Ask the kernel to zero @len bytes at @offset: BLKZEROOUT lets the
+ * device do it (e.g. with WRITE ZEROES or WRITE SAME), keeping the
+ * blocks allocated on thin storage, FALLOC_FL_ZERO_RANGE turns the
+ * range of a file into unwritten extents.
+ *
+ * Returns 0 on success, 1 if the kernel can't do it for this file
+ * or device, -1 on error with errno set.
+ */
+static int
+storageBackendZeroRange(int fd G_GNUC_UNUSED,
+                        bool blockdev,
+                        off_t offset G_GNUC_UNUSED,
+                        off_t len G_GNUC_UNUSED)
+{
+    int rc = -1;
+
+    errno = EOPNOTSUPP;
+    if (blockdev) {
+#ifdef BLKZEROOUT
+        uint64_t range[2] = { offset, len };
+
+        rc = ioctl(fd, BLKZEROOUT, range);
+#endif
+    } else {
+#if HAVE_FALLOCATE - 0 && defined(FALLOC_FL_ZERO_RANGE)
+        rc = fallocate(fd, FALLOC_FL_ZERO_RANGE, offset, len);
+#endif
+    }
+
+    if (rc < 0 &&
+        (errno == EOPNOTSUPP || errno == ENOTTY ||
+         errno == ENOSYS || errno == EINVAL))
+        return 1;
+
+    return rc;
+}
+
+
 static int
 storageBackendWipeLocal(const char *path,
                         int fd,
                         unsigned long long wipe_len,
                         size_t writebuf_length,
+                        bool blockdev,
                         bool zero_end)
 {
     int written = 0;
     unsigned long long remaining = 0;
     off_t size;
     size_t write_size = 0;
+    bool offload = true;
     g_autofree char *writebuf = NULL;
 
-    if (VIR_ALLOC_N(writebuf, writebuf_length) < 0)
-        return -1;
-
     if (!zero_end) {
         if ((size = lseek(fd, 0, SEEK_SET)) < 0) {
             virReportSystemError(errno,
@@ -2533,6 +2738,42 @@ storageBackendWipeLocal(const char *path,
 
     remaining = wipe_len;
     while (remaining > 0) {
+        off_t offset = size + (wipe_len - remaining);
+
+        if (offload) {
+            int rc;
+
+            write_size = MIN(remaining, WIPE_ZERO_RANGE_SIZE);
+            if ((rc = storageBackendZeroRange(fd, blockdev,
+                                              offset, write_size)) < 0) {
+                virReportSystemError(errno,
+                                     _("Failed to zero %zu bytes of "
+                                       "storage volume with path '%s'"),
+                                     write_size, path);
+                return -1;
+            }
+
+            if (rc == 0) {
+                remaining -= write_size;
+                continue;
+            }
+
+            VIR_DEBUG("Cannot offload zeroing of '%s', writing zeroes", path);
+            offload = false;
+
+            if (lseek(fd, offset, SEEK_SET) < 0) {
+                virReportSystemError(errno,
+                                     _("Failed to seek in volume with path '%s'"),
+                                     path);
+                return -1;
+            }
+
+            if (writebuf_length < WIPE_WRITE_SIZE)
+                writebuf_length = VIR_ROUND_UP(WIPE_WRITE_SIZE, writebuf_length);
+
+            if (VIR_ALLOC_N(writebuf, writebuf_length) < 0)
+                return -1;
+        }
 
         write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
         written = safewrite(fd, writebuf, write_size);
@@ -2639,7 +2880,7 @@ storageBackendVolWipeLocalFile(const char *path,
         return storageBackendVolZeroSparseFileLocal(path, st.st_size, fd);
 
     return storageBackendWipeLocal(path, fd, allocation, st.st_blksize,
-                                   zero_end);
+                                   S_ISBLK(st.st_mode), zero_end);
 }
 
 
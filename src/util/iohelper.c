@@ -27,6 +27,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include "virthread.h"
 #include "virfile.h"
@@ -42,6 +43,63 @@
 # define O_DIRECT 0
 #endif
 
+/*
+ * Let the kernel move the data from @fdin to @fdout without
+ * bouncing it through our buffer. One end of the copy is always
+ * the pipe connected to libvirtd, which is what splice() needs.
+ *
+ * Returns 1 if all data was transferred, 0 if the kernel can't
+ * do it for this pair of FDs (in which case nothing was
+ * transferred and the caller should fall back to read/write),
+ * -1 on error.
+ */
+static int
+runIOCopy(int fdin G_GNUC_UNUSED,
+          const char *fdinname G_GNUC_UNUSED,
+          int fdout G_GNUC_UNUSED,
+          const char *fdoutname G_GNUC_UNUSED,
+          size_t buflen G_GNUC_UNUSED)
+{
+#if HAVE_SPLICE
+    struct stat sbin;
+    struct stat sbout;
+    unsigned long long total = 0;
+
+    if (fstat(fdin, &sbin) < 0 || fstat(fdout, &sbout) < 0)
+        return 0;
+
+    if (!S_ISFIFO(sbin.st_mode) && !S_ISFIFO(sbout.st_mode))
+        return 0;
+
+    while (1) {
+        ssize_t got;
+
+        if ((got = splice(fdin, NULL, fdout, NULL, buflen,
+                          SPLICE_F_MOVE | SPLICE_F_MORE)) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            if (total == 0 &&
+                (errno == ENOSYS || errno == EINVAL))
+                return 0;
+
+            virReportSystemError(errno, _("Unable to copy %s to %s"),
+                                 fdinname, fdoutname);
+            return -1;
+        }
+
+        if (got == 0)
+            break;
+
+        total += got;
+    }
+
+    return 1;
+#else /* !HAVE_SPLICE */
+    return 0;
+#endif /* !HAVE_SPLICE */
+}
+
 static int
 runIO(const char *path, int fd, int oflags)
 {
@@ -55,6 +113,7 @@ runIO(const char *path, int fd, int oflags)
     unsigned long long total = 0;
     bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
     off_t end = 0;
+    int copied = 0;
 
 #if HAVE_POSIX_MEMALIGN
     if (posix_memalign(&base, alignMask + 1, buflen)) {
@@ -105,7 +164,13 @@ runIO(const char *path, int fd, int oflags)
         goto cleanup;
     }
 
-    while (1) {
+    /* O_DIRECT needs the aligned buffer, so only buffered I/O can
+     * be handed over to the kernel. */
+    if (!direct &&
+        (copied = runIOCopy(fdin, fdinname, fdout, fdoutname, buflen)) < 0)
+        goto cleanup;
+
+    while (!copied) {
         ssize_t got;
 
         /* If we read with O_DIRECT from file we can't use saferead as
@@ -493,6 +493,50 @@ virCgroupGetValueRaw(const char *path,
 }
 
 
+/**
+ * virCgroupGetValueAt:
+ *
+ * @dirfd: file descriptor of a cgroup directory
+ * @key: name of the file to read
+ * @value: filled with the contents of the file
+ *
+ * Same as virCgroupGetValueRaw, except the file is looked up relative
+ * to an already open directory which saves resolving the whole path.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+virCgroupGetValueAt(int dirfd,
+                    const char *key,
+                    char **value)
+{
+    VIR_AUTOCLOSE fd = -1;
+    int rc;
+
+    *value = NULL;
+
+    VIR_DEBUG("Get value %s at %d", key, dirfd);
+
+    if ((fd = openat(dirfd, key, O_RDONLY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to open '%s'"), key);
+        return -1;
+    }
+
+    if ((rc = virFileReadLimFD(fd, 1024*1024, value)) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read from '%s'"), key);
+        return -1;
+    }
+
+    /* Terminated with '\n' has sometimes harmful effects to the caller */
+    if (rc > 0 && (*value)[rc - 1] == '\n')
+        (*value)[rc - 1] = '\0';
+
+    return 0;
+}
+
+
 int
 virCgroupSetValueStr(virCgroupPtr group,
                      int controller,
@@ -662,6 +706,8 @@ virCgroupNew(pid_t pid,
              int controllers,
              virCgroupPtr *group)
 {
+    size_t i;
+
     VIR_DEBUG("pid=%lld path=%s parent=%p controllers=%d group=%p",
               (long long) pid, path, parent, controllers, group);
     *group = NULL;
@@ -669,6 +715,9 @@ virCgroupNew(pid_t pid,
     if (VIR_ALLOC((*group)) < 0)
         goto error;
 
+    for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++)
+        (*group)->statsfds[i] = -1;
+
     if (path[0] == '/' || !parent) {
         (*group)->path = g_strdup(path);
     } else {
@@ -2681,6 +2730,93 @@ virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
 }
 
 
+static int
+virCgroupGetStatsDirFD(virCgroupPtr group,
+                       int controller)
+{
+    g_autofree char *path = NULL;
+    int fd;
+
+    if (group->statsfds[controller] >= 0)
+        return group->statsfds[controller];
+
+    if (virCgroupPathOfController(group, controller, NULL, &path) < 0)
+        return -1;
+
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, _("Unable to open '%s'"), path);
+        return -1;
+    }
+
+    group->statsfds[controller] = fd;
+    return fd;
+}
+
+
+static int
+virCgroupGetStatsSnapshotController(virCgroupPtr group,
+                                    int controller,
+                                    virCgroupStatsPtr stats)
+{
+    virCgroupBackendPtr backend = virCgroupBackendForController(group, controller);
+    int dirfd;
+
+    if (!backend) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to get cgroup backend for '%s'"),
+                       "getStatsSnapshot");
+        return -1;
+    }
+
+    if (!backend->getStatsSnapshot) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                       _("operation '%s' not supported"),
+                       "getStatsSnapshot");
+        return -1;
+    }
+
+    if ((dirfd = virCgroupGetStatsDirFD(group, controller)) < 0)
+        return -1;
+
+    return backend->getStatsSnapshot(group, controller, dirfd, stats);
+}
+
+
+/**
+ * virCgroupGetStatsSnapshot:
+ *
+ * @group: The cgroup to get stats for
+ * @flags: bitwise-OR of virCgroupStatsFlags selecting the stats
+ * @stats: filled with the stats
+ *
+ * Reads the CPU accounting of @group the same way as
+ * virCgroupGetCpuacctUsage and virCgroupGetCpuacctStat do, but with
+ * each stats file read only once
+ * and relative to a directory which is kept open in @group, so that
+ * the stats of many groups can be collected repeatedly without
+ * resolving the cgroup paths again.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+virCgroupGetStatsSnapshot(virCgroupPtr group,
+                          unsigned int flags,
+                          virCgroupStatsPtr stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    if (flags & VIR_CGROUP_STATS_CPU) {
+        if (virCgroupGetStatsSnapshotController(group,
+                                                VIR_CGROUP_CONTROLLER_CPUACCT,
+                                                stats) < 0)
+            return -1;
+        stats->flags |= VIR_CGROUP_STATS_CPU;
+    }
+
+    return 0;
+}
+
+
 int
 virCgroupSetFreezerState(virCgroupPtr group, const char *state)
 {
@@ -3441,6 +3577,17 @@ virCgroupGetCpuacctStat(virCgroupPtr group G_GNUC_UNUSED,
 }
 
 
+int
+virCgroupGetStatsSnapshot(virCgroupPtr group G_GNUC_UNUSED,
+                          unsigned int flags G_GNUC_UNUSED,
+                          virCgroupStatsPtr stats G_GNUC_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupGetDomainTotalCpuStats(virCgroupPtr group G_GNUC_UNUSED,
                                 virTypedParameterPtr params G_GNUC_UNUSED,
@@ -3555,6 +3702,9 @@ virCgroupFree(virCgroupPtr *group)
     VIR_FREE((*group)->unified.mountPoint);
     VIR_FREE((*group)->unified.placement);
 
+    for (i = 0; i < VIR_CGROUP_CONTROLLER_LAST; i++)
+        VIR_FORCE_CLOSE((*group)->statsfds[i]);
+
     VIR_FREE((*group)->path);
     VIR_FREE(*group);
 }
@@ -239,6 +239,25 @@ int virCgroupGetCpuacctPercpuUsage(virCgroupPtr group, char **usage);
 int virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
                             unsigned long long *sys);
 
+typedef enum {
+    VIR_CGROUP_STATS_CPU = 1 << 0,
+} virCgroupStatsFlags;
+
+struct _virCgroupStats {
+    unsigned int flags; /* virCgroupStatsFlags that were filled in */
+
+    /* VIR_CGROUP_STATS_CPU, in nanoseconds */
+    unsigned long long cpuTime;
+    unsigned long long userTime;
+    unsigned long long sysTime;
+};
+typedef struct _virCgroupStats virCgroupStats;
+typedef virCgroupStats *virCgroupStatsPtr;
+
+int virCgroupGetStatsSnapshot(virCgroupPtr group,
+                              unsigned int flags,
+                              virCgroupStatsPtr stats);
+
 int virCgroupSetFreezerState(virCgroupPtr group, const char *state);
 int virCgroupGetFreezerState(virCgroupPtr group, char **state);
 
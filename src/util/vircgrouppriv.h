@@ -66,6 +66,10 @@ struct _virCgroup {
 
     virCgroupV1Controller legacy[VIR_CGROUP_CONTROLLER_LAST];
     virCgroupV2Controller unified;
+
+    /* Directories of controllers used by virCgroupGetStatsSnapshot,
+     * opened on first use, -1 if not opened yet */
+    int statsfds[VIR_CGROUP_CONTROLLER_LAST];
 };
 
 int virCgroupSetValueRaw(const char *path,
@@ -74,6 +78,10 @@ int virCgroupSetValueRaw(const char *path,
 int virCgroupGetValueRaw(const char *path,
                          char **value);
 
+int virCgroupGetValueAt(int dirfd,
+                        const char *key,
+                        char **value);
+
 int virCgroupSetValueStr(virCgroupPtr group,
                          int controller,
                          const char *key,
@@ -1964,18 +1964,13 @@ virCgroupV1GetCpuacctPercpuUsage(virCgroupPtr group,
 
 
 static int
-virCgroupV1GetCpuacctStat(virCgroupPtr group,
-                          unsigned long long *user,
-                          unsigned long long *sys)
+virCgroupV1ParseCpuacctStat(char *str,
+                            unsigned long long *user,
+                            unsigned long long *sys)
 {
-    g_autofree char *str = NULL;
     char *p;
     static double scale = -1.0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpuacct.stat", &str) < 0)
-        return -1;
-
     if (!(p = STRSKIP(str, "user ")) ||
         virStrToLong_ull(p, &p, 10, user) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -2009,6 +2004,56 @@ virCgroupV1GetCpuacctStat(virCgroupPtr group,
 }
 
 
+static int
+virCgroupV1GetCpuacctStat(virCgroupPtr group,
+                          unsigned long long *user,
+                          unsigned long long *sys)
+{
+    g_autofree char *str = NULL;
+
+    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                             "cpuacct.stat", &str) < 0)
+        return -1;
+
+    return virCgroupV1ParseCpuacctStat(str, user, sys);
+}
+
+
+static int
+virCgroupV1GetStatsSnapshot(virCgroupPtr group G_GNUC_UNUSED,
+                            int controller,
+                            int dirfd,
+                            virCgroupStatsPtr stats)
+{
+    g_autofree char *usage = NULL;
+    g_autofree char *str = NULL;
+
+    switch (controller) {
+    case VIR_CGROUP_CONTROLLER_CPUACCT:
+        if (virCgroupGetValueAt(dirfd, "cpuacct.usage", &usage) < 0)
+            return -1;
+
+        if (virStrToLong_ull(usage, NULL, 10, &stats->cpuTime) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to parse '%s' as an integer"),
+                           usage);
+            return -1;
+        }
+
+        if (virCgroupGetValueAt(dirfd, "cpuacct.stat", &str) < 0)
+            return -1;
+
+        return virCgroupV1ParseCpuacctStat(str, &stats->userTime,
+                                           &stats->sysTime);
+    }
+
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                   _("stats snapshot of v1 controller '%s' is not supported"),
+                   virCgroupV1ControllerTypeToString(controller));
+    return -1;
+}
+
+
 static int
 virCgroupV1SetFreezerState(virCgroupPtr group,
                            const char *state)
@@ -2163,6 +2208,7 @@ virCgroupBackend virCgroupV1Backend = {
     .getCpuacctUsage = virCgroupV1GetCpuacctUsage,
     .getCpuacctPercpuUsage = virCgroupV1GetCpuacctPercpuUsage,
     .getCpuacctStat = virCgroupV1GetCpuacctStat,
+    .getStatsSnapshot = virCgroupV1GetStatsSnapshot,
 
     .setFreezerState = virCgroupV1SetFreezerState,
     .getFreezerState = virCgroupV1GetFreezerState,
@@ -1602,82 +1602,102 @@ virCgroupV2SupportsCpuBW(virCgroupPtr cgroup)
 }
 
 
+/* Parses the value of @key from the contents of cpu.stat, converting
+ * microseconds to nanoseconds */
 static int
-virCgroupV2GetCpuacctUsage(virCgroupPtr group,
-                           unsigned long long *usage)
+virCgroupV2ParseCpuStat(const char *str,
+                        const char *key,
+                        unsigned long long *value)
 {
-    g_autofree char *str = NULL;
-    char *tmp;
+    const char *tmp = str;
+    size_t keylen = strlen(key);
+    char *end;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpu.stat", &str) < 0) {
-        return -1;
+    while ((tmp = strstr(tmp, key))) {
+        if ((tmp == str || tmp[-1] == '\n') && tmp[keylen] == ' ')
+            break;
+        tmp += keylen;
     }
 
-    if (!(tmp = strstr(str, "usage_usec "))) {
+    if (!tmp) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot parse cpu usage stat '%s'"), str);
+                       _("cannot parse '%s' from cpu stat '%s'"), key, str);
         return -1;
     }
-    tmp += strlen("usage_usec ");
+    tmp += keylen + 1;
 
-    if (virStrToLong_ull(tmp, &tmp, 10, usage) < 0) {
+    if (virStrToLong_ull(tmp, &end, 10, value) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Failed to parse value '%s' as number."), tmp);
         return -1;
     }
 
-    *usage *= 1000;
+    *value *= 1000;
 
     return 0;
 }
 
 
+static int
+virCgroupV2GetCpuacctUsage(virCgroupPtr group,
+                           unsigned long long *usage)
+{
+    g_autofree char *str = NULL;
+
+    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                             "cpu.stat", &str) < 0) {
+        return -1;
+    }
+
+    return virCgroupV2ParseCpuStat(str, "usage_usec", usage);
+}
+
+
 static int
 virCgroupV2GetCpuacctStat(virCgroupPtr group,
                           unsigned long long *user,
                           unsigned long long *sys)
 {
     g_autofree char *str = NULL;
-    char *tmp;
-    unsigned long long userVal = 0;
-    unsigned long long sysVal = 0;
 
     if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
                              "cpu.stat", &str) < 0) {
         return -1;
     }
 
-    if (!(tmp = strstr(str, "user_usec "))) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot parse cpu user stat '%s'"), str);
+    if (virCgroupV2ParseCpuStat(str, "user_usec", user) < 0 ||
+        virCgroupV2ParseCpuStat(str, "system_usec", sys) < 0)
         return -1;
-    }
-    tmp += strlen("user_usec ");
 
-    if (virStrToLong_ull(tmp, &tmp, 10, &userVal) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Failed to parse value '%s' as number."), tmp);
-        return -1;
-    }
+    return 0;
+}
 
-    if (!(tmp = strstr(str, "system_usec "))) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot parse cpu sys stat '%s'"), str);
-        return -1;
-    }
-    tmp += strlen("system_usec ");
 
-    if (virStrToLong_ull(tmp, &tmp, 10, &sysVal) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Failed to parse value '%s' as number."), tmp);
-        return -1;
-    }
+static int
+virCgroupV2GetStatsSnapshot(virCgroupPtr group G_GNUC_UNUSED,
+                            int controller,
+                            int dirfd,
+                            virCgroupStatsPtr stats)
+{
+    g_autofree char *str = NULL;
+
+    switch (controller) {
+    case VIR_CGROUP_CONTROLLER_CPUACCT:
+        if (virCgroupGetValueAt(dirfd, "cpu.stat", &str) < 0)
+            return -1;
 
-    *user = userVal * 1000;
-    *sys = sysVal * 1000;
+        if (virCgroupV2ParseCpuStat(str, "usage_usec", &stats->cpuTime) < 0 ||
+            virCgroupV2ParseCpuStat(str, "user_usec", &stats->userTime) < 0 ||
+            virCgroupV2ParseCpuStat(str, "system_usec", &stats->sysTime) < 0)
+            return -1;
 
-    return 0;
+        return 0;
+    }
+
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                   _("stats snapshot of v2 controller '%s' is not supported"),
+                   virCgroupV2ControllerTypeToString(controller));
+    return -1;
 }
 
 
@@ -1902,6 +1922,7 @@ virCgroupBackend virCgroupV2Backend = {
 
     .getCpuacctUsage = virCgroupV2GetCpuacctUsage,
     .getCpuacctStat = virCgroupV2GetCpuacctStat,
+    .getStatsSnapshot = virCgroupV2GetStatsSnapshot,
 
     .setCpusetMems = virCgroupV2SetCpusetMems,
     .getCpusetMems = virCgroupV2GetCpusetMems,
@@ -34,9 +34,14 @@
 #include "virfile.h"
 #include "virlog.h"
 #include "viralloc.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "virtypedparam.h"
 
 #include "configmake.h"
 
+#define VIR_FROM_THIS VIR_FROM_NONE
+
 #ifndef WIN32
 
 int
@@ -288,3 +293,90 @@ int virDaemonUnixSocketPaths(const char *sock_prefix G_GNUC_UNUSED,
 }
 
 #endif /* WIN32 */
+
+
+typedef struct _virDaemonStartupPhase virDaemonStartupPhase;
+struct _virDaemonStartupPhase {
+    char *name;
+    unsigned long long duration; /* ms */
+};
+
+static virMutex virDaemonStartupLock = VIR_MUTEX_INITIALIZER;
+static virDaemonStartupPhase *virDaemonStartupPhases;
+static size_t virDaemonStartupNPhases;
+
+
+/**
+ * virDaemonStartupPhaseRecord:
+ * @name: name of the phase, e.g. "qemu.load_status"
+ * @start: time the phase started at, as returned by virTimeMillisNow
+ *
+ * Records how long the startup phase @name took, for reporting via
+ * virDaemonGetStartupPhases. A phase recorded again (e.g. after the
+ * driver was reloaded) replaces the previous value.
+ */
+void
+virDaemonStartupPhaseRecord(const char *name,
+                            unsigned long long start)
+{
+    unsigned long long now;
+    size_t i;
+
+    if (virTimeMillisNow(&now) < 0)
+        return;
+
+    virMutexLock(&virDaemonStartupLock);
+
+    for (i = 0; i < virDaemonStartupNPhases; i++) {
+        if (STREQ(virDaemonStartupPhases[i].name, name))
+            break;
+    }
+
+    if (i == virDaemonStartupNPhases) {
+        if (VIR_EXPAND_N(virDaemonStartupPhases, virDaemonStartupNPhases, 1) < 0)
+            goto cleanup;
+        virDaemonStartupPhases[i].name = g_strdup(name);
+    }
+
+    virDaemonStartupPhases[i].duration = now > start ? now - start : 0;
+
+ cleanup:
+    virMutexUnlock(&virDaemonStartupLock);
+}
+
+
+/**
+ * virDaemonGetStartupPhases:
+ * @params: filled with the list of recorded startup phases
+ * @nparams: filled with the number of items in @params
+ *
+ * Returns the durations of all the startup phases recorded so far as
+ * VIR_TYPED_PARAM_ULLONG parameters named after the phase, holding the
+ * duration in milliseconds.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDaemonGetStartupPhases(virTypedParameterPtr *params,
+                          int *nparams)
+{
+    g_autoptr(virTypedParamList) list = g_new0(virTypedParamList, 1);
+    size_t i;
+    int ret = -1;
+
+    virMutexLock(&virDaemonStartupLock);
+
+    for (i = 0; i < virDaemonStartupNPhases; i++) {
+        if (virTypedParamListAddULLong(list,
+                                       virDaemonStartupPhases[i].duration,
+                                       "%s", virDaemonStartupPhases[i].name) < 0)
+            goto cleanup;
+    }
+
+    *nparams = virTypedParamListStealParams(list, params);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virDaemonStartupLock);
+    return ret;
+}
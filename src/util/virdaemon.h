@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include "internal.h"
 #include "virenum.h"
 
 enum {
@@ -72,3 +73,9 @@ int virDaemonUnixSocketPaths(const char *sock_prefix,
                              char **sockfile,
                              char **rosockfile,
                              char **adminSockfile);
+
+void virDaemonStartupPhaseRecord(const char *name,
+                                 unsigned long long start);
+
+int virDaemonGetStartupPhases(virTypedParameterPtr *params,
+                              int *nparams);
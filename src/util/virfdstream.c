@@ -46,6 +46,13 @@
 
 VIR_LOG_INIT("fdstream");
 
+#ifndef O_DIRECT
+# define O_DIRECT 0
+#endif
+
+/* Alignment of buffers, offsets and lengths for O_DIRECT I/O */
+#define VIR_FDSTREAM_DIRECT_ALIGN 4096
+
 #ifndef WIN32
 typedef enum {
     VIR_FDSTREAM_MSG_TYPE_DATA,
@@ -108,6 +115,7 @@ struct virFDStreamData {
     bool threadQuit;
     bool threadAbort;
     bool threadDoRead;
+    bool threadRaw; /* the pipe carries the data rather than messages */
     virFDStreamMsgPtr msg;
 };
 
@@ -396,6 +404,8 @@ struct _virFDStreamThreadData {
     size_t length;
     bool doRead;
     bool sparse;
+    bool raw;
+    bool direct;
     int fdin;
     char *fdinname;
     int fdout;
@@ -508,11 +518,13 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
                          const int fdin,
                          const int fdout,
                          const char *fdinname,
-                         const char *fdoutname)
+                         const char *fdoutname,
+                         size_t length)
 {
     ssize_t got = 0;
     virFDStreamMsgPtr msg = fdst->msg;
     off_t off;
+    struct stat sb;
     bool pop = false;
 
     switch (msg->type) {
@@ -548,7 +560,28 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
             return -1;
         }
 
-        if (ftruncate(fdout, off) < 0) {
+        if (length) {
+            /* Only a range of the file is written by this stream and
+             * other streams may be filling the rest of it at the same
+             * time. Don't truncate their data away, just make sure the
+             * file is large enough by writing the last byte of the
+             * hole if it lies past EOF. */
+            if (fstat(fdout, &sb) < 0) {
+                virReportSystemError(errno,
+                                     _("unable to stat %s"),
+                                     fdoutname);
+                return -1;
+            }
+
+            if (S_ISREG(sb.st_mode) &&
+                sb.st_size < off &&
+                pwrite(fdout, "", 1, off - 1) != 1) {
+                virReportSystemError(errno,
+                                     _("unable to extend %s"),
+                                     fdoutname);
+                return -1;
+            }
+        } else if (ftruncate(fdout, off) < 0) {
             virReportSystemError(errno,
                                  _("unable to truncate %s"),
                                  fdoutname);
@@ -568,6 +601,166 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
 }
 
 
+static int
+virFDStreamThreadDisableDirect(virFDStreamThreadDataPtr data)
+{
+    int fd = data->doRead ? data->fdin : data->fdout;
+    const char *fdname = data->doRead ? data->fdinname : data->fdoutname;
+    int flags;
+
+    if ((flags = fcntl(fd, F_GETFL)) < 0 ||
+        fcntl(fd, F_SETFL, flags & ~O_DIRECT) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to disable direct I/O on %s"),
+                             fdname);
+        return -1;
+    }
+
+    data->direct = false;
+    return 0;
+}
+
+
+/*
+ * Moves up to @len bytes between the file and the pipe, by splice()
+ * while @trySplice is set or through @buf otherwise. @buf is aligned
+ * for O_DIRECT, a transfer that can't be aligned (the tail of the
+ * stream) is done through the page cache.
+ *
+ * Returns the number of bytes moved, 0 on EOF, -1 on error.
+ */
+static ssize_t
+virFDStreamThreadCopyChunk(virFDStreamThreadDataPtr data,
+                           char *buf,
+                           size_t len,
+                           bool *trySplice G_GNUC_UNUSED)
+{
+    ssize_t got;
+
+#if HAVE_SPLICE
+    if (*trySplice) {
+        do {
+            got = splice(data->fdin, NULL, data->fdout, NULL, len,
+                         SPLICE_F_MOVE);
+        } while (got < 0 && errno == EINTR);
+
+        if (got >= 0)
+            return got;
+
+        /* Nothing was moved by the failed call, use read/write from
+         * now on for files which can't be spliced */
+        if (errno != EINVAL && errno != ENOSYS) {
+            virReportSystemError(errno,
+                                 _("Unable to copy %s to %s"),
+                                 data->fdinname, data->fdoutname);
+            return -1;
+        }
+
+        *trySplice = false;
+    }
+#endif /* HAVE_SPLICE */
+
+    if (data->direct && data->doRead &&
+        len % VIR_FDSTREAM_DIRECT_ALIGN != 0 &&
+        virFDStreamThreadDisableDirect(data) < 0)
+        return -1;
+
+    if (data->direct && data->doRead) {
+        /* saferead would issue an unaligned read after a short one */
+        do {
+            got = read(data->fdin, buf, len);
+        } while (got < 0 && errno == EINTR);
+    } else {
+        got = saferead(data->fdin, buf, len);
+    }
+
+    if (got < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read %s"),
+                             data->fdinname);
+        return -1;
+    }
+
+    if (got == 0)
+        return 0;
+
+    if (data->direct &&
+        (data->doRead ? (size_t) got < len :
+                        got % VIR_FDSTREAM_DIRECT_ALIGN != 0) &&
+        virFDStreamThreadDisableDirect(data) < 0)
+        return -1;
+
+    if (safewrite(data->fdout, buf, got) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to write %s"),
+                             data->fdoutname);
+        return -1;
+    }
+
+    return got;
+}
+
+
+/*
+ * Worker of non-sparse streams. The data goes through the pipe
+ * itself, so the kernel can move it with splice() and the stream
+ * reads and writes the pipe directly without the message queue.
+ * Called with @fdst locked, the lock is dropped while blocked in I/O.
+ */
+static int
+virFDStreamThreadCopy(virFDStreamDataPtr fdst,
+                      virFDStreamThreadDataPtr data)
+{
+    g_autofree void *base = NULL;
+    char *buf = NULL;
+    size_t buflen = 1024 * 1024;
+    size_t total = 0;
+    bool trySplice = !data->direct;
+
+#if HAVE_POSIX_MEMALIGN
+    if (posix_memalign(&base, VIR_FDSTREAM_DIRECT_ALIGN, buflen)) {
+        virReportOOMError();
+        return -1;
+    }
+    buf = base;
+#else
+    base = g_new0(char, buflen + VIR_FDSTREAM_DIRECT_ALIGN - 1);
+    buf = (char *) (((intptr_t) base + VIR_FDSTREAM_DIRECT_ALIGN - 1) &
+                    ~(intptr_t) (VIR_FDSTREAM_DIRECT_ALIGN - 1));
+#endif
+
+    /* A graceful close of a stream being written waits for the
+     * thread to see EOF on the pipe so that no data is lost. */
+    while (!fdst->threadQuit ||
+           !(data->doRead || fdst->threadAbort)) {
+        size_t len = buflen;
+        ssize_t got;
+
+        if (data->length) {
+            if (total == data->length)
+                break;
+
+            if (len > data->length - total)
+                len = data->length - total;
+        }
+
+        virObjectUnlock(fdst);
+        got = virFDStreamThreadCopyChunk(data, buf, len, &trySplice);
+        virObjectLock(fdst);
+
+        if (got < 0)
+            return -1;
+
+        if (got == 0)
+            break;
+
+        total += got;
+    }
+
+    return 0;
+}
+
+
 static void
 virFDStreamThread(void *opaque)
 {
@@ -588,6 +781,12 @@ virFDStreamThread(void *opaque)
     virObjectRef(fdst);
     virObjectLock(fdst);
 
+    if (data->raw) {
+        if (virFDStreamThreadCopy(fdst, data) < 0)
+            goto error;
+        goto cleanup;
+    }
+
     while (1) {
         ssize_t got;
 
@@ -619,7 +818,8 @@ virFDStreamThread(void *opaque)
         else
             got = virFDStreamThreadDoWrite(fdst, sparse,
                                            fdin, fdout,
-                                           fdinname, fdoutname);
+                                           fdinname, fdoutname,
+                                           length);
 
         if (got < 0)
             goto error;
@@ -648,6 +848,19 @@ virFDStreamThread(void *opaque)
 }
 
 
+static void
+virFDStreamThreadDrain(int fd)
+{
+    g_autofree char *buf = g_new0(char, 64 * 1024);
+
+    if (virSetBlocking(fd, true) < 0)
+        return;
+
+    while (saferead(fd, buf, 64 * 1024) > 0)
+        ;
+}
+
+
 static int
 virFDStreamJoinWorker(virFDStreamDataPtr fdst,
                       bool streamAbort)
@@ -660,13 +873,22 @@ virFDStreamJoinWorker(virFDStreamDataPtr fdst,
     fdst->threadQuit = true;
     virCondSignal(&fdst->threadCond);
 
+    /* In the raw mode the thread may be blocked on the pipe. Let it
+     * see EOF if it's writing the file, or make room in the pipe for
+     * the chunk it's reading if it's reading the file. */
+    if (fdst->threadRaw && !fdst->threadDoRead)
+        VIR_FORCE_CLOSE(fdst->fd);
+
     /* Give the thread a chance to lock the FD stream object. */
     virObjectUnlock(fdst);
+    if (fdst->threadRaw && fdst->threadDoRead)
+        virFDStreamThreadDrain(fdst->fd);
     virThreadJoin(fdst->thread);
     virObjectLock(fdst);
 
     if (fdst->threadErr && !streamAbort) {
         /* errors are expected on streamAbort */
+        virSetError(fdst->threadErr);
         goto cleanup;
     }
 
@@ -720,13 +942,14 @@ virFDStreamCloseInt(virStreamPtr st, bool streamAbort)
         fdst->abortCallbackDispatching = false;
     }
 
-    if (virFDStreamJoinWorker(fdst, streamAbort) < 0)
-        ret = -1;
+    ret = virFDStreamJoinWorker(fdst, streamAbort);
 
     /* mutex locked */
-    if ((ret = VIR_CLOSE(fdst->fd)) < 0)
+    if (VIR_CLOSE(fdst->fd) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to close"));
+        ret = -1;
+    }
 
     st->privateData = NULL;
 
@@ -793,7 +1016,7 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadRaw) {
         char *buf;
 
         if (fdst->threadQuit || fdst->threadErr) {
@@ -829,6 +1052,10 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
                 ret = -2;
             } else if (errno == EINTR) {
                 goto retry;
+            } else if (fdst->threadErr) {
+                /* the thread failed and closed its end of the pipe */
+                ret = -1;
+                virSetError(fdst->threadErr);
             } else {
                 ret = -1;
                 virReportSystemError(errno, "%s",
@@ -876,7 +1103,7 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             nbytes = fdst->length - fdst->offset;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadRaw) {
         virFDStreamMsgPtr msg = NULL;
 
         while (!(msg = fdst->msg)) {
@@ -947,6 +1174,13 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
             }
             goto cleanup;
         }
+
+        if (ret == 0 && fdst->threadErr) {
+            /* the thread failed and closed its end of the pipe */
+            ret = -1;
+            virSetError(fdst->threadErr);
+            goto cleanup;
+        }
     }
 
     if (fdst->length)
@@ -978,7 +1212,7 @@ virFDStreamSendHole(virStreamPtr st,
         fdst->offset += length;
     }
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadRaw) {
         /* Things are a bit complicated here. If FDStream is in a
          * read mode, then if the message at the queue head is
          * HOLE, just pop it. The thread has lseek()-ed anyway.
@@ -1048,7 +1282,7 @@ virFDStreamInData(virStreamPtr st,
 
     virObjectLock(fdst);
 
-    if (fdst->thread) {
+    if (fdst->thread && !fdst->threadRaw) {
         virFDStreamMsgPtr msg;
 
         if (fdst->threadErr)
@@ -1126,6 +1360,7 @@ static int virFDStreamOpenInternal(virStreamPtr st,
 
     if (threadData) {
         fdst->threadDoRead = threadData->doRead;
+        fdst->threadRaw = threadData->raw;
 
         /* Create the thread after fdst and st were initialized.
          * The thread worker expects them to be that way. */
@@ -1264,6 +1499,22 @@ virFDStreamOpenFileInternal(virStreamPtr st,
         goto error;
     }
 
+    if (O_DIRECT && (oflags & O_DIRECT)) {
+        if (!(st->flags & VIR_STREAM_NONBLOCK)) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                           _("%s: Direct I/O needs a non-blocking stream"),
+                           path);
+            goto error;
+        }
+
+        if (offset % VIR_FDSTREAM_DIRECT_ALIGN != 0) {
+            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                           _("%s: Offset %llu is not aligned to %d bytes for direct I/O"),
+                           path, offset, VIR_FDSTREAM_DIRECT_ALIGN);
+            goto error;
+        }
+    }
+
     /* Thanks to the POSIX i/o model, we can't reliably get
      * non-blocking I/O on block devs/regular files. To
      * support those we need to create a helper thread to do
@@ -1280,6 +1531,13 @@ virFDStreamOpenFileInternal(virStreamPtr st,
             goto error;
         }
 
+        if (O_DIRECT && (oflags & O_DIRECT) && sparse) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                           _("%s: Direct I/O is not supported with sparse streams"),
+                           path);
+            goto error;
+        }
+
         if (virPipe(pipefds) < 0)
             goto error;
 
@@ -1289,6 +1547,10 @@ virFDStreamOpenFileInternal(virStreamPtr st,
         threadData->st = virObjectRef(st);
         threadData->length = length;
         threadData->sparse = sparse;
+        /* Holes need the message queue, other streams pass the data
+         * through the pipe */
+        threadData->raw = !sparse;
+        threadData->direct = O_DIRECT && (oflags & O_DIRECT);
 
         if ((oflags & O_ACCMODE) == O_RDONLY) {
             threadData->fdin = fd;
@@ -49,6 +49,10 @@ struct _virFileCache {
 
     virHashTablePtr table;
 
+    /* names of the data being created with the cache unlocked */
+    virHashTablePtr creating;
+    virCond cond;
+
     char *dir;
     char *suffix;
 
@@ -78,6 +82,8 @@ virFileCacheDispose(void *obj)
     VIR_FREE(cache->suffix);
 
     virHashFree(cache->table);
+    virHashFree(cache->creating);
+    virCondDestroy(&cache->cond);
 
     virFileCachePrivFree(cache);
 }
@@ -205,13 +211,25 @@ virFileCacheNewData(virFileCachePtr cache,
         return NULL;
 
     if (rv == 0) {
-        if (!(data = cache->handlers.newData(name, cache->priv)))
+        /* Creating the data may take a long time, e.g. QEMU capabilities
+         * are probed by running QEMU, so data of other names can be looked
+         * up and created in the meantime. Lookups of @name wait for us in
+         * virFileCacheValidate. */
+        if (virHashAddEntry(cache->creating, name, (void *) 1) < 0)
             return NULL;
 
-        if (virFileCacheSave(cache, name, data) < 0) {
+        virObjectUnlock(cache);
+
+        if ((data = cache->handlers.newData(name, cache->priv)) &&
+            virFileCacheSave(cache, name, data) < 0) {
             virObjectUnref(data);
             data = NULL;
         }
+
+        virObjectLock(cache);
+
+        virHashRemoveEntry(cache->creating, name);
+        virCondBroadcast(&cache->cond);
     }
 
     return data;
@@ -245,6 +263,15 @@ virFileCacheNew(const char *dir,
     if (!(cache->table = virHashCreate(10, virObjectFreeHashData)))
         goto cleanup;
 
+    if (!(cache->creating = virHashNew(NULL)))
+        goto cleanup;
+
+    if (virCondInit(&cache->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        goto cleanup;
+    }
+
     cache->dir = g_strdup(dir);
 
     cache->suffix = g_strdup(suffix);
@@ -272,6 +299,17 @@ virFileCacheValidate(virFileCachePtr cache,
         *data = NULL;
     }
 
+    /* wait for data another thread is creating */
+    while (!*data && name && virHashLookup(cache->creating, name)) {
+        VIR_DEBUG("Waiting for data for '%s' being created", name);
+        if (virCondWait(&cache->cond, &cache->parent.lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("failed to wait on condition"));
+            return;
+        }
+        *data = virHashLookup(cache->table, name);
+    }
+
     if (!*data && name) {
         VIR_DEBUG("Creating data for '%s'", name);
         *data = virFileCacheNewData(cache, name);
@@ -101,12 +101,23 @@ static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
 static bool lockOverride; /* true to avoid lock probes */
 
+/* true if rules can be applied in batches with iptables-restore */
+static bool iptablesUseRestore;
+static bool ip6tablesUseRestore;
+
 void
 virFirewallSetLockOverride(bool avoid)
 {
     lockOverride = avoid;
 }
 
+void
+virFirewallSetUseRestore(bool useRestore)
+{
+    iptablesUseRestore = useRestore;
+    ip6tablesUseRestore = useRestore;
+}
+
 static void
 virFirewallCheckUpdateLock(bool *lockflag,
                            const char *const*args)
@@ -121,6 +132,33 @@ virFirewallCheckUpdateLock(bool *lockflag,
     }
 }
 
+static void
+virFirewallCheckUpdateRestore(bool *restoreflag,
+                              const char *bin,
+                              bool useLock)
+{
+    int status; /* Ignore failed commands without logging them */
+    g_autoptr(virCommand) cmd = NULL;
+
+    if (!virFileIsExecutable(bin)) {
+        VIR_INFO("%s is not available", bin);
+        return;
+    }
+
+    cmd = virCommandNewArgList(bin, NULL);
+    if (useLock)
+        virCommandAddArg(cmd, "-w");
+    virCommandAddArgList(cmd, "--noflush", "--test", NULL);
+    virCommandSetInputBuffer(cmd, "");
+
+    if (virCommandRun(cmd, &status) < 0 || status) {
+        VIR_INFO("batching rules not supported by %s", bin);
+    } else {
+        VIR_INFO("using %s for batching rules", bin);
+        *restoreflag = true;
+    }
+}
+
 static void
 virFirewallCheckUpdateLocking(void)
 {
@@ -141,6 +179,12 @@ virFirewallCheckUpdateLocking(void)
                                ip6tablesArgs);
     virFirewallCheckUpdateLock(&ebtablesUseLock,
                                ebtablesArgs);
+    virFirewallCheckUpdateRestore(&iptablesUseRestore,
+                                  IPTABLES_RESTORE_PATH,
+                                  iptablesUseLock);
+    virFirewallCheckUpdateRestore(&ip6tablesUseRestore,
+                                  IP6TABLES_RESTORE_PATH,
+                                  ip6tablesUseLock);
 }
 
 static int
@@ -761,25 +805,231 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return 0;
 }
 
+/*
+ * With the direct backend, consecutive rules of a transaction which
+ * change the same table are fed to a single iptables-restore --noflush
+ * run instead of running iptables for each of them. iptables-restore
+ * commits the table atomically, so if it fails nothing was changed and
+ * the rules are applied one by one, which reports errors and leaves
+ * the same state behind as if there was no batching at all.
+ *
+ * Rules are only batched if a failure of any of them fails the whole
+ * transaction, i.e. neither the rule nor the transaction ignores
+ * errors, and if they don't need the output of the command.
+ */
+typedef struct _virFirewallBatch virFirewallBatch;
+struct _virFirewallBatch {
+    virFirewallLayer layer;
+    char *table;
+
+    virBuffer lines;
+
+    size_t nrules;
+    virFirewallRulePtr *rules;
+};
+
+
+static void
+virFirewallBatchClear(virFirewallBatch *batch)
+{
+    VIR_FREE(batch->table);
+    virBufferFreeAndReset(&batch->lines);
+    VIR_FREE(batch->rules);
+    batch->nrules = 0;
+}
+
+
+static bool
+virFirewallRuleIsBatchCommand(const char *arg)
+{
+    const char *commands[] = {
+        "-A", "--append", "-I", "--insert", "-D", "--delete",
+        "-N", "--new-chain", "-X", "--delete-chain",
+        "-F", "--flush", "-E", "--rename-chain",
+    };
+    size_t i;
+
+    for (i = 0; i < G_N_ELEMENTS(commands); i++) {
+        if (STREQ(arg, commands[i]))
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Formats @rule as a line of iptables-restore input into @line and
+ * stores the table it modifies in @table.
+ *
+ * Returns true on success, false if the rule can't be batched.
+ */
+static bool
+virFirewallRuleToRestoreLine(virFirewallRulePtr rule,
+                             bool ignoreErrors,
+                             char **table,
+                             virBufferPtr line)
+{
+    const char *tableName = "filter";
+    bool haveCommand = false;
+    size_t i;
+
+    if (currentBackend != VIR_FIREWALL_BACKEND_DIRECT ||
+        ignoreErrors || rule->ignoreErrors || rule->queryCB)
+        return false;
+
+    if (!((rule->layer == VIR_FIREWALL_LAYER_IPV4 && iptablesUseRestore) ||
+          (rule->layer == VIR_FIREWALL_LAYER_IPV6 && ip6tablesUseRestore)))
+        return false;
+
+    for (i = 0; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        /* the lock is requested for the whole iptables-restore run */
+        if (i == 0 && STREQ(arg, "-w"))
+            continue;
+
+        if (STREQ(arg, "-t") || STREQ(arg, "--table")) {
+            if (++i == rule->argsLen)
+                return false;
+            tableName = rule->args[i];
+            continue;
+        }
+
+        if (!haveCommand) {
+            if (!virFirewallRuleIsBatchCommand(arg))
+                return false;
+            haveCommand = true;
+        } else {
+            virBufferAddChar(line, ' ');
+        }
+
+        /* iptables-restore splits lines on whitespace and only
+         * understands double quotes, rules with arguments which can't
+         * be represented that way are applied directly */
+        if (!*arg || strpbrk(arg, "\"\\\r\n"))
+            return false;
+
+        if (strpbrk(arg, " \t"))
+            virBufferAsprintf(line, "\"%s\"", arg);
+        else
+            virBufferAdd(line, arg, -1);
+    }
+
+    if (!haveCommand)
+        return false;
+
+    *table = g_strdup(tableName);
+    return true;
+}
+
+
+static int
+virFirewallBatchApply(virFirewallPtr firewall,
+                      virFirewallBatch *batch)
+{
+    g_autoptr(virCommand) cmd = NULL;
+    g_autofree char *input = NULL;
+    g_autofree char *error = NULL;
+    const char *bin = IPTABLES_RESTORE_PATH;
+    bool useLock = iptablesUseLock;
+    int status;
+    size_t i;
+    int ret = -1;
+
+    if (batch->nrules == 0)
+        return 0;
+
+    if (batch->layer == VIR_FIREWALL_LAYER_IPV6) {
+        bin = IP6TABLES_RESTORE_PATH;
+        useLock = ip6tablesUseLock;
+    }
+
+    input = g_strdup_printf("*%s\n%sCOMMIT\n", batch->table,
+                            virBufferCurrentContent(&batch->lines));
+
+    VIR_INFO("Applying %zu rules of table '%s' with %s",
+             batch->nrules, batch->table, bin);
+
+    cmd = virCommandNewArgList(bin, NULL);
+    if (useLock)
+        virCommandAddArg(cmd, "-w");
+    virCommandAddArg(cmd, "--noflush");
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0) {
+        VIR_WARN("Unable to run %s: %s", bin, virGetLastErrorMessage());
+        virResetLastError();
+    } else if (status != 0) {
+        VIR_DEBUG("%s failed: %s", bin, NULLSTR(error));
+    } else {
+        ret = 0;
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Applying %zu rules one by one", batch->nrules);
+    for (i = 0; i < batch->nrules; i++) {
+        if (virFirewallApplyRule(firewall, batch->rules[i], false) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virFirewallBatchClear(batch);
+    return ret;
+}
+
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
 {
     virFirewallGroupPtr group = firewall->groups[idx];
     bool ignoreErrors = (group->actionFlags & VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    virFirewallBatch batch = { 0 };
     size_t i;
+    int ret = -1;
 
     VIR_INFO("Starting transaction for firewall=%p group=%p flags=0x%x",
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
     for (i = 0; i < group->naction; i++) {
-        if (virFirewallApplyRule(firewall,
-                                 group->action[i],
-                                 ignoreErrors) < 0)
-            return -1;
+        virFirewallRulePtr rule = group->action[i];
+        g_auto(virBuffer) line = VIR_BUFFER_INITIALIZER;
+        g_autofree char *table = NULL;
+
+        if (!virFirewallRuleToRestoreLine(rule, ignoreErrors, &table, &line)) {
+            if (virFirewallBatchApply(firewall, &batch) < 0 ||
+                virFirewallApplyRule(firewall, rule, ignoreErrors) < 0)
+                goto cleanup;
+            continue;
+        }
+
+        if (batch.nrules > 0 &&
+            (batch.layer != rule->layer || STRNEQ(batch.table, table)) &&
+            virFirewallBatchApply(firewall, &batch) < 0)
+            goto cleanup;
+
+        if (batch.nrules == 0) {
+            batch.layer = rule->layer;
+            batch.table = g_steal_pointer(&table);
+        }
+
+        virBufferAddBuffer(&batch.lines, &line);
+        virBufferAddChar(&batch.lines, '\n');
+        if (VIR_APPEND_ELEMENT_COPY(batch.rules, batch.nrules, rule) < 0)
+            goto cleanup;
     }
-    return 0;
+
+    if (virFirewallBatchApply(firewall, &batch) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virFirewallBatchClear(&batch);
+    return ret;
 }
 
 
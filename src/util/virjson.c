@@ -31,6 +31,7 @@
 #include "virutil.h"
 #include "virbuffer.h"
 #include "virenum.h"
+#include "virhash.h"
 
 #if WITH_YAJL
 # include <yajl/yajl_gen.h>
@@ -41,6 +42,11 @@
 /* XXX fixme */
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+/* Number of members an object needs to have before key lookups switch from
+ * a linear scan to the hashed index. Most objects we deal with are tiny and
+ * don't warrant the extra allocations. */
+#define VIR_JSON_OBJECT_INDEX_THRESHOLD 16
+
 VIR_LOG_INIT("util.json");
 
 typedef struct _virJSONObject virJSONObject;
@@ -61,6 +67,9 @@ struct _virJSONObjectPair {
 struct _virJSONObject {
     size_t npairs;
     virJSONObjectPairPtr pairs;
+    /* maps keys to (position in @pairs + 1); built lazily once the object
+     * has at least VIR_JSON_OBJECT_INDEX_THRESHOLD members */
+    virHashTablePtr index;
 };
 
 struct _virJSONArray {
@@ -97,6 +106,24 @@ struct _virJSONParser {
     int wrap;
 };
 
+typedef struct _virJSONStreamParser virJSONStreamParser;
+typedef virJSONStreamParser *virJSONStreamParserPtr;
+struct _virJSONStreamParser {
+    const virJSONStreamCallbacks *cb;
+    void *opaque;
+
+    /* key of the next value, valid if @haveKey is true */
+    char *key;
+    size_t keyalloc;
+    bool haveKey;
+
+    /* NUL-terminated copy of the current scalar value */
+    char *scratch;
+    size_t scratchalloc;
+
+    bool stopped;
+};
+
 
 virJSONType
 virJSONValueGetType(const virJSONValue *value)
@@ -402,6 +429,7 @@ virJSONValueFree(virJSONValuePtr value)
             virJSONValueFree(value->data.object.pairs[i].value);
         }
         VIR_FREE(value->data.object.pairs);
+        virHashFree(value->data.object.index);
         break;
     case VIR_JSON_TYPE_ARRAY:
         for (i = 0; i < value->data.array.nvalues; i++)
@@ -579,6 +607,101 @@ virJSONValueNewObject(void)
 }
 
 
+static void
+virJSONObjectIndexBuild(virJSONObjectPtr obj)
+{
+    size_t i;
+
+    obj->index = virHashNew(NULL);
+
+    for (i = 0; i < obj->npairs; i++) {
+        if (virHashAddEntry(obj->index, obj->pairs[i].key,
+                            GSIZE_TO_POINTER(i + 1)) < 0) {
+            /* can't happen as keys are unique, but fall back to linear
+             * lookup rather than using an incomplete index */
+            virHashFree(obj->index);
+            obj->index = NULL;
+            return;
+        }
+    }
+}
+
+
+static void
+virJSONObjectIndexInvalidate(virJSONObjectPtr obj)
+{
+    virHashFree(obj->index);
+    obj->index = NULL;
+}
+
+
+/**
+ * virJSONObjectFind:
+ * @obj: JSON object
+ * @key: key to look up
+ *
+ * Returns the position of @key in @obj->pairs or -1 if it's not present.
+ */
+static ssize_t
+virJSONObjectFind(virJSONObjectPtr obj,
+                  const char *key)
+{
+    size_t i;
+
+    if (!obj->index && obj->npairs >= VIR_JSON_OBJECT_INDEX_THRESHOLD)
+        virJSONObjectIndexBuild(obj);
+
+    if (obj->index) {
+        size_t pos = GPOINTER_TO_SIZE(virHashLookup(obj->index, key));
+
+        if (pos == 0)
+            return -1;
+
+        return pos - 1;
+    }
+
+    for (i = 0; i < obj->npairs; i++) {
+        if (STREQ(obj->pairs[i].key, key))
+            return i;
+    }
+
+    return -1;
+}
+
+
+/**
+ * virJSONObjectRemovePair:
+ * @obj: JSON object
+ * @pos: position of the pair to remove
+ *
+ * Removes the pair at @pos from @obj and returns its value. The key is freed.
+ */
+static virJSONValuePtr
+virJSONObjectRemovePair(virJSONObjectPtr obj,
+                        size_t pos)
+{
+    virJSONValuePtr ret = g_steal_pointer(&obj->pairs[pos].value);
+    size_t i;
+
+    if (obj->index) {
+        virHashRemoveEntry(obj->index, obj->pairs[pos].key);
+
+        for (i = pos + 1; i < obj->npairs; i++) {
+            if (virHashUpdateEntry(obj->index, obj->pairs[i].key,
+                                   GSIZE_TO_POINTER(i)) < 0) {
+                virJSONObjectIndexInvalidate(obj);
+                break;
+            }
+        }
+    }
+
+    VIR_FREE(obj->pairs[pos].key);
+    VIR_DELETE_ELEMENT(obj->pairs, pos, obj->npairs);
+
+    return ret;
+}
+
+
 static int
 virJSONValueObjectInsert(virJSONValuePtr object,
                          const char *key,
@@ -602,11 +725,22 @@ virJSONValueObjectInsert(virJSONValuePtr object,
     pair.key = g_strdup(key);
 
     if (prepend) {
+        /* all positions shift, the index will be rebuilt on next lookup */
+        virJSONObjectIndexInvalidate(&object->data.object);
         ret = VIR_INSERT_ELEMENT(object->data.object.pairs, 0,
                                  object->data.object.npairs, pair);
     } else {
         ret = VIR_APPEND_ELEMENT(object->data.object.pairs,
                                  object->data.object.npairs, pair);
+
+        if (ret == 0 && object->data.object.index) {
+            size_t pos = object->data.object.npairs;
+            const char *newkey = object->data.object.pairs[pos - 1].key;
+
+            if (virHashAddEntry(object->data.object.index, newkey,
+                                GSIZE_TO_POINTER(pos)) < 0)
+                virJSONObjectIndexInvalidate(&object->data.object);
+        }
     }
 
     VIR_FREE(pair.key);
@@ -856,17 +990,13 @@ int
 virJSONValueObjectHasKey(virJSONValuePtr object,
                          const char *key)
 {
-    size_t i;
-
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return 1;
-    }
+    if (virJSONObjectFind(&object->data.object, key) < 0)
+        return 0;
 
-    return 0;
+    return 1;
 }
 
 
@@ -874,17 +1004,15 @@ virJSONValuePtr
 virJSONValueObjectGet(virJSONValuePtr object,
                       const char *key)
 {
-    size_t i;
+    ssize_t pos;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return object->data.object.pairs[i].value;
-    }
+    if ((pos = virJSONObjectFind(&object->data.object, key)) < 0)
+        return NULL;
 
-    return NULL;
+    return object->data.object.pairs[pos].value;
 }
 
 
@@ -892,23 +1020,15 @@ static virJSONValuePtr
 virJSONValueObjectSteal(virJSONValuePtr object,
                         const char *key)
 {
-    size_t i;
-    virJSONValuePtr obj = NULL;
+    ssize_t pos;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            obj = g_steal_pointer(&object->data.object.pairs[i].value);
-            VIR_FREE(object->data.object.pairs[i].key);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            break;
-        }
-    }
+    if ((pos = virJSONObjectFind(&object->data.object, key)) < 0)
+        return NULL;
 
-    return obj;
+    return virJSONObjectRemovePair(&object->data.object, pos);
 }
 
 
@@ -974,7 +1094,8 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
                             const char *key,
                             virJSONValuePtr *value)
 {
-    size_t i;
+    virJSONValuePtr removed;
+    ssize_t pos;
 
     if (value)
         *value = NULL;
@@ -982,21 +1103,17 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            if (value) {
-                *value = object->data.object.pairs[i].value;
-                object->data.object.pairs[i].value = NULL;
-            }
-            VIR_FREE(object->data.object.pairs[i].key);
-            virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            return 1;
-        }
-    }
+    if ((pos = virJSONObjectFind(&object->data.object, key)) < 0)
+        return 0;
 
-    return 0;
+    removed = virJSONObjectRemovePair(&object->data.object, pos);
+
+    if (value)
+        *value = removed;
+    else
+        virJSONValueFree(removed);
+
+    return 1;
 }
 
 
@@ -1899,6 +2016,237 @@ virJSONValueFromString(const char *jsonstring)
 }
 
 
+static const char *
+virJSONStreamParserTakeKey(virJSONStreamParserPtr parser)
+{
+    if (!parser->haveKey)
+        return NULL;
+
+    parser->haveKey = false;
+    return parser->key;
+}
+
+
+static int
+virJSONStreamParserValue(virJSONStreamParserPtr parser,
+                         virJSONType type,
+                         const char *val,
+                         size_t len)
+{
+    const char *key = virJSONStreamParserTakeKey(parser);
+
+    if (!parser->cb->value)
+        return 1;
+
+    if (val) {
+        VIR_RESIZE_N(parser->scratch, parser->scratchalloc, 0, len + 1);
+        memcpy(parser->scratch, val, len);
+        parser->scratch[len] = '\0';
+        val = parser->scratch;
+    }
+
+    if (parser->cb->value(parser->opaque, key, type, val) != 0) {
+        parser->stopped = true;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+static int
+virJSONStreamParserHandleNull(void *ctx)
+{
+    return virJSONStreamParserValue(ctx, VIR_JSON_TYPE_NULL, NULL, 0);
+}
+
+
+static int
+virJSONStreamParserHandleBoolean(void *ctx,
+                                 int boolean_)
+{
+    const char *val = boolean_ ? "true" : "false";
+
+    return virJSONStreamParserValue(ctx, VIR_JSON_TYPE_BOOLEAN,
+                                    val, strlen(val));
+}
+
+
+static int
+virJSONStreamParserHandleNumber(void *ctx,
+                                const char *s,
+                                size_t l)
+{
+    return virJSONStreamParserValue(ctx, VIR_JSON_TYPE_NUMBER, s, l);
+}
+
+
+static int
+virJSONStreamParserHandleString(void *ctx,
+                                const unsigned char *stringVal,
+                                size_t stringLen)
+{
+    return virJSONStreamParserValue(ctx, VIR_JSON_TYPE_STRING,
+                                    (const char *)stringVal, stringLen);
+}
+
+
+static int
+virJSONStreamParserHandleMapKey(void *ctx,
+                                const unsigned char *stringVal,
+                                size_t stringLen)
+{
+    virJSONStreamParserPtr parser = ctx;
+
+    VIR_RESIZE_N(parser->key, parser->keyalloc, 0, stringLen + 1);
+    memcpy(parser->key, stringVal, stringLen);
+    parser->key[stringLen] = '\0';
+    parser->haveKey = true;
+
+    return 1;
+}
+
+
+static int
+virJSONStreamParserStart(virJSONStreamParserPtr parser,
+                         virJSONType type)
+{
+    const char *key = virJSONStreamParserTakeKey(parser);
+
+    if (parser->cb->startContainer &&
+        parser->cb->startContainer(parser->opaque, key, type) != 0) {
+        parser->stopped = true;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+static int
+virJSONStreamParserEnd(virJSONStreamParserPtr parser,
+                       virJSONType type)
+{
+    if (parser->cb->endContainer &&
+        parser->cb->endContainer(parser->opaque, type) != 0) {
+        parser->stopped = true;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+static int
+virJSONStreamParserHandleStartMap(void *ctx)
+{
+    return virJSONStreamParserStart(ctx, VIR_JSON_TYPE_OBJECT);
+}
+
+
+static int
+virJSONStreamParserHandleEndMap(void *ctx)
+{
+    return virJSONStreamParserEnd(ctx, VIR_JSON_TYPE_OBJECT);
+}
+
+
+static int
+virJSONStreamParserHandleStartArray(void *ctx)
+{
+    return virJSONStreamParserStart(ctx, VIR_JSON_TYPE_ARRAY);
+}
+
+
+static int
+virJSONStreamParserHandleEndArray(void *ctx)
+{
+    return virJSONStreamParserEnd(ctx, VIR_JSON_TYPE_ARRAY);
+}
+
+
+static const yajl_callbacks streamParserCallbacks = {
+    virJSONStreamParserHandleNull,
+    virJSONStreamParserHandleBoolean,
+    NULL,
+    NULL,
+    virJSONStreamParserHandleNumber,
+    virJSONStreamParserHandleString,
+    virJSONStreamParserHandleStartMap,
+    virJSONStreamParserHandleMapKey,
+    virJSONStreamParserHandleEndMap,
+    virJSONStreamParserHandleStartArray,
+    virJSONStreamParserHandleEndArray
+};
+
+
+/**
+ * virJSONParseStream:
+ * @jsonstring: JSON document to parse
+ * @cb: callbacks to invoke for the parsed tokens
+ * @opaque: data passed to @cb
+ *
+ * Parses @jsonstring without building a virJSONValue tree, invoking @cb
+ * for every value and container as they are encountered. This allows
+ * callers which are interested only in a few members of a large document
+ * to extract them without allocating the whole tree. Parsing stops once
+ * any of the callbacks returns non-zero.
+ *
+ * Returns 0 if the whole document was parsed, 1 if parsing was stopped by
+ * one of the callbacks and -1 if @jsonstring is not valid JSON (an error
+ * is reported).
+ */
+int
+virJSONParseStream(const char *jsonstring,
+                   const virJSONStreamCallbacks *cb,
+                   void *opaque)
+{
+    yajl_handle hand;
+    virJSONStreamParser parser = { .cb = cb, .opaque = opaque };
+    size_t len = strlen(jsonstring);
+    int ret = -1;
+    int rc;
+
+    VIR_DEBUG("string=%s", jsonstring);
+
+    hand = yajl_alloc(&streamParserCallbacks, NULL, &parser);
+    if (!hand) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Unable to create JSON parser"));
+        return -1;
+    }
+
+    rc = yajl_parse(hand, (const unsigned char *)jsonstring, len);
+    if (rc == yajl_status_ok)
+        rc = yajl_complete_parse(hand);
+
+    if (parser.stopped) {
+        ret = 1;
+        goto cleanup;
+    }
+
+    if (rc != yajl_status_ok) {
+        unsigned char *errstr = yajl_get_error(hand, 1,
+                                               (const unsigned char*)jsonstring,
+                                               len);
+
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot parse json %s: %s"),
+                       jsonstring, (const char*) errstr);
+        yajl_free_error(hand, errstr);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    yajl_free(hand);
+    VIR_FREE(parser.key);
+    VIR_FREE(parser.scratch);
+    return ret;
+}
+
+
 static int
 virJSONValueToStringOne(virJSONValuePtr object,
                         yajl_gen g)
@@ -2016,6 +2364,17 @@ virJSONValueFromString(const char *jsonstring G_GNUC_UNUSED)
 }
 
 
+int
+virJSONParseStream(const char *jsonstring G_GNUC_UNUSED,
+                   const virJSONStreamCallbacks *cb G_GNUC_UNUSED,
+                   void *opaque G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return -1;
+}
+
+
 int
 virJSONValueToBuffer(virJSONValuePtr object G_GNUC_UNUSED,
                      virBufferPtr buf G_GNUC_UNUSED,
@@ -2192,6 +2551,7 @@ virJSONValueObjectDeflattenArrays(virJSONValuePtr json)
         g_free(obj->pairs[i].key);
 
     g_free(json->data.object.pairs);
+    virJSONObjectIndexInvalidate(obj);
 
     i = obj->npairs;
     json->type = VIR_JSON_TYPE_ARRAY;
@@ -152,6 +152,32 @@ int virJSONValueToBuffer(virJSONValuePtr object,
                          bool pretty)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) G_GNUC_WARN_UNUSED_RESULT;
 
+/**
+ * virJSONStreamCallbacks:
+ * @value: called for every scalar value
+ * @startContainer: called when an object or array is opened
+ * @endContainer: called when an object or array is closed
+ *
+ * @key is the name of the object member the value or container belongs to,
+ * or NULL for array elements and the top level value. @val is the
+ * NUL-terminated textual form of the value ("true"/"false" for booleans,
+ * NULL for null) and is valid only for the duration of the callback.
+ *
+ * The callbacks return 0 to continue parsing, any other value stops it.
+ */
+typedef struct _virJSONStreamCallbacks virJSONStreamCallbacks;
+struct _virJSONStreamCallbacks {
+    int (*value)(void *opaque, const char *key, virJSONType type,
+                 const char *val);
+    int (*startContainer)(void *opaque, const char *key, virJSONType type);
+    int (*endContainer)(void *opaque, virJSONType type);
+};
+
+int virJSONParseStream(const char *jsonstring,
+                       const virJSONStreamCallbacks *cb,
+                       void *opaque)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 typedef int (*virJSONValueObjectIteratorFunc)(const char *key,
                                               virJSONValuePtr value,
                                               void *opaque);
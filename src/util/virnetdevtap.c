@@ -29,6 +29,9 @@
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virnetlink.h"
+#include "virthread.h"
 #include "datatypes.h"
 
 #include <unistd.h>
@@ -42,6 +45,7 @@
 #include <fcntl.h>
 #ifdef __linux__
 # include <linux/if_tun.h>    /* IFF_TUN, IFF_NO_PI */
+# include <linux/rtnetlink.h>
 #elif defined(__FreeBSD__)
 # include <net/if_mib.h>
 # include <sys/sysctl.h>
@@ -749,21 +753,14 @@ int virNetDevTapCreateInBridgePort(const char *brname,
  * Returns 0 on success, -1 otherwise (with error reported).
  */
 #ifdef __linux__
-int
-virNetDevTapInterfaceStats(const char *ifname,
-                           virDomainInterfaceStatsPtr stats,
-                           bool swapped)
+static int
+virNetDevTapInterfaceStatsProc(const char *ifname,
+                               virDomainInterfaceStatsPtr stats)
 {
     int ifname_len;
     FILE *fp;
     char line[256], *colon;
 
-    if (!ifname) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Interface name not provided"));
-        return -1;
-    }
-
     fp = fopen("/proc/net/dev", "r");
     if (!fp) {
         virReportSystemError(errno, "%s",
@@ -801,25 +798,14 @@ virNetDevTapInterfaceStats(const char *ifname,
                        &dummy, &dummy, &dummy, &dummy) != 16)
                 continue;
 
-            if (swapped) {
-                stats->rx_bytes = tx_bytes;
-                stats->rx_packets = tx_packets;
-                stats->rx_errs = tx_errs;
-                stats->rx_drop = tx_drop;
-                stats->tx_bytes = rx_bytes;
-                stats->tx_packets = rx_packets;
-                stats->tx_errs = rx_errs;
-                stats->tx_drop = rx_drop;
-            } else {
-                stats->rx_bytes = rx_bytes;
-                stats->rx_packets = rx_packets;
-                stats->rx_errs = rx_errs;
-                stats->rx_drop = rx_drop;
-                stats->tx_bytes = tx_bytes;
-                stats->tx_packets = tx_packets;
-                stats->tx_errs = tx_errs;
-                stats->tx_drop = tx_drop;
-            }
+            stats->rx_bytes = rx_bytes;
+            stats->rx_packets = rx_packets;
+            stats->rx_errs = rx_errs;
+            stats->rx_drop = rx_drop;
+            stats->tx_bytes = tx_bytes;
+            stats->tx_packets = tx_packets;
+            stats->tx_errs = tx_errs;
+            stats->tx_drop = tx_drop;
 
             VIR_FORCE_FCLOSE(fp);
             return 0;
@@ -831,6 +817,143 @@ virNetDevTapInterfaceStats(const char *ifname,
                    _("/proc/net/dev: Interface not found"));
     return -1;
 }
+
+
+# ifdef HAVE_LIBNL
+static int
+virNetDevTapInterfaceStatsDumpCallback(struct nlmsghdr *resp,
+                                       void *opaque)
+{
+    virHashTablePtr cache = opaque;
+    struct nlattr *tb[IFLA_MAX + 1] = { NULL, };
+    g_autofree virDomainInterfaceStatsPtr stats = NULL;
+    const char *ifname;
+
+    if (resp->nlmsg_type != RTM_NEWLINK)
+        return 0;
+
+    if (nlmsg_parse(resp, sizeof(struct ifinfomsg), tb, IFLA_MAX, NULL) < 0 ||
+        !tb[IFLA_IFNAME])
+        return 0;
+
+    ifname = nla_get_string(tb[IFLA_IFNAME]);
+    stats = g_new0(virDomainInterfaceStatsStruct, 1);
+
+    /* The drop counters match what the kernel reports in /proc/net/dev */
+    if (tb[IFLA_STATS64] &&
+        nla_len(tb[IFLA_STATS64]) >= (int) sizeof(struct rtnl_link_stats64)) {
+        struct rtnl_link_stats64 link;
+
+        memcpy(&link, nla_data(tb[IFLA_STATS64]), sizeof(link));
+        stats->rx_bytes = link.rx_bytes;
+        stats->rx_packets = link.rx_packets;
+        stats->rx_errs = link.rx_errors;
+        stats->rx_drop = link.rx_dropped + link.rx_missed_errors;
+        stats->tx_bytes = link.tx_bytes;
+        stats->tx_packets = link.tx_packets;
+        stats->tx_errs = link.tx_errors;
+        stats->tx_drop = link.tx_dropped;
+    } else if (tb[IFLA_STATS] &&
+               nla_len(tb[IFLA_STATS]) >= (int) sizeof(struct rtnl_link_stats)) {
+        struct rtnl_link_stats link;
+
+        memcpy(&link, nla_data(tb[IFLA_STATS]), sizeof(link));
+        stats->rx_bytes = link.rx_bytes;
+        stats->rx_packets = link.rx_packets;
+        stats->rx_errs = link.rx_errors;
+        stats->rx_drop = link.rx_dropped + link.rx_missed_errors;
+        stats->tx_bytes = link.tx_bytes;
+        stats->tx_packets = link.tx_packets;
+        stats->tx_errs = link.tx_errors;
+        stats->tx_drop = link.tx_dropped;
+    } else {
+        return 0;
+    }
+
+    if (virHashUpdateEntry(cache, ifname, stats) < 0)
+        return -1;
+    stats = NULL;
+
+    return 0;
+}
+
+
+/*
+ * Fetches the stats of all host interfaces with a single RTM_GETLINK
+ * dump into a hash table keyed by interface name.
+ */
+static virHashTablePtr
+virNetDevTapInterfaceStatsDump(void)
+{
+    struct ifinfomsg ifinfo = { .ifi_family = AF_UNSPEC };
+    g_autoptr(virNetlinkMsg) nlmsg = NULL;
+    g_autoptr(virHashTable) stats = NULL;
+
+    if (!(nlmsg = nlmsg_alloc_simple(RTM_GETLINK,
+                                     NLM_F_REQUEST | NLM_F_DUMP))) {
+        virReportOOMError();
+        return NULL;
+    }
+
+    if (nlmsg_append(nlmsg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        return NULL;
+    }
+
+    if (!(stats = virHashNew(g_free)))
+        return NULL;
+
+    if (virNetlinkDumpCommand(nlmsg, virNetDevTapInterfaceStatsDumpCallback,
+                              0, 0, NETLINK_ROUTE, 0, stats) < 0)
+        return NULL;
+
+    VIR_DEBUG("Dumped stats of %zd interfaces", virHashSize(stats));
+
+    return g_steal_pointer(&stats);
+}
+# endif /* HAVE_LIBNL */
+
+
+static void
+virNetDevTapInterfaceStatsCopy(virDomainInterfaceStatsPtr stats,
+                               const virDomainInterfaceStatsStruct *tmp,
+                               bool swapped)
+{
+    if (swapped) {
+        stats->rx_bytes = tmp->tx_bytes;
+        stats->rx_packets = tmp->tx_packets;
+        stats->rx_errs = tmp->tx_errs;
+        stats->rx_drop = tmp->tx_drop;
+        stats->tx_bytes = tmp->rx_bytes;
+        stats->tx_packets = tmp->rx_packets;
+        stats->tx_errs = tmp->rx_errs;
+        stats->tx_drop = tmp->rx_drop;
+    } else {
+        *stats = *tmp;
+    }
+}
+
+
+int
+virNetDevTapInterfaceStats(const char *ifname,
+                           virDomainInterfaceStatsPtr stats,
+                           bool swapped)
+{
+    virDomainInterfaceStatsStruct tmp = { 0 };
+
+    if (!ifname) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Interface name not provided"));
+        return -1;
+    }
+
+    if (virNetDevTapInterfaceStatsProc(ifname, &tmp) < 0)
+        return -1;
+
+    virNetDevTapInterfaceStatsCopy(stats, &tmp, swapped);
+    return 0;
+}
 #elif defined(HAVE_GETIFADDRS) && defined(AF_LINK)
 int
 virNetDevTapInterfaceStats(const char *ifname,
@@ -914,3 +1037,117 @@ virNetDevTapInterfaceStats(const char *ifname G_GNUC_UNUSED,
 }
 
 #endif /* __linux__ */
+
+
+/*
+ * Stats of all host interfaces read at once and shared by the lookups
+ * of a single bulk stats query, so that asking for the stats of every
+ * interface of every domain does not read them once per interface. An
+ * interface missing from the dump is reported as not found rather than
+ * triggering another dump, the cache is meant to be discarded at the
+ * end of the query.
+ */
+struct _virNetDevTapStatsCache {
+    virMutex lock;
+    bool filled;
+    virHashTablePtr stats; /* NULL if the dump failed or is unsupported */
+};
+
+
+/**
+ * virNetDevTapStatsCacheNew:
+ *
+ * Creates an empty interface stats cache to be used with
+ * virNetDevTapInterfaceStatsCached during one bulk stats query. The
+ * stats are read at the first lookup.
+ */
+virNetDevTapStatsCachePtr
+virNetDevTapStatsCacheNew(void)
+{
+    virNetDevTapStatsCachePtr cache = g_new0(virNetDevTapStatsCache, 1);
+
+    if (virMutexInit(&cache->lock) < 0) {
+        g_free(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+
+void
+virNetDevTapStatsCacheFree(virNetDevTapStatsCachePtr cache)
+{
+    if (!cache)
+        return;
+
+    virHashFree(cache->stats);
+    virMutexDestroy(&cache->lock);
+    g_free(cache);
+}
+
+
+/**
+ * virNetDevTapInterfaceStatsCached:
+ * @cache: interface stats cache, or NULL
+ * @ifname: interface
+ * @stats: where to store statistics
+ * @swapped: whether to swap RX/TX fields
+ *
+ * Same as virNetDevTapInterfaceStats, but serves the stats from @cache
+ * where possible. Without a @cache, or if the stats of all interfaces
+ * can't be fetched at once on this host, the stats are read the same
+ * way virNetDevTapInterfaceStats does.
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+#if defined(__linux__) && defined(HAVE_LIBNL)
+int
+virNetDevTapInterfaceStatsCached(virNetDevTapStatsCachePtr cache,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats,
+                                 bool swapped)
+{
+    virDomainInterfaceStatsPtr cached = NULL;
+    bool dumped;
+
+    if (!cache || !ifname)
+        return virNetDevTapInterfaceStats(ifname, stats, swapped);
+
+    virMutexLock(&cache->lock);
+
+    if (!cache->filled) {
+        cache->filled = true;
+        if (!(cache->stats = virNetDevTapInterfaceStatsDump())) {
+            VIR_DEBUG("Unable to dump interface stats: %s",
+                      virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
+    dumped = !!cache->stats;
+    if (dumped && (cached = virHashLookup(cache->stats, ifname)))
+        virNetDevTapInterfaceStatsCopy(stats, cached, swapped);
+
+    virMutexUnlock(&cache->lock);
+
+    if (cached)
+        return 0;
+
+    if (!dumped)
+        return virNetDevTapInterfaceStats(ifname, stats, swapped);
+
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("Interface '%s' not found"), ifname);
+    return -1;
+}
+#else
+int
+virNetDevTapInterfaceStatsCached(virNetDevTapStatsCachePtr cache G_GNUC_UNUSED,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats,
+                                 bool swapped)
+{
+    return virNetDevTapInterfaceStats(ifname, stats, swapped);
+}
+#endif
@@ -105,3 +105,16 @@ int virNetDevTapInterfaceStats(const char *ifname,
                                virDomainInterfaceStatsPtr stats,
                                bool swapped)
     G_GNUC_WARN_UNUSED_RESULT;
+
+typedef struct _virNetDevTapStatsCache virNetDevTapStatsCache;
+typedef virNetDevTapStatsCache *virNetDevTapStatsCachePtr;
+
+virNetDevTapStatsCachePtr virNetDevTapStatsCacheNew(void);
+void virNetDevTapStatsCacheFree(virNetDevTapStatsCachePtr cache);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(virNetDevTapStatsCache, virNetDevTapStatsCacheFree);
+
+int virNetDevTapInterfaceStatsCached(virNetDevTapStatsCachePtr cache,
+                                     const char *ifname,
+                                     virDomainInterfaceStatsPtr stats,
+                                     bool swapped)
+    G_GNUC_WARN_UNUSED_RESULT;
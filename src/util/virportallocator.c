@@ -30,18 +30,40 @@
 #include "virthread.h"
 #include "virerror.h"
 #include "virfile.h"
+#include "virlog.h"
+#include "virnetlink.h"
 #include "virstring.h"
+#include "virtime.h"
 #include "virutil.h"
 
+#if defined(__linux__) && defined(HAVE_LIBNL)
+# include <netinet/tcp.h>
+# include <linux/sock_diag.h>
+# include <linux/inet_diag.h>
+#endif
+
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+VIR_LOG_INIT("util.portallocator");
+
 #define VIR_PORT_ALLOCATOR_NUM_PORTS 65536
 
+/*
+ * Ports found to be in use on the host are remembered for this many
+ * milliseconds, so that a burst of allocations, e.g. when starting many
+ * domains at once, lists the sockets of the host only once.
+ */
+#define VIR_PORT_ALLOCATOR_INUSE_AGE 1000
+
 typedef struct _virPortAllocator virPortAllocator;
 typedef virPortAllocator *virPortAllocatorPtr;
 struct _virPortAllocator {
     virObjectLockable parent;
     virBitmapPtr bitmap;
+
+    /* ports used by sockets of the host, NULL if they have to be probed */
+    virBitmapPtr inuse;
+    unsigned long long inuseTime;
 };
 
 struct _virPortAllocatorRange {
@@ -60,6 +82,7 @@ virPortAllocatorDispose(void *obj)
     virPortAllocatorPtr pa = obj;
 
     virBitmapFree(pa->bitmap);
+    virBitmapFree(pa->inuse);
 }
 
 static virPortAllocatorPtr
@@ -197,6 +220,122 @@ virPortAllocatorBindToPort(bool *used,
     return ret;
 }
 
+#if defined(__linux__) && defined(HAVE_LIBNL)
+static int
+virPortAllocatorSockDiagCallback(struct nlmsghdr *resp,
+                                 void *opaque)
+{
+    virBitmapPtr used = opaque;
+    struct inet_diag_msg *msg;
+
+    if (resp->nlmsg_type != SOCK_DIAG_BY_FAMILY ||
+        resp->nlmsg_len < NLMSG_LENGTH(sizeof(*msg)))
+        return 0;
+
+    msg = NLMSG_DATA(resp);
+    ignore_value(virBitmapSetBit(used, ntohs(msg->id.idiag_sport)));
+
+    return 0;
+}
+
+
+static int
+virPortAllocatorSockDiagDump(virBitmapPtr used,
+                             int family)
+{
+    struct inet_diag_req_v2 req = {
+        .sdiag_family = family,
+        .sdiag_protocol = IPPROTO_TCP,
+        /* sockets in TIME_WAIT don't prevent binding with SO_REUSEADDR,
+         * any other socket holding the port does */
+        .idiag_states = ~(1U << TCP_TIME_WAIT),
+    };
+    g_autoptr(virNetlinkMsg) nlmsg = NULL;
+
+    if (!(nlmsg = nlmsg_alloc_simple(SOCK_DIAG_BY_FAMILY,
+                                     NLM_F_REQUEST | NLM_F_DUMP))) {
+        virReportOOMError();
+        return -1;
+    }
+
+    if (nlmsg_append(nlmsg, &req, sizeof(req), NLMSG_ALIGNTO) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        return -1;
+    }
+
+    return virNetlinkDumpCommand(nlmsg, virPortAllocatorSockDiagCallback,
+                                 0, 0, NETLINK_SOCK_DIAG, 0, used);
+}
+
+
+/**
+ * virPortAllocatorGetUsedPorts:
+ * @used: bitmap of VIR_PORT_ALLOCATOR_NUM_PORTS bits
+ *
+ * Set the bits of all TCP ports held by IPv4 or IPv6 sockets of the host
+ * in @used, as reported by the sock_diag netlink interface.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virPortAllocatorGetUsedPorts(virBitmapPtr used)
+{
+    if (virPortAllocatorSockDiagDump(used, AF_INET) < 0 ||
+        virPortAllocatorSockDiagDump(used, AF_INET6) < 0)
+        return -1;
+
+    return 0;
+}
+#else /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+int
+virPortAllocatorGetUsedPorts(virBitmapPtr used G_GNUC_UNUSED)
+{
+    virReportError(VIR_ERR_NO_SUPPORT, "%s",
+                   _("listing the ports in use is not supported "
+                     "on this platform"));
+    return -1;
+}
+#endif /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+
+
+/*
+ * Returns the bitmap of ports in use on the host, listing them again if
+ * the last list is too old, or NULL if they can't be listed and each
+ * port has to be probed instead. Must be called with @pa locked.
+ */
+static virBitmapPtr
+virPortAllocatorGetInUse(virPortAllocatorPtr pa)
+{
+    g_autoptr(virBitmap) inuse = NULL;
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0)
+        goto error;
+
+    if (pa->inuse && now - pa->inuseTime < VIR_PORT_ALLOCATOR_INUSE_AGE)
+        return pa->inuse;
+
+    if (!(inuse = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS)) ||
+        virPortAllocatorGetUsedPorts(inuse) < 0)
+        goto error;
+
+    virBitmapFree(pa->inuse);
+    pa->inuse = g_steal_pointer(&inuse);
+    pa->inuseTime = now;
+
+    return pa->inuse;
+
+ error:
+    VIR_DEBUG("Unable to list used ports, probing them instead: %s",
+              virGetLastErrorMessage());
+    virResetLastError();
+    virBitmapFree(pa->inuse);
+    pa->inuse = NULL;
+    return NULL;
+}
+
+
 static virPortAllocatorPtr
 virPortAllocatorGet(void)
 {
@@ -213,6 +352,7 @@ virPortAllocatorAcquire(const virPortAllocatorRange *range,
     int ret = -1;
     size_t i;
     virPortAllocatorPtr pa = virPortAllocatorGet();
+    virBitmapPtr inuse;
 
     *port = 0;
 
@@ -221,15 +361,20 @@ virPortAllocatorAcquire(const virPortAllocatorRange *range,
 
     virObjectLock(pa);
 
+    inuse = virPortAllocatorGetInUse(pa);
+
     for (i = range->start; i <= range->end && !*port; i++) {
         bool used = false, v6used = false;
 
         if (virBitmapIsBitSet(pa->bitmap, i))
             continue;
 
-        if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
-            virPortAllocatorBindToPort(&used, i, AF_INET) < 0)
+        if (inuse) {
+            used = virBitmapIsBitSet(inuse, i);
+        } else if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
+                   virPortAllocatorBindToPort(&used, i, AF_INET) < 0) {
             goto cleanup;
+        }
 
         if (!used && !v6used) {
             /* Add port to bitmap of reserved ports */
@@ -23,6 +23,7 @@
 
 #include "internal.h"
 #include "virobject.h"
+#include "virbitmap.h"
 
 typedef struct _virPortAllocatorRange virPortAllocatorRange;
 typedef virPortAllocatorRange *virPortAllocatorRangePtr;
@@ -40,3 +41,6 @@ int virPortAllocatorAcquire(const virPortAllocatorRange *range,
 int virPortAllocatorRelease(unsigned short port);
 
 int virPortAllocatorSetUsed(unsigned short port);
+
+int virPortAllocatorGetUsedPorts(virBitmapPtr used)
+    G_GNUC_NO_INLINE;
@@ -19,6 +19,7 @@
 #include <config.h>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include "testutils.h"
 
@@ -310,6 +311,238 @@ static int testFDStreamWriteNonblock(const void *data)
     return testFDStreamWriteCommon(data, false);
 }
 
+struct testFDStreamSparseData {
+    const char *scratchdir;
+    size_t filelen;
+    unsigned long long length;
+    size_t expectlen;
+};
+
+/*
+ * Write PATTERN_LEN bytes of data followed by a hole of PATTERN_LEN
+ * bytes at offset PATTERN_LEN of a file initially holding @filelen
+ * bytes, through a sparse stream bounded by @length (0 for none). The
+ * file must end up @expectlen bytes long with data outside of the
+ * written range untouched.
+ */
+static int testFDStreamWriteSparse(const void *opaque)
+{
+    const struct testFDStreamSparseData *data = opaque;
+    g_autofree char *file = NULL;
+    g_autofree char *pattern = NULL;
+    g_autofree char *expect = NULL;
+    g_autofree char *actual = NULL;
+    virStreamPtr st = NULL;
+    virConnectPtr conn = NULL;
+    size_t offset = 0;
+    int fd = -1;
+    int len;
+    int ret = -1;
+    size_t i;
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    pattern = g_new0(char, PATTERN_LEN);
+    for (i = 0; i < PATTERN_LEN; i++)
+        pattern[i] = i;
+
+    expect = g_new0(char, MAX(data->filelen, data->expectlen));
+    memset(expect, 0xff, data->filelen);
+
+    file = g_strdup_printf("%s/sparse.data", data->scratchdir);
+
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_TRUNC, 0600)) < 0 ||
+        safewrite(fd, expect, data->filelen) != (ssize_t) data->filelen ||
+        VIR_CLOSE(fd) < 0)
+        goto cleanup;
+
+    memcpy(expect + PATTERN_LEN, pattern, PATTERN_LEN);
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        goto cleanup;
+
+    if (virFDStreamOpenBlockDevice(st, file, PATTERN_LEN, data->length,
+                                   true, O_WRONLY) < 0)
+        goto cleanup;
+
+    while (offset < PATTERN_LEN) {
+        int got = st->driver->streamSend(st, pattern + offset,
+                                         PATTERN_LEN - offset);
+
+        if (got == -2) {
+            g_usleep(20 * 1000);
+            continue;
+        }
+        if (got < 0) {
+            fprintf(stderr, "Failed to write stream: %s\n",
+                    virGetLastErrorMessage());
+            goto cleanup;
+        }
+        offset += got;
+    }
+
+    if (st->driver->streamSendHole(st, PATTERN_LEN, 0) < 0 ||
+        st->driver->streamFinish(st) != 0) {
+        fprintf(stderr, "Failed to finish stream: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if ((len = virFileReadAll(file, 10 * PATTERN_LEN, &actual)) < 0)
+        goto cleanup;
+
+    if (len != (int) data->expectlen) {
+        fprintf(stderr, "Expected file of %zu bytes, got %d\n",
+                data->expectlen, len);
+        goto cleanup;
+    }
+
+    if (memcmp(actual, expect, len) != 0) {
+        fprintf(stderr, "Mismatched file data\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    VIR_FORCE_CLOSE(fd);
+    if (file)
+        unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    return ret;
+}
+
+
+#ifdef O_DIRECT
+# define DIRECT_OFFSET 4096
+# define DIRECT_LEN (3 * 4096 + PATTERN_LEN / 2)
+
+/*
+ * Write a few aligned blocks followed by an unaligned tail through a
+ * direct I/O stream and read them back the same way.
+ */
+static int testFDStreamDirect(const void *opaque)
+{
+    const char *scratchdir = opaque;
+    g_autofree char *file = NULL;
+    g_autofree char *pattern = NULL;
+    g_autofree char *actual = NULL;
+    virStreamPtr st = NULL;
+    virConnectPtr conn = NULL;
+    struct stat sb;
+    size_t offset = 0;
+    int fd = -1;
+    int ret = -1;
+    size_t i;
+
+    file = g_strdup_printf("%s/direct.data", scratchdir);
+
+    /* not every file system supports direct I/O */
+    if ((fd = open(file, O_CREAT|O_WRONLY|O_TRUNC|O_DIRECT, 0600)) < 0) {
+        if (errno == EINVAL)
+            return EXIT_AM_SKIP;
+        return -1;
+    }
+    VIR_FORCE_CLOSE(fd);
+
+    if (!(conn = virConnectOpen("test:///default")))
+        goto cleanup;
+
+    pattern = g_new0(char, DIRECT_LEN);
+    actual = g_new0(char, DIRECT_LEN);
+    for (i = 0; i < DIRECT_LEN; i++)
+        pattern[i] = i;
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        goto cleanup;
+
+    if (virFDStreamOpenBlockDevice(st, file, DIRECT_OFFSET, 0,
+                                   false, O_WRONLY | O_DIRECT) < 0)
+        goto cleanup;
+
+    while (offset < DIRECT_LEN) {
+        int got = st->driver->streamSend(st, pattern + offset,
+                                         DIRECT_LEN - offset);
+
+        if (got == -2) {
+            g_usleep(20 * 1000);
+            continue;
+        }
+        if (got < 0) {
+            fprintf(stderr, "Failed to write stream: %s\n",
+                    virGetLastErrorMessage());
+            goto cleanup;
+        }
+        offset += got;
+    }
+
+    if (st->driver->streamFinish(st) != 0) {
+        fprintf(stderr, "Failed to finish stream: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+    virStreamFree(st);
+    st = NULL;
+
+    if (stat(file, &sb) < 0 ||
+        sb.st_size != DIRECT_OFFSET + DIRECT_LEN) {
+        fprintf(stderr, "Unexpected size of %s\n", file);
+        goto cleanup;
+    }
+
+    if (!(st = virStreamNew(conn, VIR_STREAM_NONBLOCK)))
+        goto cleanup;
+
+    if (virFDStreamOpenBlockDevice(st, file, DIRECT_OFFSET, 0,
+                                   false, O_RDONLY | O_DIRECT) < 0)
+        goto cleanup;
+
+    offset = 0;
+    while (1) {
+        int got = st->driver->streamRecv(st, actual + offset,
+                                         DIRECT_LEN - offset);
+
+        if (got == -2) {
+            g_usleep(20 * 1000);
+            continue;
+        }
+        if (got < 0) {
+            fprintf(stderr, "Failed to read stream: %s\n",
+                    virGetLastErrorMessage());
+            goto cleanup;
+        }
+        if (got == 0)
+            break;
+        offset += got;
+    }
+
+    if (st->driver->streamFinish(st) != 0) {
+        fprintf(stderr, "Failed to finish stream: %s\n",
+                virGetLastErrorMessage());
+        goto cleanup;
+    }
+
+    if (offset != DIRECT_LEN ||
+        memcmp(actual, pattern, DIRECT_LEN) != 0) {
+        fprintf(stderr, "Mismatched file data\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    if (st)
+        virStreamFree(st);
+    unlink(file);
+    if (conn)
+        virConnectClose(conn);
+    return ret;
+}
+#endif /* O_DIRECT */
+
+
 #define SCRATCHDIRTEMPLATE abs_builddir "/fdstreamdir-XXXXXX"
 
 static int
@@ -332,6 +565,28 @@ mymain(void)
     if (virTestRun("Stream write non-blocking ", testFDStreamWriteNonblock, scratchdir) < 0)
         ret = -1;
 
+#define TEST_SPARSE(name, filelen, length, expectlen) \
+    do { \
+        struct testFDStreamSparseData data = { \
+            scratchdir, filelen, length, expectlen \
+        }; \
+        if (virTestRun("Stream write sparse " name, \
+                       testFDStreamWriteSparse, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* a trailing hole of an unbounded stream truncates the file */
+    TEST_SPARSE("unbounded", PATTERN_LEN * 4, 0, PATTERN_LEN * 3);
+    /* a stream bounded to a range leaves the data past it alone */
+    TEST_SPARSE("range", PATTERN_LEN * 4, PATTERN_LEN * 2, PATTERN_LEN * 4);
+    /* but extends the file to cover its trailing hole */
+    TEST_SPARSE("range extend", 0, PATTERN_LEN * 2, PATTERN_LEN * 3);
+
+#ifdef O_DIRECT
+    if (virTestRun("Stream direct I/O", testFDStreamDirect, scratchdir) < 0)
+        ret = -1;
+#endif
+
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(scratchdir);
 
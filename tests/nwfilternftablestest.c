@@ -0,0 +1,477 @@
+/*
+ * nwfilternftablestest.c: Test nftables rule generation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "nwfilter/nwfilter_nftables_driver.h"
+#include "virbuffer.h"
+
+#define LIBVIRT_VIRCOMMANDPRIV_H_ALLOW
+#include "vircommandpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+
+/* vnet0 is filtered by the chains of the first generation, which also
+ * has the chains of the second generation instantiated, vnet1 has the
+ * basic rules applied and vnet10 must not be confused with vnet0 */
+#define VIR_NWFILTER_TABLE_LISTING \
+    "table bridge libvirt_nwfilter {\n" \
+    "\tmap in_ifaces {\n" \
+    "\t\ttype ifname : verdict\n" \
+    "\t\telements = { \"vnet0\" : jump I-vnet0, \"vnet1\" : jump basic,\n" \
+    "\t\t\t     \"vnet10\" : jump J-vnet10 }\n" \
+    "\t}\n" \
+    "\n" \
+    "\tmap out_ifaces {\n" \
+    "\t\ttype ifname : verdict\n" \
+    "\t\telements = { \"vnet0\" : jump O-vnet0 }\n" \
+    "\t}\n" \
+    "\n" \
+    "\tset basic_macs {\n" \
+    "\t\ttype ifname . ether_addr\n" \
+    "\t\telements = { \"vnet1\" . 52:54:00:00:00:01 }\n" \
+    "\t}\n" \
+    "\n" \
+    "\tchain prerouting {\n" \
+    "\t\ttype filter hook prerouting priority -300; policy accept;\n" \
+    "\t\tiifname vmap @in_ifaces\n" \
+    "\t}\n" \
+    "\n" \
+    "\tchain I-vnet0 {\n" \
+    "\t\tether type 0x0806 jump I-vnet0/arp\n" \
+    "\t}\n" \
+    "\n" \
+    "\tchain I-vnet0/arp {\n" \
+    "\t\tether saddr 52:54:00:00:00:00 accept\n" \
+    "\t}\n" \
+    "\n" \
+    "\tchain O-vnet0 {\n" \
+    "\t}\n" \
+    "\n" \
+    "\tchain J-vnet0 {\n" \
+    "\t}\n" \
+    "\n" \
+    "\tchain P-vnet0 {\n" \
+    "\t}\n" \
+    "\n" \
+    "\tchain J-vnet10 {\n" \
+    "\t}\n" \
+    "}\n"
+
+#define VIR_NWFILTER_LIST_TABLE \
+    "nft list table bridge libvirt_nwfilter\n"
+
+#define VIR_NWFILTER_APPLY_SCRIPT \
+    "nft -f /dev/stdin\n"
+
+#define VIR_NWFILTER_CREATE_TABLE \
+    "add table bridge libvirt_nwfilter\n" \
+    "add map bridge libvirt_nwfilter in_ifaces { type ifname : verdict; }\n" \
+    "add map bridge libvirt_nwfilter out_ifaces { type ifname : verdict; }\n" \
+    "add set bridge libvirt_nwfilter basic_macs { type ifname . ether_addr; }\n" \
+    "add chain bridge libvirt_nwfilter prerouting { type filter hook prerouting priority -300; policy accept; }\n" \
+    "flush chain bridge libvirt_nwfilter prerouting\n" \
+    "add rule bridge libvirt_nwfilter prerouting iifname vmap @in_ifaces\n" \
+    "add chain bridge libvirt_nwfilter postrouting { type filter hook postrouting priority -300; policy accept; }\n" \
+    "flush chain bridge libvirt_nwfilter postrouting\n" \
+    "add rule bridge libvirt_nwfilter postrouting oifname vmap @out_ifaces\n" \
+    "add chain bridge libvirt_nwfilter basic\n" \
+    "flush chain bridge libvirt_nwfilter basic\n" \
+    "add rule bridge libvirt_nwfilter basic iifname . ether saddr != @basic_macs drop\n" \
+    "add rule bridge libvirt_nwfilter basic ether type { ip, arp } accept\n" \
+    "add rule bridge libvirt_nwfilter basic drop\n"
+
+#define VIR_NWFILTER_REMOVE_VNET0 \
+    "delete element bridge libvirt_nwfilter in_ifaces { \"vnet0\" }\n" \
+    "delete element bridge libvirt_nwfilter out_ifaces { \"vnet0\" }\n" \
+    "flush chain bridge libvirt_nwfilter I-vnet0\n" \
+    "flush chain bridge libvirt_nwfilter I-vnet0/arp\n" \
+    "flush chain bridge libvirt_nwfilter O-vnet0\n" \
+    "flush chain bridge libvirt_nwfilter J-vnet0\n" \
+    "flush chain bridge libvirt_nwfilter P-vnet0\n" \
+    "delete chain bridge libvirt_nwfilter I-vnet0\n" \
+    "delete chain bridge libvirt_nwfilter I-vnet0/arp\n" \
+    "delete chain bridge libvirt_nwfilter O-vnet0\n" \
+    "delete chain bridge libvirt_nwfilter J-vnet0\n" \
+    "delete chain bridge libvirt_nwfilter P-vnet0\n"
+
+
+typedef struct _testNFTablesData testNFTablesData;
+struct _testNFTablesData {
+    virBufferPtr buf;
+    const char *listing; /* NULL if the table can't be listed */
+    const char *listError; /* NULL if the table does not exist */
+};
+
+
+static void
+testNFTablesCommandCallback(const char *const*args,
+                            const char *const*env G_GNUC_UNUSED,
+                            const char *input,
+                            char **output,
+                            char **error,
+                            int *status,
+                            void *opaque)
+{
+    testNFTablesData *data = opaque;
+
+    if (STREQ_NULLABLE(args[1], "list")) {
+        if (data->listing) {
+            *output = g_strdup(data->listing);
+        } else {
+            *error = g_strdup(data->listError ? data->listError :
+                              "Error: No such file or directory\n"
+                              "list table bridge libvirt_nwfilter\n");
+            *status = 1;
+        }
+    } else if (input) {
+        virBufferAdd(data->buf, input, -1);
+    }
+}
+
+
+static int
+testNFTablesCheck(testNFTablesData *data,
+                  const char *expected)
+{
+    g_autofree char *actual = NULL;
+
+    actual = virBufferContentAndReset(data->buf);
+    virTestClearCommandPath(actual);
+
+    if (STRNEQ_NULLABLE(actual, expected)) {
+        virTestDifference(stderr, expected, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testNWFilterNFTablesAllTeardown(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    testNFTablesData data = { &buf, VIR_NWFILTER_TABLE_LISTING, NULL };
+    const char *expected =
+        VIR_NWFILTER_LIST_TABLE
+        VIR_NWFILTER_APPLY_SCRIPT
+        VIR_NWFILTER_REMOVE_VNET0;
+    int ret = -1;
+
+    virCommandSetDryRun(&buf, testNFTablesCommandCallback, &data);
+
+    if (nftables_driver.allTeardown("vnet0") < 0)
+        goto cleanup;
+
+    ret = testNFTablesCheck(&data, expected);
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    nftables_driver.shutdown();
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesTearOldRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    testNFTablesData data = { &buf, VIR_NWFILTER_TABLE_LISTING, NULL };
+    const char *expected =
+        VIR_NWFILTER_LIST_TABLE
+        VIR_NWFILTER_APPLY_SCRIPT
+        "delete element bridge libvirt_nwfilter in_ifaces { \"vnet0\" }\n"
+        "delete element bridge libvirt_nwfilter out_ifaces { \"vnet0\" }\n"
+        "flush chain bridge libvirt_nwfilter I-vnet0\n"
+        "flush chain bridge libvirt_nwfilter I-vnet0/arp\n"
+        "flush chain bridge libvirt_nwfilter O-vnet0\n"
+        "delete chain bridge libvirt_nwfilter I-vnet0\n"
+        "delete chain bridge libvirt_nwfilter I-vnet0/arp\n"
+        "delete chain bridge libvirt_nwfilter O-vnet0\n"
+        "add element bridge libvirt_nwfilter in_ifaces { \"vnet0\" : jump J-vnet0 }\n"
+        "add element bridge libvirt_nwfilter out_ifaces { \"vnet0\" : jump P-vnet0 }\n";
+    int ret = -1;
+
+    virCommandSetDryRun(&buf, testNFTablesCommandCallback, &data);
+
+    if (nftables_driver.tearOldRules("vnet0") < 0)
+        goto cleanup;
+
+    ret = testNFTablesCheck(&data, expected);
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    nftables_driver.shutdown();
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesTearNewRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    testNFTablesData data = { &buf, VIR_NWFILTER_TABLE_LISTING, NULL };
+    const char *expected =
+        VIR_NWFILTER_LIST_TABLE
+        VIR_NWFILTER_APPLY_SCRIPT
+        "flush chain bridge libvirt_nwfilter J-vnet0\n"
+        "flush chain bridge libvirt_nwfilter P-vnet0\n"
+        "delete chain bridge libvirt_nwfilter J-vnet0\n"
+        "delete chain bridge libvirt_nwfilter P-vnet0\n";
+    int ret = -1;
+
+    virCommandSetDryRun(&buf, testNFTablesCommandCallback, &data);
+
+    if (nftables_driver.tearNewRules("vnet0") < 0)
+        goto cleanup;
+
+    ret = testNFTablesCheck(&data, expected);
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    nftables_driver.shutdown();
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesApplyBasicRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    testNFTablesData data = { &buf, VIR_NWFILTER_TABLE_LISTING, NULL };
+    const char *expected =
+        VIR_NWFILTER_LIST_TABLE
+        VIR_NWFILTER_APPLY_SCRIPT
+        "delete element bridge libvirt_nwfilter in_ifaces { \"vnet1\" }\n"
+        "delete element bridge libvirt_nwfilter basic_macs { \"vnet1\" . 52:54:00:00:00:01 }\n"
+        "add element bridge libvirt_nwfilter basic_macs { \"vnet1\" . 10:20:30:40:50:60 }\n"
+        "add element bridge libvirt_nwfilter in_ifaces { \"vnet1\" : jump basic }\n";
+    int ret = -1;
+    virMacAddr mac = { .addr = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 } };
+
+    virCommandSetDryRun(&buf, testNFTablesCommandCallback, &data);
+
+    if (nftables_driver.applyBasicRules("vnet1", &mac) < 0)
+        goto cleanup;
+
+    ret = testNFTablesCheck(&data, expected);
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    nftables_driver.shutdown();
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesApplyDHCPOnlyRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    testNFTablesData data = { &buf, VIR_NWFILTER_TABLE_LISTING, NULL };
+    const char *expected =
+        VIR_NWFILTER_LIST_TABLE
+        VIR_NWFILTER_APPLY_SCRIPT
+        VIR_NWFILTER_REMOVE_VNET0
+        "add chain bridge libvirt_nwfilter J-vnet0\n"
+        "add chain bridge libvirt_nwfilter P-vnet0\n"
+        "add rule bridge libvirt_nwfilter J-vnet0 ether saddr 10:20:30:40:50:60 ether type ip ip protocol udp udp sport 68 udp dport 67 accept\n"
+        "add rule bridge libvirt_nwfilter J-vnet0 drop\n"
+        "add rule bridge libvirt_nwfilter P-vnet0 ether daddr { 10:20:30:40:50:60, ff:ff:ff:ff:ff:ff } ether type ip ip protocol udp ip saddr { 192.168.122.1, 10.0.0.1 } udp sport 67 udp dport 68 accept\n"
+        "add rule bridge libvirt_nwfilter P-vnet0 drop\n"
+        "add element bridge libvirt_nwfilter in_ifaces { \"vnet0\" : jump J-vnet0 }\n"
+        "add element bridge libvirt_nwfilter out_ifaces { \"vnet0\" : jump P-vnet0 }\n";
+    int ret = -1;
+    virMacAddr mac = { .addr = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 } };
+    const char *servers[] = { "192.168.122.1", "10.0.0.1" };
+    virNWFilterVarValue val = {
+        .valType = NWFILTER_VALUE_TYPE_ARRAY,
+        .u = {
+            .array = {
+                .values = (char **)servers,
+                .nValues = 2,
+            },
+        },
+    };
+
+    virCommandSetDryRun(&buf, testNFTablesCommandCallback, &data);
+
+    if (nftables_driver.applyDHCPOnlyRules("vnet0", &mac, &val, false) < 0)
+        goto cleanup;
+
+    ret = testNFTablesCheck(&data, expected);
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    nftables_driver.shutdown();
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesApplyDropAllRules(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    testNFTablesData data = { &buf, NULL, NULL };
+    const char *expected =
+        VIR_NWFILTER_LIST_TABLE
+        VIR_NWFILTER_APPLY_SCRIPT
+        VIR_NWFILTER_CREATE_TABLE
+        "add element bridge libvirt_nwfilter in_ifaces { \"vnet0\" : drop }\n"
+        "add element bridge libvirt_nwfilter out_ifaces { \"vnet0\" : drop }\n";
+    int ret = -1;
+
+    virCommandSetDryRun(&buf, testNFTablesCommandCallback, &data);
+
+    if (nftables_driver.applyDropAllRules("vnet0") < 0)
+        goto cleanup;
+
+    ret = testNFTablesCheck(&data, expected);
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    nftables_driver.shutdown();
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesListError(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    testNFTablesData data = {
+        &buf, NULL,
+        "Error: Could not process rule: Operation not permitted\n",
+    };
+    const char *expected =
+        VIR_NWFILTER_LIST_TABLE;
+    int ret = -1;
+
+    virCommandSetDryRun(&buf, testNFTablesCommandCallback, &data);
+
+    /* a failure to list the table must not be mistaken for a missing
+     * table which would be created again */
+    if (nftables_driver.applyDropAllRules("vnet0") == 0) {
+        fprintf(stderr, "listing failure was ignored\n");
+        goto cleanup;
+    }
+    virResetLastError();
+
+    ret = testNFTablesCheck(&data, expected);
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    nftables_driver.shutdown();
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesListOnce(const void *opaque G_GNUC_UNUSED)
+{
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    testNFTablesData data = { &buf, VIR_NWFILTER_TABLE_LISTING, NULL };
+    const char *expected =
+        VIR_NWFILTER_LIST_TABLE
+        VIR_NWFILTER_APPLY_SCRIPT
+        VIR_NWFILTER_REMOVE_VNET0
+        VIR_NWFILTER_APPLY_SCRIPT
+        "delete element bridge libvirt_nwfilter in_ifaces { \"vnet1\" }\n"
+        "delete element bridge libvirt_nwfilter basic_macs { \"vnet1\" . 52:54:00:00:00:01 }\n"
+        "add element bridge libvirt_nwfilter basic_macs { \"vnet1\" . 10:20:30:40:50:60 }\n"
+        "add element bridge libvirt_nwfilter in_ifaces { \"vnet1\" : jump basic }\n"
+        VIR_NWFILTER_APPLY_SCRIPT
+        "add element bridge libvirt_nwfilter in_ifaces { \"vnet0\" : drop }\n"
+        "add element bridge libvirt_nwfilter out_ifaces { \"vnet0\" : drop }\n"
+        VIR_NWFILTER_APPLY_SCRIPT
+        "delete element bridge libvirt_nwfilter in_ifaces { \"vnet0\" }\n"
+        "delete element bridge libvirt_nwfilter out_ifaces { \"vnet0\" }\n";
+    int ret = -1;
+    virMacAddr mac = { .addr = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 } };
+
+    virCommandSetDryRun(&buf, testNFTablesCommandCallback, &data);
+
+    /* only the first operation lists the table, the following ones work
+     * with the state the previous ones left behind */
+    if (nftables_driver.allTeardown("vnet0") < 0 ||
+        nftables_driver.applyBasicRules("vnet1", &mac) < 0 ||
+        nftables_driver.applyDropAllRules("vnet0") < 0 ||
+        nftables_driver.allTeardown("vnet0") < 0)
+        goto cleanup;
+
+    ret = testNFTablesCheck(&data, expected);
+
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    nftables_driver.shutdown();
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("nftablesAllTeardown",
+                   testNWFilterNFTablesAllTeardown,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesTearOldRules",
+                   testNWFilterNFTablesTearOldRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesTearNewRules",
+                   testNWFilterNFTablesTearNewRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesApplyBasicRules",
+                   testNWFilterNFTablesApplyBasicRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesApplyDHCPOnlyRules",
+                   testNWFilterNFTablesApplyDHCPOnlyRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesApplyDropAllRules",
+                   testNWFilterNFTablesApplyDropAllRules,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesListError",
+                   testNWFilterNFTablesListError,
+                   NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("nftablesListOnce",
+                   testNWFilterNFTablesListOnce,
+                   NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,353 @@
+/*
+ * qemudomainjobtest.c: test the statistics of QEMU domain jobs
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "qemu/qemu_domain.h"
+# include "virtime.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Bytes transferred during every pass of testJobInfoPassHistory */
+# define TEST_PASS_BYTES (10 * 1000 * 1000)
+/* How long every pass of testJobInfoPassHistory takes, in milliseconds */
+# define TEST_PASS_DURATION 10000
+
+
+/*
+ * Pretend QEMU moved on to @iteration, having transferred @transferred
+ * bytes in total, and that the current pass started @duration
+ * milliseconds ago.
+ */
+static int
+testJobInfoPass(qemuDomainJobInfoPtr jobInfo,
+                unsigned long long duration,
+                unsigned long long iteration,
+                unsigned long long transferred,
+                unsigned long long dirtyRate)
+{
+    unsigned long long now;
+
+    if (jobInfo->passStarted) {
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+        jobInfo->passStarted = now - duration;
+    }
+
+    jobInfo->stats.mig.ram_iteration = iteration;
+    jobInfo->stats.mig.ram_transferred = transferred;
+    jobInfo->stats.mig.ram_dirty_rate = dirtyRate;
+
+    return qemuDomainJobInfoUpdateMigrationPass(jobInfo);
+}
+
+
+static int
+testJobInfoPassCount(qemuDomainJobInfoPtr jobInfo,
+                     size_t expect)
+{
+    if (jobInfo->npasses != expect) {
+        fprintf(stderr, "expected %zu passes in the history, got %zu\n",
+                expect, jobInfo->npasses);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testJobInfoPassHistory(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(qemuDomainJobInfo) jobInfo = g_new0(qemuDomainJobInfo, 1);
+    unsigned long long iterations[] = { 3, 4, 5, 6 };
+    unsigned long long dirtyRates[] = { 400, 500, 600, 900 };
+    unsigned long long iteration;
+    size_t i;
+
+    jobInfo->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION;
+
+    /* no memory pass started yet */
+    if (testJobInfoPass(jobInfo, 0, 0, 0, 0) < 0 ||
+        testJobInfoPassCount(jobInfo, 0) < 0)
+        return -1;
+
+    /* the first pass is only seen starting */
+    if (testJobInfoPass(jobInfo, 0, 1, 0, 0) < 0 ||
+        testJobInfoPass(jobInfo, 0, 1, TEST_PASS_BYTES / 2, 0) < 0 ||
+        testJobInfoPassCount(jobInfo, 0) < 0)
+        return -1;
+
+    /* the oldest passes are dropped from a full history */
+    for (iteration = 2; iteration <= 6; iteration++) {
+        if (testJobInfoPass(jobInfo, TEST_PASS_DURATION, iteration,
+                            (iteration - 1) * TEST_PASS_BYTES,
+                            iteration * 100) < 0)
+            return -1;
+    }
+
+    /* passes 6 to 8 weren't seen separately and share an entry */
+    if (testJobInfoPass(jobInfo, TEST_PASS_DURATION, 9,
+                        6 * TEST_PASS_BYTES, 900) < 0 ||
+        testJobInfoPassCount(jobInfo, QEMU_DOMAIN_JOB_MIGRATION_PASSES) < 0)
+        return -1;
+
+    for (i = 0; i < jobInfo->npasses; i++) {
+        qemuDomainMigrationPassPtr pass = &jobInfo->passes[i];
+
+        if (pass->iteration != iterations[i]) {
+            fprintf(stderr, "pass %zu: expected iteration %llu, got %llu\n",
+                    i, iterations[i], pass->iteration);
+            return -1;
+        }
+
+        if (pass->dirtyRate != dirtyRates[i]) {
+            fprintf(stderr, "pass %zu: expected dirty rate %llu, got %llu\n",
+                    i, dirtyRates[i], pass->dirtyRate);
+            return -1;
+        }
+
+        /* the duration is measured, allow the test to be slow */
+        if (pass->duration < TEST_PASS_DURATION ||
+            pass->bps > TEST_PASS_BYTES * 1000ULL / TEST_PASS_DURATION ||
+            pass->bps < TEST_PASS_BYTES * 1000ULL / TEST_PASS_DURATION / 2) {
+            fprintf(stderr, "pass %zu: unexpected duration %llu or rate %llu\n",
+                    i, pass->duration, pass->bps);
+            return -1;
+        }
+    }
+
+    /* a restarted iteration counter doesn't produce an entry */
+    if (testJobInfoPass(jobInfo, TEST_PASS_DURATION, 1,
+                        7 * TEST_PASS_BYTES, 0) < 0 ||
+        testJobInfoPassCount(jobInfo, QEMU_DOMAIN_JOB_MIGRATION_PASSES) < 0 ||
+        jobInfo->passes[0].iteration != 3)
+        return -1;
+
+    return 0;
+}
+
+
+struct testJobInfoParam {
+    const char *name;
+    unsigned long long value;
+};
+
+
+/*
+ * Check that every parameter in @expect is reported by @jobInfo with
+ * the expected value and that none of @absent is reported at all.
+ */
+static int
+testJobInfoCheckParams(qemuDomainJobInfoPtr jobInfo,
+                       const struct testJobInfoParam *expect,
+                       size_t nexpect,
+                       const char **absent,
+                       size_t nabsent)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    int type;
+    int ret = -1;
+    size_t i;
+
+    if (qemuDomainJobInfoToParams(jobInfo, &type, &params, &nparams) < 0)
+        return -1;
+
+    for (i = 0; i < nexpect; i++) {
+        virTypedParameterPtr param;
+        unsigned long long value;
+
+        if (!(param = virTypedParamsGet(params, nparams, expect[i].name))) {
+            fprintf(stderr, "parameter '%s' is missing\n", expect[i].name);
+            goto cleanup;
+        }
+
+        if (param->type == VIR_TYPED_PARAM_UINT)
+            value = param->value.ui;
+        else
+            value = param->value.ul;
+
+        if (value != expect[i].value) {
+            fprintf(stderr, "parameter '%s': expected %llu, got %llu\n",
+                    expect[i].name, expect[i].value, value);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < nabsent; i++) {
+        if (virTypedParamsGet(params, nparams, absent[i])) {
+            fprintf(stderr, "unexpected parameter '%s'\n", absent[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+
+static int
+testJobInfoPassParams(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(qemuDomainJobInfo) jobInfo = g_new0(qemuDomainJobInfo, 1);
+    const struct testJobInfoParam expect[] = {
+        { VIR_DOMAIN_JOB_MEMORY_PASS_COUNT, 2 },
+        { "memory_pass.0.iteration", 4 },
+        { "memory_pass.0.duration", 1200 },
+        { "memory_pass.0.bps", 300000 },
+        { "memory_pass.0.dirty_rate", 150 },
+        { "memory_pass.1.iteration", 5 },
+        { "memory_pass.1.duration", 800 },
+        { "memory_pass.1.bps", 310000 },
+        { "memory_pass.1.dirty_rate", 120 },
+    };
+    const char *absentPasses[] = {
+        "memory_pass.2.iteration",
+    };
+    const char *absentCount[] = {
+        VIR_DOMAIN_JOB_MEMORY_PASS_COUNT,
+        "memory_pass.0.iteration",
+    };
+
+    jobInfo->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION;
+    jobInfo->operation = VIR_DOMAIN_JOB_OPERATION_MIGRATION_OUT;
+
+    /* nothing is reported until a pass finished */
+    if (testJobInfoCheckParams(jobInfo, NULL, 0,
+                               absentCount, G_N_ELEMENTS(absentCount)) < 0)
+        return -1;
+
+    jobInfo->passes[0] = (qemuDomainMigrationPass) { 4, 1200, 300000, 150 };
+    jobInfo->passes[1] = (qemuDomainMigrationPass) { 5, 800, 310000, 120 };
+    jobInfo->npasses = 2;
+
+    if (testJobInfoCheckParams(jobInfo, expect, G_N_ELEMENTS(expect),
+                               absentPasses, G_N_ELEMENTS(absentPasses)) < 0)
+        return -1;
+
+    /* the history is reported for save and dump jobs too */
+    jobInfo->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_SAVEDUMP;
+    jobInfo->operation = VIR_DOMAIN_JOB_OPERATION_SAVE;
+
+    if (testJobInfoCheckParams(jobInfo, expect, G_N_ELEMENTS(expect),
+                               absentPasses, G_N_ELEMENTS(absentPasses)) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+testJobInfoMirrorParams(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(qemuDomainJobInfo) jobInfo = g_new0(qemuDomainJobInfo, 1);
+    /* vda is being copied, vdb is waiting for its mirror */
+    const struct testJobInfoParam expectCopying[] = {
+        { VIR_DOMAIN_JOB_DISK_TOTAL, 3000 },
+        { VIR_DOMAIN_JOB_DISK_PROCESSED, 400 },
+        { VIR_DOMAIN_JOB_DISK_REMAINING, 2600 },
+        { VIR_DOMAIN_JOB_DISK_BPS, 100 },
+        { VIR_DOMAIN_JOB_DISK_TIME_REMAINING, 26000 },
+        { VIR_DOMAIN_JOB_DATA_TOTAL, 3000 },
+        { VIR_DOMAIN_JOB_DATA_REMAINING, 2600 },
+    };
+    const struct testJobInfoParam expectStarting[] = {
+        { VIR_DOMAIN_JOB_DISK_TOTAL, 3000 },
+        { VIR_DOMAIN_JOB_DISK_REMAINING, 3000 },
+    };
+    const struct testJobInfoParam expectDone[] = {
+        { VIR_DOMAIN_JOB_DISK_TOTAL, 3000 },
+        { VIR_DOMAIN_JOB_DISK_REMAINING, 0 },
+        { VIR_DOMAIN_JOB_DISK_BPS, 150 },
+    };
+    const char *absentRate[] = {
+        VIR_DOMAIN_JOB_DISK_BPS,
+        VIR_DOMAIN_JOB_DISK_TIME_REMAINING,
+    };
+    const char *absentTime[] = {
+        VIR_DOMAIN_JOB_DISK_TIME_REMAINING,
+    };
+
+    jobInfo->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION;
+    jobInfo->operation = VIR_DOMAIN_JOB_OPERATION_MIGRATION_OUT;
+
+    /* nothing was copied yet, the rate is unknown */
+    jobInfo->mirrorStats.pending = 3000;
+
+    if (testJobInfoCheckParams(jobInfo, expectStarting,
+                               G_N_ELEMENTS(expectStarting),
+                               absentRate, G_N_ELEMENTS(absentRate)) < 0)
+        return -1;
+
+    jobInfo->mirrorStats.transferred = 400;
+    jobInfo->mirrorStats.total = 1000;
+    jobInfo->mirrorStats.pending = 2000;
+    jobInfo->mirrorStats.bps = 100;
+
+    if (testJobInfoCheckParams(jobInfo, expectCopying,
+                               G_N_ELEMENTS(expectCopying), NULL, 0) < 0)
+        return -1;
+
+    /* nothing is left to estimate once all disks were copied */
+    jobInfo->mirrorStats.transferred = 3000;
+    jobInfo->mirrorStats.total = 3000;
+    jobInfo->mirrorStats.pending = 0;
+    jobInfo->mirrorStats.bps = 150;
+
+    if (testJobInfoCheckParams(jobInfo, expectDone, G_N_ELEMENTS(expectDone),
+                               absentTime, G_N_ELEMENTS(absentTime)) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (virTestRun("pass history", testJobInfoPassHistory, NULL) < 0)
+        ret = -1;
+    if (virTestRun("pass params", testJobInfoPassParams, NULL) < 0)
+        ret = -1;
+    if (virTestRun("mirror params", testJobInfoMirrorParams, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
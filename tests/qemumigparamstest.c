@@ -28,6 +28,8 @@
 #include "qemu/qemu_migration_params.h"
 #define LIBVIRT_QEMU_MIGRATION_PARAMSPRIV_H_ALLOW
 #include "qemu/qemu_migration_paramspriv.h"
+#define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+#include "qemu/qemu_migrationpriv.h"
 #include "qemu/qemu_monitor.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -192,6 +194,256 @@ qemuMigParamsTestJSON(const void *opaque)
     return ret;
 }
 
+/* Reply to query-migrate-parameters used by the auto-tune tests */
+#define QEMU_MIG_PARAMS_AUTO_TUNE_REPLY(downtime) \
+    "{" \
+    "    \"return\": {" \
+    "        \"downtime-limit\": " downtime "," \
+    "        \"cpu-throttle-initial\": 20," \
+    "        \"cpu-throttle-increment\": 10," \
+    "        \"xbzrle-cache-size\": 67108864" \
+    "    }" \
+    "}"
+
+typedef struct _qemuMigParamsAutoTuneData qemuMigParamsAutoTuneData;
+struct _qemuMigParamsAutoTuneData {
+    virQEMUDriverPtr driver;
+    qemuMonitorTestPtr mon;
+    virDomainObjPtr vm;
+};
+
+
+static int
+qemuMigParamsTestAutoTuneInit(qemuMigParamsAutoTuneData *data,
+                              virQEMUDriverPtr driver,
+                              unsigned long apiFlags,
+                              bool xbzrle)
+{
+    qemuDomainObjPrivatePtr priv;
+    qemuDomainJobInfoPtr jobInfo;
+
+    data->driver = driver;
+
+    if (!(data->vm = virDomainObjNew(driver->xmlopt)) ||
+        !(data->vm->def = virDomainDefNew()))
+        return -1;
+
+    data->vm->def->id = 1;
+    data->vm->def->name = g_strdup("test");
+    virDomainDefSetMemoryTotal(data->vm->def, 4 * 1024 * 1024);
+
+    priv = data->vm->privateData;
+    if (!(priv->qemuCaps = virQEMUCapsNew()))
+        return -1;
+    virQEMUCapsSet(priv->qemuCaps, QEMU_CAPS_MIGRATION_PARAM_XBZRLE_CACHE_SIZE);
+
+    priv->job.apiFlags = apiFlags;
+    priv->job.current = jobInfo = g_new0(qemuDomainJobInfo, 1);
+    jobInfo->status = QEMU_DOMAIN_JOB_STATUS_MIGRATING;
+    jobInfo->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION;
+    jobInfo->stats.mig.ram_page_size = 4096;
+    jobInfo->stats.mig.xbzrle_set = xbzrle;
+
+    if (!(data->mon = qemuMonitorTestNew(driver->xmlopt, data->vm, driver,
+                                         NULL, NULL)))
+        return -1;
+
+    return 0;
+}
+
+
+static void
+qemuMigParamsTestAutoTuneFree(qemuMigParamsAutoTuneData *data)
+{
+    qemuDomainObjPrivatePtr priv;
+
+    if (data->vm) {
+        priv = data->vm->privateData;
+        /* don't dispose test monitor with VM */
+        if (priv->mon) {
+            virObjectLock(priv->mon);
+            priv->mon = NULL;
+        }
+        virDomainObjEndAPI(&data->vm);
+    }
+
+    qemuMonitorTestFree(data->mon);
+}
+
+
+/*
+ * Pretend the last two finished memory passes of the migration were
+ * @iteration and @iteration + 1, either both converging or both not,
+ * run the controller and check how many steps it took so far.
+ */
+static int
+qemuMigParamsTestAutoTuneRound(qemuMigParamsAutoTuneData *data,
+                               size_t npasses,
+                               unsigned long long iteration,
+                               bool converging,
+                               size_t expectSteps)
+{
+    qemuDomainObjPrivatePtr priv = data->vm->privateData;
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
+    size_t i;
+
+    jobInfo->npasses = npasses;
+    for (i = 0; i < npasses; i++) {
+        jobInfo->passes[i].iteration = iteration + i;
+        jobInfo->passes[i].duration = 1000;
+        jobInfo->passes[i].bps = 100 * 1024 * 1024;
+        /* twice the dirtied memory is either way below or above @bps */
+        jobInfo->passes[i].dirtyRate = converging ? 1000 : 100000;
+    }
+    jobInfo->passIteration = iteration + npasses;
+
+    qemuMigrationSrcAutoTune(data->driver, data->vm, QEMU_ASYNC_JOB_NONE);
+    virResetLastError();
+
+    if (jobInfo->nautoTune != expectSteps) {
+        fprintf(stderr, "pass %llu: expected %zu steps, got %zu\n",
+                jobInfo->passIteration, expectSteps, jobInfo->nautoTune);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+qemuMigParamsTestAutoTune(const void *opaque)
+{
+    virQEMUDriverPtr driver = (void *) opaque;
+    qemuMigParamsAutoTuneData data = { 0 };
+    qemuDomainObjPrivatePtr priv;
+    qemuDomainJobInfoPtr jobInfo;
+    const int actions[] = {
+        VIR_DOMAIN_JOB_AUTO_TUNE_DOWNTIME,
+        VIR_DOMAIN_JOB_AUTO_TUNE_THROTTLE,
+        VIR_DOMAIN_JOB_AUTO_TUNE_COMPRESSION,
+        VIR_DOMAIN_JOB_AUTO_TUNE_POSTCOPY,
+    };
+    const unsigned long long iterations[] = { 5, 8, 11, 14 };
+    int ret = -1;
+    size_t i;
+
+    if (qemuMigParamsTestAutoTuneInit(&data, driver,
+                                      VIR_MIGRATE_AUTO_TUNE |
+                                      VIR_MIGRATE_AUTO_CONVERGE |
+                                      VIR_MIGRATE_POSTCOPY, true) < 0)
+        goto cleanup;
+
+    /* a downtime-limit of 0 is raised from QEMU's default */
+    if (qemuMonitorTestAddItem(data.mon, "query-migrate-parameters",
+                               QEMU_MIG_PARAMS_AUTO_TUNE_REPLY("0")) < 0 ||
+        qemuMonitorTestAddItemExpect(data.mon, "migrate-set-parameters",
+                                     "{'downtime-limit':1200}", true,
+                                     "{\"return\":{}}") < 0 ||
+        qemuMonitorTestAddItem(data.mon, "query-migrate-parameters",
+                               QEMU_MIG_PARAMS_AUTO_TUNE_REPLY("1200")) < 0 ||
+        qemuMonitorTestAddItemExpect(data.mon, "migrate-set-parameters",
+                                     "{'cpu-throttle-initial':50,"
+                                     "'cpu-throttle-increment':20}", true,
+                                     "{\"return\":{}}") < 0 ||
+        qemuMonitorTestAddItem(data.mon, "query-migrate-parameters",
+                               QEMU_MIG_PARAMS_AUTO_TUNE_REPLY("1200")) < 0 ||
+        qemuMonitorTestAddItemExpect(data.mon, "migrate-set-parameters",
+                                     "{'xbzrle-cache-size':134217728}", true,
+                                     "{\"return\":{}}") < 0 ||
+        qemuMonitorTestAddItem(data.mon, "migrate-start-postcopy",
+                               "{\"return\":{}}") < 0)
+        goto cleanup;
+
+    priv = data.vm->privateData;
+    jobInfo = priv->job.current;
+    priv->mon = qemuMonitorTestGetMonitor(data.mon);
+    /* qemuDomainObjEnterMonitorInternal locks the monitor again */
+    virObjectUnlock(priv->mon);
+
+    /* a single pass doesn't tell whether the migration converges */
+    if (qemuMigParamsTestAutoTuneRound(&data, 1, 1, false, 0) < 0)
+        goto cleanup;
+
+    /* converging passes don't need any help */
+    if (qemuMigParamsTestAutoTuneRound(&data, 2, 1, true, 0) < 0)
+        goto cleanup;
+
+    if (qemuMigParamsTestAutoTuneRound(&data, 2, 3, false, 1) < 0)
+        goto cleanup;
+
+    /* two full passes have to finish after the step before the next one */
+    if (qemuMigParamsTestAutoTuneRound(&data, 2, 4, false, 1) < 0 ||
+        qemuMigParamsTestAutoTuneRound(&data, 2, 5, false, 1) < 0 ||
+        qemuMigParamsTestAutoTuneRound(&data, 2, 6, false, 2) < 0)
+        goto cleanup;
+
+    if (qemuMigParamsTestAutoTuneRound(&data, 2, 8, false, 2) < 0 ||
+        qemuMigParamsTestAutoTuneRound(&data, 2, 9, false, 3) < 0 ||
+        qemuMigParamsTestAutoTuneRound(&data, 2, 12, false, 4) < 0)
+        goto cleanup;
+
+    /* all steps were taken */
+    if (qemuMigParamsTestAutoTuneRound(&data, 2, 15, false, 4) < 0)
+        goto cleanup;
+
+    for (i = 0; i < G_N_ELEMENTS(actions); i++) {
+        if (jobInfo->autoTune[i].action != actions[i] ||
+            jobInfo->autoTune[i].iteration != iterations[i]) {
+            fprintf(stderr, "step %zu: expected action %d in pass %llu, "
+                    "got action %d in pass %llu\n",
+                    i, actions[i], iterations[i],
+                    jobInfo->autoTune[i].action,
+                    jobInfo->autoTune[i].iteration);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    qemuMigParamsTestAutoTuneFree(&data);
+    return ret;
+}
+
+
+static int
+qemuMigParamsTestAutoTuneSkip(const void *opaque)
+{
+    virQEMUDriverPtr driver = (void *) opaque;
+    qemuMigParamsAutoTuneData data = { 0 };
+    qemuDomainObjPrivatePtr priv;
+    int ret = -1;
+
+    if (qemuMigParamsTestAutoTuneInit(&data, driver,
+                                      VIR_MIGRATE_AUTO_TUNE, false) < 0)
+        goto cleanup;
+
+    /* the maximum downtime is already reached, throttling, XBZRLE, and
+     * post-copy are not enabled for the migration */
+    if (qemuMonitorTestAddItem(data.mon, "query-migrate-parameters",
+                               QEMU_MIG_PARAMS_AUTO_TUNE_REPLY("2000")) < 0)
+        goto cleanup;
+
+    priv = data.vm->privateData;
+    priv->mon = qemuMonitorTestGetMonitor(data.mon);
+    virObjectUnlock(priv->mon);
+
+    if (qemuMigParamsTestAutoTuneRound(&data, 2, 1, false, 0) < 0 ||
+        qemuMigParamsTestAutoTuneRound(&data, 2, 3, false, 0) < 0)
+        goto cleanup;
+
+    if (priv->job.current->autoTuneNext != VIR_DOMAIN_JOB_AUTO_TUNE_LAST) {
+        fprintf(stderr, "expected all steps to be skipped\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    qemuMigParamsTestAutoTuneFree(&data);
+    return ret;
+}
+
 
 static int
 mymain(void)
@@ -224,6 +476,11 @@ mymain(void)
     DO_TEST("tls-enabled");
     DO_TEST("tls-hostname");
 
+    if (virTestRun("auto-tune", qemuMigParamsTestAutoTune, &driver) < 0)
+        ret = -1;
+    if (virTestRun("auto-tune skip", qemuMigParamsTestAutoTuneSkip, &driver) < 0)
+        ret = -1;
+
     qemuTestDriverFree(&driver);
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -0,0 +1,617 @@
+/*
+ * qemumigrationtest.c: test storage migration helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "testutilsqemu.h"
+#include "qemumonitortestutils.h"
+#include "qemu/qemu_alias.h"
+#include "qemu/qemu_blockjob.h"
+#include "qemu/qemu_domain.h"
+#include "qemu/qemu_migration.h"
+#include "qemu/qemu_migration_cookie.h"
+#define LIBVIRT_QEMU_MIGRATIONPRIV_H_ALLOW
+#include "qemu/qemu_migrationpriv.h"
+#include "datatypes.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static virQEMUDriver driver;
+
+#define TEST_NDISKS 4
+
+static const char *testDomainXML =
+    "<domain type='qemu'>\n"
+    "  <name>test</name>\n"
+    "  <uuid>d091ea82-29e6-2e34-3005-f02617b36e87</uuid>\n"
+    "  <memory>219100</memory>\n"
+    "  <vcpu>1</vcpu>\n"
+    "  <os>\n"
+    "    <type arch='x86_64' machine='pc'>hvm</type>\n"
+    "  </os>\n"
+    "  <devices>\n"
+    "    <emulator>/usr/bin/qemu-system-x86_64</emulator>\n"
+    "    <disk type='file' device='disk'>\n"
+    "      <driver name='qemu' type='qcow2'/>\n"
+    "      <source file='/nonexistent/pool/vda.qcow2'/>\n"
+    "      <target dev='vda' bus='virtio'/>\n"
+    "    </disk>\n"
+    "    <disk type='file' device='disk'>\n"
+    "      <driver name='qemu' type='qcow2'/>\n"
+    "      <source file='/nonexistent/pool/vdb.qcow2'/>\n"
+    "      <target dev='vdb' bus='virtio'/>\n"
+    "    </disk>\n"
+    "    <disk type='file' device='disk'>\n"
+    "      <driver name='qemu' type='qcow2'/>\n"
+    "      <source file='/nonexistent/pool/vdc.qcow2'/>\n"
+    "      <target dev='vdc' bus='virtio'/>\n"
+    "    </disk>\n"
+    "    <disk type='file' device='disk'>\n"
+    "      <driver name='qemu' type='qcow2'/>\n"
+    "      <source file='/nonexistent/pool/vdd.qcow2'/>\n"
+    "      <target dev='vdd' bus='virtio'/>\n"
+    "    </disk>\n"
+    "  </devices>\n"
+    "</domain>\n";
+
+
+static virDomainObjPtr
+testMigrationCreateVM(void)
+{
+    virDomainObjPtr vm;
+    qemuDomainObjPrivatePtr priv;
+
+    if (!(vm = virDomainObjNew(driver.xmlopt)))
+        return NULL;
+
+    priv = vm->privateData;
+
+    if (!(priv->qemuCaps = virQEMUCapsNew()) ||
+        qemuTestCapsCacheInsert(driver.qemuCapsCache, priv->qemuCaps) < 0 ||
+        !(vm->def = virDomainDefParseString(testDomainXML, driver.xmlopt,
+                                            NULL,
+                                            VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE)) ||
+        qemuAssignDeviceAliases(vm->def, priv->qemuCaps) < 0) {
+        virDomainObjEndAPI(&vm);
+        return NULL;
+    }
+
+    vm->def->id = 1;
+
+    return vm;
+}
+
+
+static void
+testMigrationFreeVM(virDomainObjPtr vm,
+                    qemuMonitorTestPtr test)
+{
+    qemuDomainObjPrivatePtr priv;
+
+    if (vm) {
+        priv = vm->privateData;
+        /* don't dispose test monitor with VM */
+        if (priv->mon) {
+            virObjectLock(priv->mon);
+            priv->mon = NULL;
+        }
+        virDomainObjEndAPI(&vm);
+    }
+
+    qemuMonitorTestFree(test);
+}
+
+
+static const unsigned char fakeUUID[VIR_UUID_BUFLEN] = "fakeuuid";
+
+static virMutex testPrecreateLock = VIR_MUTEX_INITIALIZER;
+static virCond testPrecreateCond;
+static size_t testPrecreateRunning;
+static size_t testPrecreateMaxRunning;
+static size_t testPrecreateCreated;
+static const char *testPrecreateFail;
+
+
+static virStoragePoolPtr
+fakeStoragePoolLookupByTargetPath(virConnectPtr conn,
+                                  const char *path G_GNUC_UNUSED)
+{
+    return virGetStoragePool(conn, "pool", fakeUUID, NULL, NULL);
+}
+
+
+static virStorageVolPtr
+fakeStorageVolLookupByName(virStoragePoolPtr pool G_GNUC_UNUSED,
+                           const char *name)
+{
+    virReportError(VIR_ERR_NO_STORAGE_VOL,
+                   "no storage vol with matching name '%s'", name);
+    return NULL;
+}
+
+
+static virStorageVolPtr
+fakeStorageVolCreateXML(virStoragePoolPtr pool,
+                        const char *xmldesc,
+                        unsigned int flags G_GNUC_UNUSED)
+{
+    bool fail = testPrecreateFail && strstr(xmldesc, testPrecreateFail);
+    unsigned long long deadline;
+
+    virMutexLock(&testPrecreateLock);
+
+    testPrecreateRunning++;
+    testPrecreateMaxRunning = MAX(testPrecreateMaxRunning,
+                                  testPrecreateRunning);
+    virCondBroadcast(&testPrecreateCond);
+
+    /* give another thread a chance to create a volume meanwhile */
+    if (virTimeMillisNow(&deadline) == 0) {
+        deadline += 100;
+        while (testPrecreateRunning < 2 &&
+               virCondWaitUntil(&testPrecreateCond, &testPrecreateLock,
+                                deadline) == 0)
+            ;
+    }
+
+    testPrecreateRunning--;
+    if (!fail)
+        testPrecreateCreated++;
+
+    virMutexUnlock(&testPrecreateLock);
+
+    if (fail) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "fake volume creation failure");
+        return NULL;
+    }
+
+    return virGetStorageVol(pool->conn, pool->name, "vol", "key", NULL, NULL);
+}
+
+
+static virStorageDriver fakeStorageDriver = {
+    .storagePoolLookupByTargetPath = fakeStoragePoolLookupByTargetPath,
+    .storageVolLookupByName = fakeStorageVolLookupByName,
+    .storageVolCreateXML = fakeStorageVolCreateXML,
+};
+
+
+static int
+testMigrationPrecreate(const void *opaque)
+{
+    const char *fail = opaque;
+    g_autoptr(virConnect) conn = NULL;
+    qemuMigrationCookieNBD nbd = { 0 };
+    struct qemuMigrationCookieNBDDisk disks[TEST_NDISKS] = {
+        { (char *) "vda", 1024 * 1024 },
+        { (char *) "vdb", 1024 * 1024 },
+        { (char *) "vdc", 1024 * 1024 },
+        { (char *) "vdd", 1024 * 1024 },
+    };
+    virDomainObjPtr vm = NULL;
+    int rc;
+    int ret = -1;
+
+    if (!(conn = virGetConnect()))
+        return -1;
+
+    conn->storageDriver = &fakeStorageDriver;
+    virSetConnectStorage(conn);
+
+    if (!(vm = testMigrationCreateVM()))
+        goto cleanup;
+
+    nbd.ndisks = TEST_NDISKS;
+    nbd.disks = disks;
+
+    testPrecreateMaxRunning = 0;
+    testPrecreateCreated = 0;
+    testPrecreateFail = fail;
+
+    rc = qemuMigrationDstPrecreateStorage(vm, &nbd, 0, NULL, false);
+
+    if (fail) {
+        if (rc == 0) {
+            fprintf(stderr, "creating volumes was expected to fail\n");
+            goto cleanup;
+        }
+
+        if (!strstr(virGetLastErrorMessage(), "fake volume creation failure")) {
+            fprintf(stderr, "unexpected error: %s\n", virGetLastErrorMessage());
+            goto cleanup;
+        }
+
+        virResetLastError();
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (rc < 0)
+        goto cleanup;
+
+    if (testPrecreateCreated != TEST_NDISKS) {
+        fprintf(stderr, "expected %d volumes to be created, got %zu\n",
+                TEST_NDISKS, testPrecreateCreated);
+        goto cleanup;
+    }
+
+    if (testPrecreateMaxRunning < 2) {
+        fprintf(stderr, "volumes were not created concurrently\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virSetConnectStorage(NULL);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+typedef struct _testStorageCopyData testStorageCopyData;
+struct _testStorageCopyData {
+    virDomainObjPtr vm;
+    size_t limit;
+    bool quit;
+    size_t maxRunning;
+};
+
+
+/*
+ * Pretends to be QEMU reporting the disk mirrors as ready, one at a time.
+ * A mirror gets ready only once as many mirrors as allowed are running to
+ * check that the next wave of disks is started right away.
+ */
+static void
+testStorageCopyReadyThread(void *opaque)
+{
+    testStorageCopyData *data = opaque;
+    virDomainObjPtr vm = data->vm;
+    size_t ticks = 0;
+
+    virObjectLock(vm);
+
+    while (!data->quit) {
+        qemuBlockJobDataPtr next = NULL;
+        size_t started = 0;
+        size_t running = 0;
+        size_t i;
+
+        for (i = 0; i < vm->def->ndisks; i++) {
+            virDomainDiskDefPtr disk = vm->def->disks[i];
+            qemuBlockJobDataPtr job;
+
+            if (!QEMU_DOMAIN_DISK_PRIVATE(disk)->migrating)
+                continue;
+
+            started++;
+
+            if (disk->mirrorState == VIR_DOMAIN_DISK_MIRROR_STATE_READY)
+                continue;
+
+            running++;
+
+            if (!next &&
+                (job = qemuBlockJobDiskGetJob(disk))) {
+                if (job->newstate == -1)
+                    next = job;
+                else
+                    virObjectUnref(job);
+            }
+        }
+
+        data->maxRunning = MAX(data->maxRunning, running);
+
+        /* don't wait forever if the mirrors aren't started as expected */
+        if (next &&
+            (running == data->limit || started == vm->def->ndisks ||
+             ++ticks > 100)) {
+            next->newstate = VIR_DOMAIN_BLOCK_JOB_READY;
+            virDomainObjBroadcast(vm);
+            ticks = 0;
+        }
+
+        virObjectUnref(next);
+
+        virObjectUnlock(vm);
+        g_usleep(10 * 1000);
+        virObjectLock(vm);
+    }
+
+    virObjectUnlock(vm);
+}
+
+
+#define TEST_DRIVE_MIRROR_ARGS(alias) \
+    "{'device':'drive-" alias "'," \
+    "'target':'nbd:localhost:49153:exportname=drive-" alias "'," \
+    "'sync':'full','mode':'existing','format':'raw'}"
+
+#define TEST_QUERY_BLOCK_DEVICE(alias, size) \
+    "{\"device\":\"drive-" alias "\"," \
+    "\"inserted\":{\"image\":{\"virtual-size\":" size "}}}"
+
+#define TEST_BLOCK_JOB(alias, len, offset) \
+    "{\"device\":\"drive-" alias "\",\"type\":\"mirror\"," \
+    "\"len\":" len ",\"offset\":" offset ",\"speed\":0,\"ready\":true}"
+
+
+static int
+testMigrationStorageCopy(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(qemuMigrationCookie) mig = g_new0(qemuMigrationCookie, 1);
+    testStorageCopyData data = { 0 };
+    qemuMonitorTestPtr test = NULL;
+    qemuDomainObjPrivatePtr priv;
+    qemuDomainMirrorStatsPtr mirrorStats;
+    unsigned int migrate_flags = QEMU_MONITOR_MIGRATE_NON_SHARED_DISK;
+    virThread thread;
+    bool job = false;
+    bool threadStarted = false;
+    int rc;
+    int ret = -1;
+
+    mig->nbd = g_new0(qemuMigrationCookieNBD, 1);
+    mig->nbd->port = 49153;
+
+    data.limit = 2;
+    driver.config->migrationMaxMirrors = data.limit;
+
+    if (!(data.vm = testMigrationCreateVM()) ||
+        !(test = qemuMonitorTestNew(driver.xmlopt, data.vm, &driver,
+                                    NULL, NULL)))
+        goto cleanup;
+
+    /* capacities of the disks waiting for their turn are fetched first,
+     * then the mirrors are started in two waves */
+    if (qemuMonitorTestAddItem(test, "query-block",
+                               "{\"return\":["
+                               TEST_QUERY_BLOCK_DEVICE("virtio-disk0", "1000") ","
+                               TEST_QUERY_BLOCK_DEVICE("virtio-disk1", "2000") ","
+                               TEST_QUERY_BLOCK_DEVICE("virtio-disk2", "3000") ","
+                               TEST_QUERY_BLOCK_DEVICE("virtio-disk3", "4000")
+                               "]}") < 0 ||
+        qemuMonitorTestAddItemExpect(test, "drive-mirror",
+                                     TEST_DRIVE_MIRROR_ARGS("virtio-disk0"),
+                                     true, "{\"return\":{}}") < 0 ||
+        qemuMonitorTestAddItemExpect(test, "drive-mirror",
+                                     TEST_DRIVE_MIRROR_ARGS("virtio-disk1"),
+                                     true, "{\"return\":{}}") < 0 ||
+        qemuMonitorTestAddItemExpect(test, "drive-mirror",
+                                     TEST_DRIVE_MIRROR_ARGS("virtio-disk2"),
+                                     true, "{\"return\":{}}") < 0 ||
+        qemuMonitorTestAddItemExpect(test, "drive-mirror",
+                                     TEST_DRIVE_MIRROR_ARGS("virtio-disk3"),
+                                     true, "{\"return\":{}}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-block-jobs",
+                               "{\"return\":["
+                               TEST_BLOCK_JOB("virtio-disk0", "1000", "1000") ","
+                               TEST_BLOCK_JOB("virtio-disk1", "2000", "2000") ","
+                               TEST_BLOCK_JOB("virtio-disk2", "3000", "3000") ","
+                               TEST_BLOCK_JOB("virtio-disk3", "4000", "4000")
+                               "]}") < 0)
+        goto cleanup;
+
+    priv = data.vm->privateData;
+    priv->mon = qemuMonitorTestGetMonitor(test);
+    /* qemuDomainObjEnterMonitorInternal locks the monitor again */
+    virObjectUnlock(priv->mon);
+
+    if (qemuDomainObjBeginAsyncJob(&driver, data.vm,
+                                   QEMU_ASYNC_JOB_MIGRATION_OUT,
+                                   VIR_DOMAIN_JOB_OPERATION_MIGRATION_OUT,
+                                   0) < 0)
+        goto cleanup;
+    job = true;
+
+    if (virThreadCreate(&thread, true, testStorageCopyReadyThread, &data) < 0)
+        goto cleanup;
+    threadStarted = true;
+
+    rc = qemuMigrationSrcNBDStorageCopy(&driver, data.vm, mig, "localhost",
+                                        0, &migrate_flags, 0, NULL, NULL,
+                                        NULL, 0);
+
+    data.quit = true;
+    virObjectUnlock(data.vm);
+    virThreadJoin(&thread);
+    virObjectLock(data.vm);
+    threadStarted = false;
+
+    if (rc < 0)
+        goto cleanup;
+
+    if (data.maxRunning != data.limit) {
+        fprintf(stderr, "expected %zu mirrors running at once, got %zu\n",
+                data.limit, data.maxRunning);
+        goto cleanup;
+    }
+
+    if (migrate_flags & QEMU_MONITOR_MIGRATE_NON_SHARED_DISK) {
+        fprintf(stderr, "storage was left for the migration to copy\n");
+        goto cleanup;
+    }
+
+    mirrorStats = &priv->job.current->mirrorStats;
+    if (mirrorStats->pending != 0 ||
+        mirrorStats->total != 10000 ||
+        mirrorStats->transferred != 10000) {
+        fprintf(stderr, "unexpected mirror stats: pending=%llu total=%llu "
+                "transferred=%llu\n", mirrorStats->pending,
+                mirrorStats->total, mirrorStats->transferred);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (threadStarted) {
+        data.quit = true;
+        virObjectUnlock(data.vm);
+        virThreadJoin(&thread);
+        virObjectLock(data.vm);
+    }
+    if (job)
+        qemuDomainObjEndAsyncJob(&driver, data.vm);
+    driver.config->migrationMaxMirrors = 0;
+    testMigrationFreeVM(data.vm, test);
+    return ret;
+}
+
+
+/*
+ * Runs qemuMigrationSrcFetchMirrorStats against @reply and checks the
+ * resulting statistics.
+ */
+static int
+testMigrationMirrorStatsFetch(virDomainObjPtr vm,
+                              qemuMonitorTestPtr test,
+                              qemuDomainJobInfoPtr jobInfo,
+                              const char *reply,
+                              unsigned long long transferred,
+                              unsigned long long total,
+                              unsigned long long pending)
+{
+    qemuDomainMirrorStatsPtr stats = &jobInfo->mirrorStats;
+
+    if (qemuMonitorTestAddItem(test, "query-block-jobs", reply) < 0)
+        return -1;
+
+    if (qemuMigrationSrcFetchMirrorStats(&driver, vm, QEMU_ASYNC_JOB_NONE,
+                                         jobInfo) < 0)
+        return -1;
+
+    if (stats->transferred != transferred ||
+        stats->total != total ||
+        stats->pending != pending) {
+        fprintf(stderr, "expected transferred=%llu total=%llu pending=%llu, "
+                "got transferred=%llu total=%llu pending=%llu\n",
+                transferred, total, pending,
+                stats->transferred, stats->total, stats->pending);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testMigrationMirrorStats(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(qemuDomainJobInfo) jobInfo = g_new0(qemuDomainJobInfo, 1);
+    virDomainObjPtr vm = NULL;
+    qemuMonitorTestPtr test = NULL;
+    qemuDomainObjPrivatePtr priv;
+    qemuDomainDiskPrivatePtr diskPriv[TEST_NDISKS];
+    size_t i;
+    int ret = -1;
+
+    if (!(vm = testMigrationCreateVM()) ||
+        !(test = qemuMonitorTestNew(driver.xmlopt, vm, &driver, NULL, NULL)))
+        goto cleanup;
+
+    priv = vm->privateData;
+    priv->mon = qemuMonitorTestGetMonitor(test);
+    /* qemuDomainObjEnterMonitorInternal locks the monitor again */
+    virObjectUnlock(priv->mon);
+
+    for (i = 0; i < TEST_NDISKS; i++)
+        diskPriv[i] = QEMU_DOMAIN_DISK_PRIVATE(vm->def->disks[i]);
+
+    /* vda is being copied, the mirror of vdb has just been started, vdc
+     * waits for its turn and vdd is not migrated at all */
+    diskPriv[0]->migrating = true;
+    diskPriv[1]->migrating = true;
+    diskPriv[1]->migrPending = 2000;
+    diskPriv[2]->migrPending = 3000;
+
+    /* the disk stays pending until its mirror knows the size of the copy */
+    if (testMigrationMirrorStatsFetch(vm, test, jobInfo,
+                                      "{\"return\":["
+                                      TEST_BLOCK_JOB("virtio-disk0", "1000", "400") ","
+                                      TEST_BLOCK_JOB("virtio-disk1", "0", "0")
+                                      "]}", 400, 1000, 5000) < 0)
+        goto cleanup;
+
+    /* a mirror which isn't reported yet doesn't change anything either */
+    if (testMigrationMirrorStatsFetch(vm, test, jobInfo,
+                                      "{\"return\":["
+                                      TEST_BLOCK_JOB("virtio-disk0", "1000", "500")
+                                      "]}", 500, 1000, 5000) < 0)
+        goto cleanup;
+
+    if (testMigrationMirrorStatsFetch(vm, test, jobInfo,
+                                      "{\"return\":["
+                                      TEST_BLOCK_JOB("virtio-disk0", "1000", "600") ","
+                                      TEST_BLOCK_JOB("virtio-disk1", "2000", "100")
+                                      "]}", 700, 3000, 3000) < 0)
+        goto cleanup;
+
+    if (diskPriv[1]->migrPending != 0) {
+        fprintf(stderr, "vdb is still accounted as pending\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    testMigrationFreeVM(vm, test);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    virEventRegisterDefaultImpl();
+
+    if (virCondInit(&testPrecreateCond) < 0 ||
+        !(driver.domainEventState = virObjectEventStateNew())) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("precreate", testMigrationPrecreate, NULL) < 0)
+        ret = -1;
+    if (virTestRun("precreate failure", testMigrationPrecreate,
+                   "<name>vdb.qcow2</name>") < 0)
+        ret = -1;
+    if (virTestRun("storage copy", testMigrationStorageCopy, NULL) < 0)
+        ret = -1;
+    if (virTestRun("mirror stats", testMigrationMirrorStats, NULL) < 0)
+        ret = -1;
+
+ cleanup:
+    virCondDestroy(&testPrecreateCond);
+    virObjectUnref(driver.domainEventState);
+    qemuTestDriverFree(&driver);
+
+    return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -1526,9 +1526,110 @@ testQemuMonitorJSONqemuMonitorJSONQueryCPUsFast(const void *opaque)
                                                           true, 2))
         return -1;
 
+    /* a member the streaming decoder doesn't know makes it give up after
+     * decoding the whole "return" array; the reply must then be processed
+     * by the tree based code with the same result */
+    if (qemuMonitorTestAddItem(test, "query-cpus-fast",
+                               "{"
+                               "    \"return\": ["
+                               "        {"
+                               "            \"cpu-index\": 0,"
+                               "            \"qom-path\": \"/machine/unattached/device[0]\","
+                               "            \"thread-id\": 17629"
+                               "        },"
+                               "        {"
+                               "            \"cpu-index\": 1,"
+                               "            \"qom-path\": \"/machine/unattached/device[1]\","
+                               "            \"thread-id\": 17630"
+                               "        }"
+                               "    ],"
+                               "    \"id\": \"libvirt-9\","
+                               "    \"unexpected\": true"
+                               "}") < 0)
+        return -1;
+
+    if (testQEMUMonitorJSONqemuMonitorJSONQueryCPUsHelper(test, expect_fast,
+                                                          true, 2))
+        return -1;
+
     return 0;
 }
 
+
+static int
+testQemuMonitorJSONqemuMonitorJSONQueryCPUsFastS390(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    virDomainXMLOptionPtr xmlopt = data->xmlopt;
+    struct qemuMonitorQueryCpusEntry *cpudata = NULL;
+    size_t ncpudata = 0;
+    int ret = -1;
+    g_autoptr(qemuMonitorTest) test = NULL;
+
+    if (!(test = qemuMonitorTestNewSchema(xmlopt, data->schema)))
+        return -1;
+
+    if (qemuMonitorTestAddItem(test, "query-cpus-fast",
+                               "{"
+                               "    \"return\": ["
+                               "        {"
+                               "            \"cpu-index\": 0,"
+                               "            \"qom-path\": \"/machine/unattached/device[0]\","
+                               "            \"thread-id\": 17629,"
+                               "            \"target\": \"s390x\","
+                               "            \"cpu-state\": \"operating\""
+                               "        },"
+                               "        {"
+                               "            \"cpu-index\": 1,"
+                               "            \"qom-path\": \"/machine/unattached/device[1]\","
+                               "            \"thread-id\": 17630,"
+                               "            \"target\": \"s390x\","
+                               "            \"cpu-state\": \"stopped\""
+                               "        }"
+                               "    ],"
+                               "    \"id\": \"libvirt-8\""
+                               "}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-cpus-fast",
+                               "{"
+                               "    \"error\": {"
+                               "        \"class\": \"GenericError\","
+                               "        \"desc\": \"failed\""
+                               "    },"
+                               "    \"id\": \"libvirt-9\""
+                               "}") < 0)
+        return -1;
+
+    if (qemuMonitorJSONQueryCPUs(qemuMonitorTestGetMonitor(test),
+                                 &cpudata, &ncpudata, true, true) < 0)
+        goto cleanup;
+
+    if (ncpudata != 2 ||
+        cpudata[0].qemu_id != 0 || cpudata[0].halted ||
+        cpudata[1].qemu_id != 1 || !cpudata[1].halted) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "s390 vcpu data was not decoded correctly");
+        goto cleanup;
+    }
+
+    qemuMonitorQueryCpusFree(cpudata, ncpudata);
+    cpudata = NULL;
+    ncpudata = 0;
+
+    /* errors are left to the tree based code */
+    if (qemuMonitorJSONQueryCPUs(qemuMonitorTestGetMonitor(test),
+                                 &cpudata, &ncpudata, true, true) == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "error reply to query-cpus-fast was not reported");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    qemuMonitorQueryCpusFree(cpudata, ncpudata);
+    return ret;
+}
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetBalloonInfo(const void *opaque)
 {
@@ -1811,6 +1912,20 @@ testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsInfo(const void *opaque)
         "    ],"
         "    \"id\": \"libvirt-11\""
         "}";
+    const char *nodesreply =
+        "{"
+        "    \"return\": ["
+        "        {"
+        "            \"node-name\": \"ide0-1-0\","
+        "            \"image\": {"
+        "                \"virtual-size\": 1024"
+        "            }"
+        "        }"
+        "    ]"
+        "}";
+    g_autofree char *fallbackreply = NULL;
+    g_autoptr(virJSONValue) nodedata = NULL;
+    bool capacityErr = true;
 
     if (!(test = qemuMonitorTestNewSchema(xmlopt, data->schema)))
         return -1;
@@ -1865,6 +1980,64 @@ testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsInfo(const void *opaque)
     CHECK("virtio-disk1", 85, 348160, 8232156, 0, 0, 0, 0, 0, 0ULL, true)
     CHECK("ide0-1-0", 16, 49250, 1004952, 0, 0, 0, 0, 0, 0ULL, false)
 
+    /* a trailing member unknown to the streaming decoder makes it discard
+     * the already decoded stats; the tree based code must produce the
+     * same result */
+    virHashRemoveAll(blockstats);
+    fallbackreply = g_strdup_printf("%.*s, \"unexpected\": true }",
+                                    (int) strlen(reply) - 1, reply);
+
+    if (qemuMonitorTestAddItem(test, "query-blockstats", fallbackreply) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorTestGetMonitor(test),
+                                            blockstats, false) < 0)
+        goto cleanup;
+
+    CHECK("virtio-disk0", 1279, 28505088, 640616474, 174, 2845696, 530699221, 0, 0, 5256018944ULL, true)
+    CHECK("virtio-disk1", 85, 348160, 8232156, 0, 0, 0, 0, 0, 0ULL, true)
+    CHECK("ide0-1-0", 16, 49250, 1004952, 0, 0, 0, 0, 0, 0ULL, false)
+
+    if (virHashSize(blockstats) != 3) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "unexpected number of block stats entries: %zd",
+                       virHashSize(blockstats));
+        goto cleanup;
+    }
+
+    /* the same data fetched along with the capacity in one batch */
+    virHashFree(blockstats);
+    blockstats = NULL;
+
+    if (qemuMonitorTestAddItem(test, "query-blockstats", reply) < 0 ||
+        qemuMonitorTestAddItem(test, "query-named-block-nodes",
+                               nodesreply) < 0 ||
+        qemuMonitorTestAddItem(test, "query-named-block-nodes",
+                               nodesreply) < 0)
+        goto cleanup;
+
+    if (qemuMonitorGetAllBlockStatsCapacity(qemuMonitorTestGetMonitor(test),
+                                            &blockstats, false, true,
+                                            &capacityErr, &nodedata) < 0)
+        goto cleanup;
+
+    if (capacityErr) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "failed to fetch capacity data");
+        goto cleanup;
+    }
+
+    if (!nodedata || virJSONValueArraySize(nodedata) != 1) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "failed to fetch node data in the same batch");
+        goto cleanup;
+    }
+
+    CHECK("virtio-disk0", 1279, 28505088, 640616474, 174, 2845696, 530699221, 0, 0, 5256018944ULL, true)
+    CHECK("ide0-1-0", 16, 49250, 1004952, 0, 0, 0, 0, 0, 0ULL, false)
+    CHECK0FULL(capacity, 1024ULL, "%llu", "%llu")
+    CHECK0FULL(physical, 1024ULL, "%llu", "%llu")
+
     ret = 0;
 
 #undef CHECK
@@ -1877,6 +2050,135 @@ testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsInfo(const void *opaque)
 }
 
 
+static int
+testQemuMonitorJSONBlockStatsUpdateCapacityBlockdevCheck(virHashTablePtr stats,
+                                                         const char *name,
+                                                         unsigned long long capacity,
+                                                         unsigned long long physical,
+                                                         unsigned long long write_threshold)
+{
+    qemuBlockStatsPtr entry;
+
+    if (!(entry = virHashLookup(stats, name))) {
+        fprintf(stderr, "missing capacity data for node '%s'\n", name);
+        return -1;
+    }
+
+    if (entry->capacity != capacity ||
+        entry->physical != physical ||
+        entry->write_threshold != write_threshold) {
+        fprintf(stderr,
+                "node '%s': expected capacity=%llu physical=%llu "
+                "write_threshold=%llu, got capacity=%llu physical=%llu "
+                "write_threshold=%llu\n", name,
+                capacity, physical, write_threshold,
+                entry->capacity, entry->physical, entry->write_threshold);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testQemuMonitorJSONqemuMonitorJSONBlockStatsUpdateCapacityBlockdev(const void *opaque)
+{
+    const testGenericData *data = opaque;
+    virDomainXMLOptionPtr xmlopt = data->xmlopt;
+    g_autoptr(qemuMonitorTest) test = NULL;
+    g_autoptr(virHashTable) broken = NULL;
+    g_autofree char *fallbackreply = NULL;
+    size_t i;
+
+    const char *reply =
+        "{"
+        "    \"return\": ["
+        "        {"
+        "            \"node-name\": \"libvirt-1-format\","
+        "            \"write_threshold\": 4096,"
+        "            \"image\": {"
+        "                \"virtual-size\": 10737418240,"
+        "                \"actual-size\": 200704,"
+        "                \"format\": \"qcow2\","
+        "                \"backing-image\": {"
+        "                    \"virtual-size\": 1,"
+        "                    \"actual-size\": 2"
+        "                }"
+        "            },"
+        "            \"dirty-bitmaps\": ["
+        "                { \"name\": \"b0\", \"count\": 0 }"
+        "            ]"
+        "        },"
+        "        {"
+        "            \"node-name\": \"libvirt-1-storage\","
+        "            \"image\": {"
+        "                \"virtual-size\": 204800"
+        "            }"
+        "        }"
+        "    ],"
+        "    \"id\": \"libvirt-1\""
+        "}";
+
+    /* an unknown member makes the streaming decoder give up, the tree
+     * based code must produce the same results */
+    fallbackreply = g_strdup_printf("%.*s, \"unexpected\": true }",
+                                    (int) strlen(reply) - 1, reply);
+
+    if (!(test = qemuMonitorTestNewSchema(xmlopt, data->schema)))
+        return -1;
+
+    for (i = 0; i < 2; i++) {
+        g_autoptr(virHashTable) stats = NULL;
+
+        if (!(stats = virHashCreate(10, virHashValueFree)))
+            return -1;
+
+        if (qemuMonitorTestAddItem(test, "query-named-block-nodes",
+                                   i == 0 ? reply : fallbackreply) < 0)
+            return -1;
+
+        if (qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorTestGetMonitor(test),
+                                                            stats) < 0)
+            return -1;
+
+        if (virHashSize(stats) != 2) {
+            fprintf(stderr, "expected 2 entries, got %zd\n", virHashSize(stats));
+            return -1;
+        }
+
+        if (testQemuMonitorJSONBlockStatsUpdateCapacityBlockdevCheck(stats,
+                                                                     "libvirt-1-format",
+                                                                     10737418240ULL,
+                                                                     200704, 4096) < 0 ||
+            testQemuMonitorJSONBlockStatsUpdateCapacityBlockdevCheck(stats,
+                                                                     "libvirt-1-storage",
+                                                                     204800, 204800, 0) < 0)
+            return -1;
+    }
+
+    /* entries which are not in the expected format are still reported */
+    if (qemuMonitorTestAddItem(test, "query-named-block-nodes",
+                               "{"
+                               "    \"return\": ["
+                               "        { \"node-name\": \"libvirt-1-format\" }"
+                               "    ],"
+                               "    \"id\": \"libvirt-1\""
+                               "}") < 0)
+        return -1;
+
+    if (!(broken = virHashCreate(10, virHashValueFree)))
+        return -1;
+
+    if (qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorTestGetMonitor(test),
+                                                        broken) == 0) {
+        fprintf(stderr, "broken query-named-block-nodes entry was accepted\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetMigrationCacheSize(const void *opaque)
 {
@@ -3246,6 +3548,7 @@ mymain(void)
     DO_TEST(qemuMonitorJSONGetBalloonInfo);
     DO_TEST(qemuMonitorJSONGetBlockInfo);
     DO_TEST(qemuMonitorJSONGetAllBlockStatsInfo);
+    DO_TEST(qemuMonitorJSONBlockStatsUpdateCapacityBlockdev);
     DO_TEST(qemuMonitorJSONGetMigrationCacheSize);
     DO_TEST(qemuMonitorJSONGetMigrationStats);
     DO_TEST(qemuMonitorJSONGetChardevInfo);
@@ -3254,6 +3557,7 @@ mymain(void)
     DO_TEST(qemuMonitorJSONGetMigrationCapabilities);
     DO_TEST(qemuMonitorJSONQueryCPUs);
     DO_TEST(qemuMonitorJSONQueryCPUsFast);
+    DO_TEST(qemuMonitorJSONQueryCPUsFastS390);
     DO_TEST(qemuMonitorJSONGetVirtType);
     DO_TEST(qemuMonitorJSONSendKey);
     DO_TEST(qemuMonitorJSONGetDumpGuestMemoryCapability);
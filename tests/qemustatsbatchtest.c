@@ -0,0 +1,207 @@
+/*
+ * qemustatsbatchtest.c: test the parallel collection of domain statistics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#ifdef WITH_QEMU
+
+# include "testutilsqemu.h"
+# include "qemu/qemu_domain.h"
+# include "qemu/qemu_statsbatch.h"
+# include "virthread.h"
+
+# define VIR_FROM_THIS VIR_FROM_NONE
+
+static virQEMUDriver driver;
+
+# define TEST_NVMS 3
+# define TEST_HUNG 0
+
+static virMutex testLock = VIR_MUTEX_INITIALIZER;
+static virCond testCond;
+static bool testReleased;
+static int testCollected[TEST_NVMS];
+static virDomainObjPtr testVMs[TEST_NVMS];
+static virThreadPoolPtr testPool;
+
+
+static int
+testStatsCollect(virDomainObjPtr vm,
+                 void *opaque G_GNUC_UNUSED,
+                 virDomainStatsRecordPtr *record)
+{
+    size_t i;
+
+    for (i = 0; i < TEST_NVMS; i++) {
+        if (testVMs[i] != vm)
+            continue;
+
+        virMutexLock(&testLock);
+        testCollected[i]++;
+        /* pretend the domain is stuck in a monitor call */
+        while (i == TEST_HUNG && !testReleased)
+            ignore_value(virCondWait(&testCond, &testLock));
+        virMutexUnlock(&testLock);
+    }
+
+    *record = g_new0(virDomainStatsRecord, 1);
+    return 0;
+}
+
+
+static int
+testStatsRun(bool enforce,
+             int expectRet,
+             int expectRecords)
+{
+    virDomainStatsRecordPtr records[TEST_NVMS] = { 0 };
+    int nrecords = 0;
+    int rc;
+    size_t i;
+
+    rc = qemuStatsBatchRun(testPool, testVMs, TEST_NVMS, 100, enforce,
+                           testStatsCollect, NULL, NULL, records, &nrecords);
+
+    for (i = 0; i < nrecords; i++)
+        g_free(records[i]);
+
+    if (rc != expectRet) {
+        fprintf(stderr, "expected return value %d, got %d\n", expectRet, rc);
+        return -1;
+    }
+
+    if (nrecords != expectRecords) {
+        fprintf(stderr, "expected %d records, got %d\n", expectRecords, nrecords);
+        return -1;
+    }
+
+    virResetLastError();
+    return 0;
+}
+
+
+static int
+testStatsCollected(size_t idx,
+                   int expect)
+{
+    int collected;
+
+    virMutexLock(&testLock);
+    collected = testCollected[idx];
+    virMutexUnlock(&testLock);
+
+    if (collected != expect) {
+        fprintf(stderr, "domain %zu collected %d times, expected %d\n",
+                idx, collected, expect);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testStatsBatchHung(const void *opaque G_GNUC_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = testVMs[TEST_HUNG]->privateData;
+    size_t i;
+
+    /* the hung domain times out, the others are collected */
+    if (testStatsRun(false, 0, TEST_NVMS - 1) < 0)
+        return -1;
+
+    /* the hung domain is skipped rather than occupying another worker */
+    if (testStatsRun(false, 0, TEST_NVMS - 1) < 0 ||
+        testStatsCollected(TEST_HUNG, 1) < 0)
+        return -1;
+
+    /* enforcing stats reports the skipped domain */
+    if (testStatsRun(true, -1, 0) < 0)
+        return -1;
+
+    virMutexLock(&testLock);
+    testReleased = true;
+    virCondBroadcast(&testCond);
+    virMutexUnlock(&testLock);
+
+    for (i = 0; i < 1000 && g_atomic_int_get(&priv->statsCollecting); i++)
+        g_usleep(1000);
+
+    if (g_atomic_int_get(&priv->statsCollecting)) {
+        fprintf(stderr, "hung domain is still marked as being collected\n");
+        return -1;
+    }
+
+    /* once the monitor call returned the domain is collected again */
+    if (testStatsRun(true, 0, TEST_NVMS) < 0 ||
+        testStatsCollected(TEST_HUNG, 2) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    size_t i;
+
+    if (qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    if (virCondInit(&testCond) < 0)
+        return EXIT_FAILURE;
+
+    if (!(testPool = virThreadPoolNewFull(0, 2, 0, qemuStatsBatchJobRun,
+                                          "test-stats", NULL)))
+        return EXIT_FAILURE;
+
+    for (i = 0; i < TEST_NVMS; i++) {
+        if (!(testVMs[i] = virDomainObjNew(driver.xmlopt)) ||
+            !(testVMs[i]->def = virDomainDefNew()))
+            return EXIT_FAILURE;
+        testVMs[i]->def->name = g_strdup_printf("test%zu", i);
+        virObjectUnlock(testVMs[i]);
+    }
+
+    if (virTestRun("hung domain", testStatsBatchHung, NULL) < 0)
+        ret = -1;
+
+    virThreadPoolFree(testPool);
+    for (i = 0; i < TEST_NVMS; i++)
+        virObjectUnref(testVMs[i]);
+    virCondDestroy(&testCond);
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
+
+#else
+
+int
+main(void)
+{
+    return EXIT_AM_SKIP;
+}
+
+#endif /* WITH_QEMU */
@@ -855,6 +855,57 @@ testCgroupGetMemoryStat(const void *args G_GNUC_UNUSED)
 }
 
 
+static int
+testCgroupGetStatsSnapshot(const void *args G_GNUC_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    virCgroupStats stats;
+    unsigned long long cpuTime;
+    unsigned long long userTime;
+    unsigned long long sysTime;
+    size_t i;
+    int rv;
+    int ret = -1;
+
+    if ((rv = virCgroupNewPartition("/virtualmachines", true,
+                                    (1 << VIR_CGROUP_CONTROLLER_CPU) |
+                                    (1 << VIR_CGROUP_CONTROLLER_CPUACCT),
+                                    &cgroup)) < 0) {
+        fprintf(stderr, "Could not create /virtualmachines cgroup: %d\n", -rv);
+        goto cleanup;
+    }
+
+    if (virCgroupGetCpuacctUsage(cgroup, &cpuTime) < 0 ||
+        virCgroupGetCpuacctStat(cgroup, &userTime, &sysTime) < 0) {
+        fprintf(stderr, "Could not retrieve stats for /virtualmachines cgroup\n");
+        goto cleanup;
+    }
+
+    /* the second round reuses the directories opened by the first one */
+    for (i = 0; i < 2; i++) {
+        if (virCgroupGetStatsSnapshot(cgroup, VIR_CGROUP_STATS_CPU,
+                                      &stats) < 0) {
+            fprintf(stderr, "Could not get stats snapshot of /virtualmachines cgroup\n");
+            goto cleanup;
+        }
+
+        if (stats.flags != VIR_CGROUP_STATS_CPU ||
+            stats.cpuTime != cpuTime ||
+            stats.userTime != userTime ||
+            stats.sysTime != sysTime) {
+            fprintf(stderr, "Stats snapshot does not match the stats\n");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 static int testCgroupGetBlkioIoServiced(const void *args G_GNUC_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -1088,6 +1139,9 @@ mymain(void)
     if (virTestRun("virCgroupGetMemoryStat works", testCgroupGetMemoryStat, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("virCgroupGetStatsSnapshot works", testCgroupGetStatsSnapshot, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("virCgroupGetPercpuStats works", testCgroupGetPercpuStats, NULL) < 0)
         ret = -1;
     cleanupFakeFS(fakerootdir);
@@ -0,0 +1,337 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "virdomainobjlist.h"
+#include "virfile.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+static virDomainXMLOptionPtr xmlopt;
+static char *testDir;
+static int testPostParseCount;
+
+
+static int
+testDomainDefPostParse(virDomainDefPtr def G_GNUC_UNUSED,
+                       unsigned int parseFlags G_GNUC_UNUSED,
+                       void *opaque G_GNUC_UNUSED,
+                       void *parseOpaque G_GNUC_UNUSED)
+{
+    testPostParseCount++;
+    return 0;
+}
+
+
+static virDomainDefParserConfig testDomainDefParserConfig = {
+    .domainPostParseCallback = testDomainDefPostParse,
+};
+
+
+/* Mimics a driver whose post parse callbacks depend on data probed
+ * from the emulator binary. */
+static char *
+testParseCacheKey(virDomainDefPtr def,
+                  void *opaque G_GNUC_UNUSED)
+{
+    char *content = NULL;
+
+    if (virFileReadAll(def->emulator, 1024, &content) < 0)
+        return NULL;
+
+    return content;
+}
+
+
+static int
+testWriteFile(const char *name,
+              const char *content)
+{
+    g_autofree char *path = g_strdup_printf("%s/%s", testDir, name);
+
+    return virFileWriteStr(path, content, 0600);
+}
+
+
+/* Loads the configs in testDir using the parse cache and checks whether
+ * the post parse callbacks ran. */
+static int
+testLoadConfigs(bool expectPostParse)
+{
+    virDomainObjListPtr doms = NULL;
+    g_autofree char *configDir = g_strdup_printf("%s/config", testDir);
+    g_autofree char *autostartDir = g_strdup_printf("%s/autostart", testDir);
+    g_autofree char *cacheDir = g_strdup_printf("%s/cache", testDir);
+    virDomainObjPtr vm;
+    int ret = -1;
+
+    if (!(doms = virDomainObjListNew()))
+        return -1;
+
+    testPostParseCount = 0;
+
+    if (virDomainObjListLoadAllConfigsParallel(doms, configDir, autostartDir,
+                                               cacheDir, testParseCacheKey,
+                                               NULL, false, xmlopt, 0,
+                                               NULL, NULL) < 0)
+        goto cleanup;
+
+    if (!(vm = virDomainObjListFindByName(doms, "test"))) {
+        fprintf(stderr, "domain 'test' was not loaded\n");
+        goto cleanup;
+    }
+    virDomainObjEndAPI(&vm);
+
+    if (expectPostParse != (testPostParseCount > 0)) {
+        fprintf(stderr, "post parse callbacks %s, expected them %s\n",
+                testPostParseCount > 0 ? "ran" : "were skipped",
+                expectPostParse ? "to run" : "to be skipped");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+static int
+testParseCache(const void *opaque G_GNUC_UNUSED)
+{
+    g_autofree char *domxml = NULL;
+
+    domxml = g_strdup_printf("<domain type='qemu'>\n"
+                             "  <name>test</name>\n"
+                             "  <uuid>c7a5fdbd-edaf-9455-926a-d65c16db1809</uuid>\n"
+                             "  <memory>219136</memory>\n"
+                             "  <os>\n"
+                             "    <type>hvm</type>\n"
+                             "  </os>\n"
+                             "  <devices>\n"
+                             "    <emulator>%s/emulator</emulator>\n"
+                             "  </devices>\n"
+                             "</domain>\n", testDir);
+
+    if (testWriteFile("emulator", "version 1") < 0 ||
+        testWriteFile("config/test.xml", domxml) < 0)
+        return -1;
+
+    /* the first load fills the cache */
+    if (testLoadConfigs(true) < 0)
+        return -1;
+
+    /* nothing changed, the cached definition is used */
+    if (testLoadConfigs(false) < 0)
+        return -1;
+
+    /* a different emulator binary invalidates the cache even if its
+     * timestamps didn't change */
+    if (testWriteFile("emulator", "version 2") < 0 ||
+        testLoadConfigs(true) < 0)
+        return -1;
+
+    /* the cache was refreshed for the new binary */
+    if (testLoadConfigs(false) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/* Checks the state published for the domain with @uuid as seen by the
+ * lockless query APIs. */
+static int
+testPublishedCheck(virDomainObjListPtr doms,
+                   const unsigned char *uuid,
+                   int state,
+                   int reason,
+                   unsigned long long curBalloon,
+                   unsigned int vcpus)
+{
+    g_autoptr(virDomainObj) vm = NULL;
+    g_auto(virDomainObjPublished) pub = { 0 };
+
+    if (!(vm = virDomainObjListFindByUUIDRef(doms, uuid))) {
+        fprintf(stderr, "domain 'test' was not found\n");
+        return -1;
+    }
+
+    if (virDomainObjGetPublished(vm, &pub) < 0)
+        return -1;
+
+    if (STRNEQ_NULLABLE(pub.name, "test") ||
+        pub.state.state != state ||
+        pub.state.reason != reason ||
+        pub.curBalloon != curBalloon ||
+        pub.vcpus != vcpus) {
+        fprintf(stderr, "expected name=test state=%d reason=%d "
+                "balloon=%llu vcpus=%u, got name=%s state=%d reason=%d "
+                "balloon=%llu vcpus=%u\n",
+                state, reason, curBalloon, vcpus,
+                NULLSTR(pub.name), pub.state.state, pub.state.reason,
+                pub.curBalloon, pub.vcpus);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testPublish(const void *opaque G_GNUC_UNUSED)
+{
+    const char *domxml =
+        "<domain type='qemu'>\n"
+        "  <name>test</name>\n"
+        "  <uuid>a3d46c19-0d8c-4ab2-a6c8-2b7ef8d5c8e0</uuid>\n"
+        "  <memory>1048576</memory>\n"
+        "  <currentMemory>524288</currentMemory>\n"
+        "  <vcpu current='1'>4</vcpu>\n"
+        "  <os>\n"
+        "    <type>hvm</type>\n"
+        "  </os>\n"
+        "  <devices>\n"
+        "    <memballoon model='virtio'/>\n"
+        "  </devices>\n"
+        "</domain>\n";
+    virDomainObjListPtr doms = NULL;
+    virDomainDefPtr def = NULL;
+    virDomainObjPtr vm = NULL;
+    g_autoptr(virDomainObj) found = NULL;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int ret = -1;
+
+    if (!(doms = virDomainObjListNew()))
+        return -1;
+
+    if (!(def = virDomainDefParseString(domxml, xmlopt, NULL,
+                                        VIR_DOMAIN_DEF_PARSE_INACTIVE)))
+        goto cleanup;
+
+    if (!(vm = virDomainObjListAdd(doms, def, xmlopt, 0, NULL)))
+        goto cleanup;
+    def = NULL;
+    memcpy(uuid, vm->def->uuid, VIR_UUID_BUFLEN);
+
+    /* the domain stays locked below, as if a job was running */
+    if (testPublishedCheck(doms, uuid, VIR_DOMAIN_SHUTOFF,
+                           VIR_DOMAIN_SHUTOFF_UNKNOWN, 524288, 1) < 0)
+        goto cleanup;
+
+    /* state changes are published right away */
+    vm->def->id = 1;
+    virDomainObjSetState(vm, VIR_DOMAIN_RUNNING, VIR_DOMAIN_RUNNING_BOOTED);
+
+    if (testPublishedCheck(doms, uuid, VIR_DOMAIN_RUNNING,
+                           VIR_DOMAIN_RUNNING_BOOTED, 524288, 1) < 0)
+        goto cleanup;
+
+    /* other changes of the definition once they are published */
+    vm->def->mem.cur_balloon = 262144;
+    if (virDomainDefSetVcpus(vm->def, 3) < 0)
+        goto cleanup;
+
+    if (testPublishedCheck(doms, uuid, VIR_DOMAIN_RUNNING,
+                           VIR_DOMAIN_RUNNING_BOOTED, 524288, 1) < 0)
+        goto cleanup;
+
+    virDomainObjPublish(vm);
+
+    if (testPublishedCheck(doms, uuid, VIR_DOMAIN_RUNNING,
+                           VIR_DOMAIN_RUNNING_BOOTED, 262144, 3) < 0)
+        goto cleanup;
+
+    /* a running domain without a balloon has all of its memory */
+    vm->def->memballoon->model = VIR_DOMAIN_MEMBALLOON_MODEL_NONE;
+    virDomainObjPublish(vm);
+
+    if (testPublishedCheck(doms, uuid, VIR_DOMAIN_RUNNING,
+                           VIR_DOMAIN_RUNNING_BOOTED, 1048576, 3) < 0)
+        goto cleanup;
+
+    /* a domain being removed can't be looked up anymore, even while
+     * virDomainObjListRemove waits for the list lock */
+    vm->removing = true;
+    virDomainObjPublish(vm);
+
+    if ((found = virDomainObjListFindByUUIDRef(doms, uuid))) {
+        fprintf(stderr, "domain being removed was found\n");
+        goto cleanup;
+    }
+
+    virDomainObjListRemove(doms, vm);
+
+    if ((found = virDomainObjListFindByUUIDRef(doms, uuid))) {
+        fprintf(stderr, "removed domain was found\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virDomainDefFree(def);
+    virDomainObjEndAPI(&vm);
+    virObjectUnref(doms);
+    return ret;
+}
+
+
+#define TESTDIRTEMPLATE abs_builddir "/virdomainobjlistdata-XXXXXX"
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    g_autofree char *configDir = NULL;
+    g_autofree char *cacheDir = NULL;
+
+    testDir = g_strdup(TESTDIRTEMPLATE);
+    if (!g_mkdtemp(testDir)) {
+        fprintf(stderr, "Cannot create test directory\n");
+        return EXIT_FAILURE;
+    }
+
+    configDir = g_strdup_printf("%s/config", testDir);
+    cacheDir = g_strdup_printf("%s/cache", testDir);
+
+    if (virFileMakePath(configDir) < 0 ||
+        virFileMakePath(cacheDir) < 0 ||
+        !(xmlopt = virDomainXMLOptionNew(&testDomainDefParserConfig,
+                                         NULL, NULL, NULL, NULL))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("parse cache", testParseCache, NULL) < 0)
+        ret = -1;
+    if (virTestRun("publish", testPublish, NULL) < 0)
+        ret = -1;
+
+ cleanup:
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(testDir);
+    virObjectUnref(xmlopt);
+    VIR_FREE(testDir);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
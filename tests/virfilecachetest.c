@@ -23,6 +23,7 @@
 
 #include "virfile.h"
 #include "virfilecache.h"
+#include "virthread.h"
 
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -81,6 +82,13 @@ struct _testFileCachePriv {
     bool dataSaved;
     const char *newData;
     const char *expectData;
+
+    /* data of @blockName is created only once @blocked is cleared */
+    virMutex lock;
+    virCond cond;
+    const char *blockName;
+    bool blocked;
+    size_t nblockNewData;
 };
 typedef struct _testFileCachePriv testFileCachePriv;
 typedef testFileCachePriv *testFileCachePrivPtr;
@@ -98,11 +106,20 @@ testFileCacheIsValid(void *data,
 
 
 static void *
-testFileCacheNewData(const char *name G_GNUC_UNUSED,
+testFileCacheNewData(const char *name,
                      void *priv)
 {
     testFileCachePrivPtr testPriv = priv;
 
+    if (STREQ_NULLABLE(name, testPriv->blockName)) {
+        virMutexLock(&testPriv->lock);
+        testPriv->nblockNewData++;
+        virCondBroadcast(&testPriv->cond);
+        while (testPriv->blocked)
+            ignore_value(virCondWait(&testPriv->cond, &testPriv->lock));
+        virMutexUnlock(&testPriv->lock);
+    }
+
     return testFileCacheObjNew(testPriv->newData);
 }
 
@@ -196,6 +213,100 @@ testFileCache(const void *opaque)
 }
 
 
+#define TEST_CONCURRENT_LOOKUPS 4
+
+struct _testFileCacheThread {
+    virFileCachePtr cache;
+    const char *name;
+    testFileCacheObjPtr obj;
+};
+typedef struct _testFileCacheThread testFileCacheThread;
+
+
+static void
+testFileCacheLookupThread(void *opaque)
+{
+    testFileCacheThread *thread = opaque;
+
+    thread->obj = virFileCacheLookup(thread->cache, thread->name);
+}
+
+
+static int
+testFileCacheConcurrent(const void *opaque)
+{
+    const testFileCacheData *data = opaque;
+    testFileCachePrivPtr testPriv = virFileCacheGetPriv(data->cache);
+    testFileCacheThread threads[TEST_CONCURRENT_LOOKUPS] = { 0 };
+    virThread ids[TEST_CONCURRENT_LOOKUPS];
+    testFileCacheObjPtr other = NULL;
+    size_t nthreads = 0;
+    size_t ncreated;
+    int ret = -1;
+    size_t i;
+
+    testPriv->newData = data->newData;
+    testPriv->expectData = data->expectData;
+    testPriv->blockName = data->name;
+    testPriv->blocked = true;
+    testPriv->nblockNewData = 0;
+
+    for (; nthreads < TEST_CONCURRENT_LOOKUPS; nthreads++) {
+        threads[nthreads].cache = data->cache;
+        threads[nthreads].name = data->name;
+
+        if (virThreadCreate(&ids[nthreads], true,
+                            testFileCacheLookupThread, &threads[nthreads]) < 0)
+            goto cleanup;
+
+        /* make sure the first lookup is the one creating the data */
+        if (nthreads == 0) {
+            virMutexLock(&testPriv->lock);
+            while (testPriv->nblockNewData == 0)
+                ignore_value(virCondWait(&testPriv->cond, &testPriv->lock));
+            virMutexUnlock(&testPriv->lock);
+        }
+    }
+
+    /* data of other names can be created meanwhile */
+    if (!(other = virFileCacheLookup(data->cache, "cacheConcurrentOther"))) {
+        fprintf(stderr, "Lookup blocked by data being created failed.\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexLock(&testPriv->lock);
+    testPriv->blocked = false;
+    virCondBroadcast(&testPriv->cond);
+    virMutexUnlock(&testPriv->lock);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&ids[i]);
+
+    ncreated = testPriv->nblockNewData;
+    testPriv->blockName = NULL;
+
+    if (ret == 0 && ncreated != 1) {
+        fprintf(stderr, "Expect data to be created once, created %zu times.\n",
+                ncreated);
+        ret = -1;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        if (ret == 0 && (!threads[i].obj || threads[i].obj != threads[0].obj)) {
+            fprintf(stderr, "Lookup %zu returned different data.\n", i);
+            ret = -1;
+        }
+        virObjectUnref(threads[i].obj);
+    }
+
+    virObjectUnref(other);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -207,6 +318,10 @@ mymain(void)
                                   "cache", &testFileCacheHandlers)))
         return EXIT_FAILURE;
 
+    if (virMutexInit(&testPriv.lock) < 0 ||
+        virCondInit(&testPriv.cond) < 0)
+        return EXIT_FAILURE;
+
     virFileCacheSetPriv(cache, &testPriv);
 
 #define TEST_RUN(name, newData, expectData, expectSave) \
@@ -224,7 +339,17 @@ mymain(void)
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
 
+    do {
+        testFileCacheData data = {
+            cache, "cacheConcurrent", "ddd\n", "ddd\n", true
+        };
+        if (virTestRun("cacheConcurrent", testFileCacheConcurrent, &data) < 0)
+            ret = -1;
+    } while (0);
+
     virObjectUnref(cache);
+    virCondDestroy(&testPriv.cond);
+    virMutexDestroy(&testPriv.lock);
 
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
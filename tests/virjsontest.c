@@ -337,6 +337,106 @@ testJSONCopy(const void *data)
 }
 
 
+/* Records the tokens reported by virJSONParseStream as a string like
+ * "{a=1;b:[2;]}" and stops the parser on a string value "stop". */
+static int
+testJSONParseStreamValue(void *opaque,
+                         const char *key,
+                         virJSONType type,
+                         const char *val)
+{
+    virBufferPtr buf = opaque;
+
+    if (key)
+        virBufferAsprintf(buf, "%s=", key);
+
+    if (type == VIR_JSON_TYPE_STRING)
+        virBufferAsprintf(buf, "'%s';", val);
+    else
+        virBufferAsprintf(buf, "%s;", NULLSTR(val));
+
+    if (type == VIR_JSON_TYPE_STRING && STREQ(val, "stop"))
+        return 1;
+
+    return 0;
+}
+
+
+static int
+testJSONParseStreamStart(void *opaque,
+                         const char *key,
+                         virJSONType type)
+{
+    virBufferPtr buf = opaque;
+
+    if (key)
+        virBufferAsprintf(buf, "%s:", key);
+
+    virBufferAddChar(buf, type == VIR_JSON_TYPE_OBJECT ? '{' : '[');
+    return 0;
+}
+
+
+static int
+testJSONParseStreamEnd(void *opaque,
+                       virJSONType type)
+{
+    virBufferPtr buf = opaque;
+
+    virBufferAddChar(buf, type == VIR_JSON_TYPE_OBJECT ? '}' : ']');
+    return 0;
+}
+
+
+static const virJSONStreamCallbacks testJSONParseStreamCallbacks = {
+    .value = testJSONParseStreamValue,
+    .startContainer = testJSONParseStreamStart,
+    .endContainer = testJSONParseStreamEnd,
+};
+
+
+static int
+testJSONParseStream(const void *data)
+{
+    const struct testInfo *info = data;
+    g_auto(virBuffer) buf = VIR_BUFFER_INITIALIZER;
+    g_autofree char *actual = NULL;
+    int rc;
+
+    rc = virJSONParseStream(info->doc, &testJSONParseStreamCallbacks, &buf);
+
+    if (rc < 0) {
+        if (info->pass) {
+            VIR_TEST_VERBOSE("Failed to parse %s", info->doc);
+            return -1;
+        }
+
+        VIR_TEST_DEBUG("As expected, failed to parse %s", info->doc);
+        return 0;
+    }
+
+    if (!info->pass) {
+        VIR_TEST_VERBOSE("Unexpected success while parsing %s", info->doc);
+        return -1;
+    }
+
+    actual = virBufferContentAndReset(&buf);
+
+    /* the parser reports being stopped only if "stop" was seen */
+    if ((rc == 1) != (strstr(NULLSTR_EMPTY(actual), "'stop'") != NULL)) {
+        VIR_TEST_VERBOSE("unexpected return value %d for '%s'", rc, info->doc);
+        return -1;
+    }
+
+    if (STRNEQ_NULLABLE(info->expect, actual)) {
+        virTestDifference(stderr, info->expect, actual);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 testJSONDeflatten(const void *data)
 {
@@ -470,6 +570,68 @@ testJSONObjectFormatSteal(const void *opaque G_GNUC_UNUSED)
 }
 
 
+static int
+testJSONObjectIndex(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virJSONValue) json = virJSONValueNewObject();
+    g_autoptr(virJSONValue) stolen = NULL;
+    unsigned long long val;
+    size_t i;
+
+    /* enough keys so that lookups go through the hashed index */
+    for (i = 0; i < 64; i++) {
+        g_autofree char *key = g_strdup_printf("key%zu", i);
+
+        if (virJSONValueObjectAppendNumberUlong(json, key, i) < 0)
+            return -1;
+    }
+
+    if (virJSONValueObjectAppendNumberUlong(json, "key10", 10) == 0) {
+        VIR_TEST_VERBOSE("duplicate key was not rejected");
+        return -1;
+    }
+
+    if (virJSONValueObjectRemoveKey(json, "key5", NULL) != 1 ||
+        virJSONValueObjectRemoveKey(json, "key5", NULL) != 0) {
+        VIR_TEST_VERBOSE("failed to remove 'key5'");
+        return -1;
+    }
+
+    if (virJSONValueObjectRemoveKey(json, "key0", &stolen) != 1 ||
+        virJSONValueGetNumberUlong(stolen, &val) < 0 || val != 0) {
+        VIR_TEST_VERBOSE("failed to steal 'key0'");
+        return -1;
+    }
+
+    if (virJSONValueObjectPrependString(json, "first", "value") < 0 ||
+        virJSONValueObjectAppendString(json, "last", "value") < 0)
+        return -1;
+
+    for (i = 1; i < 64; i++) {
+        g_autofree char *key = g_strdup_printf("key%zu", i);
+
+        if (i == 5)
+            continue;
+
+        if (virJSONValueObjectGetNumberUlong(json, key, &val) < 0 || val != i) {
+            VIR_TEST_VERBOSE("lookup of '%s' failed", key);
+            return -1;
+        }
+    }
+
+    if (virJSONValueObjectHasKey(json, "key5") != 0 ||
+        virJSONValueObjectHasKey(json, "first") != 1 ||
+        virJSONValueObjectHasKey(json, "last") != 1 ||
+        STRNEQ_NULLABLE(virJSONValueObjectGetKey(json, 0), "first") ||
+        virJSONValueObjectKeysNumber(json) != 64) {
+        VIR_TEST_VERBOSE("object contents are inconsistent");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -595,6 +757,20 @@ mymain(void)
                  NULL, NULL, true);
     DO_TEST_FULL("stealing of attributes while creating objects",
                  ObjectFormatSteal, NULL, NULL, true);
+    DO_TEST_FULL("lookups in large objects", ObjectIndex, NULL, NULL, true);
+
+    DO_TEST_FULL("stream scalars", ParseStream,
+                 "[ 1, -2.5, \"str\", true, false, null ]",
+                 "[1;-2.5;'str';true;false;<null>;]", true);
+    DO_TEST_FULL("stream nested", ParseStream,
+                 "{ \"return\": [ { \"a\": 1, \"b\": { \"c\": [] } } ],"
+                 "  \"id\": \"libvirt-1\" }",
+                 "{return:[{a=1;b:{c:[]}}]id='libvirt-1';}", true);
+    DO_TEST_FULL("stream stopped", ParseStream,
+                 "{ \"a\": \"stop\", \"b\": 1 }",
+                 "{a='stop';", true);
+    DO_TEST_FULL("stream invalid", ParseStream,
+                 "{ \"a\": 1, ", NULL, false);
 
 #define DO_TEST_DEFLATTEN(name, pass) \
     DO_TEST_FULL(name, Deflatten, NULL, NULL, pass)
@@ -362,6 +362,204 @@ static int testExecRestart(const void *opaque)
 }
 
 
+# define TEST_REAP_NCLIENTS 3
+
+static virNetServerClientPtr
+testReapClientNew(virNetServerPtr srv,
+                  int *peer)
+{
+    virNetServerClientPtr client = NULL;
+    virNetSocketPtr sock = NULL;
+    int fds[2];
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        virReportSystemError(errno, "%s",
+                             "Cannot create socket pair");
+        return NULL;
+    }
+
+    if (virNetSocketNewConnectSockFD(fds[0], &sock) < 0) {
+        VIR_FORCE_CLOSE(fds[0]);
+        VIR_FORCE_CLOSE(fds[1]);
+        return NULL;
+    }
+    *peer = fds[1];
+
+    if (!(client = virNetServerClientNew(virNetServerNextClientID(srv),
+                                         sock,
+                                         VIR_NET_SERVER_SERVICE_AUTH_NONE,
+                                         true,
+                                         15,
+                                         NULL,
+                                         testClientNew,
+                                         testClientPreExec,
+                                         testClientFree,
+                                         NULL)))
+        goto cleanup;
+
+    if (virNetServerAddClient(srv, client) < 0) {
+        virObjectUnref(client);
+        client = NULL;
+    }
+
+ cleanup:
+    virObjectUnref(sock);
+    return client;
+}
+
+
+/* Checks which of @clients are known to @srv, by their ID and in the
+ * list of all clients */
+static int
+testReapCheckClients(virNetServerPtr srv,
+                     virNetServerClientPtr *clients,
+                     const bool *expect,
+                     size_t nclients)
+{
+    virNetServerClientPtr *list = NULL;
+    size_t nexpect = 0;
+    int nlist = 0;
+    size_t i;
+    int j = 0;
+    int ret = -1;
+
+    for (i = 0; i < nclients; i++) {
+        unsigned long long id = virNetServerClientGetID(clients[i]);
+        virNetServerClientPtr found = virNetServerGetClient(srv, id);
+
+        virResetLastError();
+
+        if (!!found != expect[i] || (found && found != clients[i])) {
+            fprintf(stderr, "client %llu %s, expected it %s\n",
+                    id, found ? "was found" : "was not found",
+                    expect[i] ? "to be found" : "to be reaped");
+            virObjectUnref(found);
+            goto cleanup;
+        }
+        virObjectUnref(found);
+
+        if (expect[i])
+            nexpect++;
+    }
+
+    if (virNetServerGetCurrentClients(srv) != nexpect) {
+        fprintf(stderr, "server has %zu clients, expected %zu\n",
+                virNetServerGetCurrentClients(srv), nexpect);
+        goto cleanup;
+    }
+
+    if ((nlist = virNetServerGetClients(srv, &list)) < 0)
+        goto cleanup;
+
+    /* the list is sorted by client ID */
+    for (i = 0; i < nclients; i++) {
+        if (!expect[i])
+            continue;
+
+        if (j >= nlist || list[j] != clients[i]) {
+            fprintf(stderr, "client %llu is missing in the client list\n",
+                    virNetServerClientGetID(clients[i]));
+            goto cleanup;
+        }
+        j++;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (list)
+        virObjectListFreeCount(list, nlist);
+    return ret;
+}
+
+
+static int
+testReapClients(const void *opaque G_GNUC_UNUSED)
+{
+    virNetServerPtr srv = NULL;
+    virNetServerClientPtr clients[TEST_REAP_NCLIENTS + 1] = { 0 };
+    int peers[TEST_REAP_NCLIENTS + 1] = { -1, -1, -1, -1 };
+    bool expect[TEST_REAP_NCLIENTS + 1] = { true, true, true, true };
+    size_t i;
+    int ret = -1;
+
+    if (!(srv = virNetServerNew("testReap", 1,
+                                1, 1, 0, 100, 10,
+                                120, 5,
+                                testClientNew,
+                                testClientPreExec,
+                                testClientFree,
+                                NULL)))
+        goto cleanup;
+
+    for (i = 0; i < TEST_REAP_NCLIENTS; i++) {
+        if (!(clients[i] = testReapClientNew(srv, &peers[i])))
+            goto cleanup;
+    }
+
+    if (testReapCheckClients(srv, clients, expect, TEST_REAP_NCLIENTS) < 0)
+        goto cleanup;
+
+    /* nothing was marked for closing, nothing is reaped */
+    virNetServerProcessClients(srv);
+    if (testReapCheckClients(srv, clients, expect, TEST_REAP_NCLIENTS) < 0)
+        goto cleanup;
+
+    /* only the client marked for closing is reaped */
+    virNetServerClientImmediateClose(clients[1]);
+    expect[1] = false;
+
+    virNetServerProcessClients(srv);
+    if (testReapCheckClients(srv, clients, expect, TEST_REAP_NCLIENTS) < 0)
+        goto cleanup;
+
+    for (i = 0; i < TEST_REAP_NCLIENTS; i++) {
+        bool closed;
+
+        virObjectLock(clients[i]);
+        closed = virNetServerClientIsClosedLocked(clients[i]);
+        virObjectUnlock(clients[i]);
+
+        if (closed == expect[i]) {
+            fprintf(stderr, "client %zu is %s\n",
+                    i, closed ? "closed" : "not closed");
+            goto cleanup;
+        }
+    }
+
+    /* clients added after the removal are found too */
+    if (!(clients[TEST_REAP_NCLIENTS] = testReapClientNew(srv,
+                                                          &peers[TEST_REAP_NCLIENTS])))
+        goto cleanup;
+
+    if (testReapCheckClients(srv, clients, expect, TEST_REAP_NCLIENTS + 1) < 0)
+        goto cleanup;
+
+    /* closing the server reaps all of them */
+    virNetServerClose(srv);
+    virNetServerProcessClients(srv);
+
+    if (virNetServerHasClients(srv)) {
+        fprintf(stderr, "server has clients after closing it\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0)
+        virDispatchError(NULL);
+    if (srv)
+        virNetServerClose(srv);
+    virObjectUnref(srv);
+    for (i = 0; i < TEST_REAP_NCLIENTS + 1; i++) {
+        virObjectUnref(clients[i]);
+        VIR_FORCE_CLOSE(peers[i]);
+    }
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -414,6 +612,9 @@ mymain(void)
     EXEC_RESTART_TEST("client-auth-pending", 1);
     EXEC_RESTART_TEST_FAIL("client-auth-pending-failure", 1);
 
+    if (virTestRun("Reap clients", testReapClients, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("virnetdaemon"))
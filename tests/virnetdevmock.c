@@ -22,6 +22,11 @@
 # include "internal.h"
 # include "virstring.h"
 # include "virnetdev.h"
+# include "virnetlink.h"
+
+# ifdef HAVE_LIBNL
+#  include <linux/rtnetlink.h>
+# endif
 
 # define NET_DEV_TEST_DATA_PREFIX abs_srcdir "/virnetdevtestdata/sys/class/net"
 
@@ -34,6 +39,50 @@ virNetDevSysfsFile(char **pf_sysfs_device_link,
                                             NET_DEV_TEST_DATA_PREFIX, ifname, file);
     return 0;
 }
+
+# ifdef HAVE_LIBNL
+static int dumpCount;
+
+/* Pretends the host has the vnet0 and vnet1 interfaces. The RX bytes
+ * counter holds the number of dumps done so far, so that tests can tell
+ * whether the stats were served from a cache. */
+int
+virNetlinkDumpCommand(struct nl_msg *nl_msg G_GNUC_UNUSED,
+                      virNetlinkDumpCallback callback,
+                      uint32_t src_pid G_GNUC_UNUSED,
+                      uint32_t dst_pid G_GNUC_UNUSED,
+                      unsigned int protocol G_GNUC_UNUSED,
+                      unsigned int groups G_GNUC_UNUSED,
+                      void *opaque)
+{
+    const char *ifnames[] = { "vnet0", "vnet1" };
+    size_t i;
+
+    dumpCount++;
+
+    for (i = 0; i < G_N_ELEMENTS(ifnames); i++) {
+        struct ifinfomsg ifinfo = { .ifi_family = AF_UNSPEC };
+        struct rtnl_link_stats64 link = {
+            .rx_bytes = dumpCount,
+            .rx_packets = 10 + i,
+            .tx_bytes = 100 + i,
+            .tx_packets = 1000 + i,
+        };
+        g_autoptr(virNetlinkMsg) msg = NULL;
+
+        if (!(msg = nlmsg_alloc_simple(RTM_NEWLINK, NLM_F_MULTI)) ||
+            nlmsg_append(msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0 ||
+            nla_put_string(msg, IFLA_IFNAME, ifnames[i]) < 0 ||
+            nla_put(msg, IFLA_STATS64, sizeof(link), &link) < 0)
+            abort();
+
+        if (callback(nlmsg_hdr(msg), opaque) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+# endif /* HAVE_LIBNL */
 #else
 /* Nothing to override on non-__linux__ platforms */
 #endif
@@ -23,6 +23,7 @@
 #ifdef __linux__
 
 # include "virnetdev.h"
+# include "virnetdevtap.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -59,6 +60,76 @@ testVirNetDevGetLinkInfo(const void *opaque)
     return 0;
 }
 
+
+# ifdef HAVE_LIBNL
+static int
+testVirNetDevTapInterfaceStatsCached(const void *opaque G_GNUC_UNUSED)
+{
+    g_autoptr(virNetDevTapStatsCache) cache = NULL;
+    g_autoptr(virNetDevTapStatsCache) next = NULL;
+    virDomainInterfaceStatsStruct stats;
+    unsigned long long dump;
+
+    if (!(cache = virNetDevTapStatsCacheNew()) ||
+        !(next = virNetDevTapStatsCacheNew()))
+        return -1;
+
+    if (virNetDevTapInterfaceStatsCached(cache, "vnet0", &stats, false) < 0)
+        return -1;
+
+    if (stats.rx_packets != 10 || stats.tx_bytes != 100) {
+        fprintf(stderr, "Unexpected stats of vnet0\n");
+        return -1;
+    }
+    dump = stats.rx_bytes;
+
+    /* the stats are swapped for TAP devices */
+    if (virNetDevTapInterfaceStatsCached(cache, "vnet1", &stats, true) < 0)
+        return -1;
+
+    if (stats.rx_bytes != 101 || stats.tx_packets != 11) {
+        fprintf(stderr, "Unexpected swapped stats of vnet1\n");
+        return -1;
+    }
+
+    if (stats.tx_bytes != dump) {
+        fprintf(stderr, "Stats of vnet1 weren't served from the cache\n");
+        return -1;
+    }
+
+    /* a missing interface doesn't trigger another dump */
+    if (virNetDevTapInterfaceStatsCached(cache, "missing", &stats, false) == 0) {
+        fprintf(stderr, "Stats of a missing interface returned\n");
+        return -1;
+    }
+    virResetLastError();
+
+    if (virNetDevTapInterfaceStatsCached(cache, "missing", &stats, false) == 0)
+        return -1;
+    virResetLastError();
+
+    if (virNetDevTapInterfaceStatsCached(cache, "vnet0", &stats, false) < 0)
+        return -1;
+
+    if (stats.rx_bytes != dump) {
+        fprintf(stderr, "Missing interface caused another dump\n");
+        return -1;
+    }
+
+    /* a new cache, i.e. the next stats query, reads fresh stats */
+    if (virNetDevTapInterfaceStatsCached(next, "vnet0", &stats, false) < 0)
+        return -1;
+
+    if (stats.rx_bytes != dump + 1) {
+        fprintf(stderr, "New cache didn't read fresh stats\n");
+        return -1;
+    }
+
+    return 0;
+}
+# endif /* HAVE_LIBNL */
+
+
 static int
 mymain(void)
 {
@@ -76,6 +147,12 @@ mymain(void)
     DO_TEST_LINK("lo", VIR_NETDEV_IF_STATE_UNKNOWN, 0);
     DO_TEST_LINK("eth0-broken", VIR_NETDEV_IF_STATE_DOWN, 0);
 
+# ifdef HAVE_LIBNL
+    if (virTestRun("Interface stats cache",
+                   testVirNetDevTapInterfaceStatsCached, NULL) < 0)
+        ret = -1;
+# endif
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
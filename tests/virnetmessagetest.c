@@ -520,6 +520,125 @@ static int testMessagePayloadStreamEncode(const void *args G_GNUC_UNUSED)
 }
 
 
+static int testMessagePayloadStreamAttach(const void *args G_GNUC_UNUSED)
+{
+    static const char stream[] = "The quick brown fox jumps over the lazy dog";
+    g_autofree char *data = g_strdup(stream);
+    virNetMessagePtr msg = virNetMessageNew(true);
+    static const char expect[] = {
+        0x00, 0x00, 0x00, 0x47,  /* Length */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x03,  /* Type */
+        0x00, 0x00, 0x00, 0x99,  /* Serial */
+        0x00, 0x00, 0x00, 0x02,  /* Status */
+    };
+    int ret = -1;
+
+    if (!msg)
+        return -1;
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_STREAM;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_CONTINUE;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayloadAttach(msg, &data, strlen(stream)) < 0)
+        goto cleanup;
+
+    if (data) {
+        VIR_DEBUG("Expect payload to be stolen");
+        goto cleanup;
+    }
+
+    if (G_N_ELEMENTS(expect) != msg->bufferLength) {
+        VIR_DEBUG("Expect message length %zu got %zu",
+                  sizeof(expect), msg->bufferLength);
+        goto cleanup;
+    }
+
+    if (msg->bufferOffset != 0 || msg->payloadOffset != 0) {
+        VIR_DEBUG("Expect message offsets 0 got %zu and %zu",
+                  msg->bufferOffset, msg->payloadOffset);
+        goto cleanup;
+    }
+
+    if (memcmp(expect, msg->buffer, sizeof(expect)) != 0) {
+        virTestDifferenceBin(stderr, expect, msg->buffer, sizeof(expect));
+        goto cleanup;
+    }
+
+    if (msg->payloadLength != strlen(stream) ||
+        memcmp(msg->payload, stream, msg->payloadLength) != 0) {
+        VIR_DEBUG("Payload not attached as expected");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+static int testMessageBufferReuse(const void *args G_GNUC_UNUSED)
+{
+    g_autofree virNetMessageBufferStatsPtr before = NULL;
+    g_autofree virNetMessageBufferStatsPtr after = NULL;
+    virNetMessagePtr msg = NULL;
+    char *buffer;
+    int ret = -1;
+
+    if (!(msg = virNetMessageNew(true)))
+        return -1;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    buffer = msg->buffer;
+    virNetMessageFree(msg);
+    msg = NULL;
+
+    if (virNetMessageBufferGetStats(&before) == 0 ||
+        before[0].size != VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX ||
+        before[0].cached == 0) {
+        VIR_DEBUG("Expected a cached buffer of the initial size");
+        goto cleanup;
+    }
+
+    if (!(msg = virNetMessageNew(true)))
+        goto cleanup;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (msg->buffer != buffer) {
+        VIR_DEBUG("Expected the cached buffer %p to be reused, got %p",
+                  buffer, msg->buffer);
+        goto cleanup;
+    }
+
+    virNetMessageBufferGetStats(&after);
+
+    if (after[0].hits != before[0].hits + 1 ||
+        after[0].cached != before[0].cached - 1 ||
+        after[0].inuse != before[0].inuse + 1) {
+        VIR_DEBUG("Unexpected buffer statistics hits=%llu cached=%zu inuse=%zu",
+                  after[0].hits, after[0].cached, after[0].inuse);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -544,6 +663,12 @@ mymain(void)
     if (virTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Message Payload Stream Attach", testMessagePayloadStreamAttach, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Buffer Reuse", testMessageBufferReuse, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -24,8 +24,12 @@
 
 #if defined(__linux__) && defined(RTLD_NEXT)
 # include "virsocket.h"
+# include "virerror.h"
+# include "virportallocator.h"
 # include <unistd.h>
 
+# define VIR_FROM_THIS VIR_FROM_NONE
+
 static bool host_has_ipv6;
 static int (*realsocket)(int domain, int type, int protocol);
 
@@ -71,6 +75,12 @@ int bind(int sockfd G_GNUC_UNUSED,
 {
     struct sockaddr_in saddr;
 
+    /* ports must not be probed if the used ones can be listed */
+    if (getenv("LIBVIRT_TEST_LIST_USED_PORTS")) {
+        errno = EACCES;
+        return -1;
+    }
+
     memcpy(&saddr, addr, sizeof(saddr));
 
     if (host_has_ipv6 && !getenv("LIBVIRT_TEST_IPV4ONLY")) {
@@ -97,6 +107,23 @@ int bind(int sockfd G_GNUC_UNUSED,
     return 0;
 }
 
+int
+virPortAllocatorGetUsedPorts(virBitmapPtr used)
+{
+    if (!getenv("LIBVIRT_TEST_LIST_USED_PORTS")) {
+        virReportError(VIR_ERR_NO_SUPPORT, "%s",
+                       "listing used ports is disabled");
+        return -1;
+    }
+
+    ignore_value(virBitmapSetBit(used, 5900));
+    ignore_value(virBitmapSetBit(used, 5904));
+    ignore_value(virBitmapSetBit(used, 5905));
+    ignore_value(virBitmapSetBit(used, 5906));
+
+    return 0;
+}
+
 #else /* defined(__linux__) && defined(RTLD_NEXT) */
 /* Nothing to override on other platforms. */
 #endif
@@ -178,6 +178,15 @@ mymain(void)
     if (virTestRun("Test IPv4-only alloc reuse", testAllocReuse, NULL) < 0)
         ret = -1;
 
+    g_unsetenv("LIBVIRT_TEST_IPV4ONLY");
+    g_setenv("LIBVIRT_TEST_LIST_USED_PORTS", "really", TRUE);
+
+    if (virTestRun("Test listed alloc all", testAllocAll, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Test listed alloc reuse", testAllocReuse, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,61 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "virmock.h"
+
+#if HAVE_FALLOCATE
+static int (*real_fallocate)(int fd, int mode, off_t offset, off_t len);
+
+/* Pretend the filesystem can't zero ranges of files if the test asks
+ * for it, so that zeroing falls back to writing the zeroes. */
+int
+fallocate(int fd, int mode, off_t offset, off_t len)
+{
+    VIR_MOCK_REAL_INIT(fallocate);
+
+# ifdef FALLOC_FL_ZERO_RANGE
+    if ((mode & FALLOC_FL_ZERO_RANGE) && getenv("LIBVIRT_NO_ZERO_RANGE")) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+# endif
+
+    return real_fallocate(fd, mode, offset, len);
+}
+#endif /* HAVE_FALLOCATE */
+
+
+#if HAVE_COPY_FILE_RANGE
+/* Fail with an error that is not a reason to fall back to copying the
+ * data in userspace, so that any use of copy_file_range() makes the
+ * volume build fail. */
+ssize_t
+copy_file_range(int infd G_GNUC_UNUSED,
+                loff_t *pinoff G_GNUC_UNUSED,
+                int outfd G_GNUC_UNUSED,
+                loff_t *poutoff G_GNUC_UNUSED,
+                size_t length G_GNUC_UNUSED,
+                unsigned int flags G_GNUC_UNUSED)
+{
+    errno = EIO;
+    return -1;
+}
+#endif /* HAVE_COPY_FILE_RANGE */
@@ -16,6 +16,7 @@
 
 #include <config.h>
 
+#include <fcntl.h>
 
 #include "testutils.h"
 #include "virerror.h"
@@ -23,6 +24,7 @@
 #include "virlog.h"
 #include "virstring.h"
 
+#include "virstorageobj.h"
 #include "storage/storage_util.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -70,11 +72,239 @@ testGlusterExtractPoolSources(const void *opaque)
 }
 
 
+#define TEST_DATA_LEN (1024 * 1024)
+
+static char *scratchdir;
+
+struct testBuildVolFromData {
+    const char *name;
+    unsigned long long allocation;
+    bool expectKernelCopy;
+};
+
+
+static virStorageVolDefPtr
+testBuildVolFromDef(virStoragePoolDefPtr pooldef,
+                    const char *name,
+                    unsigned long long capacity,
+                    unsigned long long allocation)
+{
+    g_autofree char *xml = NULL;
+    virStorageVolDefPtr vol;
+
+    xml = g_strdup_printf("<volume>\n"
+                          "  <name>%s</name>\n"
+                          "  <capacity unit='bytes'>%llu</capacity>\n"
+                          "  <allocation unit='bytes'>%llu</allocation>\n"
+                          "  <target>\n"
+                          "    <format type='raw'/>\n"
+                          "  </target>\n"
+                          "</volume>\n", name, capacity, allocation);
+
+    if (!(vol = virStorageVolDefParseString(pooldef, xml, 0)))
+        return NULL;
+
+    vol->target.path = g_strdup_printf("%s/%s", scratchdir, name);
+    return vol;
+}
+
+
+/*
+ * Build a raw volume from an input volume whose capacity exceeds the
+ * size of its file, so that the input can't be cloned as a whole and
+ * is copied by the kernel or the read/write loop. copy_file_range() is
+ * mocked to fail, so the build fails if the kernel copy is used.
+ */
+static int
+testBuildVolFrom(const void *opaque)
+{
+    const struct testBuildVolFromData *data = opaque;
+    virStoragePoolObjPtr pool = NULL;
+    virStoragePoolDefPtr pooldef = NULL;
+    virStorageVolDefPtr inputvol = NULL;
+    virStorageVolDefPtr vol = NULL;
+    virStorageBackendBuildVolFrom build;
+    g_autofree char *poolxml = NULL;
+    g_autofree char *pattern = NULL;
+    g_autofree char *actual = NULL;
+    g_autofree char *inputname = g_strdup_printf("%s-input", data->name);
+    unsigned long long capacity = TEST_DATA_LEN * 2;
+    VIR_AUTOCLOSE fd = -1;
+    int ret = -1;
+    int rc;
+    size_t i;
+
+    poolxml = g_strdup_printf("<pool type='dir'>\n"
+                              "  <name>test</name>\n"
+                              "  <target>\n"
+                              "    <path>%s</path>\n"
+                              "  </target>\n"
+                              "</pool>\n", scratchdir);
+
+    if (!(pooldef = virStoragePoolDefParseString(poolxml)) ||
+        !(pool = virStoragePoolObjNew()))
+        goto cleanup;
+    virStoragePoolObjSetDef(pool, pooldef);
+
+    if (!(inputvol = testBuildVolFromDef(pooldef, inputname, capacity, 0)) ||
+        !(vol = testBuildVolFromDef(pooldef, data->name, capacity,
+                                    data->allocation)))
+        goto cleanup;
+
+    pattern = g_new0(char, TEST_DATA_LEN);
+    for (i = 0; i < TEST_DATA_LEN; i++)
+        pattern[i] = i % 255 + 1;
+
+    if ((fd = open(inputvol->target.path, O_CREAT|O_WRONLY|O_EXCL, 0600)) < 0 ||
+        safewrite(fd, pattern, TEST_DATA_LEN) != TEST_DATA_LEN ||
+        VIR_CLOSE(fd) < 0) {
+        fprintf(stderr, "cannot write input volume\n");
+        goto cleanup;
+    }
+
+    if (!(build = virStorageBackendGetBuildVolFromFunction(vol, inputvol)))
+        goto cleanup;
+
+    rc = build(pool, vol, inputvol, 0);
+    virResetLastError();
+
+#if HAVE_COPY_FILE_RANGE
+    if (data->expectKernelCopy) {
+        if (rc == 0) {
+            fprintf(stderr, "copy_file_range() was not used\n");
+            goto cleanup;
+        }
+        ret = 0;
+        goto cleanup;
+    }
+#endif
+
+    if (rc < 0) {
+        fprintf(stderr, "building the volume failed\n");
+        goto cleanup;
+    }
+
+    if (virFileReadAll(vol->target.path, TEST_DATA_LEN * 4, &actual) < 0)
+        goto cleanup;
+
+    if (memcmp(actual, pattern, TEST_DATA_LEN) != 0) {
+        fprintf(stderr, "volume data doesn't match the input\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (inputvol)
+        unlink(inputvol->target.path);
+    if (vol)
+        unlink(vol->target.path);
+    virStorageVolDefFree(inputvol);
+    virStorageVolDefFree(vol);
+    virStoragePoolObjEndAPI(&pool);
+    return ret;
+}
+
+
+struct testVolWipeData {
+    const char *name;
+    bool offload;
+};
+
+
+/*
+ * Wipe a fully allocated raw volume with the zero algorithm, either
+ * letting the kernel zero the file or, with zeroing ranges of files
+ * mocked as unsupported, writing the zeroes.
+ */
+static int
+testVolWipe(const void *opaque)
+{
+    const struct testVolWipeData *data = opaque;
+    virStoragePoolDefPtr pooldef = NULL;
+    virStorageVolDefPtr vol = NULL;
+    g_autofree char *poolxml = NULL;
+    g_autofree char *pattern = NULL;
+    g_autofree char *actual = NULL;
+    size_t len = TEST_DATA_LEN + 4096;
+    ssize_t actuallen;
+    VIR_AUTOCLOSE fd = -1;
+    int ret = -1;
+    size_t i;
+
+    poolxml = g_strdup_printf("<pool type='dir'>\n"
+                              "  <name>test</name>\n"
+                              "  <target>\n"
+                              "    <path>%s</path>\n"
+                              "  </target>\n"
+                              "</pool>\n", scratchdir);
+
+    if (!(pooldef = virStoragePoolDefParseString(poolxml)) ||
+        !(vol = testBuildVolFromDef(pooldef, data->name, len, len)))
+        goto cleanup;
+
+    pattern = g_new0(char, len);
+    for (i = 0; i < len; i++)
+        pattern[i] = i % 255 + 1;
+
+    if ((fd = open(vol->target.path, O_CREAT|O_WRONLY|O_EXCL, 0600)) < 0 ||
+        safewrite(fd, pattern, len) != (ssize_t) len ||
+        VIR_CLOSE(fd) < 0) {
+        fprintf(stderr, "cannot write volume\n");
+        goto cleanup;
+    }
+
+    if (data->offload)
+        g_unsetenv("LIBVIRT_NO_ZERO_RANGE");
+    else
+        g_setenv("LIBVIRT_NO_ZERO_RANGE", "1", TRUE);
+
+    if (virStorageBackendVolWipeLocal(NULL, vol,
+                                      VIR_STORAGE_VOL_WIPE_ALG_ZERO, 0) < 0) {
+        fprintf(stderr, "wiping the volume failed\n");
+        goto cleanup;
+    }
+
+    if ((actuallen = virFileReadAll(vol->target.path, len * 2, &actual)) < 0)
+        goto cleanup;
+
+    if (actuallen != (ssize_t) len) {
+        fprintf(stderr, "volume size changed to %zd bytes\n", actuallen);
+        goto cleanup;
+    }
+
+    for (i = 0; i < len; i++) {
+        if (actual[i] != 0) {
+            fprintf(stderr, "volume data was not zeroed at offset %zu\n", i);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    g_unsetenv("LIBVIRT_NO_ZERO_RANGE");
+    if (vol)
+        unlink(vol->target.path);
+    virStorageVolDefFree(vol);
+    virStoragePoolDefFree(pooldef);
+    return ret;
+}
+
+
+#define SCRATCHDIRTEMPLATE abs_builddir "/virstorageutildir-XXXXXX"
+
 static int
 mymain(void)
 {
     int ret = 0;
 
+    scratchdir = g_strdup(SCRATCHDIRTEMPLATE);
+    if (!g_mkdtemp(scratchdir)) {
+        fprintf(stderr, "Cannot create scratch directory\n");
+        return EXIT_FAILURE;
+    }
+
 #define DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL(testname, sffx, pooltype) \
     do { \
         struct testGlusterExtractPoolSourcesData data; \
@@ -104,7 +334,39 @@ mymain(void)
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_NETFS
 #undef DO_TEST_GLUSTER_EXTRACT_POOL_SOURCES_FULL
 
+#define DO_TEST_BUILD_VOL_FROM(name, allocation, expectKernelCopy) \
+    do { \
+        struct testBuildVolFromData data = { \
+            name, allocation, expectKernelCopy \
+        }; \
+        if (virTestRun("build-vol-from-" name, \
+                       testBuildVolFrom, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* a fully allocated volume must not share extents with its input */
+    DO_TEST_BUILD_VOL_FROM("full", TEST_DATA_LEN * 2, false);
+    DO_TEST_BUILD_VOL_FROM("sparse", 0, true);
+
+#undef DO_TEST_BUILD_VOL_FROM
+
+#define DO_TEST_VOL_WIPE(name, offload) \
+    do { \
+        struct testVolWipeData data = { name, offload }; \
+        if (virTestRun("vol-wipe-" name, testVolWipe, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_VOL_WIPE("offload", true);
+    DO_TEST_VOL_WIPE("write", false);
+
+#undef DO_TEST_VOL_WIPE
+
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(scratchdir);
+    VIR_FREE(scratchdir);
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-VIR_TEST_MAIN(mymain)
+VIR_TEST_MAIN_PRELOAD(mymain, VIR_TEST_MOCK("virstorageutil"))
@@ -0,0 +1,118 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "testutils.h"
+#include "../tools/vsh.h"
+
+#define MiB (1024ULL * 1024)
+
+struct testSplitRangeData {
+    unsigned long long total;
+    unsigned long long length;
+    size_t nparts;
+    const vshRange *expect;
+    size_t nexpect;
+};
+
+
+static int
+testSplitRange(const void *opaque)
+{
+    const struct testSplitRangeData *data = opaque;
+    g_autofree vshRangePtr ranges = NULL;
+    size_t nranges;
+    size_t i;
+
+    nranges = vshSplitRange(data->total, data->length, data->nparts,
+                            MiB, &ranges);
+
+    if (nranges != data->nexpect) {
+        fprintf(stderr, "expected %zu parts, got %zu\n",
+                data->nexpect, nranges);
+        return -1;
+    }
+
+    for (i = 0; i < nranges; i++) {
+        if (ranges[i].offset != data->expect[i].offset ||
+            ranges[i].length != data->expect[i].length) {
+            fprintf(stderr,
+                    "part %zu: expected offset=%llu length=%llu, "
+                    "got offset=%llu length=%llu\n",
+                    i, data->expect[i].offset, data->expect[i].length,
+                    ranges[i].offset, ranges[i].length);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST(name, _total, _length, _nparts, ...) \
+    do { \
+        static const vshRange expect[] = { __VA_ARGS__ }; \
+        struct testSplitRangeData data = { \
+            .total = _total, .length = _length, .nparts = _nparts, \
+            .expect = expect, .nexpect = G_N_ELEMENTS(expect), \
+        }; \
+        if (virTestRun("split " name, testSplitRange, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+#define DO_TEST_EMPTY(name, _total, _length, _nparts) \
+    do { \
+        struct testSplitRangeData data = { \
+            .total = _total, .length = _length, .nparts = _nparts, \
+        }; \
+        if (virTestRun("split " name, testSplitRange, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* parts are rounded up to the alignment, the last one is shorter */
+    DO_TEST("uneven", 10 * MiB, 0, 4,
+            { 0, 3 * MiB }, { 3 * MiB, 3 * MiB },
+            { 6 * MiB, 3 * MiB }, { 9 * MiB, 1 * MiB });
+    DO_TEST("even", 8 * MiB, 0, 4,
+            { 0, 2 * MiB }, { 2 * MiB, 2 * MiB },
+            { 4 * MiB, 2 * MiB }, { 6 * MiB, 2 * MiB });
+
+    /* fewer parts than requested if the range is small */
+    DO_TEST("small", 100, 0, 4,
+            { 0, 100 });
+    DO_TEST("single", 3 * MiB, 0, 1,
+            { 0, 3 * MiB });
+
+    /* the length limits the range */
+    DO_TEST("length", 10 * MiB, 2 * MiB, 4,
+            { 0, 1 * MiB }, { 1 * MiB, 1 * MiB });
+    DO_TEST("length past the end", 5 * MiB, 8 * MiB, 2,
+            { 0, 3 * MiB }, { 3 * MiB, 2 * MiB });
+
+    DO_TEST_EMPTY("empty", 0, 0, 4);
+    DO_TEST_EMPTY("empty with length", 0, 2 * MiB, 4);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -6174,6 +6174,23 @@ virshDomainJobOperationToString(int op)
     return str ? _(str) : _("unknown");
 }
 
+VIR_ENUM_DECL(virshDomainJobAutoTuneAction);
+VIR_ENUM_IMPL(virshDomainJobAutoTuneAction,
+              VIR_DOMAIN_JOB_AUTO_TUNE_LAST,
+              N_("Unknown"),
+              N_("Raised max downtime"),
+              N_("Raised CPU throttling"),
+              N_("Enlarged compression cache"),
+              N_("Switched to post-copy"),
+);
+
+static const char *
+virshDomainJobAutoTuneActionToString(int action)
+{
+    const char *str = virshDomainJobAutoTuneActionTypeToString(action);
+    return str ? _(str) : _("unknown");
+}
+
 
 static int
 virshDomainJobStatsToDomainJobInfo(virTypedParameterPtr params,
@@ -6226,6 +6243,8 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
     const char *svalue;
     int op;
     int rc;
+    unsigned int npasses = 0;
+    unsigned int nsteps = 0;
     size_t i;
     bool rawstats = vshCommandOptBool(cmd, "rawstats");
 
@@ -6368,6 +6387,63 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         } else if (rc) {
             vshPrint(ctl, "%-17s %-12llu\n", _("Postcopy requests:"), value);
         }
+
+        if ((rc = virTypedParamsGetUInt(params, nparams,
+                                        VIR_DOMAIN_JOB_MEMORY_PASS_COUNT,
+                                        &npasses)) < 0)
+            goto save_error;
+
+        for (i = 0; rc && i < npasses; i++) {
+            unsigned long long iteration = 0;
+            unsigned long long duration = 0;
+            unsigned long long bps = 0;
+            unsigned long long dirtyRate = 0;
+            char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+            g_snprintf(field, sizeof(field),
+                       VIR_DOMAIN_JOB_MEMORY_PASS_ITERATION, (unsigned int) i);
+            if (virTypedParamsGetULLong(params, nparams, field, &iteration) < 0)
+                goto save_error;
+            g_snprintf(field, sizeof(field),
+                       VIR_DOMAIN_JOB_MEMORY_PASS_DURATION, (unsigned int) i);
+            if (virTypedParamsGetULLong(params, nparams, field, &duration) < 0)
+                goto save_error;
+            g_snprintf(field, sizeof(field),
+                       VIR_DOMAIN_JOB_MEMORY_PASS_BPS, (unsigned int) i);
+            if (virTypedParamsGetULLong(params, nparams, field, &bps) < 0)
+                goto save_error;
+            g_snprintf(field, sizeof(field),
+                       VIR_DOMAIN_JOB_MEMORY_PASS_DIRTY_RATE, (unsigned int) i);
+            if (virTypedParamsGetULLong(params, nparams, field, &dirtyRate) < 0)
+                goto save_error;
+
+            val = vshPrettyCapacity(bps, &unit);
+            vshPrint(ctl, _("Pass %-12llu %llu ms, %.3lf %s/s, %llu pages/s dirtied\n"),
+                     iteration, duration, val, unit, dirtyRate);
+        }
+
+        if ((rc = virTypedParamsGetUInt(params, nparams,
+                                        VIR_DOMAIN_JOB_AUTO_TUNE_COUNT,
+                                        &nsteps)) < 0)
+            goto save_error;
+
+        for (i = 0; rc && i < nsteps; i++) {
+            unsigned long long iteration = 0;
+            int action = 0;
+            char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+            g_snprintf(field, sizeof(field),
+                       VIR_DOMAIN_JOB_AUTO_TUNE_ACTION, (unsigned int) i);
+            if (virTypedParamsGetInt(params, nparams, field, &action) < 0)
+                goto save_error;
+            g_snprintf(field, sizeof(field),
+                       VIR_DOMAIN_JOB_AUTO_TUNE_ITERATION, (unsigned int) i);
+            if (virTypedParamsGetULLong(params, nparams, field, &iteration) < 0)
+                goto save_error;
+
+            vshPrint(ctl, _("%-17s %s in iteration %llu\n"), _("Auto-tune step:"),
+                     virshDomainJobAutoTuneActionToString(action), iteration);
+        }
     }
 
     if (info.fileTotal || info.fileRemaining || info.fileProcessed) {
@@ -6387,6 +6463,14 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
             vshPrint(ctl, "%-17s %-.3lf %s/s\n",
                      _("File bandwidth:"), val, unit);
         }
+
+        if ((rc = virTypedParamsGetULLong(params, nparams,
+                                          VIR_DOMAIN_JOB_DISK_TIME_REMAINING,
+                                          &value)) < 0) {
+            goto save_error;
+        } else if (rc) {
+            vshPrint(ctl, "%-17s %-12llu ms\n", _("File time left:"), value);
+        }
     }
 
     if ((rc = virTypedParamsGetULLong(params, nparams,
@@ -10692,6 +10776,10 @@ static const vshCmdOptDef opts_migrate[] = {
      .type = VSH_OT_INT,
      .help = N_("number of connections for parallel migration")
     },
+    {.name = "auto-tune",
+     .type = VSH_OT_BOOL,
+     .help = N_("let libvirt escalate tuning when migration does not converge")
+    },
     {.name = "bandwidth",
      .type = VSH_OT_INT,
      .help = N_("migration bandwidth limit in MiB/s")
@@ -10982,6 +11070,9 @@ doMigrate(void *opaque)
     if (vshCommandOptBool(cmd, "parallel"))
         flags |= VIR_MIGRATE_PARALLEL;
 
+    if (vshCommandOptBool(cmd, "auto-tune"))
+        flags |= VIR_MIGRATE_AUTO_TUNE;
+
     if (flags & VIR_MIGRATE_PEER2PEER || vshCommandOptBool(cmd, "direct")) {
         if (virDomainMigrateToURI3(dom, desturi, params, nparams, flags) == 0)
             data->ret = 0;
@@ -633,6 +633,321 @@ cmdVolClone(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/*
+ * Parallel volume transfers
+ *
+ * The volume range is split into parts which are transferred
+ * concurrently, each over its own stream and its own connection so
+ * that the RPC/TLS processing is not serialized on a single socket.
+ */
+#define VIRSH_VOL_TRANSFER_ALIGN (1024 * 1024)
+
+typedef struct _virshVolTransferPart virshVolTransferPart;
+typedef virshVolTransferPart *virshVolTransferPartPtr;
+struct _virshVolTransferPart {
+    vshControl *ctl;
+    const char *name;
+    bool upload;
+    unsigned int flags;
+    virConnectPtr conn;
+    virStorageVolPtr vol;
+    virStreamPtr st;
+    int fd;
+    unsigned long long offset;      /* offset within the volume */
+    unsigned long long fileOffset;  /* offset within the local file */
+    unsigned long long length;
+    unsigned long long done;
+    bool ok;
+};
+
+
+static int
+virshVolPartSource(virStreamPtr st G_GNUC_UNUSED,
+                   char *bytes,
+                   size_t nbytes,
+                   void *opaque)
+{
+    virshVolTransferPartPtr part = opaque;
+    int got;
+
+    if (nbytes > part->length - part->done)
+        nbytes = part->length - part->done;
+
+    if ((got = saferead(part->fd, bytes, nbytes)) > 0)
+        part->done += got;
+
+    return got;
+}
+
+
+static int
+virshVolPartSink(virStreamPtr st G_GNUC_UNUSED,
+                 const char *bytes,
+                 size_t nbytes,
+                 void *opaque)
+{
+    virshVolTransferPartPtr part = opaque;
+    int got;
+
+    if ((got = safewrite(part->fd, bytes, nbytes)) > 0)
+        part->done += got;
+
+    return got;
+}
+
+
+/* Unlike virshStreamSkip this never truncates the file as other
+ * parts may have written data past this one already. */
+static int
+virshVolPartSkip(virStreamPtr st G_GNUC_UNUSED,
+                 long long offset,
+                 void *opaque)
+{
+    virshVolTransferPartPtr part = opaque;
+
+    if (lseek(part->fd, offset, SEEK_CUR) == (off_t) -1)
+        return -1;
+
+    part->done += offset;
+    return 0;
+}
+
+
+static int
+virshVolPartInData(virStreamPtr st G_GNUC_UNUSED,
+                   int *inData,
+                   long long *offset,
+                   void *opaque)
+{
+    virshVolTransferPartPtr part = opaque;
+
+    if (virFileInData(part->fd, inData, offset) < 0) {
+        vshError(part->ctl, "%s", _("Unable to get current position in stream"));
+        return -1;
+    }
+
+    if (*offset > part->length - part->done)
+        *offset = part->length - part->done;
+
+    return 0;
+}
+
+
+static void
+virshVolTransferPartThread(void *opaque)
+{
+    virshVolTransferPartPtr part = opaque;
+    vshControl *ctl = part->ctl;
+    int rc;
+
+    if (!part->upload)
+        rc = virStreamSparseRecvAll(part->st, virshVolPartSink,
+                                    virshVolPartSkip, part);
+    else if (part->flags & VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM)
+        rc = virStreamSparseSendAll(part->st, virshVolPartSource,
+                                    virshVolPartInData,
+                                    virshVolPartSkip, part);
+    else
+        rc = virStreamSendAll(part->st, virshVolPartSource, part);
+
+    if (rc < 0) {
+        if (part->upload)
+            vshError(ctl, _("cannot send data to volume %s"), part->name);
+        else
+            vshError(ctl, _("cannot receive data from volume %s"), part->name);
+        return;
+    }
+
+    if (virStreamFinish(part->st) < 0) {
+        vshError(ctl, _("cannot close volume %s"), part->name);
+        virStreamAbort(part->st);
+        return;
+    }
+
+    part->ok = true;
+}
+
+
+/**
+ * virshVolTransferParallel:
+ * @ctl: virsh control structure
+ * @vol: volume to transfer
+ * @name: volume name for error messages
+ * @file: local file
+ * @fd: FD of @file as opened by the caller
+ * @upload: true for upload, false for download
+ * @offset: volume offset to start at
+ * @length: amount of data to transfer, 0 for everything
+ * @flags: flags for virStorageVolUpload/virStorageVolDownload
+ * @nparts: number of concurrent streams
+ *
+ * Returns true on success, false on error.
+ */
+static bool
+virshVolTransferParallel(vshControl *ctl,
+                         virStorageVolPtr vol,
+                         const char *name,
+                         const char *file,
+                         int fd,
+                         bool upload,
+                         unsigned long long offset,
+                         unsigned long long length,
+                         unsigned int flags,
+                         unsigned int nparts)
+{
+    virshControlPtr priv = ctl->privData;
+    g_autofree virshVolTransferPartPtr parts = NULL;
+    g_autofree virThread *threads = NULL;
+    g_autofree vshRangePtr ranges = NULL;
+    g_autofree char *uri = NULL;
+    const char *key;
+    unsigned long long total;
+    unsigned long long end = 0;
+    size_t nthreads = 0;
+    size_t i;
+    bool ret = false;
+
+    if (upload) {
+        struct stat sb;
+
+        if (fstat(fd, &sb) < 0) {
+            vshError(ctl, _("cannot stat %s"), file);
+            return false;
+        }
+        total = sb.st_size;
+
+        if (length && total > length) {
+            vshError(ctl, _("%s is larger than the requested length"), file);
+            return false;
+        }
+    } else {
+        virStorageVolInfo info;
+
+        if (virStorageVolGetInfoFlags(vol, &info,
+                                      VIR_STORAGE_VOL_GET_PHYSICAL) < 0)
+            return false;
+
+        if (offset > info.allocation) {
+            vshError(ctl, _("offset %llu is past the end of volume %s"),
+                     offset, name);
+            return false;
+        }
+        total = info.allocation - offset;
+    }
+
+    nparts = vshSplitRange(total, length, nparts,
+                           VIRSH_VOL_TRANSFER_ALIGN, &ranges);
+
+    if (!(uri = virConnectGetURI(priv->conn)) ||
+        !(key = virStorageVolGetKey(vol)))
+        return false;
+
+    parts = g_new0(virshVolTransferPart, nparts);
+    threads = g_new0(virThread, nparts);
+
+    for (i = 0; i < nparts; i++) {
+        virshVolTransferPartPtr part = &parts[i];
+
+        part->ctl = ctl;
+        part->name = name;
+        part->upload = upload;
+        part->flags = flags;
+        part->fileOffset = ranges[i].offset;
+        part->offset = offset + part->fileOffset;
+        part->length = ranges[i].length;
+        part->fd = -1;
+    }
+
+    /* Connect and open the streams from this thread so that
+     * authentication callbacks don't interleave and so that the
+     * daemon doesn't see the transfers starting all at once (it
+     * refuses to open a volume while another stream is being set
+     * up for it). */
+    for (i = 0; i < nparts; i++) {
+        virshVolTransferPartPtr part = &parts[i];
+
+        if (!(part->conn = virshConnect(ctl, uri, priv->readonly)))
+            goto cleanup;
+
+        if (!(part->vol = virStorageVolLookupByKey(part->conn, key)))
+            goto cleanup;
+
+        if ((part->fd = open(file, upload ? O_RDONLY : O_WRONLY)) < 0) {
+            vshError(ctl, _("cannot open %s"), file);
+            goto cleanup;
+        }
+
+        if (lseek(part->fd, part->fileOffset, SEEK_SET) == (off_t) -1) {
+            vshError(ctl, _("cannot seek in %s"), file);
+            goto cleanup;
+        }
+
+        if (!(part->st = virStreamNew(part->conn, 0))) {
+            vshError(ctl, _("cannot create a new stream"));
+            goto cleanup;
+        }
+
+        if (upload) {
+            if (virStorageVolUpload(part->vol, part->st, part->offset,
+                                    part->length, flags) < 0) {
+                vshError(ctl, _("cannot upload to volume %s"), name);
+                goto cleanup;
+            }
+        } else {
+            if (virStorageVolDownload(part->vol, part->st, part->offset,
+                                      part->length, flags) < 0) {
+                vshError(ctl, _("cannot download from volume %s"), name);
+                goto cleanup;
+            }
+        }
+    }
+
+    for (nthreads = 0; nthreads < nparts; nthreads++) {
+        if (virThreadCreate(&threads[nthreads], true,
+                            virshVolTransferPartThread,
+                            &parts[nthreads]) < 0) {
+            vshError(ctl, "%s", _("cannot create transfer thread"));
+            goto cleanup;
+        }
+    }
+
+    ret = true;
+
+ cleanup:
+    for (i = 0; i < nthreads; i++) {
+        virThreadJoin(&threads[i]);
+        if (!parts[i].ok)
+            ret = false;
+        if (parts[i].done)
+            end = MAX(end, parts[i].fileOffset + parts[i].done);
+    }
+
+    /* A trailing hole was only seeked over, extend the file to cover it */
+    if (ret && !upload && ftruncate(fd, end) < 0) {
+        vshError(ctl, _("cannot truncate %s"), file);
+        ret = false;
+    }
+
+    for (i = 0; i < nparts; i++) {
+        if (VIR_CLOSE(parts[i].fd) < 0) {
+            vshError(ctl, _("cannot close file %s"), file);
+            ret = false;
+        }
+        if (parts[i].st) {
+            /* streams of threads that failed were aborted by them */
+            if (i >= nthreads)
+                virStreamAbort(parts[i].st);
+            virStreamFree(parts[i].st);
+        }
+        if (parts[i].vol)
+            virStorageVolFree(parts[i].vol);
+        if (parts[i].conn)
+            virConnectClose(parts[i].conn);
+    }
+
+    return ret;
+}
+
 /*
  * "vol-upload" command
  */
@@ -662,6 +977,14 @@ static const vshCmdOptDef opts_vol_upload[] = {
      .type = VSH_OT_BOOL,
      .help = N_("preserve sparseness of volume")
     },
+    {.name = "parallel",
+     .type = VSH_OT_INT,
+     .help = N_("number of concurrent streams to use")
+    },
+    {.name = "bypass-cache",
+     .type = VSH_OT_BOOL,
+     .help = N_("avoid file system cache when accessing the volume")
+    },
     {.name = NULL}
 };
 
@@ -678,6 +1001,9 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
     virshControlPtr priv = ctl->privData;
     unsigned int flags = 0;
     virshStreamCallbackData cbData;
+    unsigned int parallel = 1;
+
+    VSH_EXCLUSIVE_OPTIONS("sparse", "bypass-cache");
 
     if (vshCommandOptULongLong(ctl, cmd, "offset", &offset) < 0)
         return false;
@@ -685,6 +1011,9 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptULongLongWrap(ctl, cmd, "length", &length) < 0)
         return false;
 
+    if (vshCommandOptUInt(ctl, cmd, "parallel", &parallel) < 0)
+        return false;
+
     if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", &name)))
         return false;
 
@@ -702,6 +1031,15 @@ cmdVolUpload(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "sparse"))
         flags |= VIR_STORAGE_VOL_UPLOAD_SPARSE_STREAM;
 
+    if (vshCommandOptBool(cmd, "bypass-cache"))
+        flags |= VIR_STORAGE_VOL_UPLOAD_BYPASS_CACHE;
+
+    if (parallel > 1) {
+        ret = virshVolTransferParallel(ctl, vol, name, file, fd, true,
+                                       offset, length, flags, parallel);
+        goto cleanup;
+    }
+
     if (!(st = virStreamNew(priv->conn, 0))) {
         vshError(ctl, _("cannot create a new stream"));
         goto cleanup;
@@ -777,6 +1115,14 @@ static const vshCmdOptDef opts_vol_download[] = {
      .type = VSH_OT_BOOL,
      .help = N_("preserve sparseness of volume")
     },
+    {.name = "parallel",
+     .type = VSH_OT_INT,
+     .help = N_("number of concurrent streams to use")
+    },
+    {.name = "bypass-cache",
+     .type = VSH_OT_BOOL,
+     .help = N_("avoid file system cache when accessing the volume")
+    },
     {.name = NULL}
 };
 
@@ -793,6 +1139,9 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
     bool created = false;
     virshControlPtr priv = ctl->privData;
     unsigned int flags = 0;
+    unsigned int parallel = 1;
+
+    VSH_EXCLUSIVE_OPTIONS("sparse", "bypass-cache");
 
     if (vshCommandOptULongLong(ctl, cmd, "offset", &offset) < 0)
         return false;
@@ -800,6 +1149,9 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptULongLongWrap(ctl, cmd, "length", &length) < 0)
         return false;
 
+    if (vshCommandOptUInt(ctl, cmd, "parallel", &parallel) < 0)
+        return false;
+
     if (!(vol = virshCommandOptVol(ctl, cmd, "vol", "pool", &name)))
         return false;
 
@@ -809,6 +1161,9 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "sparse"))
         flags |= VIR_STORAGE_VOL_DOWNLOAD_SPARSE_STREAM;
 
+    if (vshCommandOptBool(cmd, "bypass-cache"))
+        flags |= VIR_STORAGE_VOL_DOWNLOAD_BYPASS_CACHE;
+
     if ((fd = open(file, O_WRONLY|O_CREAT|O_EXCL, 0666)) < 0) {
         if (errno != EEXIST ||
             (fd = open(file, O_WRONLY|O_TRUNC, 0666)) < 0) {
@@ -819,6 +1174,12 @@ cmdVolDownload(vshControl *ctl, const vshCmd *cmd)
         created = true;
     }
 
+    if (parallel > 1) {
+        ret = virshVolTransferParallel(ctl, vol, name, file, fd, false,
+                                       offset, length, flags, parallel);
+        goto cleanup;
+    }
+
     if (!(st = virStreamNew(priv->conn, 0))) {
         vshError(ctl, _("cannot create a new stream"));
         goto cleanup;
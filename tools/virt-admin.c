@@ -1119,6 +1119,125 @@ cmdDaemonLogOutputs(vshControl *ctl, const vshCmd *cmd)
     return true;
 }
 
+/* ------------------------------
+ * Command daemon-startup-timings
+ * ------------------------------
+ */
+static const vshCmdInfo info_daemon_startup_timings[] = {
+    {.name = "help",
+     .data = N_("show how long the phases of the daemon startup took")
+    },
+    {.name = "desc",
+     .data = N_("Show the duration of the individual phases of the daemon "
+                "startup in milliseconds.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonStartupTimings(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (virAdmConnectGetStartupTimings(priv->conn, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to get daemon startup timings"));
+        return false;
+    }
+
+    for (i = 0; i < nparams; i++)
+        vshPrint(ctl, "%-30s: %llu ms\n", params[i].field, params[i].value.ul);
+
+    virTypedParamsFree(params, nparams);
+    return true;
+}
+
+/* ------------------------------
+ * Command daemon-message-buffers
+ * ------------------------------
+ */
+static const vshCmdInfo info_daemon_message_buffers[] = {
+    {.name = "help",
+     .data = N_("show usage of the RPC message buffer pool")
+    },
+    {.name = "desc",
+     .data = N_("Show for each size class of the pool the daemon recycles "
+                "RPC message buffers through how many buffers are cached and "
+                "in use, the highest number of buffers used at once and how "
+                "many allocations were served from the pool.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonMessageBuffers(vshControl *ctl, const vshCmd *cmd G_GNUC_UNUSED)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int nclasses = 0;
+    size_t i;
+    bool ret = false;
+    vshTablePtr table = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (virAdmConnectGetMessageBufferStats(priv->conn, &params, &nparams, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to get message buffer statistics"));
+        return false;
+    }
+
+    if (virTypedParamsGetUInt(params, nparams, "class.count", &nclasses) < 0)
+        goto cleanup;
+
+    table = vshTableNew(_("Size"), _("Cached"), _("Cached max"), _("In use"),
+                        _("In use high"), _("Hits"), _("Misses"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < nclasses; i++) {
+        static const char *fields[] = {
+            "size", "cached", "cached_max", "in_use",
+            "in_use_high", "hits", "misses",
+        };
+        char *values[G_N_ELEMENTS(fields)] = { NULL };
+        size_t j;
+        int rc;
+
+        for (j = 0; j < G_N_ELEMENTS(fields); j++) {
+            g_autofree char *field = g_strdup_printf("class.%zu.%s", i, fields[j]);
+            unsigned long long value = 0;
+
+            if (virTypedParamsGetULLong(params, nparams, field, &value) < 0)
+                break;
+            values[j] = g_strdup_printf("%llu", value);
+        }
+
+        rc = -1;
+        if (j == G_N_ELEMENTS(fields))
+            rc = vshTableRowAppend(table, values[0], values[1], values[2],
+                                   values[3], values[4], values[5], values[6],
+                                   NULL);
+
+        for (j = 0; j < G_N_ELEMENTS(fields); j++)
+            g_free(values[j]);
+
+        if (rc < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(table);
+    virTypedParamsFree(params, nparams);
+    if (!ret)
+        vshError(ctl, "%s", _("Unable to get message buffer statistics"));
+    return ret;
+}
+
 static void *
 vshAdmConnectionHandler(vshControl *ctl)
 {
@@ -1460,6 +1579,18 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_clients_info,
      .flags = 0
     },
+    {.name = "daemon-startup-timings",
+     .handler = cmdDaemonStartupTimings,
+     .opts = NULL,
+     .info = info_daemon_startup_timings,
+     .flags = 0
+    },
+    {.name = "daemon-message-buffers",
+     .handler = cmdDaemonMessageBuffers,
+     .opts = NULL,
+     .info = info_daemon_message_buffers,
+     .flags = 0
+    },
     {.name = NULL}
 };
 
@@ -99,6 +99,50 @@ vshPrettyCapacity(unsigned long long val, const char **unit)
 }
 
 
+/**
+ * vshSplitRange:
+ * @total: size of the range to split
+ * @length: upper limit of the size of the range, 0 for no limit
+ * @nparts: maximum number of parts
+ * @align: alignment of the boundaries between the parts
+ * @ranges: filled with an array of the parts
+ *
+ * Splits the range [0, MIN(@total, @length)) into at most @nparts
+ * consecutive parts of the same size, rounded up to @align. Only the
+ * last part may be shorter. The caller has to free @ranges.
+ *
+ * Returns the number of parts, 0 for an empty range.
+ */
+size_t
+vshSplitRange(unsigned long long total,
+              unsigned long long length,
+              size_t nparts,
+              unsigned long long align,
+              vshRangePtr *ranges)
+{
+    unsigned long long chunk;
+    size_t i;
+
+    if (length && length < total)
+        total = length;
+
+    chunk = VIR_DIV_UP(total, MAX(nparts, 1));
+    chunk = VIR_ROUND_UP(chunk, align);
+    if (chunk == 0)
+        chunk = align;
+    nparts = VIR_DIV_UP(total, chunk);
+
+    *ranges = g_new0(vshRange, nparts);
+
+    for (i = 0; i < nparts; i++) {
+        (*ranges)[i].offset = i * chunk;
+        (*ranges)[i].length = MIN(chunk, total - i * chunk);
+    }
+
+    return nparts;
+}
+
+
 void *
 _vshMalloc(vshControl *ctl, size_t size, const char *filename, int line)
 {
@@ -323,6 +323,20 @@ char *vshGetTypedParamValue(vshControl *ctl, virTypedParameterPtr item)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
 double vshPrettyCapacity(unsigned long long val, const char **unit);
+
+typedef struct _vshRange vshRange;
+typedef vshRange *vshRangePtr;
+struct _vshRange {
+    unsigned long long offset;
+    unsigned long long length;
+};
+
+size_t vshSplitRange(unsigned long long total,
+                     unsigned long long length,
+                     size_t nparts,
+                     unsigned long long align,
+                     vshRangePtr *ranges);
+
 int vshStringToArray(const char *str, char ***array);
 
 /* Given an index, return either the name of that device (non-NULL) or